@@ -0,0 +1,98 @@
+// chip8-batch.cpp : Runs many ROM instances headless, on every core.
+//
+// Usage: chip8-batch <jobs.txt> [threads]
+//        chip8-batch --verify <movie> <rom> [threads]
+// A job per line in jobs.txt, "<rom> <frames> [input script] [seed]", see CBatch.h. Prints a line per job with the
+// hash of the final state, the frames run and the wall time, then the totals. Without a thread count there is one
+// thread per hardware thread.
+//
+// --verify replays a movie recorded with keyframes (see CMovie.h) one segment between keyframes per task, and prints
+// the first segment that doesn't end as recorded.
+
+#include <iostream>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../chip8-lib/src/CBatch.h"
+#include "../chip8-lib/src/CMovie.h"
+
+static int
+verify(int argc, char* argv[])
+{
+    CMovie                  my_movie;
+    std::vector<uint8_t>    my_rom;
+
+    if (!my_movie.map(argv[2]) || !CBatch::load_rom(argv[3], my_rom))
+        return 1;
+
+    CBatch          my_batch(argc == 5 ? strtoul(argv[4], nullptr, 10) : 0);
+    SBatchVerify    my_verify = my_batch.verify(my_movie, my_rom);
+
+    if (my_verify.the_segments == 0)
+    {
+        std::cerr << "No keyframes in " << argv[2] << " to verify it by\n";
+        return 1;
+    }
+
+    if (my_verify.the_ok)
+        printf("%s: %llu frames in %zu segments check out\n", argv[2], (unsigned long long)my_movie.get_frame_count(), my_verify.the_segments);
+    else
+        printf("%s: segment %zu of %zu, from frame %llu, doesn't end as recorded\n", argv[2], my_verify.the_first_bad,
+            my_verify.the_segments, (unsigned long long)my_verify.the_first_bad_frame);
+
+    printf("%zu threads, %.3f s\n", my_batch.get_thread_count(), my_verify.the_seconds);
+
+    return my_verify.the_ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc >= 2 && std::string(argv[1]) == "--verify" && (argc == 4 || argc == 5))
+        return verify(argc, argv);
+
+    if (argc != 2 && argc != 3)
+    {
+        std::cerr << "Usage: chip8-batch <jobs.txt> [threads]\n       chip8-batch --verify <movie> <rom> [threads]\n";
+        return 1;
+    }
+
+    std::vector<SBatchJob> my_jobs;
+
+    if (!CBatch::load_jobs(argv[1], my_jobs))
+        return 1;
+
+    CBatch my_batch(argc == 3 ? strtoul(argv[2], nullptr, 10) : 0);
+
+    auto my_start = std::chrono::steady_clock::now();
+    std::vector<SBatchResult> my_results = my_batch.run(my_jobs);
+    std::chrono::duration<double> my_elapsed = std::chrono::steady_clock::now() - my_start;
+
+    int         my_failed = 0;
+    uint64_t    my_frames = 0;
+
+    printf("%-6s %-32s %-24s %16s %10s %10s\n", "job", "rom", "input", "hash", "frames", "seconds");
+
+    for (size_t i = 0; i < my_jobs.size(); i++)
+    {
+        const SBatchJob&    my_job      = my_jobs[i];
+        const SBatchResult& my_result   = my_results[i];
+        const char*         my_input    = my_job.the_input.empty() ? "-" : my_job.the_input.c_str();
+
+        if (!my_result.the_ok)
+        {
+            printf("%-6zu %-32s %-24s %16s\n", i, my_job.the_rom.c_str(), my_input, "failed");
+            my_failed++;
+            continue;
+        }
+
+        printf("%-6zu %-32s %-24s %016llx %10llu %10.4f\n", i, my_job.the_rom.c_str(), my_input,
+            (unsigned long long)my_result.the_hash, (unsigned long long)my_result.the_frames, my_result.the_seconds);
+
+        my_frames += my_result.the_frames;
+    }
+
+    printf("\n%zu jobs, %d failed, %llu frames on %zu threads in %.3f s, %.0f frames/s\n", my_jobs.size(), my_failed,
+        (unsigned long long)my_frames, my_batch.get_thread_count(), my_elapsed.count(), my_frames / my_elapsed.count());
+
+    return my_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,951 @@
+// chip8-bench.cpp : Throughput benchmarks for the interpreter.
+//
+// Usage: chip8-bench [rom...]
+// Without arguments the bundled space-invaders and test_opcode ROMs are used.
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <memory>
+#include <stdio.h>
+#if defined(_WIN32)
+#include <io.h>
+#define dup _dup
+#define dup2 _dup2
+#define close _close
+#define fileno _fileno
+#define NULL_DEVICE "NUL"
+#else
+#include <unistd.h>
+#define NULL_DEVICE "/dev/null"
+#endif
+#include "../chip8-lib/src/CMemory.h"
+#include "../chip8-lib/src/CRegisters.h"
+#include "../chip8-lib/src/CStack.h"
+#include "../chip8-lib/src/CKeyboard.h"
+#include "../chip8-lib/src/CGraphics.h"
+#include "../chip8-lib/src/CPresenter.h"
+#include "../chip8-lib/src/CPixels.h"
+#include "../chip8-lib/src/CCPU.h"
+#include "../chip8-lib/src/CJit.h"
+#include "../chip8-lib/src/CFusion.h"
+#include "../chip8-lib/src/CBatch.h"
+#include "../chip8-lib/src/CLockstep.h"
+#include "../chip8-lib/src/CSnapshot.h"
+#include "../chip8-lib/src/CRewind.h"
+#include "../chip8-lib/src/CRandom.h"
+#include "../chip8-lib/src/CMovie.h"
+
+// How many instructions each run executes, and how many go into one call to CCPU::run().
+static const uint64_t BENCH_INSTRUCTIONS = 20000000;
+static const uint32_t BENCH_BATCH = 10000;
+
+// Frames of a turbo run, ten minutes of emulated time.
+static const uint64_t BENCH_TURBO_FRAMES = 36000;
+
+// Batch runs: this many jobs of a minute of emulated time each, spread over the ROMs.
+static const size_t BENCH_BATCH_JOBS = 256;
+static const uint64_t BENCH_BATCH_FRAMES = 3600;
+
+// Lockstep runs: this many instances for a minute of emulated time, at a clock fast enough to time.
+static const size_t BENCH_LOCKSTEP_INSTANCES = 256;
+static const uint64_t BENCH_LOCKSTEP_FRAMES = 3600;
+static const uint32_t BENCH_LOCKSTEP_CLOCK = 6000;
+
+// Frames of a damage tracking run, a minute of emulated time.
+static const uint64_t BENCH_DAMAGE_FRAMES = 3600;
+
+// Screens expanded to texture pixels per format and path.
+static const uint64_t BENCH_PIXELS_FRAMES = 200000;
+
+// Snapshots: taken after this many frames, saved and loaded this many times.
+static const uint64_t BENCH_SNAPSHOT_FRAMES = 600;
+static const uint64_t BENCH_SNAPSHOT_ROUNDS = 200000;
+
+// Rewind: a session of this many frames captured, then this many of them stepped back through.
+static const uint64_t BENCH_REWIND_FRAMES = CRewind::DEFAULT_FRAMES;
+static const uint64_t BENCH_REWIND_STEPS = 3600;
+
+// Movies: an hour of play at 60 frames a second, a key going down or up every this many frames on average.
+static const uint64_t BENCH_MOVIE_FRAMES = 60 * 60 * 60;
+static const uint64_t BENCH_MOVIE_KEY_EVERY = 30;
+
+// Seeking: movies of these many minutes with a keyframe every this many frames, seeked to this many random frames.
+static const uint64_t BENCH_SEEK_MINUTES[] = { 10, 60, 240 };
+static const uint32_t BENCH_SEEK_KEYFRAME_INTERVAL = 600;
+static const uint64_t BENCH_SEEK_COUNT = 1000;
+
+// Verifying: a movie of this many minutes, with keyframes as for seeking.
+static const uint64_t BENCH_VERIFY_MINUTES = 240;
+
+// Run-ahead: frames run with each of these many frames ahead.
+static const uint64_t BENCH_RUN_AHEAD_FRAMES = 36000;
+static const uint32_t BENCH_RUN_AHEADS[] = { 0, 1, 2, 4 };
+
+// Random bytes drawn per thread, through rand() and through CRandom.
+static const uint64_t BENCH_RANDOM_DRAWS = 10000000;
+
+// Traced runs make two printf calls per instruction, they get fewer.
+static const uint64_t BENCH_TRACE_INSTRUCTIONS = 1000000;
+
+/**
+    Runs a ROM for a fixed number of instructions on a fresh machine, returns the instructions per second.
+    All engines run through CCPU::run(), so they all tick the timers once per instruction.
+*/
+static double
+bench_rom(const std::string& a_rom, CCPU::EEngine an_engine, bool a_fusion = false, CCPU** a_result = nullptr)
+{
+    SChip8State my_state = {};
+    CMemory     my_memory(my_state);
+    CGraphics   my_graphics(my_state);
+
+    CCPU* my_cpu = new CCPU(my_state, &my_memory, &my_graphics);
+
+    if (!my_cpu->load_game(a_rom))
+    {
+        delete my_cpu;
+        return 0.0;
+    }
+
+    my_cpu->reset();
+    my_cpu->set_trace(false);
+    my_cpu->set_engine(an_engine);
+    my_cpu->set_fusion(a_fusion);
+
+    uint64_t my_count = 0;
+    auto my_start = std::chrono::steady_clock::now();
+
+    // A ROM that runs off the end of memory has nothing left to measure.
+    while (my_count < BENCH_INSTRUCTIONS && my_cpu->get_pc() < my_memory.get_size() - 1)
+        my_count += my_cpu->run(BENCH_BATCH);
+
+    std::chrono::duration<double> my_elapsed = std::chrono::steady_clock::now() - my_start;
+
+    // The caller wants to look at the counters, the machine is theirs now.
+    if (a_result != nullptr)
+        *a_result = my_cpu;
+    else
+        delete my_cpu;
+
+    return my_count / my_elapsed.count();
+}
+
+/**
+    Prints which share of the executed instructions ran as part of every fused idiom.
+*/
+static void
+report_fusion(const std::vector<std::string>& some_roms)
+{
+    printf("\n%-32s", "fusion hits");
+
+    for (int i = 0; i < CFusion::IDIOM_COUNT; i++)
+        printf(" %15s", CFusion::get_name((CFusion::EIdiom)i));
+
+    printf(" %15s\n", "table+fusion");
+
+    for (const std::string& my_rom : some_roms)
+    {
+        CCPU*   my_cpu      = nullptr;
+        double  my_fused    = bench_rom(my_rom, CCPU::EEngine::TABLE, true, &my_cpu);
+
+        if (my_cpu == nullptr)
+            continue;
+
+        printf("%-32s", my_rom.c_str());
+
+        for (int i = 0; i < CFusion::IDIOM_COUNT; i++)
+            printf(" %14.2f%%", 100.0 * my_cpu->get_fusion_hits((CFusion::EIdiom)i) / my_cpu->get_instruction_count());
+
+        printf(" %10.2f MIPS\n", my_fused / 1e6);
+
+        delete my_cpu;
+    }
+}
+
+/**
+    Runs a ROM on the table engine with the given tracing policy, returns the instructions per second.
+    stdout goes to the null device meanwhile, that way the trace costs its formatting and writes but not a terminal.
+*/
+template <typename TTrace>
+static double
+bench_trace(const std::string& a_rom, uint64_t an_instructions)
+{
+    SChip8State my_state = {};
+    CMemory     my_memory(my_state);
+    CGraphics   my_graphics(my_state);
+    CCPU        my_cpu(my_state, &my_memory, &my_graphics);
+
+    if (!my_cpu.load_game(a_rom))
+        return 0.0;
+
+    my_cpu.reset();
+    my_cpu.set_fusion(false);
+
+    fflush(stdout);
+    int my_stdout = dup(fileno(stdout));
+    FILE* my_null = freopen(NULL_DEVICE, "w", stdout);
+
+    uint64_t my_count = 0;
+    auto my_start = std::chrono::steady_clock::now();
+
+    while (my_count < an_instructions && my_cpu.get_pc() < my_memory.get_size() - 1)
+        my_count += my_cpu.run<TTrace>(BENCH_BATCH);
+
+    std::chrono::duration<double> my_elapsed = std::chrono::steady_clock::now() - my_start;
+
+    fflush(stdout);
+    dup2(my_stdout, fileno(stdout));
+    close(my_stdout);
+
+    return my_null != nullptr ? my_count / my_elapsed.count() : 0.0;
+}
+
+/**
+    What the disassembly trace costs: the same run with the trace compiled in and compiled out.
+*/
+static void
+report_trace(const std::vector<std::string>& some_roms)
+{
+    printf("\n%-32s %14s %14s %9s\n", "trace", "traced MIPS", "untraced MIPS", "speedup");
+
+    for (const std::string& my_rom : some_roms)
+    {
+        double my_traced    = bench_trace<CCPU::STraceOn>(my_rom, BENCH_TRACE_INSTRUCTIONS);
+        double my_untraced  = bench_trace<CCPU::STraceOff>(my_rom, BENCH_INSTRUCTIONS);
+
+        if (my_traced == 0.0 || my_untraced == 0.0)
+            continue;
+
+        printf("%-32s %14.2f %14.2f %8.2fx\n", my_rom.c_str(), my_traced / 1e6, my_untraced / 1e6, my_untraced / my_traced);
+    }
+}
+
+/**
+    Emulated frames per wall second in turbo mode, at the default clock rate.
+*/
+static void
+report_turbo(const std::vector<std::string>& some_roms)
+{
+    printf("\n%-32s %14s %14s %14s\n", "turbo", "frames/s", "realtime", "presents");
+
+    for (const std::string& my_rom : some_roms)
+    {
+        SChip8State my_state = {};
+        CMemory     my_memory(my_state);
+        CGraphics   my_graphics(my_state);
+        CCPU        my_cpu(my_state, &my_memory, &my_graphics);
+
+        if (!my_cpu.load_game(my_rom))
+            continue;
+
+        my_cpu.reset();
+        my_cpu.set_trace(false);
+        my_cpu.set_turbo(true);
+        my_cpu.set_frame_limit(BENCH_TURBO_FRAMES);
+        my_cpu.start();
+
+        // Presents are held to the refresh rate however fast the frames go.
+        printf("%-32s %14.0f %13.0fx %14llu\n", my_rom.c_str(), my_cpu.get_frames_per_second(), my_cpu.get_frames_per_second() / CCPU::FRAME_RATE,
+            (unsigned long long)my_graphics.get_present_count());
+    }
+}
+
+/**
+    Uploads a byte per pixel of the rectangle it's given, the same as CSDLPresenter without a window.
+*/
+class CUploadPresenter : public CPresenter
+{
+public:
+    bool    init() override { return true; }
+    size_t  present(const uint64_t* a_screen, const SDirtyRect& a_dirty) override { return a_dirty.the_width * a_dirty.the_height; }
+};
+
+/**
+    What damage tracking saves: the frames presented and skipped, and the bytes uploaded per frame against the 2048
+    of uploading the whole screen every frame.
+*/
+static void
+report_damage(const std::vector<std::string>& some_roms)
+{
+    printf("\n%-32s %14s %14s %14s %14s\n", "damage", "presented", "skipped", "bytes/frame", "full/frame");
+
+    for (const std::string& my_rom : some_roms)
+    {
+        SChip8State         my_state = {};
+        CMemory             my_memory(my_state);
+        CGraphics           my_graphics(my_state);
+        CUploadPresenter    my_presenter;
+        CCPU                my_cpu(my_state, &my_memory, &my_graphics);
+
+        if (!my_cpu.load_game(my_rom))
+            continue;
+
+        my_graphics.set_presenter(&my_presenter);
+        my_cpu.reset();
+        my_cpu.set_trace(false);
+        my_cpu.set_turbo(true);
+        my_cpu.set_frame_limit(BENCH_DAMAGE_FRAMES);
+
+        // Every frame that changed the screen, as if paced.
+        my_graphics.set_refresh_rate(0);
+        my_cpu.start();
+
+        printf("%-32s %14llu %14llu %14.1f %14d\n", my_rom.c_str(),
+            (unsigned long long)my_graphics.get_present_count(), (unsigned long long)my_graphics.get_skipped_count(),
+            (double)my_graphics.get_uploaded_bytes() / my_cpu.get_frame_count(), SChip8State::SCREEN_WIDTH * SChip8State::SCREEN_HEIGHT);
+    }
+}
+
+/**
+    Expands BENCH_PIXELS_FRAMES screens of a_screen through a_expand, returns the screens per second.
+*/
+template <typename TPixel>
+static double
+bench_pixels(const uint64_t* a_screen, void (*a_expand)(uint64_t, TPixel*))
+{
+    std::vector<TPixel> my_pixels(SChip8State::SCREEN_WIDTH * SChip8State::SCREEN_HEIGHT);
+    uint64_t            my_check = 0;
+
+    auto my_start = std::chrono::steady_clock::now();
+
+    for (uint64_t i = 0; i < BENCH_PIXELS_FRAMES; i++)
+    {
+        for (int y = 0; y < SChip8State::SCREEN_HEIGHT; y++)
+            a_expand(a_screen[y] ^ i, &my_pixels[y * SChip8State::SCREEN_WIDTH]);
+
+        my_check += my_pixels[i % my_pixels.size()];
+    }
+
+    std::chrono::duration<double> my_elapsed = std::chrono::steady_clock::now() - my_start;
+
+    // Keeps the expansion from being optimised away.
+    if (my_check == 1)
+        printf(" ");
+
+    return BENCH_PIXELS_FRAMES / my_elapsed.count();
+}
+
+/**
+    Screens per second expanded from the packed rows to texture pixels, bit by bit and vectorised.
+*/
+static void
+report_pixels()
+{
+    const char* my_kernels[] = { "pixels (no SIMD)", "pixels (SSE2)", "pixels (AVX2)" };
+
+    printf("\n%-32s %14s %14s %9s\n", my_kernels[(int)CPixels::get_kernel()], "scalar/s", "vector/s", "speedup");
+
+    uint64_t my_screen[SChip8State::SCREEN_HEIGHT];
+    uint64_t my_random = 0x9e3779b97f4a7c15ull;
+
+    for (uint64_t& my_row : my_screen)
+    {
+        my_random = my_random * 6364136223846793005ull + 1442695040888963407ull;
+        my_row = my_random;
+    }
+
+    double my_scalar = bench_pixels<uint8_t>(my_screen, &CPixels::expand_rgb332_scalar);
+    double my_vector = bench_pixels<uint8_t>(my_screen, &CPixels::expand_rgb332);
+    printf("%-32s %14.0f %14.0f %8.2fx\n", "RGB332", my_scalar, my_vector, my_vector / my_scalar);
+
+    my_scalar = bench_pixels<uint32_t>(my_screen, &CPixels::expand_argb8888_scalar);
+    my_vector = bench_pixels<uint32_t>(my_screen, &CPixels::expand_argb8888);
+    printf("%-32s %14.0f %14.0f %8.2fx\n", "ARGB8888", my_scalar, my_vector, my_vector / my_scalar);
+}
+
+/**
+    Snapshot sizes and the time a save and a load take, with the RAM whole and as changes to the ROM image.
+*/
+static void
+report_snapshot(const std::vector<std::string>& some_roms)
+{
+    printf("\n%-32s %8s %10s %10s %8s %10s %10s\n", "snapshot", "bytes", "save ns", "load ns", "delta", "save ns", "load ns");
+
+    for (const std::string& my_rom : some_roms)
+    {
+        SChip8State my_state = {};
+        CMemory     my_memory(my_state);
+        CGraphics   my_graphics(my_state);
+        CCPU        my_cpu(my_state, &my_memory, &my_graphics);
+
+        if (!my_cpu.load_game(my_rom))
+            continue;
+
+        my_cpu.reset();
+        my_cpu.set_trace(false);
+
+        std::vector<uint8_t> my_image(my_state.the_memory, my_state.the_memory + sizeof(my_state.the_memory));
+
+        for (uint64_t i = 0; i < BENCH_SNAPSHOT_FRAMES; i++)
+            my_cpu.run_frame();
+
+        printf("%-32s", my_rom.c_str());
+
+        for (const uint8_t* my_base : { (const uint8_t*)nullptr, (const uint8_t*)my_image.data() })
+        {
+            std::vector<uint8_t> my_blob(CSnapshot::MAX_SIZE);
+            size_t my_size = 0;
+
+            auto my_start = std::chrono::steady_clock::now();
+
+            for (uint64_t i = 0; i < BENCH_SNAPSHOT_ROUNDS; i++)
+                my_size = my_cpu.save_state(my_blob.data(), my_blob.size(), my_base);
+
+            auto my_saved = std::chrono::steady_clock::now();
+
+            for (uint64_t i = 0; i < BENCH_SNAPSHOT_ROUNDS; i++)
+                my_cpu.load_state(my_blob.data(), my_size, my_base);
+
+            std::chrono::duration<double, std::nano> my_save = my_saved - my_start;
+            std::chrono::duration<double, std::nano> my_load = std::chrono::steady_clock::now() - my_saved;
+
+            printf(" %8zu %10.0f %10.0f", my_size, my_save.count() / BENCH_SNAPSHOT_ROUNDS, my_load.count() / BENCH_SNAPSHOT_ROUNDS);
+        }
+
+        printf("\n");
+    }
+}
+
+/**
+    What a ten minute session takes in the rewind ring with the default budget, and how long a capture and a step back
+    take on average and at most.
+*/
+static void
+report_rewind(const std::vector<std::string>& some_roms)
+{
+    printf("\n%-32s %10s %10s %12s %12s %12s %12s\n", "rewind", "frames", "bytes", "bytes/frame", "capture ns", "back ns", "back max ns");
+
+    for (const std::string& my_rom : some_roms)
+    {
+        SChip8State my_state = {};
+        CMemory     my_memory(my_state);
+        CGraphics   my_graphics(my_state);
+        CCPU        my_cpu(my_state, &my_memory, &my_graphics);
+
+        if (!my_cpu.load_game(my_rom))
+            continue;
+
+        my_cpu.reset();
+        my_cpu.set_trace(false);
+
+        CRewind my_rewind(BENCH_REWIND_FRAMES, CRewind::DEFAULT_BUDGET, CRewind::DEFAULT_KEYFRAME_INTERVAL, my_state.the_memory);
+        std::chrono::duration<double, std::nano> my_capture(0);
+
+        for (uint64_t i = 0; i < BENCH_REWIND_FRAMES; i++)
+        {
+            my_cpu.run_frame();
+
+            auto my_start = std::chrono::steady_clock::now();
+            my_rewind.capture(my_state, my_cpu.get_clock());
+            my_capture += std::chrono::steady_clock::now() - my_start;
+        }
+
+        size_t my_frames    = my_rewind.get_size();
+        size_t my_bytes     = my_rewind.get_used_bytes();
+
+        SChip8State     my_back;
+        SSnapshotClock  my_clock;
+        std::chrono::duration<double, std::nano> my_total(0), my_most(0);
+
+        for (uint64_t i = 0; i < BENCH_REWIND_STEPS; i++)
+        {
+            auto my_start = std::chrono::steady_clock::now();
+            my_rewind.step_back(my_back, my_clock);
+
+            std::chrono::duration<double, std::nano> my_step = std::chrono::steady_clock::now() - my_start;
+
+            my_total    += my_step;
+            my_most     = std::max(my_most, my_step);
+        }
+
+        printf("%-32s %10zu %10zu %12.1f %12.0f %12.0f %12.0f\n", my_rom.c_str(), my_frames, my_bytes, (double)my_bytes / my_frames,
+            my_capture.count() / BENCH_REWIND_FRAMES, my_total.count() / BENCH_REWIND_STEPS, my_most.count());
+    }
+}
+
+/**
+    A machine with nothing but the ROM loaded, the way chip8-batch runs them.
+*/
+struct SBenchMachine
+{
+    std::unique_ptr<SChip8State>    the_state;
+    std::unique_ptr<CMemory>        the_memory;
+    CGraphics                       the_graphics;
+    CKeyboard                       the_keyboard;
+    CCPU                            the_cpu;
+
+    SBenchMachine(const std::vector<uint8_t>& a_rom) :
+        the_state(new SChip8State()),
+        the_memory(new CMemory(*the_state)),
+        the_graphics(*the_state),
+        the_keyboard(*the_state),
+        the_cpu(*the_state, the_memory.get(), &the_graphics)
+    {
+        the_memory->load_data(a_rom);
+        the_cpu.reset();
+        the_cpu.set_trace(false);
+    }
+};
+
+/**
+    Plays a ROM for a number of frames with a key going down or up every BENCH_MOVIE_KEY_EVERY frames on average, and
+    records it with a keyframe every a_keyframe_interval frames (none for 0).
+*/
+static void
+record_movie(const std::vector<uint8_t>& a_rom, uint64_t a_frames, uint32_t a_keyframe_interval, CMovie& a_movie)
+{
+    SBenchMachine   my_machine(a_rom);
+    uint64_t        my_random = 0;
+
+    my_machine.the_cpu.set_seed(1);
+    a_movie.begin(*my_machine.the_state, my_machine.the_cpu.get_clock(), a_rom.size(), a_keyframe_interval);
+
+    for (uint64_t i = 0; i < a_frames; i++)
+    {
+        my_machine.the_cpu.run_frame();
+
+        uint64_t my_value = CRandom::next(my_random);
+
+        if (my_value % BENCH_MOVIE_KEY_EVERY == 0)
+            my_machine.the_keyboard.set_key_state((my_value >> 8) & 0xf, (my_value >> 16) & 1);
+
+        a_movie.record(*my_machine.the_state, my_machine.the_cpu.get_clock());
+    }
+
+    a_movie.end(*my_machine.the_state, my_machine.the_cpu.get_frame_count());
+}
+
+/**
+    Replays a movie from power-on, true when it ended as recorded.
+*/
+static bool
+replay_movie(const std::vector<uint8_t>& a_rom, CMovie& a_movie, double& a_seconds)
+{
+    SBenchMachine my_machine(a_rom);
+
+    auto my_start   = std::chrono::steady_clock::now();
+    bool my_match   = a_movie.replay(my_machine.the_cpu, my_machine.the_keyboard);
+
+    a_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - my_start).count();
+
+    return my_match;
+}
+
+/**
+    An hour of play recorded as a movie: its size, and how fast it replays in turbo against the hour it took.
+*/
+static void
+report_movie(const std::vector<std::string>& some_roms)
+{
+    printf("\n%-32s %10s %10s %10s %12s %12s %8s\n", "movie", "frames", "changes", "bytes", "replay s", "x realtime", "match");
+
+    for (const std::string& my_rom : some_roms)
+    {
+        std::vector<uint8_t> my_image;
+
+        if (!CBatch::load_rom(my_rom, my_image))
+            continue;
+
+        CMovie my_movie;
+        record_movie(my_image, BENCH_MOVIE_FRAMES, 0, my_movie);
+
+        std::vector<uint8_t> my_bytes;
+        my_movie.write(my_bytes);
+
+        CMovie my_copy;
+
+        if (!my_copy.read(my_bytes.data(), my_bytes.size()))
+            continue;
+
+        double  my_seconds;
+        bool    my_match = replay_movie(my_image, my_copy, my_seconds);
+
+        printf("%-32s %10llu %10zu %10zu %12.3f %12.0f %8s\n", my_rom.c_str(), (unsigned long long)BENCH_MOVIE_FRAMES,
+            my_copy.get_inputs().size(), my_bytes.size(), my_seconds, BENCH_MOVIE_FRAMES / 60.0 / my_seconds, my_match ? "yes" : "NO");
+    }
+}
+
+/**
+    Seeking in ever longer movies mapped from their files: each seek loads the keyframe before its frame and runs the
+    rest, so it should take about as long whatever the length. Replaying from power-on is what it would be without.
+*/
+static void
+report_seek(const std::vector<std::string>& some_roms)
+{
+    printf("\n%-32s %10s %10s %10s %10s %10s %10s %12s\n", "seek", "minutes", "bytes", "keyframes", "map us", "seek us", "max us",
+        "replay ms");
+
+    for (const std::string& my_rom : some_roms)
+    {
+        std::vector<uint8_t> my_rom_image;
+
+        if (!CBatch::load_rom(my_rom, my_rom_image))
+            continue;
+
+        for (uint64_t my_minutes : BENCH_SEEK_MINUTES)
+        {
+            uint64_t    my_frames = my_minutes * 60 * 60;
+            CMovie      my_movie;
+
+            record_movie(my_rom_image, my_frames, BENCH_SEEK_KEYFRAME_INTERVAL, my_movie);
+
+            if (!my_movie.save("bench_seek.c8mv"))
+                continue;
+
+            CMovie  my_mapped;
+            auto    my_start = std::chrono::steady_clock::now();
+
+            if (!my_mapped.map("bench_seek.c8mv"))
+                continue;
+
+            std::chrono::duration<double, std::micro> my_map = std::chrono::steady_clock::now() - my_start;
+            std::chrono::duration<double, std::micro> my_total(0), my_most(0);
+
+            SBenchMachine           my_machine(my_rom_image);
+            std::vector<uint8_t>    my_image(my_machine.the_state->the_memory, my_machine.the_state->the_memory + 4096);
+            uint64_t                my_random = 0;
+
+            for (uint64_t i = 0; i < BENCH_SEEK_COUNT; i++)
+            {
+                uint64_t my_frame = CRandom::next(my_random) % (my_frames + 1);
+
+                my_start = std::chrono::steady_clock::now();
+                my_mapped.seek(my_machine.the_cpu, my_machine.the_keyboard, my_frame, my_image.data());
+
+                std::chrono::duration<double, std::micro> my_seek = std::chrono::steady_clock::now() - my_start;
+
+                my_total    += my_seek;
+                my_most     = std::max(my_most, my_seek);
+            }
+
+            double my_replay;
+            replay_movie(my_rom_image, my_mapped, my_replay);
+
+            std::vector<uint8_t> my_bytes;
+            my_mapped.write(my_bytes);
+
+            printf("%-32s %10llu %10zu %10zu %10.1f %10.1f %10.1f %12.1f\n", my_rom.c_str(), (unsigned long long)my_minutes,
+                my_bytes.size(), my_mapped.get_keyframe_count(), my_map.count(), my_total.count() / BENCH_SEEK_COUNT, my_most.count(),
+                my_replay * 1000.0);
+        }
+    }
+
+    remove("bench_seek.c8mv");
+}
+
+/**
+    A long movie checked segment by segment on 1, 2, 4... threads up to one per hardware thread, against replaying it
+    through from power-on.
+*/
+static void
+report_verify(const std::vector<std::string>& some_roms)
+{
+    std::vector<size_t> my_thread_counts;
+    size_t              my_hardware = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+    for (size_t i = 1; i < my_hardware; i *= 2)
+        my_thread_counts.push_back(i);
+
+    my_thread_counts.push_back(my_hardware);
+
+    printf("\n%-32s %10s %10s %10s %12s %12s %9s %6s\n", "verify", "minutes", "segments", "threads", "replay s", "verify s", "speedup", "ok");
+
+    for (const std::string& my_rom : some_roms)
+    {
+        std::vector<uint8_t> my_image;
+
+        if (!CBatch::load_rom(my_rom, my_image))
+            continue;
+
+        CMovie my_movie;
+        record_movie(my_image, BENCH_VERIFY_MINUTES * 60 * 60, BENCH_SEEK_KEYFRAME_INTERVAL, my_movie);
+
+        double  my_replay;
+        bool    my_match = replay_movie(my_image, my_movie, my_replay);
+
+        for (size_t my_threads : my_thread_counts)
+        {
+            CBatch          my_batch(my_threads);
+            SBatchVerify    my_verify = my_batch.verify(my_movie, my_image);
+
+            printf("%-32s %10llu %10zu %10zu %12.3f %12.3f %8.2fx %6s\n", my_rom.c_str(), (unsigned long long)BENCH_VERIFY_MINUTES,
+                my_verify.the_segments, my_threads, my_replay, my_verify.the_seconds, my_replay / my_verify.the_seconds,
+                my_verify.the_ok && my_match ? "yes" : "NO");
+        }
+    }
+}
+
+/**
+    What run-ahead costs a frame, every frame presented the way a window at the frame rate would have it, and what
+    that comes to in a core at 60 frames a second. Extra is over running without.
+*/
+static void
+report_run_ahead(const std::vector<std::string>& some_roms)
+{
+    printf("\n%-32s %10s %12s %12s %12s\n", "run-ahead", "ahead", "us/frame", "core at 60", "extra");
+
+    for (const std::string& my_rom : some_roms)
+    {
+        double my_without = 0.0;
+
+        for (uint32_t my_run_ahead : BENCH_RUN_AHEADS)
+        {
+            std::unique_ptr<SChip8State>    my_state(new SChip8State());
+            std::unique_ptr<CMemory>        my_memory(new CMemory(*my_state));
+            CGraphics                       my_graphics(*my_state);
+            CUploadPresenter                my_presenter;
+            CCPU                            my_cpu(*my_state, my_memory.get(), &my_graphics);
+
+            if (!my_cpu.load_game(my_rom))
+                break;
+
+            my_graphics.set_presenter(&my_presenter);
+            my_cpu.reset();
+            my_cpu.set_trace(false);
+            my_cpu.set_turbo(true);
+            my_graphics.set_refresh_rate(0);
+            my_cpu.set_run_ahead(my_run_ahead);
+            my_cpu.set_frame_limit(BENCH_RUN_AHEAD_FRAMES);
+            my_cpu.start();
+
+            double my_frame = 1e6 / my_cpu.get_frames_per_second();
+
+            if (my_run_ahead == 0)
+                my_without = my_frame;
+
+            printf("%-32s %10u %12.2f %11.3f%% %11.3f%%\n", my_rom.c_str(), my_run_ahead, my_frame, my_frame * CCPU::FRAME_RATE / 1e4,
+                (my_frame - my_without) * CCPU::FRAME_RATE / 1e4);
+        }
+    }
+}
+
+/**
+    Random bytes per second on 1, 2, 4... threads at once, the libc rand() RND used to call against a CRandom per
+    thread the way every machine has its own.
+*/
+static void
+report_random()
+{
+    printf("\n%-32s %14s %14s %9s\n", "random threads", "rand() M/s", "CRandom M/s", "speedup");
+
+    std::vector<size_t> my_thread_counts;
+    size_t              my_hardware = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+    for (size_t i = 1; i < my_hardware; i *= 2)
+        my_thread_counts.push_back(i);
+
+    my_thread_counts.push_back(my_hardware);
+
+    for (size_t my_threads : my_thread_counts)
+    {
+        double my_rates[2];
+
+        for (int my_source = 0; my_source < 2; my_source++)
+        {
+            std::vector<std::thread>    my_workers;
+            std::vector<uint64_t>       my_sums(my_threads * 8, 0);
+
+            auto my_start = std::chrono::steady_clock::now();
+
+            for (size_t i = 0; i < my_threads; i++)
+            {
+                my_workers.emplace_back([my_source, i, &my_sums]()
+                {
+                    // Something has to use the numbers, or the loop goes away. The sums are a cache line apart.
+                    uint64_t my_random  = i;
+                    uint64_t my_sum     = 0;
+
+                    for (uint64_t j = 0; j < BENCH_RANDOM_DRAWS; j++)
+                        my_sum += my_source == 0 ? (uint8_t)(rand() % 255) : CRandom::next_byte(my_random);
+
+                    my_sums[i * 8] = my_sum;
+                });
+            }
+
+            for (std::thread& my_worker : my_workers)
+                my_worker.join();
+
+            std::chrono::duration<double> my_elapsed = std::chrono::steady_clock::now() - my_start;
+            my_rates[my_source] = my_threads * BENCH_RANDOM_DRAWS / my_elapsed.count();
+        }
+
+        printf("%-32zu %14.1f %14.1f %8.2fx\n", my_threads, my_rates[0] / 1e6, my_rates[1] / 1e6, my_rates[1] / my_rates[0]);
+    }
+}
+
+/**
+    How the batch runner scales: the same jobs on 1, 2, 4... threads up to one per hardware thread.
+*/
+static void
+report_batch(const std::vector<std::string>& some_roms)
+{
+    std::vector<SBatchJob> my_jobs;
+
+    for (size_t i = 0; i < BENCH_BATCH_JOBS; i++)
+        my_jobs.push_back({ some_roms[i % some_roms.size()], "", BENCH_BATCH_FRAMES });
+
+    std::vector<size_t> my_thread_counts;
+    size_t              my_hardware = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+    for (size_t i = 1; i < my_hardware; i *= 2)
+        my_thread_counts.push_back(i);
+
+    my_thread_counts.push_back(my_hardware);
+
+    printf("\n%-32s %14s %14s %9s %11s\n", "batch threads", "jobs/s", "frames/s", "speedup", "efficiency");
+
+    double my_single = 0.0;
+
+    for (size_t my_threads : my_thread_counts)
+    {
+        CBatch my_batch(my_threads);
+
+        auto my_start = std::chrono::steady_clock::now();
+        std::vector<SBatchResult> my_results = my_batch.run(my_jobs);
+        std::chrono::duration<double> my_elapsed = std::chrono::steady_clock::now() - my_start;
+
+        if (std::any_of(my_results.begin(), my_results.end(), [](const SBatchResult& a_result) { return !a_result.the_ok; }))
+        {
+            std::cerr << "Unable to run the batch\n";
+            return;
+        }
+
+        double my_jobs_per_second = my_jobs.size() / my_elapsed.count();
+
+        if (my_single == 0.0)
+            my_single = my_jobs_per_second;
+
+        printf("%-32zu %14.1f %14.0f %8.2fx %10.0f%%\n", my_threads, my_jobs_per_second, my_jobs_per_second * BENCH_BATCH_FRAMES,
+            my_jobs_per_second / my_single, 100.0 * my_jobs_per_second / my_single / my_threads);
+    }
+}
+
+/**
+    The lockstep engine against as many CCPUs one after the other, in instances x instructions per second. The
+    instances start alike but for their seeds, RND is what splits them up.
+
+    The gain is in the register opcodes. DRW, RND, CALL, RET and the RAM copies still go lane by lane at about what
+    CCPU pays per instance, so ROMs where those are most of the steps gain least: with AVX2, test_opcode (a DRW
+    every fourth step) runs about 1.7-1.9x, space-invaders 3.5-5x.
+*/
+static void
+report_lockstep(const std::vector<std::string>& some_roms)
+{
+    printf("\n%-32s %14s %14s %9s %11s %s\n", "lockstep", "scalar MIPS", "lockstep MIPS", "speedup", "lanes/step", CLockstep::is_vectorised() ? "(AVX2)" : "(scalar lanes)");
+
+    for (const std::string& my_rom : some_roms)
+    {
+        std::unique_ptr<SChip8State> my_state(new SChip8State());
+        std::unique_ptr<CMemory>     my_memory(new CMemory(*my_state));
+        CGraphics                    my_graphics(*my_state);
+        CCPU                         my_cpu(*my_state, my_memory.get(), &my_graphics);
+
+        if (!my_cpu.load_game(my_rom))
+            continue;
+
+        my_cpu.reset();
+        my_cpu.set_trace(false);
+        my_cpu.set_clock_rate(BENCH_LOCKSTEP_CLOCK);
+
+        SChip8State my_start = *my_state;
+
+        // The scalar CPU runs every instance in turn, from the same start with the instance as the seed.
+        uint64_t my_scalar_count = 0;
+        auto my_start_time = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < BENCH_LOCKSTEP_INSTANCES; i++)
+        {
+            *my_state = my_start;
+            my_memory->invalidate_all();
+            my_cpu.reset();
+            my_cpu.set_seed(i);
+
+            for (uint64_t j = 0; j < BENCH_LOCKSTEP_FRAMES; j++)
+                my_cpu.run_frame();
+
+            my_scalar_count += my_cpu.get_instruction_count();
+        }
+
+        std::chrono::duration<double> my_scalar = std::chrono::steady_clock::now() - my_start_time;
+
+        CLockstep my_lockstep(BENCH_LOCKSTEP_INSTANCES);
+
+        my_lockstep.load(my_start);
+        my_lockstep.set_clock_rate(BENCH_LOCKSTEP_CLOCK);
+
+        for (size_t i = 0; i < BENCH_LOCKSTEP_INSTANCES; i++)
+        {
+            SChip8State my_instance = my_start;
+
+            my_instance.the_random = i;
+            my_lockstep.set_instance(i, my_instance);
+        }
+
+        my_start_time = std::chrono::steady_clock::now();
+
+        for (uint64_t j = 0; j < BENCH_LOCKSTEP_FRAMES; j++)
+            my_lockstep.run_frame();
+
+        std::chrono::duration<double> my_lockstep_time = std::chrono::steady_clock::now() - my_start_time;
+
+        double my_scalar_rate   = my_scalar_count / my_scalar.count();
+        double my_lockstep_rate = my_lockstep.get_instruction_count() / my_lockstep_time.count();
+
+        printf("%-32s %14.2f %14.2f %8.2fx %11.1f\n", my_rom.c_str(), my_scalar_rate / 1e6, my_lockstep_rate / 1e6, my_lockstep_rate / my_scalar_rate,
+            (double)my_lockstep.get_instruction_count() / my_lockstep.get_step_count());
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> my_roms;
+
+    for (int i = 1; i < argc; i++)
+        my_roms.push_back(argv[i]);
+
+    if (my_roms.empty())
+    {
+        my_roms.push_back("../games/space-invaders.ch8");
+        my_roms.push_back("../games/test_opcode.ch8");
+    }
+
+    printf("%-32s %14s %14s %14s %14s %9s %9s\n", "rom", "switch MIPS", "table MIPS", "threaded MIPS", "jit MIPS", "threaded", "best");
+
+    for (const std::string& my_rom : my_roms)
+    {
+        double my_switch    = bench_rom(my_rom, CCPU::EEngine::SWITCH);
+        double my_table     = bench_rom(my_rom, CCPU::EEngine::TABLE);
+        double my_threaded  = bench_rom(my_rom, CCPU::EEngine::THREADED);
+        double my_jit       = CJit::is_supported() ? bench_rom(my_rom, CCPU::EEngine::JIT) : my_table;
+
+        if (my_switch == 0.0 || my_table == 0.0 || my_threaded == 0.0 || my_jit == 0.0)
+        {
+            std::cerr << "Unable to run " << my_rom << "\n";
+            continue;
+        }
+
+        // Speedups over the switch.
+        printf("%-32s %14.2f %14.2f %14.2f %14.2f %8.2fx %8.2fx\n", my_rom.c_str(), my_switch / 1e6, my_table / 1e6, my_threaded / 1e6, my_jit / 1e6,
+            my_threaded / my_switch, std::max({ my_table, my_threaded, my_jit }) / my_switch);
+    }
+
+    report_fusion(my_roms);
+    report_trace(my_roms);
+    report_turbo(my_roms);
+    report_damage(my_roms);
+    report_pixels();
+    report_snapshot(my_roms);
+    report_rewind(my_roms);
+    report_movie(my_roms);
+    report_seek(my_roms);
+    report_verify(my_roms);
+    report_run_ahead(my_roms);
+    report_random();
+    report_batch(my_roms);
+    report_lockstep(my_roms);
+
+    return 0;
+}
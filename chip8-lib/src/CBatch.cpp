@@ -0,0 +1,243 @@
+#include "CBatch.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include "CCPU.h"
+#include "CMovie.h"
+#include "CRecompRuntime.h"
+
+CBatch::CBatch(size_t a_threads) :
+	the_pool(a_threads)
+{
+}
+
+size_t
+CBatch::get_thread_count()
+{
+	return the_pool.get_thread_count();
+}
+
+std::vector<SBatchResult>
+CBatch::run(const std::vector<SBatchJob>& some_jobs)
+{
+	// Every ROM and script once, however many jobs use it.
+	std::map<std::string, std::vector<uint8_t>>		my_roms;
+	std::map<std::string, std::vector<SBatchInput>>	my_inputs;
+	std::map<std::string, bool>						my_loaded;
+
+	for (const SBatchJob& my_job : some_jobs)
+	{
+		if (my_loaded.count("rom:" + my_job.the_rom) == 0)
+			my_loaded["rom:" + my_job.the_rom] = load_rom(my_job.the_rom, my_roms[my_job.the_rom]);
+
+		if (!my_job.the_input.empty() && my_loaded.count("input:" + my_job.the_input) == 0)
+			my_loaded["input:" + my_job.the_input] = load_input(my_job.the_input, my_inputs[my_job.the_input]);
+	}
+
+	// Each job writes its own result, the maps are only read from here on.
+	std::vector<SBatchResult>		my_results(some_jobs.size(), SBatchResult());
+	std::vector<CThreadPool::task>	my_tasks;
+	const std::vector<SBatchInput>	my_no_input;
+
+	for (size_t i = 0; i < some_jobs.size(); i++)
+	{
+		const SBatchJob& my_job = some_jobs[i];
+
+		if (!my_loaded["rom:" + my_job.the_rom] || (!my_job.the_input.empty() && !my_loaded["input:" + my_job.the_input]))
+			continue;
+
+		const std::vector<uint8_t>*		my_rom		= &my_roms[my_job.the_rom];
+		const std::vector<SBatchInput>*	my_input	= my_job.the_input.empty() ? &my_no_input : &my_inputs[my_job.the_input];
+
+		my_tasks.push_back([&my_results, i, my_rom, my_input, &my_job]()
+		{
+			my_results[i] = run_job(*my_rom, *my_input, my_job.the_frames, my_job.the_seed);
+		});
+	}
+
+	the_pool.run(my_tasks);
+
+	return my_results;
+}
+
+SBatchVerify
+CBatch::verify(CMovie& a_movie, const std::vector<uint8_t>& a_rom)
+{
+	auto my_start = std::chrono::steady_clock::now();
+
+	// Keyframes are stored against the RAM of the reset machine.
+	std::unique_ptr<SChip8State>	my_state(new SChip8State());
+	std::unique_ptr<CMemory>		my_memory(new CMemory(*my_state));
+	CGraphics						my_graphics(*my_state);
+	CCPU							my_cpu(*my_state, my_memory.get(), &my_graphics);
+
+	my_memory->load_data(a_rom);
+	my_cpu.reset();
+
+	const uint8_t*					my_image	= my_state->the_memory;
+	size_t							my_segments	= a_movie.get_keyframe_count();
+	std::vector<uint8_t>			my_results(my_segments, 0);
+	std::vector<CThreadPool::task>	my_tasks;
+
+	for (size_t i = 0; i < my_segments; i++)
+	{
+		my_tasks.push_back([&my_results, &a_movie, i, my_image]()
+		{
+			my_results[i] = a_movie.check_segment(i, my_image) ? 1 : 0;
+		});
+	}
+
+	the_pool.run(my_tasks);
+
+	SBatchVerify my_verify;
+
+	my_verify.the_segments			= my_segments;
+	my_verify.the_first_bad			= std::find(my_results.begin(), my_results.end(), 0) - my_results.begin();
+	my_verify.the_first_bad_frame	= my_verify.the_first_bad < my_segments ? a_movie.get_keyframe_frame(my_verify.the_first_bad) : 0;
+	my_verify.the_ok				= my_segments > 0 && my_verify.the_first_bad == my_segments;
+	my_verify.the_seconds			= std::chrono::duration<double>(std::chrono::steady_clock::now() - my_start).count();
+
+	return my_verify;
+}
+
+bool
+CBatch::load_jobs(const std::string& a_file, std::vector<SBatchJob>& some_jobs)
+{
+	std::ifstream my_file(a_file);
+
+	if (!my_file)
+	{
+		std::cerr << "Unable to load " << a_file << "\n";
+		return false;
+	}
+
+	std::string my_line;
+
+	while (std::getline(my_file, my_line))
+	{
+		if (my_line.empty() || my_line[0] == '#')
+			continue;
+
+		std::istringstream	my_fields(my_line);
+		SBatchJob			my_job = {};
+
+		if (!(my_fields >> my_job.the_rom >> my_job.the_frames))
+		{
+			std::cerr << "Bad job in " << a_file << ": " << my_line << "\n";
+			return false;
+		}
+
+		if (my_fields >> my_job.the_input && my_job.the_input == "-")
+			my_job.the_input.clear();
+
+		if (!(my_fields >> std::ws).eof() && !(my_fields >> my_job.the_seed))
+		{
+			std::cerr << "Bad seed in " << a_file << ": " << my_line << "\n";
+			return false;
+		}
+
+		some_jobs.push_back(my_job);
+	}
+
+	return true;
+}
+
+bool
+CBatch::load_input(const std::string& a_file, std::vector<SBatchInput>& some_inputs)
+{
+	std::ifstream my_file(a_file);
+
+	if (!my_file)
+	{
+		std::cerr << "Unable to load " << a_file << "\n";
+		return false;
+	}
+
+	std::string my_line;
+
+	while (std::getline(my_file, my_line))
+	{
+		if (my_line.empty() || my_line[0] == '#')
+			continue;
+
+		std::istringstream	my_fields(my_line);
+		uint64_t			my_frame;
+		unsigned			my_key;
+		unsigned			my_state;
+
+		if (!(my_fields >> my_frame >> std::hex >> my_key >> std::dec >> my_state) || my_key > 0xf)
+		{
+			std::cerr << "Bad input in " << a_file << ": " << my_line << "\n";
+			return false;
+		}
+
+		some_inputs.push_back({ my_frame, (uint8_t)my_key, (uint8_t)(my_state != 0) });
+	}
+
+	// In frame order, changes within a frame as they were written.
+	std::stable_sort(some_inputs.begin(), some_inputs.end(), [](const SBatchInput& a_left, const SBatchInput& a_right)
+	{
+		return a_left.the_frame < a_right.the_frame;
+	});
+
+	return true;
+}
+
+bool
+CBatch::load_rom(const std::string& a_file, std::vector<uint8_t>& a_rom)
+{
+	std::ifstream my_file(a_file, std::ios::binary | std::ios::ate);
+
+	if (!my_file)
+	{
+		std::cerr << "Unable to load " << a_file << "\n";
+		return false;
+	}
+
+	a_rom.resize((size_t)my_file.tellg());
+	my_file.seekg(0, std::ios::beg);
+	my_file.read(reinterpret_cast<char*>(a_rom.data()), a_rom.size());
+
+	return true;
+}
+
+SBatchResult
+CBatch::run_job(const std::vector<uint8_t>& a_rom, const std::vector<SBatchInput>& some_inputs, uint64_t a_frames, uint64_t a_seed)
+{
+	auto my_start = std::chrono::steady_clock::now();
+
+	// The decode cache makes CMemory too big for a worker's stack.
+	std::unique_ptr<SChip8State>	my_state(new SChip8State());
+	std::unique_ptr<CMemory>		my_memory(new CMemory(*my_state));
+	CGraphics						my_graphics(*my_state);
+	CKeyboard						my_keyboard(*my_state);
+	CCPU							my_cpu(*my_state, my_memory.get(), &my_graphics);
+
+	my_memory->load_data(a_rom);
+	my_cpu.reset();
+	my_cpu.set_trace(false);
+	my_cpu.set_seed(a_seed);
+
+	size_t my_input = 0;
+
+	for (uint64_t i = 0; i < a_frames; i++)
+	{
+		for (; my_input < some_inputs.size() && some_inputs[my_input].the_frame <= i; my_input++)
+			my_keyboard.set_key_state(some_inputs[my_input].the_key, some_inputs[my_input].the_state);
+
+		my_cpu.run_frame();
+	}
+
+	SBatchResult my_result;
+
+	my_result.the_ok		= true;
+	my_result.the_hash		= CRecompRuntime::hash(*my_state);
+	my_result.the_frames	= my_cpu.get_frame_count();
+	my_result.the_seconds	= std::chrono::duration<double>(std::chrono::steady_clock::now() - my_start).count();
+
+	return my_result;
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "CThreadPool.h"
+
+class CMovie;
+
+/**
+	A key going down or up at the start of a frame.
+*/
+struct SBatchInput
+{
+	uint64_t	the_frame;
+	uint8_t		the_key;
+	uint8_t		the_state;
+};
+
+/**
+	One ROM to run headless, for a number of frames, with the keys of an input script (none when the path is empty)
+	and the seed of its random numbers.
+*/
+struct SBatchJob
+{
+	std::string	the_rom;
+	std::string	the_input;
+	uint64_t	the_frames;
+	uint64_t	the_seed;
+};
+
+/**
+	How a job ended: the hash of the final state (see CRecompRuntime::hash()), the frames it ran and how long they
+	took. the_ok is false when the ROM or the input script couldn't be loaded.
+*/
+struct SBatchResult
+{
+	bool		the_ok;
+	uint64_t	the_hash;
+	uint64_t	the_frames;
+	double		the_seconds;
+};
+
+/**
+	How a movie checked out: the segments between its keyframes (see CMovie::check_segment()), how long they took,
+	and the first that didn't end as recorded with the frame it starts at. the_first_bad is the_segments when none.
+*/
+struct SBatchVerify
+{
+	bool		the_ok;
+	size_t		the_segments;
+	size_t		the_first_bad;
+	uint64_t	the_first_bad_frame;
+	double		the_seconds;
+};
+
+/**
+	Runs many ROM instances at once, one machine per job on a CThreadPool.
+
+	Jobs share nothing but the ROM images and input scripts, loaded once up front. Every machine runs its frames
+	back to back without a presenter or timer, the keys of a frame are set before it runs.
+
+	Job files have a job per line, "<rom> <frames> [input script] [seed]", - for no script when there's a seed. A
+	job's machine and its random numbers are its own, it ends the same on any number of threads. Input scripts have a key change per line,
+	"<frame> <key, hex> <1 down, 0 up>". Lines starting with # are comments in both.
+*/
+class CBatch
+{
+	public:
+		CBatch(size_t a_threads = 0);
+		~CBatch() = default;
+
+		size_t						get_thread_count();
+		std::vector<SBatchResult>	run(const std::vector<SBatchJob>& some_jobs);
+
+		// Every segment of a movie at once. One without keyframes has none to split at and doesn't check out.
+		SBatchVerify				verify(CMovie& a_movie, const std::vector<uint8_t>& a_rom);
+
+		static bool			load_jobs(const std::string& a_file, std::vector<SBatchJob>& some_jobs);
+		static bool			load_input(const std::string& a_file, std::vector<SBatchInput>& some_inputs);
+		static bool			load_rom(const std::string& a_file, std::vector<uint8_t>& a_rom);
+		static SBatchResult	run_job(const std::vector<uint8_t>& a_rom, const std::vector<SBatchInput>& some_inputs, uint64_t a_frames,
+			uint64_t a_seed = 0);
+
+	private:
+		CThreadPool	the_pool;
+};
@@ -1,31 +1,51 @@
 #pragma once
 #include "CCPU.h"
+#include "CCPUOpcodes.h"
+#include "CJit.h"
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <fstream>
 #include <vector>
+#include <chrono>
 #include <assert.h>
 #include <iostream>
 #include <boost/asio.hpp>
 #include <boost/chrono.hpp>
 #include <boost/bind.hpp>
 
-CCPU::CCPU(CMemory* a_memory, CRegisters* a_register, CStack* a_stack, CGraphics* a_graphics, CKeyboard* a_keyboard) : 
+CCPU::CCPU(SChip8State& a_state, CMemory* a_memory, CGraphics* a_graphics) : 
+	the_state(a_state),
 	the_memory(a_memory),
-	the_V_registers(a_register),
-	the_stack(a_stack),
 	the_graphics(a_graphics),
-	the_keyboard(a_keyboard),
-	the_I_register(0x0),
 	the_opcode(0x0),
-	the_pc(0x0),
-	the_delay_timer(0x0),
-	the_sound_timer(0x0),
-	//the_stack({}),
-	the_sp(0x0),
 	the_drawflag(false),
+	the_draw_log(nullptr),
+	the_run_ahead(0),
+	the_ahead_flag(false),
+	the_latency_keys(),
+	the_latency_changed(0),
+	the_latency_seen(false),
+	the_latency_answered(false),
+	the_latency_start(0),
+	the_latency_frames(0),
+	the_latency_count(0),
+	the_engine(EEngine::TABLE),
+	the_trace(true),
+	the_fusion(true),
+	the_instruction_count(0),
+	the_fusion_hits({}),
+	the_clock_rate(500),
+	the_clock_credit(0),
+	the_frame_count(0),
+	the_timers_per_instruction(true),
 	the_start_flag(false),
-	the_timer(the_context, boost::asio::chrono::milliseconds(2))
+	the_turbo(false),
+	the_frame_limit(0),
+	the_timer(the_context, boost::asio::chrono::milliseconds(2)),
+	the_start_frame(0),
+	the_run_frames(0),
+	the_run_seconds(0.0)
 {
 }
 
@@ -36,22 +56,41 @@ CCPU::~CCPU()
 
 void
 CCPU::initialize()
+{
+	reset();
+
+	// A session draws other random numbers every time, set_seed() after this for one that repeats.
+	set_seed((uint64_t)time(NULL));
+
+	// Initialise SDL stuff.
+	the_graphics->init();
+}
+
+void
+CCPU::reset()
 {
 	// Set program counter to 0x200, the rest to 0x0.
 	// Everything before is system info, rom, etc.
-	the_pc			= 0x200;
-	the_opcode		= 0x0;
-	the_I_register	= 0x0;
-	the_sp			= 0x0;
+	the_state.the_pc	= 0x200;
+	the_opcode			= 0x0;
+	the_state.the_I		= 0x0;
+	the_state.the_sp	= 0x0;
+
+	// The counters start over with the machine.
+	the_instruction_count	= 0;
+	the_fusion_hits			= {};
+	the_clock_credit		= 0;
+	the_frame_count			= 0;
+	the_drawflag			= false;
+	the_latency_changed		= 0;
+	the_latency_frames		= 0;
+	the_latency_count		= 0;
 	
 	// Clear registers.
 	//the_stack		= {};
 	//the_V_reg		= {};
 	//the_memory		= {};
 
-	// For random number generation.
-	srand(time(NULL));
-
 	// The fontset
 	uint8_t chip8_fontset[80] =
 	{
@@ -78,9 +117,6 @@ CCPU::initialize()
 	{
 		the_memory->set_byte(i, chip8_fontset[i]);
 	}
-
-	// Initialise SDL stuff.
-	the_graphics->init();
 }
 
 bool
@@ -119,466 +155,488 @@ CCPU::load_game(std::string sname)
 void
 CCPU::cpu_cycle(boost::system::error_code const& e, boost::asio::steady_timer* t)
 {	
-	// Fetch the opcode.
-	//the_opcode = the_memory[the_pc] << 8 | the_memory[the_pc + 1];
-	the_opcode = the_memory->get_opcode(the_pc);
+	// One wakeup per frame.
+	cpu_frame();
 
-	// Parse the opcode.
-	parse_opcode(the_opcode);
+	// If we're done with our timer, return to stop endlessly continuing. Make sure to do this after we've performed our last cycle!
+	if (!the_start_flag)
+		return;
 
-	// Update the timers.
-	if (the_delay_timer > 0)
-		--the_delay_timer;
+	// For the timer to continue and not drift away, every frame is due at its own offset from the start.
+	t->expires_at(the_start_time + boost::asio::chrono::microseconds((the_frame_count - the_start_frame + 1) * 1000000 / FRAME_RATE));
+	t->async_wait(boost::bind(&CCPU::cpu_cycle, this, boost::asio::placeholders::error, t));
+	
+}
 
-	if (the_sound_timer > 0)
+void
+CCPU::cpu_frame()
+{
+	// Keys that changed since the last frame start the input latency, or join it when it's running already.
+	uint16_t my_changed = 0;
+
+	for (int i = 0; i < (int)sizeof(the_latency_keys); i++)
+		if (the_latency_keys[i] != the_state.the_keys[i])
+			my_changed |= 1 << i;
+
+	if (my_changed != 0 && the_latency_changed == 0)
 	{
-		if (the_sound_timer == 1)
-		{
-			printf("BEEP\n");
-			// beep noise here.
-		}
-		--the_sound_timer;
+		the_latency_start		= the_frame_count;
+		the_latency_seen		= false;
+		the_latency_answered	= false;
 	}
 
-	// Do we need to draw?
-	if (the_drawflag)
-		the_graphics->draw();
+	the_latency_changed |= my_changed;
+	memcpy(the_latency_keys, the_state.the_keys, sizeof(the_latency_keys));
 
-	// If we're done with our timer, return to stop endlessly continuing. Make sure to do this after we've performed our last cycle!
-	if (!the_start_flag)
-		return;
+	// Its share of the instructions and one timer tick, the same paced or in turbo.
+	run_frame();
 
-	// For the timer to continue and not drift away.
-	t->expires_at(t->expiry() + boost::asio::chrono::milliseconds(2));
-	t->async_wait(boost::bind(&CCPU::cpu_cycle, this, boost::asio::placeholders::error, t));
-	
+	// The frame is done, whether it drew anything goes with it. The graphics present it now or with a later one.
+	if (the_run_ahead > 0)
+	{
+		run_ahead();
+	}
+	else
+	{
+		uint64_t my_presents = the_graphics->get_present_count();
+
+		the_graphics->frame_ready(the_drawflag);
+		measure_latency(my_presents, the_latency_answered);
+	}
+
+	the_drawflag = false;
+
+	if (the_frame_hook)
+		the_frame_hook(*this);
+
+	if (the_frame_limit != 0 && the_frame_count >= the_frame_limit)
+		the_start_flag = false;
 }
 
-void CCPU::parse_opcode(uint16_t an_opcode)
+void
+CCPU::run_ahead()
 {
-	// Split up for easy access later.
-	uint8_t code[2];
-	code[0] = (an_opcode & 0xff00) >> 8;
-	code[1] = an_opcode & 0x00ff;
+	// The real machine aside, counters and all. The frames ahead run with the keys it has now. Whether they answer a
+	// key only goes for the present they make, the real machine hasn't got that far.
+	SSnapshotClock								my_clock		= get_clock();
+	uint64_t									my_instructions	= the_instruction_count;
+	std::array<uint64_t, CFusion::IDIOM_COUNT>	my_fusion_hits	= the_fusion_hits;
+	CDrawLog*									my_draw_log		= the_draw_log;
+	bool										my_seen			= the_latency_seen;
+	bool										my_answered		= the_latency_answered;
 
-	printf("%04x %02x %02x ", the_pc, code[0], code[1]);
+	memcpy(the_ahead_state.get(), &the_state, sizeof(SChip8State));
 
-	switch (an_opcode & 0xf000)
+	// What they draw belongs to frames that haven't happened, it stays out of the log.
+	the_draw_log	= nullptr;
+	the_ahead_flag	= true;
+
+	for (uint32_t i = 0; i < the_run_ahead; i++)
+		run_frame();
+
+	// The last of them is the one presented, with what the real frame drew too.
+	uint64_t	my_presents			= the_graphics->get_present_count();
+	bool		my_ahead_answered	= the_latency_answered;
+
+	the_graphics->frame_ready(the_drawflag);
+
+	the_ahead_flag			= false;
+	the_latency_seen		= my_seen;
+	the_latency_answered	= my_answered;
+	the_draw_log			= my_draw_log;
+	the_instruction_count	= my_instructions;
+	the_fusion_hits			= my_fusion_hits;
+
+	restore_state(*the_ahead_state, my_clock);
+
+	// Counted to the real frame, the present shows it sooner.
+	measure_latency(my_presents, my_ahead_answered);
+}
+
+void
+CCPU::measure_latency(uint64_t a_presents, bool an_answered)
+{
+	// The first present since the game looked at a changed key and drew is its answer. Games that draw every frame
+	// but don't read the keys never answer.
+	if (the_latency_changed != 0 && an_answered && the_graphics->get_present_count() != a_presents)
 	{
-		case 0x0000:
+		the_latency_frames += the_frame_count - the_latency_start;
+		the_latency_count++;
+		the_latency_changed = 0;
+	}
+}
+
+void
+CCPU::step()
+{
+	// Fetch through the decode cache and execute, without tracing.
+	const CMemory::SDecoded& my_decoded = the_memory->get_decoded(the_state.the_pc);
+	the_opcode = my_decoded.the_opcode;
+
+	my_decoded.the_handler(*this);
+}
+
+void
+CCPU::update_timers()
+{
+	if (the_state.the_delay_timer > 0)
+		--the_state.the_delay_timer;
+
+	if (the_state.the_sound_timer > 0)
+	{
+		// Frames run ahead beep when they come for real.
+		if (the_state.the_sound_timer == 1 && !the_ahead_flag)
 		{
-			switch (an_opcode & 0x00ff)
-			{
-			case 0xe0:
-				{
-					the_graphics->clear();
-					the_drawflag = true;
-					the_pc += 2;
-
-					printf("%-10s", "CLS\n");
-					break;
-				}
-				case 0xee:
-				{
-					the_pc = the_stack->top();
-					the_sp--;
-										
-					//the_sp--;
-					//the_pc = the_stack[the_sp];
-					//the_pc += 2;
-
-					printf("%-10s\n", "RET");
-					break;
-				}
-				default:
-				{
-					printf("unknown opcode: 0x%04x\n", an_opcode);
-				}
-			}
-			break;
+			printf("BEEP\n");
+			// beep noise here.
 		}
-		case 0x1000:
-		{
-			the_pc = an_opcode & 0x0FFF;
+		--the_state.the_sound_timer;
+	}
+}
+
+void CCPU::parse_opcode(uint16_t an_opcode)
+{
+	if (CHIP8_TRACE && the_trace)
+		trace_opcode(an_opcode);
 
-			printf("%-10s #$%03x\n", "JP", the_pc);
+	// A single opcode goes to the selected interpreter, the JIT only works on whole blocks.
+	switch (the_engine)
+	{
+		case EEngine::SWITCH:
+			execute_switch(an_opcode);
 			break;
-		}
-		case 0x2000:
-		{
-			uint16_t addr = ((code[0] & 0x0f) << 8) + code[1];
-			
-			the_sp++;
-			the_stack->push(the_pc);
+		case EEngine::THREADED:
+			execute_threaded(an_opcode);
+			break;
+		default:
+			execute(an_opcode);
+			break;
+	}
+}
 
-			//the_stack[the_sp] = the_pc;
-			//the_sp++;
-			the_pc = addr;
+uint32_t
+CCPU::run(uint32_t a_count)
+{
+	// Without CHIP8_TRACE only the untraced loop gets built into run().
+	if (CHIP8_TRACE && the_trace)
+		return run<STraceOn>(a_count);
 
-			printf("%-10s #$%03x\n", "CALL", addr);
-			break;
-		}
-		case 0x3000:
-		{
-			uint8_t reg = code[0] & 0x0f;
+	return run<STraceOff>(a_count);
+}
 
-			//if (the_V_reg[reg] == code[1])
-			if(the_V_registers->get_register_value(reg) == code[1])
-			{
-				the_pc += 2;
-			}
+template <typename TTrace>
+uint32_t
+CCPU::run(uint32_t a_count)
+{
+	uint32_t my_executed = 0;
 
-			the_pc += 2;
+	// The threaded loop and the JIT don't stop between instructions. Traced, they go through the loop below like
+	// the others, the threaded engine an opcode at a time and the JIT on the table it falls back to.
+	if (the_engine == EEngine::THREADED && !TTrace::enabled)
+	{
+		my_executed = run_threaded(a_count);
+	}
+	else if (the_engine == EEngine::JIT && the_jit && !TTrace::enabled)
+	{
+		// The JIT runs whole blocks, so it can go up to a block past the count.
+		while (my_executed < a_count)
+			my_executed += the_jit->run_block();
+	}
+	else
+	{
+		// Fused sequences can't be traced one by one, and mustn't run past the count.
+		bool my_fusion = the_fusion && !TTrace::enabled && the_engine != EEngine::SWITCH;
 
-			printf("%-10s V%01X,#$%02x\n", "SE", reg, code[1]);
-			break;
-		}
-		case 0x4000:
+		while (my_executed < a_count)
 		{
-			uint8_t reg = code[0] & 0x0f;
+			// Fetch the opcode, already decoded unless the code was written to.
+			const CMemory::SDecoded& my_decoded = the_memory->get_decoded(the_state.the_pc);
+			the_opcode = my_decoded.the_opcode;
 
-			//if (the_V_reg[reg] != code[1])
-			if(the_V_registers->get_register_value(reg) != code[1])
+			if (my_fusion && my_decoded.the_fused_handler != nullptr && a_count - my_executed >= CFusion::MAX_LENGTH)
 			{
-				the_pc += 2;
+				uint32_t my_count = my_decoded.the_fused_handler(*this, the_opcode, my_decoded.the_fused_opcodes[0], my_decoded.the_fused_opcodes[1]);
+				the_fusion_hits[my_decoded.the_idiom] += my_count;
+
+				for (uint32_t i = 0; i < my_count && the_timers_per_instruction; i++)
+					update_timers();
+
+				my_executed += my_count;
+				continue;
 			}
 
-			the_pc += 2;
+			TTrace::trace(*this, the_opcode);
 
-			printf("%-10s V%01X,#$%02x\n", "SNE", reg, code[1]);
-			break;
+			if (the_engine == EEngine::SWITCH)
+				execute_switch(the_opcode);
+			else if (the_engine == EEngine::THREADED)
+				execute_threaded(the_opcode);
+			else
+				my_decoded.the_handler(*this);
+
+			if (the_timers_per_instruction)
+				update_timers();
+
+			my_executed++;
 		}
-		case 0x5000:
-		{
-			uint16_t my_opcode = an_opcode;
-			
-			uint8_t regx = code[0] & 0x0f;
-			uint8_t regy = (code[1] & 0xf0) >> 4;
+	}
 
-			if (the_V_registers->get_register_value(regx) == the_V_registers->get_register_value(regy))
-			{
-				the_pc += 2;
-			}
+	the_instruction_count += my_executed;
 
-			the_pc += 2;
+	return my_executed;
+}
 
-			printf("%-10s V%01X,V%01X\n", "SNE", regx, regy);
-			break;
-		}
-		case 0x6000:
-		{
-			uint8_t reg = code[0] & 0x0f;
-			the_V_registers->set_register_value(reg, code[1]);
+// Both are there for callers that pick one themselves, chip8-bench compares them.
+template uint32_t CCPU::run<CCPU::STraceOff>(uint32_t a_count);
+template uint32_t CCPU::run<CCPU::STraceOn>(uint32_t a_count);
 
-			the_pc += 2;
-			printf("%-10s V%01X,#$%02x\n", "MVI", reg, code[1]);
+void
+CCPU::set_engine(EEngine an_engine)
+{
+	the_engine = an_engine;
 
-			break;
-		}
-		case 0x7000:
-		{
-			uint8_t reg = code[0] & 0x0f;
-			uint8_t my_value = the_V_registers->get_register_value(reg) + code[1];
+	// The JIT hooks into the memory, only keep it around while it's in use.
+	if (the_engine == EEngine::JIT && CJit::is_supported())
+	{
+		if (!the_jit)
+			the_jit.reset(new CJit(this, the_memory, &the_state));
+	}
+	else
+	{
+		the_jit.reset();
+	}
+}
+
+CCPU::EEngine
+CCPU::get_engine()
+{
+	return the_engine;
+}
+
+uint32_t
+CCPU::run_frame()
+{
+	// The budget is the clock rate over the frame rate. What doesn't divide evenly carries over, so 500 Hz runs
+	// 8, 8, 9, 8, 8, 9... instructions and exactly 500 of them every 60 frames. The JIT can run past its count,
+	// that comes off the next frame.
+	the_clock_credit += the_clock_rate;
 
-			the_V_registers->set_register_value(reg, my_value);
-			//the_V_reg[reg] += code[1];
+	uint32_t my_count		= the_clock_credit > 0 ? (uint32_t)(the_clock_credit / FRAME_RATE) : 0;
+	uint32_t my_executed	= 0;
 
-			the_pc += 2;
-			printf("%-10s V%01X,#$%02x\n", "ADD", reg, code[1]);
+	the_timers_per_instruction = false;
 
+	if (my_count > 0)
+		my_executed = run(my_count);
+
+	the_timers_per_instruction = true;
+	the_clock_credit -= (int64_t)my_executed * FRAME_RATE;
+
+	// The timers run at the frame rate whatever the clock is.
+	update_timers();
+	the_frame_count++;
+
+	return my_executed;
+}
+
+void
+CCPU::set_clock_rate(uint32_t an_instructions_per_second)
+{
+	the_clock_rate = an_instructions_per_second;
+}
+
+double
+CCPU::get_frame_budget()
+{
+	return (double)the_clock_rate / FRAME_RATE;
+}
+
+void
+CCPU::set_trace(bool a_trace)
+{
+	the_trace = a_trace;
+}
+
+void
+CCPU::set_fusion(bool a_fusion)
+{
+	the_fusion = a_fusion;
+}
+
+uint64_t
+CCPU::get_instruction_count()
+{
+	return the_instruction_count;
+}
+
+uint64_t
+CCPU::get_frame_count()
+{
+	return the_frame_count;
+}
+
+uint64_t
+CCPU::get_fusion_hits(CFusion::EIdiom an_idiom)
+{
+	return the_fusion_hits[an_idiom];
+}
+
+void
+CCPU::execute(uint16_t an_opcode)
+{
+	// One indirect call, the handler has the operands baked in.
+	COpcodeTable::get_handler(an_opcode)(*this);
+}
+
+void
+CCPU::execute_switch(uint16_t an_opcode)
+{
+	// The reference decoder, kept to check and benchmark the dispatch table against.
+	uint8_t regx	= (an_opcode & 0x0f00) >> 8;
+	uint8_t regy	= (an_opcode & 0x00f0) >> 4;
+	uint8_t byte	= an_opcode & 0x00ff;
+	uint16_t addr	= an_opcode & 0x0fff;
+
+	switch (an_opcode & 0xf000)
+	{
+		case 0x0000:
+		{
+			switch (an_opcode & 0x00ff)
+			{
+				case 0xe0:	op_CLS();		break;
+				case 0xee:	op_RET();		break;
+				default:	op_unknown();	break;
+			}
 			break;
 		}
+		case 0x1000:	op_JP_addr(addr);				break;
+		case 0x2000:	op_CALL_addr(addr);				break;
+		case 0x3000:	op_SE_Vx_byte(regx, byte);		break;
+		case 0x4000:	op_SNE_Vx_byte(regx, byte);		break;
+		case 0x5000:	op_SE_Vx_Vy(regx, regy);		break;
+		case 0x6000:	op_LD_Vx_byte(regx, byte);		break;
+		case 0x7000:	op_ADD_Vx_byte(regx, byte);		break;
 		case 0x8000:
 		{
 			switch (an_opcode & 0x000f)
 			{
-				case 0x00:
-				{
-					uint8_t regx = code[0] & 0x0f;
-					uint8_t regy = (code[1] & 0xf0) >> 4;
-					uint8_t my_value = the_V_registers->get_register_value(regy);
-
-					//the_V_reg[regx] = the_V_reg[regy];
-					the_V_registers->set_register_value(regx, my_value);
-					the_pc += 2;
-
-					printf("%-10s V%01X,V%01X\n", "LD", regx, regy);
-					break;
-				}
-				case 0x01:
-				{
-					uint8_t regx = code[0] & 0x0f;
-					uint8_t regy = (code[1] & 0xf0) >> 4;
-					uint8_t my_value = the_V_registers->get_register_value(regx) | the_V_registers->get_register_value(regy);
-
-
-					//the_V_reg[regx] = the_V_reg[regx] | the_V_reg[regy];
-					the_V_registers->set_register_value(regx, my_value);
-					the_pc += 2;
-
-					printf("%-10s V%01X,V%01X\n", "OR", regx, regy);
-					break;
-				}
-				case 0x02:
-				{
-					uint8_t regx = code[0] & 0x0f;
-					uint8_t regy = (code[1] & 0xf0) >> 4;
-					uint8_t my_value = the_V_registers->get_register_value(regx) & the_V_registers->get_register_value(regy);
-
-					//the_V_reg[regx] = the_V_reg[regx] & the_V_reg[regy];
-					the_V_registers->set_register_value(regx, my_value);
-					the_pc += 2;
-
-					printf("%-10s V%01X,V%01X\n", "AND", regx, regy);
-					break;
-				}
-				case 0x03:
-				{
-					uint8_t regx = code[0] & 0x0f;
-					uint8_t regy = (code[1] & 0xf0) >> 4;
-					uint8_t my_value = the_V_registers->get_register_value(regx) ^ the_V_registers->get_register_value(regy);
-
-					//the_V_reg[regx] = the_V_reg[regx] ^ the_V_reg[regy];
-					the_V_registers->set_register_value(regx, my_value);
-					the_pc += 2;
-
-					printf("%-10s V%01X,V%01X\n", "XOR", regx, regy);
-					break;
-				}
-				case 0x04:
-				{
-					uint8_t regx = code[0] & 0x0f;
-					uint8_t regy = (code[1] & 0xf0) >> 4;
-					uint8_t my_value = the_V_registers->get_register_value(regx) + the_V_registers->get_register_value(regy);
-
-					if (the_V_registers->get_register_value(regx) + the_V_registers->get_register_value(regy) <= 0xff)
-					{
-						the_V_registers->set_register_value(regx, my_value);
-					}
-					else
-					{
-						the_V_registers->set_register_value(regx, my_value);
-						the_V_registers->set_register_value(0xf, 1);
-					}
-
-					the_pc += 2;
-
-					printf("%-10s V%01X,V%01X\n", "ADD", regx, regy);
-					break;
-				}
-				case 0x05:
-				{
-					uint8_t regx = code[0] & 0x0f;
-					uint8_t regy = (code[1] & 0xf0) >> 4;
-
-					if (the_V_registers->get_register_value(regx) > the_V_registers->get_register_value(regy))
-					{
-						the_V_registers->set_register_value(0xf, 1);
-					}
-					else
-					{
-						the_V_registers->set_register_value(0xf, 0);
-					}
-
-					uint8_t my_value = the_V_registers->get_register_value(regx) - the_V_registers->get_register_value(regy);
-
-					the_V_registers->set_register_value(regx, my_value);
-					the_pc += 2;
-
-					printf("%-10s V%01X,V%01X\n", "SUB", regx, regy);
-					break;
-				}
-				case 0x06:
-				{
-					uint8_t regx = code[0] & 0x0f;
-					uint8_t regy = (code[1] & 0xf0) >> 4;
-					uint8_t my_value = the_V_registers->get_register_value(regx) >> 1;
-					uint8_t my_lsb = the_V_registers->get_register_value(regy) & 0b0001;
-
-					the_V_registers->set_register_value(0xf, my_lsb);
-					the_V_registers->set_register_value(regx, my_value);
-					the_pc += 2;
-
-					printf("%-10s V%01X,V%01X\n", "SHR", regx, regy);
-					break;
-				}
-				case 0x07:
-				{
-					uint8_t regx = code[0] & 0x0f;
-					uint8_t regy = (code[1] & 0xf0) >> 4;
-
-					if (the_V_registers->get_register_value(regy) > the_V_registers->get_register_value(regx))
-					{
-						the_V_registers->set_register_value(0xf, 1);
-					}
-					else
-					{
-						the_V_registers->set_register_value(0xf, 0);
-					}
-
-					uint8_t my_value = the_V_registers->get_register_value(regy) - the_V_registers->get_register_value(regx);
-
-					the_V_registers->set_register_value(regx, my_value);
-					the_pc += 2;
-
-					printf("%-10s V%01X,V%01X\n", "SUBN", regx, regy);
-					break;
-				}
-				case 0x0E:
-				{
-					uint8_t regx = code[0] & 0x0f;
-					uint8_t regy = (code[1] & 0xf0) >> 4;
-					uint8_t my_msb = the_V_registers->get_register_value(regy) & 0b1000;
-					
-					the_V_registers->set_register_value(0xf, my_msb);
-
-					uint8_t my_value = the_V_registers->get_register_value(regy) << 1;
-
-					the_V_registers->set_register_value(regx, my_value);
-					the_pc += 2;
-
-					printf("%-10s V%01X,V%01X\n", "SHL", regx, regy);
-					break;
-				}
-				default:
-				{
-					printf("unknown opcode: 0x%04x\n", an_opcode);
-				}
-				break;
+				case 0x00:	op_LD_Vx_Vy(regx, regy);	break;
+				case 0x01:	op_OR_Vx_Vy(regx, regy);	break;
+				case 0x02:	op_AND_Vx_Vy(regx, regy);	break;
+				case 0x03:	op_XOR_Vx_Vy(regx, regy);	break;
+				case 0x04:	op_ADD_Vx_Vy(regx, regy);	break;
+				case 0x05:	op_SUB_Vx_Vy(regx, regy);	break;
+				case 0x06:	op_SHR_Vx_Vy(regx, regy);	break;
+				case 0x07:	op_SUBN_Vx_Vy(regx, regy);	break;
+				case 0x0E:	op_SHL_Vx_Vy(regx, regy);	break;
+				default:	op_unknown();				break;
 			}
-
 			break;
 		}
-		case 0x9000:
+		case 0x9000:	op_SNE_Vx_Vy(regx, regy);							break;
+		case 0xA000:	op_LD_I_addr(addr);									break;
+		case 0xB000:	op_JP_V0_addr(addr);								break;
+		case 0xC000:	op_RND_Vx_byte(regx, byte);							break;
+		case 0xD000:	op_DRW_Vx_Vy_nibble(regx, regy, an_opcode & 0x000F);	break;
+		case 0xE000:
 		{
-			uint8_t regx = code[0] & 0x0f;
-			uint8_t regy = (code[1] & 0xf0) >> 4;
-
-			if (the_V_registers->get_register_value(regx) != the_V_registers->get_register_value(regy))
+			switch (an_opcode & 0x00FF)
 			{
-				the_pc += 2;
+				case 0x9E:	op_SKP_Vx(regx);	break;
+				case 0xA1:	op_SKNP_Vx(regx);	break;
+				default:	op_unknown();		break;
 			}
-
-			the_pc += 2;
-
-			printf("%-10s V%01X,V%01X\n", "SNE", regx, regy);
 			break;
 		}
-		case 0xA000:
+		case 0xF000:
 		{
-			//the_I_register.set_byte(an_opcode & 0x0FFF);
-			the_I_register = an_opcode & 0x0FFF;
-			the_pc += 2;
-
-			//printf("%-10s #$%03x\n", "LD I", the_I_register.get_byte());
-			printf("%-10s #$%03x\n", "LD I", the_I_register);
+			switch (an_opcode & 0x00FF)
+			{
+				case 0x07:	op_LD_Vx_DT(regx);	break;
+				case 0x0A:	op_LD_Vx_K(regx);	break;
+				case 0x15:	op_LD_DT_Vx(regx);	break;
+				case 0x18:	op_LD_ST_Vx(regx);	break;
+				case 0x1E:	op_ADD_I_Vx(regx);	break;
+				case 0x29:	op_LD_F_Vx(regx);	break;
+				case 0x33:	op_LD_B_Vx(regx);	break;
+				case 0x55:	op_LD_I_Vx(regx);	break;
+				case 0x65:	op_LD_Vx_I(regx);	break;
+				default:	op_unknown();		break;
+			}
 			break;
 		}
-		case 0xB000:
-		{
-			the_pc = (an_opcode & 0x0FFF) + the_V_registers->get_register_value(0x0);
+	}
+}
 
-			printf("%-10s #$%03x\n", "JP", the_pc);
-			break;
-		}
-		case 0xC000:
-		{
-			uint8_t reg = code[0] & 0x0f;
-			uint8_t num = rand() % 255;
+void
+CCPU::trace_opcode(uint16_t an_opcode)
+{
+	// Split up for easy access later.
+	uint8_t code[2];
+	code[0] = (an_opcode & 0xff00) >> 8;
+	code[1] = an_opcode & 0x00ff;
+
+	uint8_t reg		= code[0] & 0x0f;
+	uint8_t regx	= code[0] & 0x0f;
+	uint8_t regy	= (code[1] & 0xf0) >> 4;
 
-			the_V_registers->set_register_value(reg, num & code[1]);
-			the_pc += 2;
+	printf("%04x %02x %02x ", the_state.the_pc, code[0], code[1]);
 
-			printf("%-10s V%01X,#$%02x\n", "RND", reg, code[1]);
+	switch (an_opcode & 0xf000)
+	{
+		case 0x0000:
+		{
+			switch (an_opcode & 0x00ff)
+			{
+				case 0xe0:	printf("%-10s", "CLS\n");							break;
+				case 0xee:	printf("%-10s\n", "RET");							break;
+				default:	printf("unknown opcode: 0x%04x\n", an_opcode);		break;
+			}
 			break;
 		}
-		case 0xD000:
+		case 0x1000:	printf("%-10s #$%03x\n", "JP", an_opcode & 0x0FFF);					break;
+		case 0x2000:	printf("%-10s #$%03x\n", "CALL", an_opcode & 0x0FFF);				break;
+		case 0x3000:	printf("%-10s V%01X,#$%02x\n", "SE", reg, code[1]);					break;
+		case 0x4000:	printf("%-10s V%01X,#$%02x\n", "SNE", reg, code[1]);				break;
+		case 0x5000:	printf("%-10s V%01X,V%01X\n", "SNE", regx, regy);					break;
+		case 0x6000:	printf("%-10s V%01X,#$%02x\n", "MVI", reg, code[1]);				break;
+		case 0x7000:	printf("%-10s V%01X,#$%02x\n", "ADD", reg, code[1]);				break;
+		case 0x8000:
 		{
-			// DXYN - Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels.
-			// All sprites are 8bit wide, but n high.
-
-			// Sprites are ALWAYS 8 pixels wide, and between 1 and 15 pixels high, where N is height.
-			// height = rows = n
-			// width = columns = 8
-
-			uint8_t regx = code[0] & 0x0f;
-			uint8_t regy = (code[1] & 0xf0) >> 4;
-
-			// Get the co-ordinates and height.
-			uint8_t x = the_V_registers->get_register_value(regx);
-			uint8_t y = the_V_registers->get_register_value(regy);
-			uint8_t height = an_opcode & 0x000F;
-			uint8_t pixel;
-
-			// Reset F register.
-			the_V_registers->set_register_value(0xf, 0);
-
-			// First check each row.
-			for (int row = 0; row < height; row++)
+			switch (an_opcode & 0x000f)
 			{
-				// Retrieve the pixel state from memory.
-				//pixel = the_memory.get_byte(the_I_register.get_byte() + row);
-				pixel = the_memory->get_byte(the_I_register + row);
-
-				// Then check each column,
-				for (int col = 0; col < 8; col++)
-				{
-					// Check if the pixel is already set.
-					if ((pixel & (0x80 >> col)) != 0)
-					{
-						int my_pixel = (x + row + ((y + col) * 64));
-
-						the_pixels.push_back(my_pixel);
-
-						if (the_graphics->get_pixel_state((x + row + ((y + col) * 64))) == 1)
-						{
-							the_V_registers->set_register_value(0xf, 1);
-						}
-						the_graphics->flip_pixel((x + row + ((y + col) * 64)));
-					}
-				}
+				case 0x00:	printf("%-10s V%01X,V%01X\n", "LD", regx, regy);		break;
+				case 0x01:	printf("%-10s V%01X,V%01X\n", "OR", regx, regy);		break;
+				case 0x02:	printf("%-10s V%01X,V%01X\n", "AND", regx, regy);		break;
+				case 0x03:	printf("%-10s V%01X,V%01X\n", "XOR", regx, regy);		break;
+				case 0x04:	printf("%-10s V%01X,V%01X\n", "ADD", regx, regy);		break;
+				case 0x05:	printf("%-10s V%01X,V%01X\n", "SUB", regx, regy);		break;
+				case 0x06:	printf("%-10s V%01X,V%01X\n", "SHR", regx, regy);		break;
+				case 0x07:	printf("%-10s V%01X,V%01X\n", "SUBN", regx, regy);		break;
+				case 0x0E:	printf("%-10s V%01X,V%01X\n", "SHL", regx, regy);		break;
+				default:	printf("unknown opcode: 0x%04x\n", an_opcode);			break;
 			}
+			break;
+		}
+		case 0x9000:	printf("%-10s V%01X,V%01X\n", "SNE", regx, regy);					break;
+		case 0xA000:	printf("%-10s #$%03x\n", "LD I", an_opcode & 0x0FFF);				break;
+		case 0xB000:
+		{
+			// The jump target, printed as the PC will be after the jump.
+			uint16_t my_target = (an_opcode & 0x0FFF) + the_state.the_V[0x0];
 
-			the_drawflag = true;
-			the_pc += 2;
-
-			printf("%-10s V%01X,V%01X,#$%01X\n", "DRW", regx, regy, height);
+			printf("%-10s #$%03x\n", "JP", my_target);
 			break;
 		}
+		case 0xC000:	printf("%-10s V%01X,#$%02x\n", "RND", reg, code[1]);				break;
+		case 0xD000:	printf("%-10s V%01X,V%01X,#$%01X\n", "DRW", regx, regy, an_opcode & 0x000F);	break;
 		case 0xE000:
 		{
 			switch (an_opcode & 0x00FF)
 			{
-				case 0x9E:
-				{
-					uint8_t reg = code[0] & 0x0f;
-					if (the_keyboard->get_key_state(the_V_registers->get_register_value(reg)) == 1)
-					{
-						the_pc += 2;
-					}
-
-					the_pc += 2;
-
-					printf("%-10s V%01X\n", "SKP", reg);
-					break;
-				}
-				case 0xA1:
-				{
-					uint8_t reg = code[0] & 0x0f;
-					if (the_keyboard->get_key_state(the_V_registers->get_register_value(reg)) != 1)
-					{
-						the_pc += 2;
-					}
-
-					the_pc += 2;
-
-					printf("%-10s V%01X\n", "SKNP", reg);
-					break;
-				}
-				default:
-				{
-					printf("unknown opcode: 0x%04x\n", an_opcode);
-				}
+				case 0x9E:	printf("%-10s V%01X\n", "SKP", reg);				break;
+				case 0xA1:	printf("%-10s V%01X\n", "SKNP", reg);				break;
+				default:	printf("unknown opcode: 0x%04x\n", an_opcode);		break;
 			}
 			break;
 		}
@@ -586,139 +644,17 @@ void CCPU::parse_opcode(uint16_t an_opcode)
 		{
 			switch (an_opcode & 0x00FF)
 			{
-				case 0x07:
-				{
-					uint8_t reg = code[0] & 0x0f;
-					the_V_registers->set_register_value(reg, the_delay_timer);
-
-					the_pc += 2;
-
-					printf("%-10s V%01X,#DT\n", "LD Vx DT", reg);
-					break;
-				}
-				case 0x0A:
-				{
-					uint8_t reg = code[0] & 0x0f;
-
-					// Check status of all keys stored in key.
-					for (int i = 0; i < the_keyboard->get_size(); i++)
-					{
-						// If key state is active.
-						if (the_keyboard->get_key_state(i) == 1)
-						{
-							// Store key value in Vreg.
-							the_V_registers->set_register_value(reg, the_keyboard->get_key_state(i));
-							the_pc += 2;
-						}
-					}
-
-					printf("%-10s V%01X,#K\n", "LD Vx K", reg);
-					break;
-				}
-				case 0x15:
-				{
-					uint8_t reg = code[0] & 0x0f;
-					the_delay_timer = the_V_registers->get_register_value(reg);
-
-					the_pc += 2;
-
-					printf("%-10s V%01X\n", "LD DT Vx", reg);
-					break;
-				}
-				case 0x18:
-				{
-					uint8_t reg = code[0] & 0x0f;
-					the_sound_timer = the_V_registers->get_register_value(reg);
-
-					the_pc += 2;
-
-					printf("%-10s V%01X\n", "LD ST Vx", reg);
-					break;
-				}
-				case 0x1E:
-				{
-					uint8_t reg = code[0] & 0x0f;
-					//uint8_t my_value = the_I_register.get_byte() + the_V_registers.get_register_value(reg);
-					uint8_t my_value = the_I_register + the_V_registers->get_register_value(reg);
-
-					//the_I_register.set_byte(my_value);
-					the_I_register = my_value;
-					the_pc += 2;
-
-					printf("%-10s V%01X\n", "ADD F Vx", reg);
-					break;
-				}
-				case 0x29:
-				{
-					uint8_t reg = code[0] & 0x0f;
-					uint8_t my_value = the_V_registers->get_register_value(reg) * 0x05;
-
-					//the_I_register.set_byte(my_value);
-					the_I_register = my_value;
-					the_pc += 2;
-
-					printf("%-10s V%01X\n", "LD F Vx", reg);
-					break;
-				}
-				case 0x33:
-				{
-					uint8_t reg = code[0] & 0x0f;
-					uint8_t bcd = the_V_registers->get_register_value(reg);
-
-					//the_memory.set_byte(the_I_register.get_byte(),		bcd / 100);
-					//the_memory.set_byte(the_I_register.get_byte(),		(bcd / 10) % 10);
-					//the_memory.set_byte(the_I_register.get_byte() + 2,	bcd % 10);
-
-					the_memory->set_byte(the_I_register,		bcd / 100);
-					the_memory->set_byte(the_I_register + 1,	(bcd / 10) % 10);
-					the_memory->set_byte(the_I_register + 2,	bcd % 10);
-
-					the_pc += 2;
-
-					printf("%-10s V%01X\n", "LD B Vx", reg);
-					break;
-				}
-				case 0x55:
-				{
-					uint8_t reg = code[0] & 0x0f;
-					for (int i = 0; i <= reg; i++)
-					{
-						//the_memory.set_byte(the_I_register.get_byte() + i, the_V_registers.get_register_value(i));
-						the_memory->set_byte(the_I_register + i, the_V_registers->get_register_value(i));
-					}
-
-					the_pc += 2;
-
-					printf("%-10s V%01X\n", "LD [I] Vx", reg);
-					break;
-				}
-				case 0x65:
-				{
-					uint8_t reg = code[0] & 0x0f;
-					for (int i = 0; i <= reg; i++)
-					{
-						//uint8_t my_value = the_memory.get_byte(the_I_register.get_byte() + 1);
-						uint8_t my_value = the_memory->get_byte(the_I_register + i);
-						
-						the_V_registers->set_register_value(i, my_value);
-					}
-
-					the_pc += 2;
-
-					printf("%-10s V%01X\n", "LD Vx [I]", reg);
-					break;
-				}
-				default:
-				{
-					printf("unknown opcode: 0x%04x\n", an_opcode);
-				}
+				case 0x07:	printf("%-10s V%01X,#DT\n", "LD Vx DT", reg);		break;
+				case 0x0A:	printf("%-10s V%01X,#K\n", "LD Vx K", reg);			break;
+				case 0x15:	printf("%-10s V%01X\n", "LD DT Vx", reg);			break;
+				case 0x18:	printf("%-10s V%01X\n", "LD ST Vx", reg);			break;
+				case 0x1E:	printf("%-10s V%01X\n", "ADD F Vx", reg);			break;
+				case 0x29:	printf("%-10s V%01X\n", "LD F Vx", reg);			break;
+				case 0x33:	printf("%-10s V%01X\n", "LD B Vx", reg);			break;
+				case 0x55:	printf("%-10s V%01X\n", "LD [I] Vx", reg);			break;
+				case 0x65:	printf("%-10s V%01X\n", "LD Vx [I]", reg);			break;
+				default:	printf("unknown opcode: 0x%04x\n", an_opcode);		break;
 			}
-
-			break;
-		}
-		default:
-		{
-			printf("unknown opcode: 0x%04x\n", an_opcode);
 			break;
 		}
 	}
@@ -727,35 +663,209 @@ void CCPU::parse_opcode(uint16_t an_opcode)
 uint16_t
 CCPU::get_pc()
 {
-	return the_pc;
+	return the_state.the_pc;
 }
 
 uint16_t 
 CCPU::get_I_reg()
 {
-	return the_I_register;
+	return the_state.the_I;
+}
+
+uint8_t
+CCPU::get_sp()
+{
+	return the_state.the_sp;
 }
 
 uint8_t
 CCPU::get_delay_timer()
 {
-	return the_delay_timer;
+	return the_state.the_delay_timer;
 }
 
 uint8_t
 CCPU::get_sound_timer()
 {
-	return the_sound_timer;
+	return the_state.the_sound_timer;
+}
+
+SChip8State&
+CCPU::get_state()
+{
+	return the_state;
+}
+
+size_t
+CCPU::save_state(uint8_t* a_buffer, size_t a_size, const uint8_t* an_image)
+{
+	// The state, and where the machine is in its frames. See CSnapshot for the format and an_image.
+	return CSnapshot::save(the_state, get_clock(), a_buffer, a_size, an_image);
+}
+
+bool
+CCPU::load_state(const uint8_t* a_buffer, size_t a_size, const uint8_t* an_image)
+{
+	// Into a copy first, a snapshot that's no good leaves the machine as it is.
+	SChip8State		my_state;
+	SSnapshotClock	my_clock;
+
+	if (!CSnapshot::load(my_state, my_clock, a_buffer, a_size, an_image))
+		return false;
+
+	restore_state(my_state, my_clock);
+
+	return true;
+}
+
+void
+CCPU::set_seed(uint64_t a_seed)
+{
+	// RND draws from the state, the same seed gives the same numbers on any machine and thread.
+	the_state.the_random = a_seed;
+}
+
+SSnapshotClock
+CCPU::get_clock()
+{
+	return { the_frame_count, the_clock_credit, the_clock_rate };
+}
+
+void
+CCPU::restore_state(const SChip8State& a_state, const SSnapshotClock& a_clock)
+{
+	// Only the RAM that differs goes through the memory, the decoded instructions and JIT blocks of the rest stay.
+	// It's compared a block at a time, where a block differs the words from the first to the last changed one are
+	// written in one go.
+	const int my_block = 256;
+
+	for (int i = 0; i < (int)sizeof(a_state.the_memory); i += my_block)
+	{
+		const uint8_t* my_old = the_state.the_memory + i;
+		const uint8_t* my_new = a_state.the_memory + i;
+
+		if (memcmp(my_old, my_new, my_block) == 0)
+			continue;
+
+		int my_first	= 0;
+		int my_last		= my_block - 8;
+
+		while (memcmp(my_old + my_first, my_new + my_first, 8) == 0)
+			my_first += 8;
+
+		while (memcmp(my_old + my_last, my_new + my_last, 8) == 0)
+			my_last -= 8;
+
+		the_memory->set_bytes(i + my_first, my_new + my_first, my_last - my_first + 8);
+	}
+
+	memcpy(&the_state, &a_state, offsetof(SChip8State, the_memory));
+
+	the_frame_count		= a_clock.the_frame_count;
+	the_clock_credit	= a_clock.the_clock_credit;
+	the_clock_rate		= a_clock.the_clock_rate;
+
+	// The screen may be a different one now.
+	the_drawflag = true;
+}
+
+void
+CCPU::set_frame_hook(frame_hook a_hook)
+{
+	// Empty switches it off again.
+	the_frame_hook = a_hook;
+}
+
+void
+CCPU::set_turbo(bool a_turbo)
+{
+	the_turbo = a_turbo;
+
+	// Paced frames come once a refresh already, back to back they'd be presented thousands of times a second.
+	the_graphics->set_refresh_rate(a_turbo ? CGraphics::REFRESH_RATE : 0);
+}
+
+void
+CCPU::set_frame_limit(uint64_t a_frames)
+{
+	the_frame_limit = a_frames;
+}
+
+void
+CCPU::set_draw_log(CDrawLog* a_log)
+{
+	// Null switches it off again.
+	the_draw_log = a_log;
+}
+
+void
+CCPU::set_run_ahead(uint32_t a_frames)
+{
+	// Every frame start() runs is run a_frames further and presented from there, then the real one is put back.
+	// Games that answer a key some frames late show it that much sooner. 0 switches it off.
+	the_run_ahead = a_frames;
+
+	if (a_frames > 0 && !the_ahead_state)
+		the_ahead_state.reset(new SChip8State());
+}
+
+uint32_t
+CCPU::get_run_ahead()
+{
+	return the_run_ahead;
+}
+
+double
+CCPU::get_input_latency()
+{
+	// In frames: from the first frame to run with keys that changed to the one whose present showed what the game
+	// drew after it looked at them.
+	return the_latency_count > 0 ? (double)the_latency_frames / the_latency_count : 0.0;
+}
+
+uint64_t
+CCPU::get_input_latency_count()
+{
+	return the_latency_count;
+}
+
+double
+CCPU::get_frames_per_second()
+{
+	// Emulated frames per wall second of the last start(), 60 when paced.
+	return the_run_seconds > 0.0 ? the_run_frames / the_run_seconds : 0.0;
 }
 
 void CCPU::start()
 {
 	/*the_start_time = boost::posix_time::microsec_clock::local_time();*/
 	
-	the_start_flag = true;
+	the_start_flag	= the_frame_limit == 0 || the_frame_count < the_frame_limit;
+	the_start_time	= boost::asio::steady_timer::clock_type::now();
+	the_start_frame	= the_frame_count;
+
+	if (the_turbo)
+	{
+		// As fast as the host goes. The frames are the same ones the timer would run, only sooner.
+		while (the_start_flag)
+			cpu_frame();
+	}
+	else if (the_start_flag)
+	{
+		// The first frame is due one frame from now.
+		the_timer.expires_at(the_start_time + boost::asio::chrono::microseconds(1000000 / FRAME_RATE));
+		the_timer.async_wait(boost::bind(&CCPU::cpu_cycle, this, boost::asio::placeholders::error, &the_timer));
+		the_context.restart();
+		the_context.run();
+	}
+
+	// Whatever the refresh rate held back.
+	the_graphics->flush();
+
+	std::chrono::duration<double> my_elapsed = boost::asio::steady_timer::clock_type::now() - the_start_time;
 
-	the_timer.async_wait(boost::bind(&CCPU::cpu_cycle, this, boost::asio::placeholders::error, &the_timer));
-	the_context.run();
+	the_run_frames	= the_frame_count - the_start_frame;
+	the_run_seconds	= my_elapsed.count();
 }
 
 void CCPU::stop()
@@ -8,6 +8,8 @@
 #include <vector>
 #include <atomic>
 #include <stack>
+#include <memory>
+#include <functional>
 
 #include "CCPU.h"
 #include "CMemory.h"
@@ -15,54 +17,239 @@
 #include "CStack.h"
 #include "CGraphics.h"
 #include "CKeyboard.h"
+#include "COpcodeTable.h"
+#include "CFusion.h"
+#include "CDrawLog.h"
+#include "CSnapshot.h"
+#include "SChip8State.h"
+
+class CJit;
+
+/**
+	Whether the disassembly trace is compiled in. Debug builds have it, release builds run without a single trace
+	instruction on the hot path. Define CHIP8_TRACE to 0 or 1 to override.
+*/
+#if !defined(CHIP8_TRACE)
+#if defined(_DEBUG)
+#define CHIP8_TRACE 1
+#else
+#define CHIP8_TRACE 0
+#endif
+#endif
 
 class CCPU
 {
 public:
-	CCPU(CMemory* a_memory, CRegisters* a_register, CStack* a_stack, CGraphics* a_graphics, CKeyboard* a_keyboard);
+	// The timers count down and the screen is shown at this rate, see run_frame().
+	static const uint32_t FRAME_RATE = 60;
+
+	/**
+		The ways of running code, see set_engine().
+	*/
+	enum class EEngine
+	{
+		SWITCH,		// The reference switch decoder.
+		TABLE,		// The compile-time handler table through the decode cache, the default.
+		THREADED,	// Direct-threaded dispatch, see CCPUThreaded.cpp.
+		JIT			// Basic blocks translated to x86-64, see CJit.h. Falls back to TABLE where it isn't supported.
+	};
+
+	/**
+		Tracing policies for run<>(). STraceOff compiles to nothing, STraceOn prints every instruction the way
+		parse_opcode() does.
+	*/
+	struct STraceOff
+	{
+		static const bool enabled = false;
+
+		static void trace(CCPU&, uint16_t) {}
+	};
+
+	struct STraceOn
+	{
+		static const bool enabled = true;
+
+		static void trace(CCPU& a_cpu, uint16_t an_opcode) { a_cpu.trace_opcode(an_opcode); }
+	};
+
+	// Called at the end of every frame start() runs, after the graphics have it. See set_frame_hook().
+	typedef std::function<void(CCPU&)> frame_hook;
+
+	/**
+		The machine is a_state, the CPU keeps no registers of its own. a_memory has to be a view onto the same state,
+		writes go through it to keep the decode cache right, and a_graphics shows its screen.
+	*/
+	CCPU(SChip8State& a_state, CMemory* a_memory, CGraphics* a_graphics);
 	~CCPU();
 
 	void		initialize();
+	void		reset();
 	bool		load_game(std::string sname);
 	void		cpu_cycle(boost::system::error_code const& e, boost::asio::steady_timer* t);
+	void		step();
+	void		update_timers();
 	void		parse_opcode(uint16_t an_opcode);
+	void		execute(uint16_t an_opcode);
+	void		execute_switch(uint16_t an_opcode);
+	void		execute_threaded(uint16_t an_opcode);
+	uint32_t	run(uint32_t a_count);
+	template <typename TTrace>
+	uint32_t	run(uint32_t a_count);
+	uint32_t	run_threaded(uint32_t a_count);
+	uint32_t	run_frame();
+	void		set_engine(EEngine an_engine);
+	EEngine		get_engine();
+	void		set_clock_rate(uint32_t an_instructions_per_second);
+	double		get_frame_budget();
+	void		set_trace(bool a_trace);
+	void		set_fusion(bool a_fusion);
+	uint64_t	get_instruction_count();
+	uint64_t	get_frame_count();
+	uint64_t	get_fusion_hits(CFusion::EIdiom an_idiom);
 	uint16_t	get_pc();
 	uint16_t	get_I_reg();
+	uint8_t		get_sp();
 	uint8_t		get_delay_timer();
 	uint8_t		get_sound_timer();
+	SChip8State&	get_state();
+	size_t		save_state(uint8_t* a_buffer, size_t a_size, const uint8_t* an_image = nullptr);
+	bool		load_state(const uint8_t* a_buffer, size_t a_size, const uint8_t* an_image = nullptr);
+	void		set_seed(uint64_t a_seed);
+	SSnapshotClock	get_clock();
+	void		restore_state(const SChip8State& a_state, const SSnapshotClock& a_clock);
+	void		set_frame_hook(frame_hook a_hook);
+	void		set_turbo(bool a_turbo);
+	void		set_frame_limit(uint64_t a_frames);
+	void		set_draw_log(CDrawLog* a_log);
+	void		set_run_ahead(uint32_t a_frames);
+	uint32_t	get_run_ahead();
+	double		get_input_latency();
+	uint64_t	get_input_latency_count();
+	double		get_frames_per_second();
 	void		start();
 	void		stop();
 
 private:
+	friend struct COpcodeTable::handlers;
+	friend class CJit;
+	friend class CFusion;
+
+	void		trace_opcode(uint16_t an_opcode);
+	void		cpu_frame();
+	void		run_ahead();
+	void		see_keys(uint16_t some_keys);
+	void		measure_latency(uint64_t a_presents, bool an_answered);
+	uint32_t	threaded_loop(uint32_t a_count, int32_t a_first_opcode, bool a_tick_timers);
+
+	// How the opcodes in COpcodes.h reach the RAM, the draw flag and the draw log, see CCPUOpcodes.h.
+	struct SBus;
+
+	// Opcode semantics, see COpcodes.h.
+	void		op_CLS();
+	void		op_RET();
+	void		op_JP_addr(uint16_t an_address);
+	void		op_CALL_addr(uint16_t an_address);
+	void		op_SE_Vx_byte(uint8_t a_regx, uint8_t a_byte);
+	void		op_SNE_Vx_byte(uint8_t a_regx, uint8_t a_byte);
+	void		op_SE_Vx_Vy(uint8_t a_regx, uint8_t a_regy);
+	void		op_LD_Vx_byte(uint8_t a_regx, uint8_t a_byte);
+	void		op_ADD_Vx_byte(uint8_t a_regx, uint8_t a_byte);
+	void		op_LD_Vx_Vy(uint8_t a_regx, uint8_t a_regy);
+	void		op_OR_Vx_Vy(uint8_t a_regx, uint8_t a_regy);
+	void		op_AND_Vx_Vy(uint8_t a_regx, uint8_t a_regy);
+	void		op_XOR_Vx_Vy(uint8_t a_regx, uint8_t a_regy);
+	void		op_ADD_Vx_Vy(uint8_t a_regx, uint8_t a_regy);
+	void		op_SUB_Vx_Vy(uint8_t a_regx, uint8_t a_regy);
+	void		op_SHR_Vx_Vy(uint8_t a_regx, uint8_t a_regy);
+	void		op_SUBN_Vx_Vy(uint8_t a_regx, uint8_t a_regy);
+	void		op_SHL_Vx_Vy(uint8_t a_regx, uint8_t a_regy);
+	void		op_SNE_Vx_Vy(uint8_t a_regx, uint8_t a_regy);
+	void		op_LD_I_addr(uint16_t an_address);
+	void		op_JP_V0_addr(uint16_t an_address);
+	void		op_RND_Vx_byte(uint8_t a_regx, uint8_t a_byte);
+	void		op_DRW_Vx_Vy_nibble(uint8_t a_regx, uint8_t a_regy, uint8_t a_height);
+	void		op_SKP_Vx(uint8_t a_regx);
+	void		op_SKNP_Vx(uint8_t a_regx);
+	void		op_LD_Vx_DT(uint8_t a_regx);
+	void		op_LD_Vx_K(uint8_t a_regx);
+	void		op_LD_DT_Vx(uint8_t a_regx);
+	void		op_LD_ST_Vx(uint8_t a_regx);
+	void		op_ADD_I_Vx(uint8_t a_regx);
+	void		op_LD_F_Vx(uint8_t a_regx);
+	void		op_LD_B_Vx(uint8_t a_regx);
+	void		op_LD_I_Vx(uint8_t a_regx);
+	void		op_LD_Vx_I(uint8_t a_regx);
+	void		op_unknown();
+
+	SChip8State&				the_state;
 	CMemory*					the_memory;
-	CRegisters*					the_V_registers;
 	CGraphics*					the_graphics;
-	CKeyboard*					the_keyboard;
-	CStack*						the_stack;
-	//std::stack<uint16_t>		the_stack;
 
-	
 	uint16_t					the_opcode;
-	uint16_t					the_pc;
-	uint16_t					the_I_register;
-	uint8_t						the_sp;
-	uint8_t						the_sound_timer;
-	uint8_t						the_delay_timer;
+
+	// CLS or DRW ran in the current frame, cleared when it's handed to the graphics. Every DRW goes to the log too,
+	// when there is one.
 	bool						the_drawflag;
+	CDrawLog*					the_draw_log;
+
+	// Rewind and the like, see set_frame_hook().
+	frame_hook					the_frame_hook;
+
+	// Run-ahead: the frames run past every real one to present, the real machine while they run, and whether they
+	// are running. See set_run_ahead().
+	uint32_t						the_run_ahead;
+	std::unique_ptr<SChip8State>	the_ahead_state;
+	bool							the_ahead_flag;
+
+	// Input latency: the keys as of the last frame, those that changed since the last answer and the frame the first
+	// of them did, whether the game looked at one of them (EX9E, EXA1, FX0A) and then drew, and the frames from key
+	// changes to the presents that showed the answer, summed over the changes measured. See cpu_frame().
+	uint8_t						the_latency_keys[16];
+	uint16_t					the_latency_changed;
+	bool						the_latency_seen;
+	bool						the_latency_answered;
+	uint64_t					the_latency_start;
+	uint64_t					the_latency_frames;
+	uint64_t					the_latency_count;
+
+	// How code is run and whether it gets disassembled (builds with CHIP8_TRACE only).
+	EEngine						the_engine;
+	bool						the_trace;
+	std::unique_ptr<CJit>		the_jit;
+
+	// Superinstructions, only the table engine runs them. Counts the instructions run() executed in total and
+	// through every idiom.
+	bool						the_fusion;
+	uint64_t					the_instruction_count;
+	std::array<uint64_t, CFusion::IDIOM_COUNT>	the_fusion_hits;
 	
 	//std::array<uint16_t, 16>	the_stack;
 	
+	// Frames: instructions per second, what's left of them after the last frame (in 1/FRAME_RATE instructions),
+	// frames run so far. run() ticks the timers after every instruction, unless run_frame() ticks them per frame.
+	uint32_t					the_clock_rate;
+	int64_t						the_clock_credit;
+	uint64_t					the_frame_count;
+	bool						the_timers_per_instruction;
 
-	// for timing...
+	// for timing... Turbo runs the frames back to back without the timer, the frame count is the only clock then.
+	// start() returns by itself once the frame count reaches the limit (0 for none).
 	std::atomic<bool>			the_start_flag;
+	bool						the_turbo;
+	uint64_t					the_frame_limit;
 	boost::asio::io_context		the_context;
 	boost::asio::steady_timer	the_timer;
+	boost::asio::steady_timer::time_point	the_start_time;
+	uint64_t					the_start_frame;
+
+	// Frames and wall time of the last start().
+	uint64_t					the_run_frames;
+	double						the_run_seconds;
 
 	//// debug stuff
 	//int							the_count;
 	//boost::posix_time::ptime	the_start_time;
 	//boost::posix_time::ptime	the_end_time;
-	std::vector<int>			the_pixels;
 
 };
 
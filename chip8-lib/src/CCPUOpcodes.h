@@ -0,0 +1,134 @@
+#pragma once
+#include "CCPU.h"
+#include "COpcodes.h"
+
+// CCPU's instance of the opcode semantics in COpcodes.h, for the dispatch table (COpcodeTable), the reference switch
+// (CCPU::execute_switch), the threaded loop and the superinstructions. RAM goes through CMemory, which keeps the
+// decode cache right, and every CLS or DRW raises the draw flag.
+
+struct CCPU::SBus
+{
+	CCPU& the_cpu;
+
+	uint8_t get_byte(int an_address)
+	{
+		return the_cpu.the_memory->get_byte(an_address);
+	}
+
+	void set_byte(int an_address, uint8_t a_value)
+	{
+		the_cpu.the_memory->set_byte(an_address, a_value);
+	}
+
+	void cleared()
+	{
+		the_cpu.the_drawflag			= true;
+		the_cpu.the_latency_answered	|= the_cpu.the_latency_seen;
+	}
+
+	void drawn(uint16_t an_address, uint8_t x, uint8_t y, uint8_t a_height, bool a_collision)
+	{
+		if (the_cpu.the_draw_log != nullptr)
+			the_cpu.the_draw_log->record({ the_cpu.the_frame_count, an_address, x, y, a_height, a_collision });
+
+		the_cpu.the_drawflag			= true;
+		the_cpu.the_latency_answered	|= the_cpu.the_latency_seen;
+	}
+};
+
+inline void CCPU::op_RET()											{ COpcodes::op_RET(the_state); }
+inline void CCPU::op_JP_addr(uint16_t an_address)					{ COpcodes::op_JP_addr(the_state, an_address); }
+inline void CCPU::op_CALL_addr(uint16_t an_address)					{ COpcodes::op_CALL_addr(the_state, an_address); }
+inline void CCPU::op_SE_Vx_byte(uint8_t a_regx, uint8_t a_byte)		{ COpcodes::op_SE_Vx_byte(the_state, a_regx, a_byte); }
+inline void CCPU::op_SNE_Vx_byte(uint8_t a_regx, uint8_t a_byte)	{ COpcodes::op_SNE_Vx_byte(the_state, a_regx, a_byte); }
+inline void CCPU::op_SE_Vx_Vy(uint8_t a_regx, uint8_t a_regy)		{ COpcodes::op_SE_Vx_Vy(the_state, a_regx, a_regy); }
+inline void CCPU::op_LD_Vx_byte(uint8_t a_regx, uint8_t a_byte)		{ COpcodes::op_LD_Vx_byte(the_state, a_regx, a_byte); }
+inline void CCPU::op_ADD_Vx_byte(uint8_t a_regx, uint8_t a_byte)	{ COpcodes::op_ADD_Vx_byte(the_state, a_regx, a_byte); }
+inline void CCPU::op_LD_Vx_Vy(uint8_t a_regx, uint8_t a_regy)		{ COpcodes::op_LD_Vx_Vy(the_state, a_regx, a_regy); }
+inline void CCPU::op_OR_Vx_Vy(uint8_t a_regx, uint8_t a_regy)		{ COpcodes::op_OR_Vx_Vy(the_state, a_regx, a_regy); }
+inline void CCPU::op_AND_Vx_Vy(uint8_t a_regx, uint8_t a_regy)		{ COpcodes::op_AND_Vx_Vy(the_state, a_regx, a_regy); }
+inline void CCPU::op_XOR_Vx_Vy(uint8_t a_regx, uint8_t a_regy)		{ COpcodes::op_XOR_Vx_Vy(the_state, a_regx, a_regy); }
+inline void CCPU::op_ADD_Vx_Vy(uint8_t a_regx, uint8_t a_regy)		{ COpcodes::op_ADD_Vx_Vy(the_state, a_regx, a_regy); }
+inline void CCPU::op_SUB_Vx_Vy(uint8_t a_regx, uint8_t a_regy)		{ COpcodes::op_SUB_Vx_Vy(the_state, a_regx, a_regy); }
+inline void CCPU::op_SHR_Vx_Vy(uint8_t a_regx, uint8_t a_regy)		{ COpcodes::op_SHR_Vx_Vy(the_state, a_regx, a_regy); }
+inline void CCPU::op_SUBN_Vx_Vy(uint8_t a_regx, uint8_t a_regy)		{ COpcodes::op_SUBN_Vx_Vy(the_state, a_regx, a_regy); }
+inline void CCPU::op_SHL_Vx_Vy(uint8_t a_regx, uint8_t a_regy)		{ COpcodes::op_SHL_Vx_Vy(the_state, a_regx, a_regy); }
+inline void CCPU::op_SNE_Vx_Vy(uint8_t a_regx, uint8_t a_regy)		{ COpcodes::op_SNE_Vx_Vy(the_state, a_regx, a_regy); }
+inline void CCPU::op_LD_I_addr(uint16_t an_address)					{ COpcodes::op_LD_I_addr(the_state, an_address); }
+inline void CCPU::op_JP_V0_addr(uint16_t an_address)				{ COpcodes::op_JP_V0_addr(the_state, an_address); }
+inline void CCPU::op_RND_Vx_byte(uint8_t a_regx, uint8_t a_byte)	{ COpcodes::op_RND_Vx_byte(the_state, a_regx, a_byte); }
+inline void CCPU::op_LD_Vx_DT(uint8_t a_regx)						{ COpcodes::op_LD_Vx_DT(the_state, a_regx); }
+inline void CCPU::op_LD_DT_Vx(uint8_t a_regx)						{ COpcodes::op_LD_DT_Vx(the_state, a_regx); }
+inline void CCPU::op_LD_ST_Vx(uint8_t a_regx)						{ COpcodes::op_LD_ST_Vx(the_state, a_regx); }
+inline void CCPU::op_ADD_I_Vx(uint8_t a_regx)						{ COpcodes::op_ADD_I_Vx(the_state, a_regx); }
+inline void CCPU::op_LD_F_Vx(uint8_t a_regx)						{ COpcodes::op_LD_F_Vx(the_state, a_regx); }
+inline void CCPU::op_unknown()										{ COpcodes::op_unknown(the_state); }
+
+// The key opcodes tell the input latency which keys the game looked at, FX0A looks at all of them.
+inline void
+CCPU::see_keys(uint16_t some_keys)
+{
+	if ((the_latency_changed & some_keys) != 0)
+		the_latency_seen = true;
+}
+
+inline void
+CCPU::op_SKP_Vx(uint8_t a_regx)
+{
+	see_keys(the_state.the_V[a_regx] < 16 ? 1 << the_state.the_V[a_regx] : 0);
+	COpcodes::op_SKP_Vx(the_state, a_regx);
+}
+
+inline void
+CCPU::op_SKNP_Vx(uint8_t a_regx)
+{
+	see_keys(the_state.the_V[a_regx] < 16 ? 1 << the_state.the_V[a_regx] : 0);
+	COpcodes::op_SKNP_Vx(the_state, a_regx);
+}
+
+inline void
+CCPU::op_LD_Vx_K(uint8_t a_regx)
+{
+	see_keys(0xffff);
+	COpcodes::op_LD_Vx_K(the_state, a_regx);
+}
+
+inline void
+CCPU::op_CLS()
+{
+	SBus my_bus{ *this };
+
+	COpcodes::op_CLS(the_state, my_bus);
+}
+
+inline void
+CCPU::op_DRW_Vx_Vy_nibble(uint8_t a_regx, uint8_t a_regy, uint8_t a_height)
+{
+	SBus my_bus{ *this };
+
+	COpcodes::op_DRW_Vx_Vy_nibble(the_state, my_bus, a_regx, a_regy, a_height);
+}
+
+inline void
+CCPU::op_LD_B_Vx(uint8_t a_regx)
+{
+	SBus my_bus{ *this };
+
+	COpcodes::op_LD_B_Vx(the_state, my_bus, a_regx);
+}
+
+inline void
+CCPU::op_LD_I_Vx(uint8_t a_regx)
+{
+	SBus my_bus{ *this };
+
+	COpcodes::op_LD_I_Vx(the_state, my_bus, a_regx);
+}
+
+inline void
+CCPU::op_LD_Vx_I(uint8_t a_regx)
+{
+	SBus my_bus{ *this };
+
+	COpcodes::op_LD_Vx_I(the_state, my_bus, a_regx);
+}
@@ -0,0 +1,177 @@
+#include "CCPU.h"
+#include "CCPUOpcodes.h"
+
+/**
+	The direct-threaded interpreter.
+
+	Every opcode has a label, and every label ends by fetching the next opcode and jumping straight to the label of
+	that one through a table of label addresses (labels as values, a GCC and Clang extension). There is no central
+	loop, so each opcode gets its own indirect jump and with that its own branch prediction history.
+
+	The opcode semantics are the op_ functions from CCPUOpcodes.h, the same ones the switch and the table use.
+	Compilers without labels as values get the same loop with a switch.
+*/
+
+uint32_t
+CCPU::run_threaded(uint32_t a_count)
+{
+	return threaded_loop(a_count, -1, the_timers_per_instruction);
+}
+
+void
+CCPU::execute_threaded(uint16_t an_opcode)
+{
+	// Enter at the label of the given opcode and leave right after it, like execute() does.
+	threaded_loop(1, an_opcode, false);
+}
+
+uint32_t
+CCPU::threaded_loop(uint32_t a_count, int32_t a_first_opcode, bool a_tick_timers)
+{
+	uint32_t my_executed = 0;
+	uint16_t my_opcode;
+
+	if (a_count == 0)
+		return 0;
+
+	// The operands of the opcode at hand.
+#define THREADED_X		((my_opcode & 0x0f00) >> 8)
+#define THREADED_Y		((my_opcode & 0x00f0) >> 4)
+#define THREADED_N		(my_opcode & 0x000f)
+#define THREADED_KK		(my_opcode & 0x00ff)
+#define THREADED_NNN	(my_opcode & 0x0fff)
+
+#if defined(__GNUC__)
+	static void* const my_groups[16] =
+	{
+		&&group_0,		&&JP_addr,		&&CALL_addr,	&&SE_Vx_byte,
+		&&SNE_Vx_byte,	&&SE_Vx_Vy,		&&LD_Vx_byte,	&&ADD_Vx_byte,
+		&&group_8,		&&SNE_Vx_Vy,	&&LD_I_addr,	&&JP_V0_addr,
+		&&RND_Vx_byte,	&&DRW,			&&group_E,		&&group_F
+	};
+
+	static void* const my_group_8[16] =
+	{
+		&&LD_Vx_Vy,		&&OR_Vx_Vy,		&&AND_Vx_Vy,	&&XOR_Vx_Vy,
+		&&ADD_Vx_Vy,	&&SUB_Vx_Vy,	&&SHR_Vx_Vy,	&&SUBN_Vx_Vy,
+		&&unknown,		&&unknown,		&&unknown,		&&unknown,
+		&&unknown,		&&unknown,		&&SHL_Vx_Vy,	&&unknown
+	};
+
+	// Count the instruction, tick the timers like cpu_cycle() does and go to the next handler.
+#define THREADED_NEXT()												\
+	do {															\
+		if (a_tick_timers)											\
+			update_timers();										\
+		if (++my_executed == a_count)								\
+			goto done;												\
+		my_opcode = the_memory->get_opcode(the_state.the_pc);		\
+		the_opcode = my_opcode;										\
+		goto *my_groups[my_opcode >> 12];							\
+	} while (0)
+
+	my_opcode = a_first_opcode >= 0 ? (uint16_t)a_first_opcode : the_memory->get_opcode(the_state.the_pc);
+	the_opcode = my_opcode;
+	goto *my_groups[my_opcode >> 12];
+
+	// The groups with more than one opcode decode a second time.
+group_0:
+	switch (THREADED_KK)
+	{
+		case 0xe0: goto CLS;
+		case 0xee: goto RET;
+		default: goto unknown;
+	}
+
+group_8:
+	goto *my_group_8[THREADED_N];
+
+group_E:
+	switch (THREADED_KK)
+	{
+		case 0x9e: goto SKP_Vx;
+		case 0xa1: goto SKNP_Vx;
+		default: goto unknown;
+	}
+
+group_F:
+	switch (THREADED_KK)
+	{
+		case 0x07: goto LD_Vx_DT;
+		case 0x0a: goto LD_Vx_K;
+		case 0x15: goto LD_DT_Vx;
+		case 0x18: goto LD_ST_Vx;
+		case 0x1e: goto ADD_I_Vx;
+		case 0x29: goto LD_F_Vx;
+		case 0x33: goto LD_B_Vx;
+		case 0x55: goto LD_I_Vx;
+		case 0x65: goto LD_Vx_I;
+		default: goto unknown;
+	}
+
+CLS:			op_CLS();											THREADED_NEXT();
+RET:			op_RET();											THREADED_NEXT();
+JP_addr:		op_JP_addr(THREADED_NNN);							THREADED_NEXT();
+CALL_addr:		op_CALL_addr(THREADED_NNN);							THREADED_NEXT();
+SE_Vx_byte:		op_SE_Vx_byte(THREADED_X, THREADED_KK);				THREADED_NEXT();
+SNE_Vx_byte:	op_SNE_Vx_byte(THREADED_X, THREADED_KK);			THREADED_NEXT();
+SE_Vx_Vy:		op_SE_Vx_Vy(THREADED_X, THREADED_Y);				THREADED_NEXT();
+LD_Vx_byte:		op_LD_Vx_byte(THREADED_X, THREADED_KK);				THREADED_NEXT();
+ADD_Vx_byte:	op_ADD_Vx_byte(THREADED_X, THREADED_KK);			THREADED_NEXT();
+LD_Vx_Vy:		op_LD_Vx_Vy(THREADED_X, THREADED_Y);				THREADED_NEXT();
+OR_Vx_Vy:		op_OR_Vx_Vy(THREADED_X, THREADED_Y);				THREADED_NEXT();
+AND_Vx_Vy:		op_AND_Vx_Vy(THREADED_X, THREADED_Y);				THREADED_NEXT();
+XOR_Vx_Vy:		op_XOR_Vx_Vy(THREADED_X, THREADED_Y);				THREADED_NEXT();
+ADD_Vx_Vy:		op_ADD_Vx_Vy(THREADED_X, THREADED_Y);				THREADED_NEXT();
+SUB_Vx_Vy:		op_SUB_Vx_Vy(THREADED_X, THREADED_Y);				THREADED_NEXT();
+SHR_Vx_Vy:		op_SHR_Vx_Vy(THREADED_X, THREADED_Y);				THREADED_NEXT();
+SUBN_Vx_Vy:		op_SUBN_Vx_Vy(THREADED_X, THREADED_Y);				THREADED_NEXT();
+SHL_Vx_Vy:		op_SHL_Vx_Vy(THREADED_X, THREADED_Y);				THREADED_NEXT();
+SNE_Vx_Vy:		op_SNE_Vx_Vy(THREADED_X, THREADED_Y);				THREADED_NEXT();
+LD_I_addr:		op_LD_I_addr(THREADED_NNN);							THREADED_NEXT();
+JP_V0_addr:		op_JP_V0_addr(THREADED_NNN);						THREADED_NEXT();
+RND_Vx_byte:	op_RND_Vx_byte(THREADED_X, THREADED_KK);			THREADED_NEXT();
+DRW:			op_DRW_Vx_Vy_nibble(THREADED_X, THREADED_Y, THREADED_N);	THREADED_NEXT();
+SKP_Vx:			op_SKP_Vx(THREADED_X);								THREADED_NEXT();
+SKNP_Vx:		op_SKNP_Vx(THREADED_X);								THREADED_NEXT();
+LD_Vx_DT:		op_LD_Vx_DT(THREADED_X);							THREADED_NEXT();
+LD_Vx_K:		op_LD_Vx_K(THREADED_X);								THREADED_NEXT();
+LD_DT_Vx:		op_LD_DT_Vx(THREADED_X);							THREADED_NEXT();
+LD_ST_Vx:		op_LD_ST_Vx(THREADED_X);							THREADED_NEXT();
+ADD_I_Vx:		op_ADD_I_Vx(THREADED_X);							THREADED_NEXT();
+LD_F_Vx:		op_LD_F_Vx(THREADED_X);								THREADED_NEXT();
+LD_B_Vx:		op_LD_B_Vx(THREADED_X);								THREADED_NEXT();
+LD_I_Vx:		op_LD_I_Vx(THREADED_X);								THREADED_NEXT();
+LD_Vx_I:		op_LD_Vx_I(THREADED_X);								THREADED_NEXT();
+unknown:		op_unknown();										THREADED_NEXT();
+
+done:
+#undef THREADED_NEXT
+
+#else
+	// No labels as values (MSVC), the same batch with a switch.
+	my_opcode = a_first_opcode >= 0 ? (uint16_t)a_first_opcode : the_memory->get_opcode(the_state.the_pc);
+
+	while (true)
+	{
+		the_opcode = my_opcode;
+		execute_switch(my_opcode);
+
+		if (a_tick_timers)
+			update_timers();
+
+		if (++my_executed == a_count)
+			break;
+
+		my_opcode = the_memory->get_opcode(the_state.the_pc);
+	}
+#endif
+
+#undef THREADED_X
+#undef THREADED_Y
+#undef THREADED_N
+#undef THREADED_KK
+#undef THREADED_NNN
+
+	return my_executed;
+}
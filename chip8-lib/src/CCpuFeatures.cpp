@@ -0,0 +1,34 @@
+#include "CCpuFeatures.h"
+
+#if defined(_MSC_VER) && defined(CHIP8_AVX2_KERNELS)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+bool
+CCpuFeatures::has_avx2()
+{
+#if defined(_MSC_VER) && defined(CHIP8_AVX2_KERNELS)
+	int my_registers[4];
+
+	__cpuid(my_registers, 0);
+
+	if (my_registers[0] < 7)
+		return false;
+
+	// AVX and OSXSAVE, then the OS has to have the XMM and YMM state enabled.
+	__cpuid(my_registers, 1);
+
+	if ((my_registers[2] & (1 << 27)) == 0 || (my_registers[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(my_registers, 7, 0);
+
+	return (my_registers[1] & (1 << 5)) != 0;
+#elif defined(CHIP8_AVX2_KERNELS)
+	// Checks the OS support as well.
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
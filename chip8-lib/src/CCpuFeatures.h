@@ -0,0 +1,23 @@
+#pragma once
+
+/**
+	What the CPU the program runs on has, for code with a faster way on newer CPUs.
+
+	The build stays at the baseline instruction set (SSE2 on x86-64). Kernels for more are compiled on their own,
+	functions marked CHIP8_TARGET_AVX2, where CHIP8_AVX2_KERNELS says the compiler can, and picked at run time when
+	has_avx2() says the CPU can run them. MSVC takes AVX2 intrinsics in any function, GCC and clang need the target.
+*/
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CHIP8_AVX2_KERNELS
+#define CHIP8_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define CHIP8_AVX2_KERNELS
+#define CHIP8_TARGET_AVX2
+#endif
+
+class CCpuFeatures
+{
+	public:
+		// AVX2, and an OS that saves the YMM registers.
+		static bool has_avx2();
+};
@@ -0,0 +1,84 @@
+#include "CDrawLog.h"
+
+CDrawLog::CDrawLog(size_t a_capacity) :
+	the_events(a_capacity > 0 ? a_capacity : 1),
+	the_first(0),
+	the_size(0),
+	the_recorded_count(0),
+	the_dropped_count(0)
+{
+}
+
+void
+CDrawLog::record(const SDrawEvent& an_event)
+{
+	size_t my_slot = the_first + the_size;
+
+	if (my_slot >= the_events.size())
+		my_slot -= the_events.size();
+
+	the_events[my_slot] = an_event;
+	the_recorded_count++;
+
+	// Full, the oldest one is gone.
+	if (the_size == the_events.size())
+	{
+		if (++the_first == the_events.size())
+			the_first = 0;
+
+		the_dropped_count++;
+	}
+	else
+	{
+		the_size++;
+	}
+}
+
+size_t
+CDrawLog::drain(SDrawEvent* some_events, size_t a_count)
+{
+	size_t my_count = a_count < the_size ? a_count : the_size;
+
+	for (size_t i = 0; i < my_count; i++)
+	{
+		some_events[i] = the_events[the_first];
+
+		if (++the_first == the_events.size())
+			the_first = 0;
+	}
+
+	the_size -= my_count;
+
+	return my_count;
+}
+
+void
+CDrawLog::clear()
+{
+	the_first	= 0;
+	the_size	= 0;
+}
+
+size_t
+CDrawLog::get_capacity()
+{
+	return the_events.size();
+}
+
+size_t
+CDrawLog::get_size()
+{
+	return the_size;
+}
+
+uint64_t
+CDrawLog::get_recorded_count()
+{
+	return the_recorded_count;
+}
+
+uint64_t
+CDrawLog::get_dropped_count()
+{
+	return the_dropped_count;
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/**
+	One DRW: the frame it ran in, the sprite address and position, its height and whether it hit a lit pixel.
+*/
+struct SDrawEvent
+{
+	uint64_t	the_frame;
+	uint16_t	the_I;
+	uint8_t		the_x;
+	uint8_t		the_y;
+	uint8_t		the_height;
+	bool		the_collision;
+};
+
+/**
+	The last DRWs of a CPU, for diagnostics. CCPU::set_draw_log() switches it on, without one DRW only tests a pointer.
+
+	A ring of fixed capacity, allocated once: when it's full the oldest event makes room and counts as dropped, so a
+	run can go on for as long as it likes without the log growing. drain() takes the events out oldest first. It's
+	filled from the thread running the CPU, drain from the same one or between runs.
+*/
+class CDrawLog
+{
+	public:
+		static const size_t DEFAULT_CAPACITY = 4096;
+
+		CDrawLog(size_t a_capacity = DEFAULT_CAPACITY);
+		~CDrawLog() = default;
+
+		void		record(const SDrawEvent& an_event);
+		size_t		drain(SDrawEvent* some_events, size_t a_count);
+		void		clear();
+
+		size_t		get_capacity();
+		size_t		get_size();
+		uint64_t	get_recorded_count();
+		uint64_t	get_dropped_count();
+
+	private:
+		std::vector<SDrawEvent>	the_events;
+
+		// The oldest event and how many there are, all of them ever recorded and those overwritten before a drain.
+		size_t					the_first;
+		size_t					the_size;
+		uint64_t				the_recorded_count;
+		uint64_t				the_dropped_count;
+};
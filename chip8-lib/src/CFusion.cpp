@@ -0,0 +1,106 @@
+#include "CFusion.h"
+#include "CCPUOpcodes.h"
+
+namespace {
+
+	uint8_t		get_x(uint16_t an_opcode)	{ return (an_opcode & 0x0f00) >> 8; }
+	uint8_t		get_y(uint16_t an_opcode)	{ return (an_opcode & 0x00f0) >> 4; }
+	uint8_t		get_n(uint16_t an_opcode)	{ return an_opcode & 0x000f; }
+	uint8_t		get_kk(uint16_t an_opcode)	{ return an_opcode & 0x00ff; }
+	uint16_t	get_nnn(uint16_t an_opcode)	{ return an_opcode & 0x0fff; }
+}
+
+CFusion::EIdiom
+CFusion::match(uint16_t a_first, uint16_t a_second, uint16_t a_third)
+{
+	// The longer sequences go first, they save the most.
+	bool my_jumps = (a_third & 0xf000) == 0x1000;
+	bool my_same_x = get_x(a_first) == get_x(a_second);
+
+	if ((a_first & 0xf0ff) == 0xf007 && (a_second & 0xf0ff) == 0x3000 && my_same_x && my_jumps)
+		return TIMER_WAIT;
+
+	if ((a_first & 0xf000) == 0x7000 && (a_second & 0xf000) == 0x4000 && my_same_x && my_jumps)
+		return COUNTED_LOOP;
+
+	if ((a_first & 0xf000) == 0xa000 && (a_second & 0xf000) == 0xd000)
+		return LOAD_I_DRAW;
+
+	if ((a_first & 0xf000) == 0x6000 && (a_second & 0xf000) == 0x6000)
+		return LOAD_PAIR;
+
+	return NO_IDIOM;
+}
+
+CFusion::fused_handler
+CFusion::get_handler(EIdiom an_idiom)
+{
+	switch (an_idiom)
+	{
+		case TIMER_WAIT:	return &timer_wait;
+		case COUNTED_LOOP:	return &counted_loop;
+		case LOAD_I_DRAW:	return &load_I_draw;
+		case LOAD_PAIR:		return &load_pair;
+		default:			return nullptr;
+	}
+}
+
+const char*
+CFusion::get_name(EIdiom an_idiom)
+{
+	switch (an_idiom)
+	{
+		case TIMER_WAIT:	return "FX07 3X00 1NNN";
+		case COUNTED_LOOP:	return "7XKK 4XKK 1NNN";
+		case LOAD_I_DRAW:	return "ANNN DXYN";
+		case LOAD_PAIR:		return "6XKK 6YKK";
+		default:			return "none";
+	}
+}
+
+uint32_t
+CFusion::timer_wait(CCPU& a_cpu, uint16_t a_first, uint16_t a_second, uint16_t a_third)
+{
+	uint16_t my_jump_pc = a_cpu.the_state.the_pc + 4;
+
+	a_cpu.op_LD_Vx_DT(get_x(a_first));
+	a_cpu.op_SE_Vx_byte(get_x(a_second), get_kk(a_second));
+
+	// The timer ran out and the jump got skipped.
+	if (a_cpu.the_state.the_pc != my_jump_pc)
+		return 2;
+
+	a_cpu.op_JP_addr(get_nnn(a_third));
+	return 3;
+}
+
+uint32_t
+CFusion::counted_loop(CCPU& a_cpu, uint16_t a_first, uint16_t a_second, uint16_t a_third)
+{
+	uint16_t my_jump_pc = a_cpu.the_state.the_pc + 4;
+
+	a_cpu.op_ADD_Vx_byte(get_x(a_first), get_kk(a_first));
+	a_cpu.op_SNE_Vx_byte(get_x(a_second), get_kk(a_second));
+
+	if (a_cpu.the_state.the_pc != my_jump_pc)
+		return 2;
+
+	a_cpu.op_JP_addr(get_nnn(a_third));
+	return 3;
+}
+
+uint32_t
+CFusion::load_I_draw(CCPU& a_cpu, uint16_t a_first, uint16_t a_second, uint16_t)
+{
+	a_cpu.op_LD_I_addr(get_nnn(a_first));
+	a_cpu.op_DRW_Vx_Vy_nibble(get_x(a_second), get_y(a_second), get_n(a_second));
+	return 2;
+}
+
+uint32_t
+CFusion::load_pair(CCPU& a_cpu, uint16_t a_first, uint16_t a_second, uint16_t)
+{
+	a_cpu.op_LD_Vx_byte(get_x(a_first), get_kk(a_first));
+	a_cpu.op_LD_Vx_byte(get_x(a_second), get_kk(a_second));
+	return 2;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+
+class CCPU;
+
+/**
+	Superinstructions for the sequences ROMs keep repeating.
+
+	The decode cache asks match() about the instructions following every address it decodes. A sequence that matches
+	is stored with the first instruction and runs as one fused operation, which saves the fetch and dispatch of the
+	instructions after the first. A write to any byte of the sequence throws the entry away, the next decode
+	finds out whether it still matches.
+
+	The fused operations run the same op_ functions as the interpreter, in the same order, so the state afterwards is
+	exactly what single stepping would give. None of them reads a timer after its first instruction, so the timers
+	can be ticked afterwards once per instruction executed.
+*/
+class CFusion
+{
+	public:
+		enum EIdiom
+		{
+			TIMER_WAIT,		// FX07, 3X00, 1NNN		Wait for the delay timer.
+			COUNTED_LOOP,	// 7XKK, 4XKK, 1NNN		Count Vx up and jump back until it reaches a limit.
+			LOAD_I_DRAW,	// ANNN, DXYN			Point I at a sprite and draw it.
+			LOAD_PAIR,		// 6XKK, 6YKK			Load both coordinates, usually before a draw.
+			IDIOM_COUNT,
+			NO_IDIOM = IDIOM_COUNT
+		};
+
+		// Runs a fused sequence given its opcodes, returns how many instructions were executed.
+		typedef uint32_t (*fused_handler)(CCPU& a_cpu, uint16_t a_first, uint16_t a_second, uint16_t a_third);
+
+		// The most instructions a fused operation runs.
+		static const uint32_t MAX_LENGTH = 3;
+
+		static EIdiom			match(uint16_t a_first, uint16_t a_second, uint16_t a_third);
+		static fused_handler	get_handler(EIdiom an_idiom);
+		static const char*		get_name(EIdiom an_idiom);
+
+	private:
+		static uint32_t		timer_wait(CCPU& a_cpu, uint16_t a_first, uint16_t a_second, uint16_t a_third);
+		static uint32_t		counted_loop(CCPU& a_cpu, uint16_t a_first, uint16_t a_second, uint16_t a_third);
+		static uint32_t		load_I_draw(CCPU& a_cpu, uint16_t a_first, uint16_t a_second, uint16_t a_third);
+		static uint32_t		load_pair(CCPU& a_cpu, uint16_t a_first, uint16_t a_second, uint16_t a_third);
+};
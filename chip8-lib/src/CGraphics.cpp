@@ -1,99 +1,197 @@
 #include "CGraphics.h"
-
-CGraphics::CGraphics() :
-	the_graphics({})
+#include <string.h>
+
+CGraphics::CGraphics(SChip8State& a_state) :
+	the_state(a_state),
+	the_presenter(&the_null_presenter),
+	the_presented(),
+	the_presented_flag(false),
+	the_refresh_interval(0),
+	the_present_time(),
+	the_pending_flag(false),
+	the_present_count(0),
+	the_skipped_count(0),
+	the_coalesced_count(0),
+	the_uploaded_bytes(0)
 {
 }
 
 int
 CGraphics::get_pixel_state(int a_pixel)
 {
-	return the_graphics[a_pixel];
+	// Pixels count along the rows, the leftmost pixel of a row is its top bit.
+	int my_shift = SChip8State::SCREEN_WIDTH - 1 - a_pixel % SChip8State::SCREEN_WIDTH;
+
+	return (the_state.the_screen[a_pixel / SChip8State::SCREEN_WIDTH] >> my_shift) & 1;
 }
 
 void
 CGraphics::flip_pixel(int a_pixel)
 {
-	the_graphics[a_pixel] ^= 1;
+	int my_shift = SChip8State::SCREEN_WIDTH - 1 - a_pixel % SChip8State::SCREEN_WIDTH;
+
+	the_state.the_screen[a_pixel / SChip8State::SCREEN_WIDTH] ^= (uint64_t)1 << my_shift;
 }
 
 void
 CGraphics::clear()
 {
-	the_graphics = {};
+	memset(the_state.the_screen, 0, sizeof(the_state.the_screen));
 }
 
 size_t
 CGraphics::get_size()
 {
-	return the_graphics.size();
+	return SChip8State::SCREEN_WIDTH * SChip8State::SCREEN_HEIGHT;
+}
+
+void
+CGraphics::set_presenter(CPresenter* a_presenter)
+{
+	// Null goes back to dropping the frames.
+	the_presenter = a_presenter != nullptr ? a_presenter : &the_null_presenter;
+
+	// A new presenter hasn't seen anything yet.
+	the_presented_flag = false;
 }
 
 bool
 CGraphics::init()
 {
-	bool my_return_flag;
+	the_presented_flag = false;
+
+	return the_presenter->init();
+}
+
+void
+CGraphics::draw()
+{
+	SDirtyRect my_dirty;
 
-	if (SDL_Init(SDL_INIT_VIDEO) < 0)
+	if (!get_damage(my_dirty))
 	{
-		my_return_flag = false;
+		the_skipped_count++;
+		return;
 	}
+
+	the_uploaded_bytes += the_presenter->present(the_state.the_screen, my_dirty);
+	the_present_count++;
+
+	memcpy(the_presented, the_state.the_screen, sizeof(the_presented));
+	the_presented_flag = true;
+}
+
+void
+CGraphics::set_refresh_rate(uint32_t a_rate)
+{
+	if (a_rate == 0)
+		the_refresh_interval = std::chrono::steady_clock::duration(0);
 	else
+		the_refresh_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) / a_rate;
+}
+
+void
+CGraphics::frame_ready(bool a_changed)
+{
+	if (a_changed)
 	{
-		// Create the window at the desired size.
-		//SDL_CreateWindowAndRenderer(WINDOW_WIDTH * SCALE, WINDOW_HEIGHT * SCALE, SDL_WINDOW_SHOWN, &the_window, &the_renderer);
-		the_window = SDL_CreateWindow("chip8", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_SHOWN);
-		the_renderer = SDL_CreateRenderer(the_window, -1, SDL_RENDERER_SOFTWARE);
-
-		if (the_window == nullptr || the_renderer == nullptr)
-		{
-			my_return_flag = false;
-		}
-		else
-		{
-			// Create the texture at the size of the pixel buffer.
-			the_texture = SDL_CreateTexture(the_renderer, SDL_PIXELFORMAT_RGB332, SDL_TEXTUREACCESS_STATIC, 64, 32);
-
-			// Set the colour to black, copy texture to render and render it.
-			/*SDL_SetTextureColorMod(the_texture, 0xff, 0xff, 0xff);
-			SDL_RenderCopy(the_renderer, the_texture, NULL, NULL);
-			SDL_RenderPresent(the_renderer);*/
-
-			my_return_flag = true;
-		}
+		// Folded into the pending one.
+		if (the_pending_flag)
+			the_coalesced_count++;
+
+		the_pending_flag = true;
 	}
 
-	return my_return_flag;
+	if (!the_pending_flag)
+		return;
+
+	// Too soon after the last present, it waits.
+	if (the_refresh_interval.count() != 0 && std::chrono::steady_clock::now() - the_present_time < the_refresh_interval)
+		return;
+
+	flush();
 }
 
 void
-CGraphics::draw()
+CGraphics::flush()
 {
-	// Before we draw, we need to convert our array to an array suitable for drawing with RGB values. This means convert each uint_8 which 
-	// has a 1 to an 0xff = black.
+	if (!the_pending_flag)
+		return;
 
-	std::array<uint8_t, 2048> my_graphics = the_graphics;
+	draw();
 
-	for (int i = 0; i < my_graphics.size(); i++)
+	the_pending_flag = false;
+
+	if (the_refresh_interval.count() != 0)
+		the_present_time = std::chrono::steady_clock::now();
+}
+
+uint64_t
+CGraphics::get_present_count()
+{
+	return the_present_count;
+}
+
+uint64_t
+CGraphics::get_skipped_count()
+{
+	return the_skipped_count;
+}
+
+uint64_t
+CGraphics::get_coalesced_count()
+{
+	return the_coalesced_count;
+}
+
+uint64_t
+CGraphics::get_uploaded_bytes()
+{
+	return the_uploaded_bytes;
+}
+
+bool
+CGraphics::get_damage(SDirtyRect& a_dirty)
+{
+	if (!the_presented_flag)
 	{
-		if (my_graphics[i] == (uint8_t)(1))
-			my_graphics[i] = 0xff;
-		else
-			my_graphics[i] = 0x0;
+		a_dirty = { 0, 0, SChip8State::SCREEN_WIDTH, SChip8State::SCREEN_HEIGHT };
+		return true;
 	}
 
-	// Update texture.
-	SDL_UpdateTexture(the_texture, NULL, &my_graphics, 32 * sizeof(uint8_t));
+	// The rows that differ, and every column that differs in any of them.
+	int			my_top		= -1;
+	int			my_bottom	= -1;
+	uint64_t	my_columns	= 0;
+
+	for (int y = 0; y < SChip8State::SCREEN_HEIGHT; y++)
+	{
+		uint64_t my_changed = the_state.the_screen[y] ^ the_presented[y];
+
+		if (my_changed == 0)
+			continue;
+
+		if (my_top < 0)
+			my_top = y;
+
+		my_bottom = y;
+		my_columns |= my_changed;
+	}
+
+	if (my_columns == 0)
+		return false;
+
+	// Column 0 is the top bit.
+	int my_left		= 0;
+	int my_right	= SChip8State::SCREEN_WIDTH - 1;
+
+	while (((my_columns >> (SChip8State::SCREEN_WIDTH - 1 - my_left)) & 1) == 0)
+		my_left++;
+
+	while (((my_columns >> (SChip8State::SCREEN_WIDTH - 1 - my_right)) & 1) == 0)
+		my_right--;
 
-	// Rect set-up for auto scaling.
-	SDL_Rect my_rect;
-	my_rect.w = 640;
-	my_rect.h = 320;
-	my_rect.x = 0;
-	my_rect.y = 0;
+	a_dirty = { my_left, my_top, my_right - my_left + 1, my_bottom - my_top + 1 };
 
-	// Copy texture to renderer. In this case, the texture will be automatically scaled to the render size.
-	//SDL_RenderCopyEx(the_renderer, the_texture, NULL, &my_rect, 180, &my_point, SDL_FLIP_HORIZONTAL);
-	SDL_RenderCopy(the_renderer, the_texture, NULL, &my_rect);
-	SDL_RenderPresent(the_renderer);
+	return true;
 }
\ No newline at end of file
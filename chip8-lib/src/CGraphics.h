@@ -1,15 +1,27 @@
 #pragma once
 #include <array>
+#include <chrono>
 #include <stdint.h>
-#include <SDL2/SDL.h>
+#include "SChip8State.h"
+#include "CPresenter.h"
 
-#define WINDOW_WIDTH 640
-#define WINDOW_HEIGHT 320
+/**
+	The screen in the state, and the presenter its frames go to. Without set_presenter() they go nowhere.
 
+	draw() keeps a copy of the rows it presented last and only hands the presenter the rectangle around the pixels
+	that differ from it. A frame that looks the same, even when DRW changed it and changed it back, isn't presented.
+
+	The CPU signals every finished frame with frame_ready(). A frame that changed the screen is presented then, unless
+	less than a refresh went by since the last present: it stays pending and goes out with a later frame or flush().
+	With a refresh rate of 0 every frame that changed the screen is presented.
+*/
 class CGraphics
 {
 	public:
-		CGraphics();
+		// Presents per second at most, the host display's refresh.
+		static const uint32_t REFRESH_RATE = 60;
+
+		CGraphics(SChip8State& a_state);
 		~CGraphics() = default;
 
 		int		get_pixel_state(int a_pixel);
@@ -17,17 +29,36 @@ class CGraphics
 		void	clear();
 		size_t	get_size();
 
+		void	set_presenter(CPresenter* a_presenter);
 		bool	init();
 		void	draw();
+		void	set_refresh_rate(uint32_t a_rate);
+		void	frame_ready(bool a_changed);
+		void	flush();
+
+		uint64_t	get_present_count();
+		uint64_t	get_skipped_count();
+		uint64_t	get_coalesced_count();
+		uint64_t	get_uploaded_bytes();
 
 	private:
-		std::array<uint8_t, 2048>	the_graphics;
+		bool	get_damage(SDirtyRect& a_dirty);
 
-		// sdl stuff
-		SDL_Window* the_window;
-		SDL_Renderer* the_renderer;
-		SDL_Surface* the_surface;
-		SDL_Texture* the_texture;
+		SChip8State&	the_state;
+		CPresenter*		the_presenter;
+		CNullPresenter	the_null_presenter;
 
-};
+		// The screen as the presenter last saw it, not at all after set_presenter() or init().
+		uint64_t		the_presented[SChip8State::SCREEN_HEIGHT];
+		bool			the_presented_flag;
+
+		// A changed frame not presented yet, and when the last one was.
+		std::chrono::steady_clock::duration		the_refresh_interval;
+		std::chrono::steady_clock::time_point	the_present_time;
+		bool									the_pending_flag;
 
+		uint64_t		the_present_count;
+		uint64_t		the_skipped_count;
+		uint64_t		the_coalesced_count;
+		uint64_t		the_uploaded_bytes;
+};
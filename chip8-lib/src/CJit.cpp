@@ -0,0 +1,442 @@
+#include "CJit.h"
+#include "CCPU.h"
+#include "CMemory.h"
+#include "SChip8State.h"
+#include "COpcodeTable.h"
+#include <initializer_list>
+#include <string.h>
+#include <stddef.h>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CHIP8_JIT_X64
+#endif
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+	// Longest straight line of instructions in one block.
+	const uint32_t	MAX_BLOCK_INSTRUCTIONS	= 64;
+
+	// Worst case bytes a single instruction emits (PC store + call), plus prologue and epilogue.
+	const size_t	MAX_INSTRUCTION_BYTES	= 32;
+	const size_t	MAX_BLOCK_BYTES			= 64 + MAX_BLOCK_INSTRUCTIONS * MAX_INSTRUCTION_BYTES;
+
+	const size_t	CODE_BUFFER_SIZE		= 1024 * 1024;
+
+	// Where the emitted code finds things in the state, all of them fit a disp8 from r12.
+	const uint8_t	PC_OFFSET				= offsetof(SChip8State, the_pc);
+	const uint8_t	I_OFFSET				= offsetof(SChip8State, the_I);
+	const uint8_t	V_OFFSET				= offsetof(SChip8State, the_V);
+
+	/**
+		The timer opcodes. They get a block to themselves.
+	*/
+	bool is_timer_opcode(uint16_t an_opcode)
+	{
+		if ((an_opcode & 0xf000) != 0xf000)
+			return false;
+
+		uint8_t my_low_byte = an_opcode & 0x00ff;
+
+		return my_low_byte == 0x07 || my_low_byte == 0x15 || my_low_byte == 0x18;
+	}
+
+	/**
+		Whether the block has to stop after this opcode: its successor isn't simply the next instruction, or it may
+		have written to the code that follows.
+	*/
+	bool ends_block(uint16_t an_opcode)
+	{
+		if (!COpcodeTable::is_known(an_opcode))
+			return true;
+
+		switch (an_opcode & 0xf000)
+		{
+			case 0x0000:	return (an_opcode & 0x00ff) == 0xee;
+			case 0x1000:
+			case 0x2000:
+			case 0x3000:
+			case 0x4000:
+			case 0x5000:
+			case 0x9000:
+			case 0xB000:
+			case 0xE000:	return true;
+			case 0xF000:
+			{
+				uint8_t my_low_byte = an_opcode & 0x00ff;
+
+				return my_low_byte == 0x0a || my_low_byte == 0x33 || my_low_byte == 0x55 || is_timer_opcode(an_opcode);
+			}
+			default:		return false;
+		}
+	}
+}
+
+CJit::CJit(CCPU* a_cpu, CMemory* a_memory, SChip8State* a_state) :
+	the_cpu(a_cpu),
+	the_memory(a_memory),
+	the_state(a_state),
+	the_code_buffer(nullptr),
+	the_code_size(0),
+	the_code_used(0),
+	the_previous(nullptr),
+	the_generation(0)
+{
+#if defined(CHIP8_JIT_X64)
+#if defined(_WIN32)
+	void* my_buffer = VirtualAlloc(nullptr, CODE_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+	void* my_buffer = mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (my_buffer == MAP_FAILED)
+		my_buffer = nullptr;
+#endif
+
+	if (my_buffer != nullptr)
+	{
+		the_code_buffer	= static_cast<uint8_t*>(my_buffer);
+		the_code_size	= CODE_BUFFER_SIZE;
+	}
+#endif
+
+	// Writes into translated code throw the blocks away.
+	the_memory->set_code_write_hook([this](int an_index) { invalidate(an_index); });
+}
+
+CJit::~CJit()
+{
+	the_memory->set_code_write_hook(nullptr);
+	the_memory->mark_code(0, (int)the_memory->get_size(), false);
+
+	if (the_code_buffer != nullptr)
+	{
+#if defined(_WIN32)
+		VirtualFree(the_code_buffer, 0, MEM_RELEASE);
+#else
+		munmap(the_code_buffer, the_code_size);
+#endif
+	}
+}
+
+bool
+CJit::is_supported()
+{
+#if defined(CHIP8_JIT_X64)
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint32_t
+CJit::run_block()
+{
+	uint16_t my_pc = the_state->the_pc;
+
+	// Without native code, or at the very end of memory, interpret a single instruction.
+	if (the_code_buffer == nullptr || my_pc >= the_memory->get_size() - 1)
+	{
+		the_previous = nullptr;
+		the_cpu->step();
+
+		if (the_cpu->the_timers_per_instruction)
+			the_cpu->update_timers();
+
+		return 1;
+	}
+
+	SBlock* my_block = nullptr;
+
+	// Follow the links of the previous block before going to the lookup.
+	if (the_previous != nullptr)
+	{
+		for (SBlock* my_link : the_previous->the_links)
+		{
+			if (my_link != nullptr && my_link->the_start == my_pc)
+				my_block = my_link;
+		}
+	}
+
+	if (my_block == nullptr)
+	{
+		my_block = lookup(my_pc);
+
+		if (the_previous != nullptr)
+		{
+			// Keep the most recent successor in the first slot.
+			the_previous->the_links[1] = the_previous->the_links[0];
+			the_previous->the_links[0] = my_block;
+		}
+	}
+
+	// The block can be thrown away while it runs (FX33, FX55 into itself), so take what's needed first. The code
+	// itself stays in the buffer until the next flush, which only happens when translating.
+	uint32_t	my_count		= my_block->the_count;
+	uint32_t	my_generation	= the_generation;
+
+	my_block->the_code(the_cpu, the_state);
+
+	for (uint32_t i = 0; i < my_count && the_cpu->the_timers_per_instruction; i++)
+		the_cpu->update_timers();
+
+	the_previous = (my_generation == the_generation) ? my_block : nullptr;
+
+	return my_count;
+}
+
+void
+CJit::flush()
+{
+	for (std::unique_ptr<SBlock>& my_block : the_blocks)
+		my_block.reset();
+
+	the_memory->mark_code(0, (int)the_memory->get_size(), false);
+
+	the_code_used = 0;
+	the_previous = nullptr;
+	the_generation++;
+}
+
+size_t
+CJit::get_block_count()
+{
+	size_t my_count = 0;
+
+	for (std::unique_ptr<SBlock>& my_block : the_blocks)
+	{
+		if (my_block)
+			my_count++;
+	}
+
+	return my_count;
+}
+
+CJit::SBlock*
+CJit::lookup(uint16_t a_pc)
+{
+	if (!the_blocks[a_pc])
+	{
+		// Out of space, start over. Nothing is running at this point.
+		if (the_code_size - the_code_used < MAX_BLOCK_BYTES)
+			flush();
+
+		translate(a_pc);
+	}
+
+	return the_blocks[a_pc].get();
+}
+
+CJit::SBlock*
+CJit::translate(uint16_t a_pc)
+{
+	std::unique_ptr<SBlock> my_block(new SBlock());
+
+	my_block->the_start	= a_pc;
+	my_block->the_code	= reinterpret_cast<block_code>(the_code_buffer + the_code_used);
+	my_block->the_links	= {};
+
+	emit_prologue();
+
+	uint16_t	my_pc		= a_pc;
+	uint32_t	my_count	= 0;
+	bool		my_ended	= false;
+
+	while (my_count < MAX_BLOCK_INSTRUCTIONS && my_pc < the_memory->get_size() - 1)
+	{
+		uint16_t my_opcode = the_memory->get_opcode(my_pc);
+
+		// Timer opcodes start a block of their own.
+		if (is_timer_opcode(my_opcode) && my_count > 0)
+			break;
+
+		if (!emit_inline(my_opcode))
+		{
+			// Handlers work on the PC, so it has to be right before calling one.
+			emit_store_pc(my_pc);
+			emit_call(my_opcode);
+		}
+
+		my_pc += 2;
+		my_count++;
+
+		if (ends_block(my_opcode))
+		{
+			my_ended = true;
+			break;
+		}
+	}
+
+	// Falling out of the block, the inline opcodes never touched the PC.
+	if (!my_ended)
+		emit_store_pc(my_pc);
+
+	emit_epilogue();
+
+	my_block->the_end	= my_pc;
+	my_block->the_count	= my_count;
+
+	// From now on writes to these bytes invalidate the block.
+	the_memory->mark_code(my_block->the_start, my_block->the_end, true);
+
+	the_blocks[a_pc] = std::move(my_block);
+
+	return the_blocks[a_pc].get();
+}
+
+void
+CJit::invalidate(int an_index)
+{
+	bool my_removed = false;
+
+	for (std::unique_ptr<SBlock>& my_block : the_blocks)
+	{
+		if (my_block && my_block->the_start <= an_index && an_index < my_block->the_end)
+		{
+			my_block.reset();
+			my_removed = true;
+		}
+	}
+
+	if (!my_removed)
+		return;
+
+	// Links may point at the removed blocks, drop them all. Then mark what's still translated.
+	the_memory->mark_code(0, (int)the_memory->get_size(), false);
+
+	for (std::unique_ptr<SBlock>& my_block : the_blocks)
+	{
+		if (my_block)
+		{
+			my_block->the_links = {};
+			the_memory->mark_code(my_block->the_start, my_block->the_end, true);
+		}
+	}
+
+	the_previous = nullptr;
+	the_generation++;
+}
+
+void
+CJit::emit(std::initializer_list<uint8_t> some_bytes)
+{
+	for (uint8_t my_byte : some_bytes)
+		the_code_buffer[the_code_used++] = my_byte;
+}
+
+void
+CJit::emit16(uint16_t a_value)
+{
+	memcpy(the_code_buffer + the_code_used, &a_value, sizeof(a_value));
+	the_code_used += sizeof(a_value);
+}
+
+void
+CJit::emit32(uint32_t a_value)
+{
+	memcpy(the_code_buffer + the_code_used, &a_value, sizeof(a_value));
+	the_code_used += sizeof(a_value);
+}
+
+void
+CJit::emit64(uint64_t a_value)
+{
+	memcpy(the_code_buffer + the_code_used, &a_value, sizeof(a_value));
+	the_code_used += sizeof(a_value);
+}
+
+void
+CJit::emit_prologue()
+{
+	// rbx holds the CPU, r12 the state. Both are callee saved, so they survive the handler calls.
+	emit({ 0x53 });								// push rbx
+	emit({ 0x41, 0x54 });						// push r12
+	emit({ 0x48, 0x83, 0xec, 0x28 });			// sub rsp, 40 (shadow space, keeps rsp 16 byte aligned)
+#if defined(_WIN32)
+	emit({ 0x48, 0x89, 0xcb });					// mov rbx, rcx
+	emit({ 0x49, 0x89, 0xd4 });					// mov r12, rdx
+#else
+	emit({ 0x48, 0x89, 0xfb });					// mov rbx, rdi
+	emit({ 0x49, 0x89, 0xf4 });					// mov r12, rsi
+#endif
+}
+
+void
+CJit::emit_epilogue()
+{
+	emit({ 0x48, 0x83, 0xc4, 0x28 });			// add rsp, 40
+	emit({ 0x41, 0x5c });						// pop r12
+	emit({ 0x5b });								// pop rbx
+	emit({ 0xc3 });								// ret
+}
+
+void
+CJit::emit_store_pc(uint16_t a_pc)
+{
+	emit({ 0x66, 0x41, 0xc7, 0x44, 0x24, PC_OFFSET });	// mov word [r12 + pc], imm16
+	emit16(a_pc);
+}
+
+void
+CJit::emit_call(uint16_t an_opcode)
+{
+#if defined(_WIN32)
+	emit({ 0x48, 0x89, 0xd9 });					// mov rcx, rbx
+#else
+	emit({ 0x48, 0x89, 0xdf });					// mov rdi, rbx
+#endif
+	emit({ 0x48, 0xb8 });						// mov rax, handler
+	emit64(reinterpret_cast<uint64_t>(COpcodeTable::get_handler(an_opcode)));
+	emit({ 0xff, 0xd0 });						// call rax
+}
+
+bool
+CJit::emit_inline(uint16_t an_opcode)
+{
+	uint8_t regx	= (an_opcode & 0x0f00) >> 8;
+	uint8_t regy	= (an_opcode & 0x00f0) >> 4;
+	uint8_t byte	= an_opcode & 0x00ff;
+
+	switch (an_opcode & 0xf000)
+	{
+		case 0x6000:
+		{
+			emit({ 0x41, 0xc6, 0x44, 0x24, (uint8_t)(V_OFFSET + regx), byte });		// mov byte [r12 + Vx], kk
+			return true;
+		}
+		case 0x7000:
+		{
+			emit({ 0x41, 0x80, 0x44, 0x24, (uint8_t)(V_OFFSET + regx), byte });		// add byte [r12 + Vx], kk
+			return true;
+		}
+		case 0x8000:
+		{
+			// The logic opcodes, al = Vy, then mov/or/and/xor Vx with al.
+			static const uint8_t my_operations[4] = { 0x88, 0x08, 0x20, 0x30 };
+			uint8_t my_kind = an_opcode & 0x000f;
+
+			if (my_kind > 0x3)
+				return false;
+
+			emit({ 0x41, 0x8a, 0x44, 0x24, (uint8_t)(V_OFFSET + regy) });							// mov al, [r12 + Vy]
+			emit({ 0x41, my_operations[my_kind], 0x44, 0x24, (uint8_t)(V_OFFSET + regx) });		// op [r12 + Vx], al
+			return true;
+		}
+		case 0xA000:
+		{
+			emit({ 0x66, 0x41, 0xc7, 0x44, 0x24, I_OFFSET });	// mov word [r12 + I], nnn
+			emit16(an_opcode & 0x0fff);
+			return true;
+		}
+		default:
+		{
+			return false;
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <stdint.h>
+#include <array>
+#include <memory>
+#include <vector>
+
+class CCPU;
+class CMemory;
+struct SChip8State;
+
+/**
+	Basic-block JIT for x86-64.
+
+	A block runs from its start address up to and including the first instruction that can leave the straight line
+	(1NNN, 2NNN, 00EE, BNNN, the skips, FX0A), writes memory (FX33, FX55) or is unknown. The timer opcodes (FX07, FX15,
+	FX18) always get a block of their own, that way the timers can be ticked once per instruction after the block and
+	still be seen exactly as the interpreter sees them.
+
+	Simple register opcodes are emitted inline, the rest call the handler from COpcodeTable. Writes into translated
+	memory throw the affected blocks away. Blocks are linked in the dispatcher: every block remembers which blocks
+	followed it, so a hot loop never goes through the lookup.
+
+	On other architectures run_block() falls back to the interpreter.
+*/
+class CJit
+{
+	public:
+		CJit(CCPU* a_cpu, CMemory* a_memory, SChip8State* a_state);
+		~CJit();
+
+		static bool	is_supported();
+
+		uint32_t	run_block();
+		void		flush();
+		size_t		get_block_count();
+
+	private:
+		typedef void (*block_code)(CCPU*, SChip8State*);
+
+		struct SBlock
+		{
+			uint16_t				the_start;
+			uint16_t				the_end;		// One past the last byte.
+			uint32_t				the_count;		// Instructions in the block.
+			block_code				the_code;
+
+			// The blocks seen after this one, by start address.
+			std::array<SBlock*, 2>	the_links;
+		};
+
+		SBlock*		lookup(uint16_t a_pc);
+		SBlock*		translate(uint16_t a_pc);
+		void		invalidate(int an_index);
+
+		// Emitter.
+		void		emit(std::initializer_list<uint8_t> some_bytes);
+		void		emit16(uint16_t a_value);
+		void		emit32(uint32_t a_value);
+		void		emit64(uint64_t a_value);
+		void		emit_prologue();
+		void		emit_epilogue();
+		void		emit_store_pc(uint16_t a_pc);
+		void		emit_call(uint16_t an_opcode);
+		bool		emit_inline(uint16_t an_opcode);
+
+		CCPU*			the_cpu;
+		CMemory*		the_memory;
+		SChip8State*	the_state;
+
+		// Executable memory, filled front to back and flushed as a whole when it runs out.
+		uint8_t*	the_code_buffer;
+		size_t		the_code_size;
+		size_t		the_code_used;
+
+		std::array<std::unique_ptr<SBlock>, 4096>	the_blocks;
+		SBlock*										the_previous;
+		uint32_t									the_generation;
+};
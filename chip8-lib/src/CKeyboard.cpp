@@ -1,24 +1,23 @@
 #include "CKeyboard.h"
 
-CKeyboard::CKeyboard()
+CKeyboard::CKeyboard(SChip8State& a_state) : the_state(a_state)
 {
-	the_keyboard = {};
 }
 
 void
 CKeyboard::set_key_state(int a_key, int a_state)
 {
-	the_keyboard[a_key] = a_state;
+	the_state.the_keys[a_key & 0xf] = a_state;
 }
 
 uint8_t
 CKeyboard::get_key_state(int a_key)
 {
-	return the_keyboard[a_key];
+	return the_state.the_keys[a_key & 0xf];
 }
 
 size_t
 CKeyboard::get_size()
 {
-	return the_keyboard.size();
+	return sizeof(the_state.the_keys);
 }
\ No newline at end of file
@@ -1,11 +1,12 @@
 #pragma once
 #include <stdint.h>
 #include <array>
+#include "SChip8State.h"
 
 class CKeyboard
 {
 	public:
-		CKeyboard();
+		CKeyboard(SChip8State& a_state);
 		~CKeyboard() = default;
 
 		void	set_key_state(int a_key, int a_state);
@@ -13,6 +14,5 @@ class CKeyboard
 		size_t	get_size();
 
 	private:
-		std::array<uint8_t, 16> the_keyboard;
+		SChip8State&	the_state;
 };
-
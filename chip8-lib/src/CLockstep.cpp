@@ -0,0 +1,329 @@
+#include "CLockstep.h"
+#include <string.h>
+#include <algorithm>
+#include "CCPU.h"
+#include "CCpuFeatures.h"
+#include "COpcodes.h"
+#include "CLockstepLanes.h"
+
+namespace {
+
+	/**
+		The lane operations as plain loops, the compiler vectorises them as far as the baseline instruction set
+		allows. CLockstepAVX2.cpp has the same with AVX2.
+	*/
+	struct SPlainLanes
+	{
+		struct bytes { uint8_t the_lanes[32]; };
+		struct words { uint16_t the_lanes[16]; };
+
+#define CHIP8_LANES8(an_expression)		bytes my_result; for (int i = 0; i < 32; i++) my_result.the_lanes[i] = (uint8_t)(an_expression); return my_result;
+#define CHIP8_LANES16(an_expression)	words my_result; for (int i = 0; i < 16; i++) my_result.the_lanes[i] = (uint16_t)(an_expression); return my_result;
+
+		static inline bytes	load8(const uint8_t* a_lanes)				{ bytes my_result; memcpy(my_result.the_lanes, a_lanes, 32); return my_result; }
+		static inline void	store8(uint8_t* a_lanes, bytes a_value)		{ memcpy(a_lanes, a_value.the_lanes, 32); }
+		static inline bytes	set8(uint8_t a_value)						{ CHIP8_LANES8(a_value) }
+		static inline bytes	blend8(bytes a_old, bytes a_new, bytes a_mask)	{ CHIP8_LANES8(a_mask.the_lanes[i] ? a_new.the_lanes[i] : a_old.the_lanes[i]) }
+		static inline bytes	add8(bytes a_left, bytes a_right)			{ CHIP8_LANES8(a_left.the_lanes[i] + a_right.the_lanes[i]) }
+		static inline bytes	sub8(bytes a_left, bytes a_right)			{ CHIP8_LANES8(a_left.the_lanes[i] - a_right.the_lanes[i]) }
+		static inline bytes	and8(bytes a_left, bytes a_right)			{ CHIP8_LANES8(a_left.the_lanes[i] & a_right.the_lanes[i]) }
+		static inline bytes	or8(bytes a_left, bytes a_right)			{ CHIP8_LANES8(a_left.the_lanes[i] | a_right.the_lanes[i]) }
+		static inline bytes	xor8(bytes a_left, bytes a_right)			{ CHIP8_LANES8(a_left.the_lanes[i] ^ a_right.the_lanes[i]) }
+		static inline bytes	eq8(bytes a_left, bytes a_right)			{ CHIP8_LANES8(a_left.the_lanes[i] == a_right.the_lanes[i] ? 0xff : 0) }
+		static inline bytes	ne8(bytes a_left, bytes a_right)			{ CHIP8_LANES8(a_left.the_lanes[i] != a_right.the_lanes[i] ? 0xff : 0) }
+		static inline bytes	gt8(bytes a_left, bytes a_right)			{ CHIP8_LANES8(a_left.the_lanes[i] > a_right.the_lanes[i] ? 0xff : 0) }
+		static inline bytes	shr8(bytes a_value)							{ CHIP8_LANES8(a_value.the_lanes[i] >> 1) }
+		static inline bytes	dec8(bytes a_value)							{ CHIP8_LANES8(a_value.the_lanes[i] > 0 ? a_value.the_lanes[i] - 1 : 0) }
+
+		static inline bool
+		any8(bytes a_mask)
+		{
+			uint8_t my_any = 0;
+
+			for (int i = 0; i < 32; i++)
+				my_any |= a_mask.the_lanes[i];
+
+			return my_any != 0;
+		}
+
+		static inline words	load16(const uint16_t* a_lanes)				{ words my_result; memcpy(my_result.the_lanes, a_lanes, 32); return my_result; }
+		static inline void	store16(uint16_t* a_lanes, words a_value)	{ memcpy(a_lanes, a_value.the_lanes, 32); }
+		static inline words	set16(uint16_t a_value)						{ CHIP8_LANES16(a_value) }
+		static inline words	blend16(words a_old, words a_new, words a_mask)	{ CHIP8_LANES16(a_mask.the_lanes[i] ? a_new.the_lanes[i] : a_old.the_lanes[i]) }
+		static inline words	add16(words a_left, words a_right)			{ CHIP8_LANES16(a_left.the_lanes[i] + a_right.the_lanes[i]) }
+		static inline words	and16(words a_left, words a_right)			{ CHIP8_LANES16(a_left.the_lanes[i] & a_right.the_lanes[i]) }
+		static inline words	mul16(words a_left, words a_right)			{ CHIP8_LANES16(a_left.the_lanes[i] * a_right.the_lanes[i]) }
+		static inline words	max16(words a_left, words a_right)			{ CHIP8_LANES16(std::max(a_left.the_lanes[i], a_right.the_lanes[i])) }
+		static inline words	eq16(words a_left, words a_right)			{ CHIP8_LANES16(a_left.the_lanes[i] == a_right.the_lanes[i] ? 0xffff : 0) }
+		static inline words	andnot16(words a_mask, words a_value)		{ CHIP8_LANES16(~a_mask.the_lanes[i] & a_value.the_lanes[i]) }
+		static inline words	mask16(const uint8_t* a_mask)				{ CHIP8_LANES16(a_mask[i] ? 0xffff : 0) }
+		static inline words	widen16(const uint8_t* a_lanes)				{ CHIP8_LANES16(a_lanes[i]) }
+
+		static inline void
+		narrow16(uint8_t* a_mask, words a_value)
+		{
+			for (int i = 0; i < 16; i++)
+				a_mask[i] = a_value.the_lanes[i] ? 0xff : 0;
+		}
+
+		static inline uint32_t
+		count16(words a_mask)
+		{
+			uint32_t my_count = 0;
+
+			for (int i = 0; i < 16; i++)
+				my_count += a_mask.the_lanes[i] ? 1 : 0;
+
+			return my_count;
+		}
+
+		static inline int
+		first16(words a_mask)
+		{
+			for (int i = 0; i < 16; i++)
+				if (a_mask.the_lanes[i])
+					return i;
+
+			return -1;
+		}
+
+		static inline bool
+		any16(words a_mask)
+		{
+			return first16(a_mask) >= 0;
+		}
+
+		static inline uint16_t
+		reduce_max16(words a_value)
+		{
+			return *std::max_element(a_value.the_lanes, a_value.the_lanes + 16);
+		}
+
+#undef CHIP8_LANES8
+#undef CHIP8_LANES16
+	};
+}
+
+// The AVX2 kernels where the CPU has them.
+bool CLockstep::the_vectorised = CCpuFeatures::has_avx2();
+
+CLockstep::CLockstep(size_t an_instances) :
+	the_instances(an_instances),
+	the_lanes(std::max<size_t>((an_instances + LANE_GROUP - 1) / LANE_GROUP, 1) * LANE_GROUP),
+	the_V(16 * the_lanes),
+	the_pc(the_lanes),
+	the_I(the_lanes),
+	the_delay_timer(the_lanes),
+	the_sound_timer(the_lanes),
+	the_keys(16 * the_lanes),
+	the_budget(the_lanes),
+	the_mask(the_lanes),
+	the_condition(the_lanes),
+	the_states(the_lanes, SChip8State()),
+	the_image(),
+	the_written(),
+	the_clock_rate(500),
+	the_clock_credit(0),
+	the_instruction_count(0),
+	the_step_count(0),
+	the_frame_count(0)
+{
+}
+
+bool
+CLockstep::is_vectorised()
+{
+	return the_vectorised;
+}
+
+bool
+CLockstep::set_vectorised(bool a_vectorised)
+{
+	if (a_vectorised && !CCpuFeatures::has_avx2())
+		return false;
+
+	the_vectorised = a_vectorised;
+
+	return true;
+}
+
+void
+CLockstep::load(const SChip8State& a_state)
+{
+	// Padding lanes get the machine too, they never run.
+	for (size_t i = 0; i < the_lanes; i++)
+	{
+		the_states[i] = a_state;
+		fill(i);
+
+		for (int j = 0; j < 16; j++)
+			the_keys[j * the_lanes + i] = a_state.the_keys[j];
+	}
+
+	memcpy(the_image.data(), a_state.the_memory, sizeof(a_state.the_memory));
+	the_written.fill(false);
+
+	the_clock_credit		= 0;
+	the_instruction_count	= 0;
+	the_step_count			= 0;
+	the_frame_count			= 0;
+}
+
+void
+CLockstep::set_instance(size_t an_instance, const SChip8State& a_state)
+{
+	the_states[an_instance] = a_state;
+	fill(an_instance);
+
+	for (int i = 0; i < 16; i++)
+		the_keys[i * the_lanes + an_instance] = a_state.the_keys[i];
+
+	// RAM that isn't what the others started with is fetched per lane from now on.
+	for (size_t i = 0; i < the_image.size(); i++)
+		if (a_state.the_memory[i] != the_image[i])
+			the_written[i] = true;
+}
+
+void
+CLockstep::get_instance(size_t an_instance, SChip8State& a_state)
+{
+	spill(an_instance);
+	a_state = the_states[an_instance];
+}
+
+void
+CLockstep::set_key_state(size_t an_instance, int a_key, int a_state)
+{
+	the_states[an_instance].the_keys[a_key & 0xf]		= a_state;
+	the_keys[(a_key & 0xf) * the_lanes + an_instance]	= a_state;
+}
+
+void
+CLockstep::set_clock_rate(uint32_t an_instructions_per_second)
+{
+	the_clock_rate = an_instructions_per_second;
+}
+
+uint32_t
+CLockstep::run_frame()
+{
+	// The budget of CCPU::run_frame(), the same for every instance.
+	the_clock_credit += the_clock_rate;
+
+	uint32_t my_count = the_clock_credit > 0 ? (uint32_t)(the_clock_credit / CCPU::FRAME_RATE) : 0;
+
+#if defined(CHIP8_AVX2_KERNELS)
+	if (the_vectorised)
+		run_lanes_avx2(my_count);
+	else
+#endif
+		run_lanes<SPlainLanes>(my_count);
+
+	the_clock_credit -= (int64_t)my_count * CCPU::FRAME_RATE;
+
+	the_frame_count++;
+
+	return my_count;
+}
+
+size_t
+CLockstep::get_instance_count()
+{
+	return the_instances;
+}
+
+uint64_t
+CLockstep::get_instruction_count()
+{
+	return the_instruction_count;
+}
+
+uint64_t
+CLockstep::get_step_count()
+{
+	return the_step_count;
+}
+
+uint64_t
+CLockstep::get_frame_count()
+{
+	return the_frame_count;
+}
+
+void
+CLockstep::execute_lanes(uint16_t an_opcode)
+{
+	uint8_t		x	= (an_opcode & 0x0f00) >> 8;
+	uint8_t		kk	= an_opcode & 0x00ff;
+	uint16_t	nnn	= an_opcode & 0x0fff;
+
+	// What's left is BNNN, CXKK, FX0A and unknown opcodes, which leave the lanes alone. Only the V registers they use
+	// go over to the lane's SChip8State and back, it's strided.
+	uint16_t my_registers;
+
+	switch (an_opcode & 0xf000)
+	{
+		case 0xb000:	my_registers = 1;		break;
+		case 0xc000:	my_registers = 1 << x;	break;
+		case 0xf000:
+			if (kk != 0x0a)
+				return;
+
+			my_registers = 1 << x;
+			break;
+		default:		return;
+	}
+
+	for_lanes(the_mask, the_instances, [&](size_t i)
+	{
+		SChip8State& my_state = the_states[i];
+
+		spill(i, my_registers);
+
+		switch (an_opcode & 0xf000)
+		{
+			case 0xb000:	COpcodes::op_JP_V0_addr(my_state, nnn);		break;
+			case 0xc000:	COpcodes::op_RND_Vx_byte(my_state, x, kk);	break;
+			default:		COpcodes::op_LD_Vx_K(my_state, x);			break;
+		}
+
+		fill(i, my_registers);
+	});
+}
+
+void
+CLockstep::mark_written(int a_begin, int an_end)
+{
+	for (int i = std::max(a_begin, 0); i < std::min(an_end, (int)the_written.size()); i++)
+		the_written[i] = true;
+}
+
+void
+CLockstep::spill(size_t a_lane, uint16_t a_registers)
+{
+	SChip8State& my_state = the_states[a_lane];
+
+	my_state.the_pc				= the_pc[a_lane];
+	my_state.the_I				= the_I[a_lane];
+	my_state.the_delay_timer	= the_delay_timer[a_lane];
+	my_state.the_sound_timer	= the_sound_timer[a_lane];
+
+	for (int i = 0; i < 16; i++)
+		if (a_registers & (1 << i))
+			my_state.the_V[i] = the_V[i * the_lanes + a_lane];
+}
+
+void
+CLockstep::fill(size_t a_lane, uint16_t a_registers)
+{
+	const SChip8State& my_state = the_states[a_lane];
+
+	the_pc[a_lane]			= my_state.the_pc;
+	the_I[a_lane]			= my_state.the_I;
+	the_delay_timer[a_lane]	= my_state.the_delay_timer;
+	the_sound_timer[a_lane]	= my_state.the_sound_timer;
+
+	for (int i = 0; i < 16; i++)
+		if (a_registers & (1 << i))
+			the_V[i * the_lanes + a_lane] = my_state.the_V[i];
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <stdint.h>
+#include <array>
+#include <vector>
+#include "SChip8State.h"
+
+/**
+	Many instances of one ROM in lockstep, structure of arrays.
+
+	The V registers, PC, I and timers of every instance are kept one array per register with an instance per lane,
+	the stack, keys, screen and RAM stay in an SChip8State per instance. Every step fetches one opcode and runs it
+	on all lanes that are at the same PC with frame budget left. Register opcodes (6XKK, 7XKK, the 8XY* arithmetic,
+	all skips, ANNN, 1NNN, the timer loads, FX1E and FX29) run on 32 lanes at a time under a lane mask, with AVX2
+	where the CPU has it. CALL, RET, CLS, DRW and the RAM copies go lane by lane straight from the lane arrays, DRW
+	through COpcodes::draw(). The rest (BNNN, RND, FX0A) copy the registers they use over to the lane's SChip8State
+	and run the COpcodes.h opcode there.
+
+	Lanes whose PCs diverge are regrouped every step: the next PC is the one of the lane furthest behind in its
+	frame, so lanes that went different ways get a chance to meet again. All instances start from the same RAM, so
+	the opcode is only fetched per lane at addresses some instance has written to.
+
+	A frame runs the same number of instructions on every instance and ticks the timers once, like
+	CCPU::run_frame(). The sound timer doesn't beep.
+*/
+class CLockstep
+{
+	public:
+		// Lanes per AVX2 register of byte registers, the instance count is padded up to a multiple of it.
+		static const size_t LANE_GROUP = 32;
+
+		CLockstep(size_t an_instances);
+		~CLockstep() = default;
+
+		// Whether the lanes run on AVX2, picked for the CPU. Tests turn it off, it can't be turned on without AVX2.
+		static bool	is_vectorised();
+		static bool	set_vectorised(bool a_vectorised);
+
+		void		load(const SChip8State& a_state);
+		void		set_instance(size_t an_instance, const SChip8State& a_state);
+		void		get_instance(size_t an_instance, SChip8State& a_state);
+		void		set_key_state(size_t an_instance, int a_key, int a_state);
+		void		set_clock_rate(uint32_t an_instructions_per_second);
+		uint32_t	run_frame();
+
+		size_t		get_instance_count();
+		uint64_t	get_instruction_count();
+		uint64_t	get_step_count();
+		uint64_t	get_frame_count();
+
+	private:
+		// The lane kernels, see CLockstepLanes.h. run_lanes() runs a frame of a_count instructions on every lane.
+		template <typename TLanes>
+		void		run_lanes(uint32_t a_count);
+		template <typename TLanes>
+		bool		select(uint16_t& a_pc, size_t& a_leader);
+		template <typename TLanes>
+		uint32_t	group(uint16_t a_pc, size_t a_leader, uint16_t& an_opcode);
+		template <typename TLanes>
+		void		execute(uint16_t a_pc, uint16_t an_opcode);
+		template <typename TLanes>
+		void		advance(uint16_t a_pc, bool a_condition);
+		template <typename TLanes>
+		void		jump(uint16_t an_address);
+
+		// run_lanes() built for AVX2, in CLockstepAVX2.cpp.
+		void		run_lanes_avx2(uint32_t a_count);
+		void		execute_lanes(uint16_t an_opcode);
+		void		mark_written(int a_begin, int an_end);
+		void		spill(size_t a_lane, uint16_t a_registers = 0xffff);
+		void		fill(size_t a_lane, uint16_t a_registers = 0xffff);
+
+		size_t						the_instances;
+		size_t						the_lanes;
+
+		// One entry per lane: V and the keys are 16 rows of the_lanes bytes, the keys mirror the SChip8States. The
+		// budget is what's left of the frame, padding lanes have none. The mask marks the lanes of the current step,
+		// the condition those whose skip is taken.
+		std::vector<uint8_t>		the_V;
+		std::vector<uint16_t>		the_pc;
+		std::vector<uint16_t>		the_I;
+		std::vector<uint8_t>		the_delay_timer;
+		std::vector<uint8_t>		the_sound_timer;
+		std::vector<uint8_t>		the_keys;
+		std::vector<uint16_t>		the_budget;
+		std::vector<uint8_t>		the_mask;
+		std::vector<uint8_t>		the_condition;
+
+		// The rest of every instance, the RAM all of them started with and the bytes any of them wrote since.
+		std::vector<SChip8State>	the_states;
+		std::array<uint8_t, 4096>	the_image;
+		std::array<bool, 4096>		the_written;
+
+		static bool					the_vectorised;
+
+		uint32_t					the_clock_rate;
+		int64_t						the_clock_credit;
+		uint64_t					the_instruction_count;
+		uint64_t					the_step_count;
+		uint64_t					the_frame_count;
+};
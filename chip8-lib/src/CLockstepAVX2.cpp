@@ -0,0 +1,117 @@
+#include "CCpuFeatures.h"
+
+#if defined(CHIP8_AVX2_KERNELS)
+#include <string.h>
+#include <algorithm>
+#include <bitset>
+#include <immintrin.h>
+#include "CLockstep.h"
+#include "CCPU.h"
+#include "COpcodes.h"
+#include "CRecompRuntime.h"
+
+// Everything from here on is built for AVX2, the headers above stay at the baseline.
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("avx2")
+#endif
+
+namespace {
+
+	/**
+		The lane operations of CLockstepLanes.h, a group of lanes to a YMM register.
+	*/
+	struct SAvx2Lanes
+	{
+		typedef __m256i bytes;
+		typedef __m256i words;
+
+		static inline bytes	load8(const uint8_t* a_lanes)				{ return _mm256_loadu_si256((const __m256i*)a_lanes); }
+		static inline void	store8(uint8_t* a_lanes, bytes a_value)		{ _mm256_storeu_si256((__m256i*)a_lanes, a_value); }
+		static inline bytes	set8(uint8_t a_value)						{ return _mm256_set1_epi8((char)a_value); }
+		static inline bytes	blend8(bytes a_old, bytes a_new, bytes a_mask)	{ return _mm256_blendv_epi8(a_old, a_new, a_mask); }
+		static inline bytes	add8(bytes a_left, bytes a_right)			{ return _mm256_add_epi8(a_left, a_right); }
+		static inline bytes	sub8(bytes a_left, bytes a_right)			{ return _mm256_sub_epi8(a_left, a_right); }
+		static inline bytes	and8(bytes a_left, bytes a_right)			{ return _mm256_and_si256(a_left, a_right); }
+		static inline bytes	or8(bytes a_left, bytes a_right)			{ return _mm256_or_si256(a_left, a_right); }
+		static inline bytes	xor8(bytes a_left, bytes a_right)			{ return _mm256_xor_si256(a_left, a_right); }
+		static inline bytes	eq8(bytes a_left, bytes a_right)			{ return _mm256_cmpeq_epi8(a_left, a_right); }
+		static inline bytes	ne8(bytes a_left, bytes a_right)			{ return xor8(eq8(a_left, a_right), set8(0xff)); }
+		static inline bytes	shr8(bytes a_value)							{ return and8(_mm256_srli_epi16(a_value, 1), set8(0x7f)); }
+		static inline bytes	dec8(bytes a_value)							{ return _mm256_subs_epu8(a_value, set8(1)); }
+		static inline bool	any8(bytes a_mask)							{ return !_mm256_testz_si256(a_mask, a_mask); }
+
+		// Unsigned a_left > a_right, AVX2 only compares signed.
+		static inline bytes
+		gt8(bytes a_left, bytes a_right)
+		{
+			return _mm256_cmpgt_epi8(xor8(a_left, set8(0x80)), xor8(a_right, set8(0x80)));
+		}
+
+		static inline words	load16(const uint16_t* a_lanes)				{ return _mm256_loadu_si256((const __m256i*)a_lanes); }
+		static inline void	store16(uint16_t* a_lanes, words a_value)	{ _mm256_storeu_si256((__m256i*)a_lanes, a_value); }
+		static inline words	set16(uint16_t a_value)						{ return _mm256_set1_epi16((short)a_value); }
+		static inline words	blend16(words a_old, words a_new, words a_mask)	{ return _mm256_blendv_epi8(a_old, a_new, a_mask); }
+		static inline words	add16(words a_left, words a_right)			{ return _mm256_add_epi16(a_left, a_right); }
+		static inline words	and16(words a_left, words a_right)			{ return _mm256_and_si256(a_left, a_right); }
+		static inline words	mul16(words a_left, words a_right)			{ return _mm256_mullo_epi16(a_left, a_right); }
+		static inline words	max16(words a_left, words a_right)			{ return _mm256_max_epu16(a_left, a_right); }
+		static inline words	eq16(words a_left, words a_right)			{ return _mm256_cmpeq_epi16(a_left, a_right); }
+		static inline words	andnot16(words a_mask, words a_value)		{ return _mm256_andnot_si256(a_mask, a_value); }
+		static inline bool	any16(words a_mask)							{ return !_mm256_testz_si256(a_mask, a_mask); }
+
+		// Byte masks to word masks and back, zero extended byte registers.
+		static inline words	mask16(const uint8_t* a_mask)				{ return _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)a_mask)); }
+		static inline words	widen16(const uint8_t* a_lanes)				{ return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)a_lanes)); }
+
+		static inline void
+		narrow16(uint8_t* a_mask, words a_value)
+		{
+			_mm_storeu_si128((__m128i*)a_mask, _mm_packs_epi16(_mm256_castsi256_si128(a_value), _mm256_extracti128_si256(a_value, 1)));
+		}
+
+		static inline uint32_t
+		count16(words a_mask)
+		{
+			return (uint32_t)std::bitset<32>(_mm256_movemask_epi8(a_mask)).count() / 2;
+		}
+
+		static inline int
+		first16(words a_mask)
+		{
+			uint32_t my_bits = _mm256_movemask_epi8(a_mask);
+
+			for (int i = 0; i < 16; i++)
+				if (my_bits & (1u << (i * 2)))
+					return i;
+
+			return -1;
+		}
+
+		static inline uint16_t
+		reduce_max16(words a_value)
+		{
+			__m128i my_max = _mm_max_epu16(_mm256_castsi256_si128(a_value), _mm256_extracti128_si256(a_value, 1));
+
+			my_max = _mm_max_epu16(my_max, _mm_srli_si128(my_max, 8));
+			my_max = _mm_max_epu16(my_max, _mm_srli_si128(my_max, 4));
+			my_max = _mm_max_epu16(my_max, _mm_srli_si128(my_max, 2));
+
+			return (uint16_t)_mm_extract_epi16(my_max, 0);
+		}
+	};
+}
+
+#include "CLockstepLanes.h"
+
+void
+CLockstep::run_lanes_avx2(uint32_t a_count)
+{
+	run_lanes<SAvx2Lanes>(a_count);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+#endif
@@ -0,0 +1,492 @@
+#pragma once
+#include <string.h>
+#include <algorithm>
+#include "CLockstep.h"
+#include "CCPU.h"
+#include "COpcodes.h"
+#include "CRecompRuntime.h"
+
+/**
+	The lane kernels of CLockstep, written once over a set of lane operations TLanes and built twice: with plain
+	loops in CLockstep.cpp and with AVX2 in CLockstepAVX2.cpp. Only those two include this.
+
+	TLanes has the types bytes, 32 lanes of uint8_t, and words, 16 lanes of uint16_t, and static functions on them:
+	load8(), store8(), set8(), blend8() under a mask, the arithmetic and compares, and so on, see SPlainLanes in
+	CLockstep.cpp. Masks have every bit of a lane set or none.
+*/
+
+/**
+	Runs an_operation(first lane, mask) for every group of LANE_GROUP lanes with at least one lane in a_mask.
+*/
+template <typename TLanes, typename TOperation>
+static inline void
+for_groups(const std::vector<uint8_t>& a_mask, TOperation an_operation)
+{
+	typedef typename TLanes::bytes bytes;
+
+	for (size_t i = 0; i < a_mask.size(); i += CLockstep::LANE_GROUP)
+	{
+		bytes my_mask = TLanes::load8(&a_mask[i]);
+
+		if (TLanes::any8(my_mask))
+			an_operation(i, my_mask);
+	}
+}
+
+// The same for the word registers, 16 lanes at a time.
+template <typename TLanes, typename TOperation>
+static inline void
+for_word_groups(const std::vector<uint8_t>& a_mask, TOperation an_operation)
+{
+	typedef typename TLanes::words words;
+
+	for (size_t i = 0; i < a_mask.size(); i += CLockstep::LANE_GROUP / 2)
+	{
+		words my_mask = TLanes::mask16(&a_mask[i]);
+
+		if (TLanes::any16(my_mask))
+			an_operation(i, my_mask);
+	}
+}
+
+// And for every lane in a_mask on its own, for the opcodes that work on the rest of the SChip8State.
+template <typename TOperation>
+static inline void
+for_lanes(const std::vector<uint8_t>& a_mask, size_t an_instances, TOperation an_operation)
+{
+	for (size_t i = 0; i < an_instances; i++)
+		if (a_mask[i] != 0)
+			an_operation(i);
+}
+
+template <typename TLanes>
+void
+CLockstep::run_lanes(uint32_t a_count)
+{
+	// The lanes count their budget down in 16 bits.
+	for (uint32_t my_left = a_count; my_left > 0; )
+	{
+		uint16_t my_chunk = (uint16_t)std::min<uint32_t>(my_left, 0xffff);
+
+		std::fill(the_budget.begin(), the_budget.begin() + the_instances, my_chunk);
+
+		uint16_t	my_pc;
+		size_t		my_leader;
+
+		while (select<TLanes>(my_pc, my_leader))
+		{
+			uint16_t my_opcode;
+
+			the_instruction_count += group<TLanes>(my_pc, my_leader, my_opcode);
+			the_step_count++;
+
+			execute<TLanes>(my_pc, my_opcode);
+		}
+
+		my_left -= my_chunk;
+	}
+
+	for (size_t i = 0; i < the_lanes; i += LANE_GROUP)
+	{
+		TLanes::store8(&the_delay_timer[i], TLanes::dec8(TLanes::load8(&the_delay_timer[i])));
+		TLanes::store8(&the_sound_timer[i], TLanes::dec8(TLanes::load8(&the_sound_timer[i])));
+	}
+}
+
+template <typename TLanes>
+bool
+CLockstep::select(uint16_t& a_pc, size_t& a_leader)
+{
+	typedef typename TLanes::words words;
+
+	// The lane with the most budget left leads, the first of them.
+	words my_max = TLanes::set16(0);
+
+	for (size_t i = 0; i < the_lanes; i += LANE_GROUP / 2)
+		my_max = TLanes::max16(my_max, TLanes::load16(&the_budget[i]));
+
+	uint16_t my_budget = TLanes::reduce_max16(my_max);
+
+	if (my_budget == 0)
+		return false;
+
+	for (size_t i = 0; ; i += LANE_GROUP / 2)
+	{
+		int my_lane = TLanes::first16(TLanes::eq16(TLanes::load16(&the_budget[i]), TLanes::set16(my_budget)));
+
+		if (my_lane >= 0)
+		{
+			a_leader = i + my_lane;
+			break;
+		}
+	}
+
+	a_pc = the_pc[a_leader];
+
+	return true;
+}
+
+template <typename TLanes>
+uint32_t
+CLockstep::group(uint16_t a_pc, size_t a_leader, uint16_t& an_opcode)
+{
+	typedef typename TLanes::words words;
+
+	uint32_t my_count = 0;
+
+	// Every lane at a_pc with budget left runs this step and pays for it.
+	for (size_t i = 0; i < the_lanes; i += LANE_GROUP / 2)
+	{
+		words my_budget	= TLanes::load16(&the_budget[i]);
+		words my_mask	= TLanes::andnot16(TLanes::eq16(my_budget, TLanes::set16(0)), TLanes::eq16(TLanes::load16(&the_pc[i]), TLanes::set16(a_pc)));
+
+		TLanes::store16(&the_budget[i], TLanes::add16(my_budget, my_mask));
+		TLanes::narrow16(&the_mask[i], my_mask);
+
+		my_count += TLanes::count16(my_mask);
+	}
+
+	// Past the end of RAM nothing runs, like CMemory's the_outside. 0x0000 is an unknown opcode.
+	if (a_pc >= the_image.size() - 1)
+	{
+		an_opcode = 0x0000;
+		return my_count;
+	}
+
+	if (!the_written[a_pc] && !the_written[a_pc + 1])
+	{
+		an_opcode = the_image[a_pc] << 8 | the_image[a_pc + 1];
+		return my_count;
+	}
+
+	// Someone wrote here, lanes with another opcode than the leader's wait for a step of their own.
+	const uint8_t* my_memory = the_states[a_leader].the_memory;
+
+	an_opcode = my_memory[a_pc] << 8 | my_memory[a_pc + 1];
+
+	for (size_t i = 0; i < the_instances; i++)
+	{
+		const uint8_t* my_lane = the_states[i].the_memory;
+
+		if (the_mask[i] != 0 && (my_lane[a_pc] != my_memory[a_pc] || my_lane[a_pc + 1] != my_memory[a_pc + 1]))
+		{
+			the_mask[i] = 0;
+			the_budget[i]++;
+			my_count--;
+		}
+	}
+
+	return my_count;
+}
+
+template <typename TLanes>
+void
+CLockstep::execute(uint16_t a_pc, uint16_t an_opcode)
+{
+	typedef typename TLanes::bytes bytes;
+	typedef typename TLanes::words words;
+
+	if (a_pc >= the_image.size() - 1)
+		return;
+
+	uint8_t		x	= (an_opcode & 0x0f00) >> 8;
+	uint8_t		y	= (an_opcode & 0x00f0) >> 4;
+	uint8_t		kk	= an_opcode & 0x00ff;
+	uint16_t	nnn	= an_opcode & 0x0fff;
+
+	uint8_t*	my_V	= the_V.data();
+	size_t		my_row	= the_lanes;
+
+	// Vx, Vy and VF of the group starting at lane i.
+	auto Vx = [=](size_t i) { return my_V + x * my_row + i; };
+	auto Vy = [=](size_t i) { return my_V + y * my_row + i; };
+	auto VF = [=](size_t i) { return my_V + 0xf * my_row + i; };
+
+	switch (an_opcode & 0xf000)
+	{
+		case 0x0000:
+			if (kk == 0xe0)
+			{
+				for_lanes(the_mask, the_instances, [&](size_t i)
+				{
+					memset(the_states[i].the_screen, 0, sizeof(the_states[i].the_screen));
+				});
+				advance<TLanes>(a_pc, false);
+				return;
+			}
+
+			if (kk == 0xee)
+			{
+				// CALL pushed its own address.
+				for_lanes(the_mask, the_instances, [&](size_t i)
+				{
+					SChip8State& my_state = the_states[i];
+
+					my_state.the_sp--;
+					the_pc[i] = my_state.the_stack[my_state.the_sp & 0xf];
+				});
+				return;
+			}
+			break;
+
+		case 0x1000:
+			jump<TLanes>(nnn);
+			return;
+
+		case 0x2000:
+			for_lanes(the_mask, the_instances, [&](size_t i)
+			{
+				SChip8State& my_state = the_states[i];
+
+				my_state.the_stack[my_state.the_sp & 0xf] = a_pc;
+				my_state.the_sp++;
+			});
+			jump<TLanes>(nnn);
+			return;
+
+		case 0x3000:
+		case 0x4000:
+			for_groups<TLanes>(the_mask, [&](size_t i, bytes)
+			{
+				bytes my_equal = TLanes::eq8(TLanes::load8(Vx(i)), TLanes::set8(kk));
+
+				TLanes::store8(&the_condition[i], (an_opcode & 0xf000) == 0x3000 ? my_equal : TLanes::xor8(my_equal, TLanes::set8(0xff)));
+			});
+			advance<TLanes>(a_pc, true);
+			return;
+
+		case 0x5000:
+		case 0x9000:
+			for_groups<TLanes>(the_mask, [&](size_t i, bytes)
+			{
+				TLanes::store8(&the_condition[i], (an_opcode & 0xf000) == 0x5000 ? TLanes::eq8(TLanes::load8(Vx(i)), TLanes::load8(Vy(i))) : TLanes::ne8(TLanes::load8(Vx(i)), TLanes::load8(Vy(i))));
+			});
+			advance<TLanes>(a_pc, true);
+			return;
+
+		case 0x6000:
+			for_groups<TLanes>(the_mask, [&](size_t i, bytes a_mask)
+			{
+				TLanes::store8(Vx(i), TLanes::blend8(TLanes::load8(Vx(i)), TLanes::set8(kk), a_mask));
+			});
+			advance<TLanes>(a_pc, false);
+			return;
+
+		case 0x7000:
+			for_groups<TLanes>(the_mask, [&](size_t i, bytes a_mask)
+			{
+				bytes my_x = TLanes::load8(Vx(i));
+
+				TLanes::store8(Vx(i), TLanes::blend8(my_x, TLanes::add8(my_x, TLanes::set8(kk)), a_mask));
+			});
+			advance<TLanes>(a_pc, false);
+			return;
+
+		case 0x8000:
+		{
+			// In the order of COpcodes.h, where x or y may be F.
+			uint8_t my_operation = an_opcode & 0x000f;
+
+			if (my_operation > 0x7 && my_operation != 0xe)
+				break;
+
+			for_groups<TLanes>(the_mask, [&](size_t i, bytes a_mask)
+			{
+				bytes my_x = TLanes::load8(Vx(i));
+				bytes my_y = TLanes::load8(Vy(i));
+
+				switch (my_operation)
+				{
+					case 0x0: TLanes::store8(Vx(i), TLanes::blend8(my_x, my_y, a_mask)); break;
+					case 0x1: TLanes::store8(Vx(i), TLanes::blend8(my_x, TLanes::or8(my_x, my_y), a_mask)); break;
+					case 0x2: TLanes::store8(Vx(i), TLanes::blend8(my_x, TLanes::and8(my_x, my_y), a_mask)); break;
+					case 0x3: TLanes::store8(Vx(i), TLanes::blend8(my_x, TLanes::xor8(my_x, my_y), a_mask)); break;
+					case 0x4:
+					{
+						// VF is only ever set, never cleared.
+						bytes my_sum = TLanes::add8(my_x, my_y);
+
+						TLanes::store8(Vx(i), TLanes::blend8(my_x, my_sum, a_mask));
+						TLanes::store8(VF(i), TLanes::blend8(TLanes::load8(VF(i)), TLanes::set8(1), TLanes::and8(a_mask, TLanes::gt8(my_x, my_sum))));
+						break;
+					}
+					case 0x5:
+						TLanes::store8(VF(i), TLanes::blend8(TLanes::load8(VF(i)), TLanes::and8(TLanes::gt8(my_x, my_y), TLanes::set8(1)), a_mask));
+						my_x = TLanes::load8(Vx(i));
+						my_y = TLanes::load8(Vy(i));
+						TLanes::store8(Vx(i), TLanes::blend8(my_x, TLanes::sub8(my_x, my_y), a_mask));
+						break;
+					case 0x6:
+						TLanes::store8(VF(i), TLanes::blend8(TLanes::load8(VF(i)), TLanes::and8(my_y, TLanes::set8(1)), a_mask));
+						TLanes::store8(Vx(i), TLanes::blend8(TLanes::load8(Vx(i)), TLanes::shr8(my_x), a_mask));
+						break;
+					case 0x7:
+						TLanes::store8(VF(i), TLanes::blend8(TLanes::load8(VF(i)), TLanes::and8(TLanes::gt8(my_y, my_x), TLanes::set8(1)), a_mask));
+						my_x = TLanes::load8(Vx(i));
+						my_y = TLanes::load8(Vy(i));
+						TLanes::store8(Vx(i), TLanes::blend8(my_x, TLanes::sub8(my_y, my_x), a_mask));
+						break;
+					case 0xe:
+						TLanes::store8(VF(i), TLanes::blend8(TLanes::load8(VF(i)), TLanes::and8(my_y, TLanes::set8(8)), a_mask));
+						my_y = TLanes::load8(Vy(i));
+						TLanes::store8(Vx(i), TLanes::blend8(TLanes::load8(Vx(i)), TLanes::add8(my_y, my_y), a_mask));
+						break;
+				}
+			});
+			advance<TLanes>(a_pc, false);
+			return;
+		}
+
+		case 0xa000:
+			for_word_groups<TLanes>(the_mask, [&](size_t i, words a_mask)
+			{
+				TLanes::store16(&the_I[i], TLanes::blend16(TLanes::load16(&the_I[i]), TLanes::set16(nnn), a_mask));
+			});
+			advance<TLanes>(a_pc, false);
+			return;
+
+		case 0xd000:
+			// Straight from the lane arrays onto the lane's screen, the registers don't have to go over.
+			for_lanes(the_mask, the_instances, [&](size_t i)
+			{
+				CRecompRuntime::SBus my_bus = { the_states[i], nullptr };
+
+				*VF(i) = COpcodes::draw(the_states[i], my_bus, *Vx(i), *Vy(i), the_I[i], an_opcode & 0x000f) ? 1 : 0;
+			});
+			advance<TLanes>(a_pc, false);
+			return;
+
+		case 0xe000:
+			if (kk != 0x9e && kk != 0xa1)
+				break;
+
+			// Vx is a different key on every lane, try all 16. Keys past F are never down.
+			for_groups<TLanes>(the_mask, [&](size_t i, bytes)
+			{
+				bytes my_key	= TLanes::load8(Vx(i));
+				bytes my_down	= TLanes::set8(0);
+
+				for (int k = 0; k < 16; k++)
+					my_down = TLanes::or8(my_down, TLanes::and8(TLanes::eq8(my_key, TLanes::set8(k)), TLanes::eq8(TLanes::load8(&the_keys[k * my_row + i]), TLanes::set8(1))));
+
+				TLanes::store8(&the_condition[i], kk == 0x9e ? my_down : TLanes::xor8(my_down, TLanes::set8(0xff)));
+			});
+			advance<TLanes>(a_pc, true);
+			return;
+
+		case 0xf000:
+			switch (kk)
+			{
+				case 0x33:
+				case 0x55:
+				case 0x65:
+					// RAM is per lane, so is the copy. Past the end reads 0 and writes are dropped, like CMemory.
+					for_lanes(the_mask, the_instances, [&](size_t i)
+					{
+						uint8_t*	my_memory	= the_states[i].the_memory;
+						int			my_I		= the_I[i];
+						int			my_size		= (int)sizeof(the_states[i].the_memory);
+
+						if (kk == 0x65)
+						{
+							for (int r = 0; r <= x; r++)
+								my_V[r * my_row + i] = my_I + r < my_size ? my_memory[my_I + r] : 0;
+
+							return;
+						}
+
+						uint8_t my_bytes[16];
+						int		my_count = kk == 0x33 ? 3 : x + 1;
+
+						if (kk == 0x33)
+						{
+							uint8_t my_value = my_V[x * my_row + i];
+
+							my_bytes[0] = my_value / 100;
+							my_bytes[1] = (my_value / 10) % 10;
+							my_bytes[2] = my_value % 10;
+						}
+						else
+						{
+							for (int r = 0; r <= x; r++)
+								my_bytes[r] = my_V[r * my_row + i];
+						}
+
+						// Those bytes can't be fetched from the image any more.
+						mark_written(my_I, my_I + my_count);
+
+						for (int j = 0; j < my_count; j++)
+							if (my_I + j < my_size)
+								my_memory[my_I + j] = my_bytes[j];
+					});
+					advance<TLanes>(a_pc, false);
+					return;
+
+				case 0x07:
+					for_groups<TLanes>(the_mask, [&](size_t i, bytes a_mask)
+					{
+						TLanes::store8(Vx(i), TLanes::blend8(TLanes::load8(Vx(i)), TLanes::load8(&the_delay_timer[i]), a_mask));
+					});
+					advance<TLanes>(a_pc, false);
+					return;
+
+				case 0x15:
+				case 0x18:
+				{
+					uint8_t* my_timer = kk == 0x15 ? the_delay_timer.data() : the_sound_timer.data();
+
+					for_groups<TLanes>(the_mask, [&](size_t i, bytes a_mask)
+					{
+						TLanes::store8(my_timer + i, TLanes::blend8(TLanes::load8(my_timer + i), TLanes::load8(Vx(i)), a_mask));
+					});
+					advance<TLanes>(a_pc, false);
+					return;
+				}
+
+				case 0x1e:
+				case 0x29:
+					// Both truncate I to 8 bits, like COpcodes.h.
+					for_word_groups<TLanes>(the_mask, [&](size_t i, words a_mask)
+					{
+						words my_x = TLanes::widen16(Vx(i));
+						words my_I = kk == 0x1e ? TLanes::add16(TLanes::load16(&the_I[i]), my_x) : TLanes::mul16(my_x, TLanes::set16(0x05));
+
+						TLanes::store16(&the_I[i], TLanes::blend16(TLanes::load16(&the_I[i]), TLanes::and16(my_I, TLanes::set16(0xff)), a_mask));
+					});
+					advance<TLanes>(a_pc, false);
+					return;
+			}
+			break;
+	}
+
+	execute_lanes(an_opcode);
+}
+
+template <typename TLanes>
+void
+CLockstep::advance(uint16_t a_pc, bool a_condition)
+{
+	typedef typename TLanes::words words;
+
+	// Every lane of the step is at a_pc, the next PC is the same for all of them but for taken skips.
+	words my_next = TLanes::set16(a_pc + 2);
+
+	for_word_groups<TLanes>(the_mask, [&](size_t i, words a_mask)
+	{
+		words my_pc = a_condition ? TLanes::add16(my_next, TLanes::and16(TLanes::mask16(&the_condition[i]), TLanes::set16(2))) : my_next;
+
+		TLanes::store16(&the_pc[i], TLanes::blend16(TLanes::load16(&the_pc[i]), my_pc, a_mask));
+	});
+}
+
+template <typename TLanes>
+void
+CLockstep::jump(uint16_t an_address)
+{
+	typedef typename TLanes::words words;
+
+	for_word_groups<TLanes>(the_mask, [&](size_t i, words a_mask)
+	{
+		TLanes::store16(&the_pc[i], TLanes::blend16(TLanes::load16(&the_pc[i]), TLanes::set16(an_address), a_mask));
+	});
+}
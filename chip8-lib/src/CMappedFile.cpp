@@ -0,0 +1,116 @@
+#include "CMappedFile.h"
+#include <iostream>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CMappedFile::CMappedFile() :
+	the_data(nullptr),
+	the_size(0),
+	the_file(nullptr),
+	the_mapping(nullptr)
+{
+}
+
+CMappedFile::~CMappedFile()
+{
+	close();
+}
+
+bool
+CMappedFile::open(const std::string& a_file)
+{
+	close();
+
+#if defined(_WIN32)
+	HANDLE my_file = CreateFileA(a_file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	LARGE_INTEGER my_size;
+
+	if (my_file != INVALID_HANDLE_VALUE && GetFileSizeEx(my_file, &my_size) && my_size.QuadPart > 0)
+	{
+		HANDLE my_mapping = CreateFileMappingA(my_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+		if (my_mapping != nullptr)
+		{
+			the_data = static_cast<const uint8_t*>(MapViewOfFile(my_mapping, FILE_MAP_READ, 0, 0, 0));
+
+			if (the_data != nullptr)
+			{
+				the_size	= (size_t)my_size.QuadPart;
+				the_file	= my_file;
+				the_mapping	= my_mapping;
+				return true;
+			}
+
+			CloseHandle(my_mapping);
+		}
+	}
+
+	if (my_file != INVALID_HANDLE_VALUE)
+		CloseHandle(my_file);
+#else
+	// The mapping holds on to the file, the descriptor isn't needed past mmap().
+	int			my_file = ::open(a_file.c_str(), O_RDONLY);
+	struct stat	my_stat;
+
+	if (my_file >= 0 && fstat(my_file, &my_stat) == 0 && my_stat.st_size > 0)
+	{
+		void* my_data = mmap(nullptr, (size_t)my_stat.st_size, PROT_READ, MAP_PRIVATE, my_file, 0);
+
+		if (my_data != MAP_FAILED)
+		{
+			the_data = static_cast<const uint8_t*>(my_data);
+			the_size = (size_t)my_stat.st_size;
+		}
+	}
+
+	if (my_file >= 0)
+		::close(my_file);
+
+	if (the_data != nullptr)
+		return true;
+#endif
+
+	std::cerr << "Unable to map " << a_file << "\n";
+	return false;
+}
+
+void
+CMappedFile::close()
+{
+	if (the_data == nullptr)
+		return;
+
+#if defined(_WIN32)
+	UnmapViewOfFile(the_data);
+	CloseHandle(the_mapping);
+	CloseHandle(the_file);
+#else
+	munmap(const_cast<uint8_t*>(the_data), the_size);
+#endif
+
+	the_data	= nullptr;
+	the_size	= 0;
+	the_file	= nullptr;
+	the_mapping	= nullptr;
+}
+
+const uint8_t*
+CMappedFile::get_data()
+{
+	return the_data;
+}
+
+size_t
+CMappedFile::get_size()
+{
+	return the_size;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/**
+	A file mapped read only into memory, for as long as the object lives or until close(). The pages are read in as
+	they are touched, opening a large file costs the same as a small one.
+*/
+class CMappedFile
+{
+	public:
+		CMappedFile();
+		~CMappedFile();
+
+		CMappedFile(const CMappedFile&) = delete;
+		CMappedFile& operator=(const CMappedFile&) = delete;
+
+		bool			open(const std::string& a_file);
+		void			close();
+
+		const uint8_t*	get_data();
+		size_t			get_size();
+
+	private:
+		const uint8_t*	the_data;
+		size_t			the_size;
+
+		// The handles the mapping needs to be kept open on Windows.
+		void*			the_file;
+		void*			the_mapping;
+};
@@ -1,40 +1,142 @@
 #include "CMemory.h"
+#include <string.h>
+#include <algorithm>
 
-CMemory::CMemory()
+CMemory::CMemory(SChip8State& a_state) :
+	the_state(a_state)
 {
-	// Initialise our memory to 0.
-	the_memory = {};
+	// The RAM lives in the state, nothing is decoded yet.
+	the_decoded = {};
+	the_code = {};
+
+	the_outside = {};
+	the_outside.the_handler	= COpcodeTable::get_handler(0x0000);
+	the_outside.the_idiom	= CFusion::NO_IDIOM;
 }
 
 void
 CMemory::load_data(std::vector<uint8_t> a_data)
 {
-	for (int i = 0; i < a_data.size(); i++)
-		set_byte(0x200 + i, a_data[i]);
+	// set_bytes invalidates the decoded entries the ROM covers.
+	set_bytes(0x200, a_data.data(), (int)a_data.size());
 }
 
 uint8_t
 CMemory::get_byte(int an_index)
 {
-	return the_memory[an_index];
+	// I can point up to 15 bytes past the end, that reads as 0 instead of whatever follows in the state.
+	return an_index >= 0 && an_index < (int)sizeof(the_state.the_memory) ? the_state.the_memory[an_index] : 0;
 }
 
 void
 CMemory::set_byte(int an_index, uint8_t a_value)
 {
-	the_memory[an_index] = a_value;
+	// And writes there are dropped.
+	if (an_index < 0 || an_index >= (int)sizeof(the_state.the_memory))
+		return;
+
+	the_state.the_memory[an_index] = a_value;
+	invalidate(an_index, an_index + 1);
+
+	if (the_code[an_index] && the_code_write_hook)
+		the_code_write_hook(an_index);
+}
+
+void
+CMemory::set_bytes(int an_index, const uint8_t* some_bytes, int a_count)
+{
+	// Like set_byte() for every one of them, but the decode cache is invalidated once for all.
+	int my_begin	= std::max(an_index, 0);
+	int my_end		= std::min(an_index + a_count, (int)sizeof(the_state.the_memory));
+
+	if (my_begin >= my_end)
+		return;
+
+	memcpy(the_state.the_memory + my_begin, some_bytes + (my_begin - an_index), my_end - my_begin);
+	invalidate(my_begin, my_end);
+
+	// The hook unmarks what it drops, so a translated block is only reported once.
+	if (!the_code_write_hook)
+		return;
+
+	for (int i = my_begin; i < my_end; i++)
+	{
+		if (the_code[i])
+			the_code_write_hook(i);
+	}
 }
 
 uint16_t
 CMemory::get_opcode(int a_program_counter)
 {
 	// Fetch the opcode.
-	return the_memory[a_program_counter] << 8 | the_memory[a_program_counter + 1];
+	return get_byte(a_program_counter) << 8 | get_byte(a_program_counter + 1);
+}
+
+const CMemory::SDecoded&
+CMemory::get_decoded(int a_program_counter)
+{
+	// Past the last whole instruction there's nothing to run, the machine stops like on an unknown opcode.
+	if (a_program_counter < 0 || a_program_counter >= (int)sizeof(the_state.the_memory) - 1)
+		return the_outside;
+
+	SDecoded& my_decoded = the_decoded[a_program_counter];
+
+	// Decode on first use, and again after the code has been written to.
+	if (my_decoded.the_handler == nullptr)
+	{
+		my_decoded.the_opcode	= get_opcode(a_program_counter);
+		my_decoded.the_handler	= COpcodeTable::get_handler(my_decoded.the_opcode);
+
+		// Look for a sequence to fuse, in the bytes that are there.
+		uint16_t my_second	= a_program_counter + 3 < (int)sizeof(the_state.the_memory) ? get_opcode(a_program_counter + 2) : 0;
+		uint16_t my_third	= a_program_counter + 5 < (int)sizeof(the_state.the_memory) ? get_opcode(a_program_counter + 4) : 0;
+
+		CFusion::EIdiom my_idiom = CFusion::match(my_decoded.the_opcode, my_second, my_third);
+
+		my_decoded.the_fused_handler	= CFusion::get_handler(my_idiom);
+		my_decoded.the_fused_opcodes[0]	= my_second;
+		my_decoded.the_fused_opcodes[1]	= my_third;
+		my_decoded.the_idiom			= my_idiom;
+	}
+
+	return my_decoded;
 }
 
 size_t
 CMemory::get_size()
 {
-	return the_memory.size();
+	return sizeof(the_state.the_memory);
+}
+
+void
+CMemory::set_code_write_hook(code_write_hook a_hook)
+{
+	the_code_write_hook = a_hook;
+}
+
+void
+CMemory::mark_code(int a_begin, int an_end, bool a_state)
+{
+	for (int i = a_begin; i < an_end && i < (int)the_code.size(); i++)
+		the_code[i] = a_state;
+}
+
+void
+CMemory::invalidate_all()
+{
+	// For when the whole state has been copied in from somewhere else.
+	for (SDecoded& my_decoded : the_decoded)
+		my_decoded.the_handler = nullptr;
 }
 
+void
+CMemory::invalidate(int a_begin, int an_end)
+{
+	// A byte is part of the instruction starting at it and of the one starting just before it, and of every fused
+	// sequence starting up to a whole sequence before it.
+	int my_first = a_begin - (int)(2 * CFusion::MAX_LENGTH - 1);
+
+	for (int i = my_first > 0 ? my_first : 0; i < an_end; i++)
+		the_decoded[i].the_handler = nullptr;
+}
@@ -1,18 +1,51 @@
 #pragma once
 #include <array>
 #include <vector>
+#include <functional>
+#include "COpcodeTable.h"
+#include "CFusion.h"
+#include "SChip8State.h"
 
 class CMemory {
 	public:
-		CMemory();
+		// A pre-decoded instruction, one per address (even and odd, ROMs may jump to either).
+		struct SDecoded
+		{
+			opcode_handler	the_handler;	// nullptr when the entry needs decoding.
+			uint16_t		the_opcode;		// The operands, handlers have them baked in already.
+
+			// Set when this instruction starts a sequence CFusion knows, the opcodes after the first come along.
+			CFusion::fused_handler	the_fused_handler;
+			uint16_t				the_fused_opcodes[2];
+			uint8_t					the_idiom;
+		};
+
+		// Called when a byte marked as code gets written to, with the index of that byte.
+		typedef std::function<void(int)> code_write_hook;
+
+		CMemory(SChip8State& a_state);
 		~CMemory() = default;
 
-		void		load_data(std::vector<uint8_t> a_data);
-		uint8_t		get_byte(int an_index);
-		void		set_byte(int an_index, uint8_t a_value);
-		uint16_t	get_opcode(int a_program_counter);
-		size_t		get_size();
+		void			load_data(std::vector<uint8_t> a_data);
+		uint8_t			get_byte(int an_index);
+		void			set_byte(int an_index, uint8_t a_value);
+		void			set_bytes(int an_index, const uint8_t* some_bytes, int a_count);
+		uint16_t		get_opcode(int a_program_counter);
+		const SDecoded&	get_decoded(int a_program_counter);
+		size_t			get_size();
+
+		void			set_code_write_hook(code_write_hook a_hook);
+		void			mark_code(int a_begin, int an_end, bool a_state);
+		void			invalidate_all();
 		
 	private:
-		std::array<uint8_t, 4096>	the_memory;
-};
\ No newline at end of file
+		void			invalidate(int a_begin, int an_end);
+
+		SChip8State&				the_state;
+		std::array<SDecoded, 4096>	the_decoded;
+		SDecoded					the_outside;
+
+		// Bytes something (the JIT) has translated, writes to them go to the hook.
+		std::array<bool, 4096>		the_code;
+		code_write_hook				the_code_write_hook;
+};
@@ -0,0 +1,581 @@
+#include "CMovie.h"
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include "CCPU.h"
+#include "CGraphics.h"
+#include "CKeyboard.h"
+#include "CMemory.h"
+#include "CRecompRuntime.h"
+
+static const char MOVIE_MAGIC[4] = { 'C', '8', 'M', 'V' };
+
+// The trailer: keyframe count, interval, checksum over the index and those two, "C8KI".
+static const uint32_t	KEYFRAME_MAGIC	= 0x494b3843;
+static const size_t		TRAILER_SIZE	= 16;
+
+static void
+put_varint(std::vector<uint8_t>& some_bytes, uint64_t a_value)
+{
+	// Seven bits at a time, lowest first, the top bit says more follow.
+	while (a_value >= 0x80)
+	{
+		some_bytes.push_back((uint8_t)(a_value | 0x80));
+		a_value >>= 7;
+	}
+
+	some_bytes.push_back((uint8_t)a_value);
+}
+
+static bool
+take_varint(const uint8_t*& a_bytes, const uint8_t* an_end, uint64_t& a_value)
+{
+	a_value = 0;
+
+	for (int my_shift = 0; my_shift < 64; my_shift += 7)
+	{
+		if (a_bytes == an_end)
+			return false;
+
+		uint8_t my_byte = *a_bytes++;
+		a_value |= (uint64_t)(my_byte & 0x7f) << my_shift;
+
+		if ((my_byte & 0x80) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+CMovie::CMovie() :
+	the_rom_size(0),
+	the_rom_hash(0),
+	the_seed(0),
+	the_clock_rate(0),
+	the_frames(0),
+	the_final_hash(0),
+	the_keys(),
+	the_keyframe_interval(0),
+	the_mapped_keyframes(nullptr),
+	the_mapped_count(0),
+	the_mapped_bytes(nullptr)
+{
+	static_assert(sizeof(SKeyframe) == 16, "the index is read where it lies");
+}
+
+void
+CMovie::begin(const SChip8State& a_state, const SSnapshotClock& a_clock, size_t a_rom_size, uint32_t a_keyframe_interval)
+{
+	// From a machine right after its reset, the ROM is still as it was loaded.
+	the_rom_size	= (uint32_t)std::min<size_t>(a_rom_size, sizeof(a_state.the_memory) - 0x200);
+	the_rom_hash	= hash(a_state.the_memory + 0x200, the_rom_size);
+	the_seed		= a_state.the_random;
+	the_clock_rate	= a_clock.the_clock_rate;
+	the_frames		= 0;
+	the_final_hash	= 0;
+
+	the_inputs.clear();
+	memset(the_keys, 0, sizeof(the_keys));
+
+	the_file.close();
+	the_mapped_keyframes	= nullptr;
+	the_mapped_count		= 0;
+	the_mapped_bytes		= nullptr;
+
+	the_keyframe_interval = a_keyframe_interval;
+	the_keyframes.clear();
+	the_keyframe_bytes.clear();
+	the_image.assign(a_state.the_memory, a_state.the_memory + sizeof(a_state.the_memory));
+
+	// Keys held from the start go in at frame 0, and so does the first keyframe.
+	record(a_state, a_clock);
+}
+
+void
+CMovie::record(const SChip8State& a_state, const SSnapshotClock& a_clock)
+{
+	uint64_t my_frame = a_clock.the_frame_count;
+
+	for (uint8_t i = 0; i < 16; i++)
+	{
+		uint8_t my_state = a_state.the_keys[i] != 0 ? 1 : 0;
+
+		if (my_state != the_keys[i])
+		{
+			the_inputs.push_back({ my_frame, i, my_state });
+			the_keys[i] = my_state;
+		}
+	}
+
+	// After the keys, a keyframe has the ones the next frame runs with.
+	if (the_keyframe_interval == 0 || my_frame % the_keyframe_interval != 0)
+		return;
+
+	size_t my_offset = the_keyframe_bytes.size();
+
+	the_keyframe_bytes.resize(my_offset + CSnapshot::MAX_SIZE);
+
+	size_t my_size = CSnapshot::save(a_state, a_clock, the_keyframe_bytes.data() + my_offset, CSnapshot::MAX_SIZE, the_image.data());
+
+	the_keyframe_bytes.resize(my_offset + my_size);
+	the_keyframes.push_back({ my_frame, (uint32_t)my_offset, (uint32_t)my_size });
+}
+
+void
+CMovie::end(const SChip8State& a_state, uint64_t a_frame)
+{
+	the_frames		= a_frame;
+	the_final_hash	= CRecompRuntime::hash(a_state);
+}
+
+bool
+CMovie::replay(CCPU& a_cpu, CKeyboard& a_keyboard)
+{
+	// The machine has to be reset with the ROM loaded, the movie sets everything else.
+	if (hash(a_cpu.get_state().the_memory + 0x200, the_rom_size) != the_rom_hash || a_cpu.get_frame_count() != 0)
+		return false;
+
+	a_cpu.set_seed(the_seed);
+	a_cpu.set_clock_rate(the_clock_rate);
+
+	size_t my_input = 0;
+
+	// The keys of a frame go in before it runs: at the end of the one before, or now for the first.
+	auto my_feed = [this, &a_keyboard, &my_input](uint64_t a_frame)
+	{
+		for (; my_input < the_inputs.size() && the_inputs[my_input].the_frame <= a_frame; my_input++)
+			a_keyboard.set_key_state(the_inputs[my_input].the_key, the_inputs[my_input].the_state);
+	};
+
+	for (int i = 0; i < 16; i++)
+		a_keyboard.set_key_state(i, 0);
+
+	my_feed(0);
+
+	a_cpu.set_frame_hook([&my_feed](CCPU& a_running) { my_feed(a_running.get_frame_count()); });
+	a_cpu.set_turbo(true);
+	a_cpu.set_frame_limit(the_frames);
+
+	if (the_frames > 0)
+		a_cpu.start();
+
+	a_cpu.set_frame_hook(nullptr);
+	a_cpu.set_frame_limit(0);
+
+	return a_cpu.get_frame_count() == the_frames && CRecompRuntime::hash(a_cpu.get_state()) == the_final_hash;
+}
+
+bool
+CMovie::seek(CCPU& a_cpu, CKeyboard& a_keyboard, uint64_t a_frame, const uint8_t* an_image)
+{
+	const SKeyframe*	my_first	= get_keyframes();
+	const SKeyframe*	my_last		= my_first + get_keyframe_count();
+
+	if (a_frame > the_frames || hash(an_image + 0x200, the_rom_size) != the_rom_hash)
+		return false;
+
+	// The last keyframe at or before the frame.
+	const SKeyframe* my_keyframe = std::upper_bound(my_first, my_last, a_frame,
+		[](uint64_t a_value, const SKeyframe& a_keyframe) { return a_value < a_keyframe.the_frame; });
+
+	if (my_keyframe == my_first || !start_at(my_keyframe - 1 - my_first, a_cpu, an_image))
+		return false;
+
+	run_to(a_cpu, a_keyboard, a_frame);
+
+	return true;
+}
+
+bool
+CMovie::check_segment(size_t an_index, const uint8_t* an_image)
+{
+	size_t my_count = get_keyframe_count();
+
+	if (an_index >= my_count || hash(an_image + 0x200, the_rom_size) != the_rom_hash)
+		return false;
+
+	// The decode cache makes CMemory too big for a worker's stack.
+	std::unique_ptr<SChip8State>	my_state(new SChip8State());
+	std::unique_ptr<CMemory>		my_memory(new CMemory(*my_state));
+	CGraphics						my_graphics(*my_state);
+	CKeyboard						my_keyboard(*my_state);
+	CCPU							my_cpu(*my_state, my_memory.get(), &my_graphics);
+
+	my_cpu.set_trace(false);
+
+	if (!start_at(an_index, my_cpu, an_image))
+		return false;
+
+	// The last segment runs to the end of the movie and has its final hash to match.
+	if (an_index + 1 == my_count)
+	{
+		run_to(my_cpu, my_keyboard, the_frames);
+
+		return my_cpu.get_frame_count() == the_frames && CRecompRuntime::hash(*my_state) == the_final_hash;
+	}
+
+	const SKeyframe&				my_next = get_keyframes()[an_index + 1];
+	std::unique_ptr<SChip8State>	my_expected(new SChip8State());
+	SSnapshotClock					my_expected_clock;
+
+	if (!CSnapshot::load(*my_expected, my_expected_clock, get_keyframe_bytes() + my_next.the_offset, my_next.the_size, an_image))
+		return false;
+
+	run_to(my_cpu, my_keyboard, my_next.the_frame);
+
+	SSnapshotClock my_clock = my_cpu.get_clock();
+
+	return my_clock.the_frame_count == my_expected_clock.the_frame_count && my_clock.the_clock_credit == my_expected_clock.the_clock_credit
+		&& memcmp(my_state.get(), my_expected.get(), offsetof(SChip8State, the_memory) + sizeof(SChip8State::the_memory)) == 0;
+}
+
+void
+CMovie::write(std::vector<uint8_t>& some_bytes)
+{
+	some_bytes.assign(MOVIE_MAGIC, MOVIE_MAGIC + sizeof(MOVIE_MAGIC));
+
+	put_varint(some_bytes, VERSION);
+	put_varint(some_bytes, the_rom_size);
+	put_varint(some_bytes, the_rom_hash);
+	put_varint(some_bytes, the_seed);
+	put_varint(some_bytes, the_clock_rate);
+	put_varint(some_bytes, the_frames);
+	put_varint(some_bytes, the_final_hash);
+	put_varint(some_bytes, the_inputs.size());
+
+	uint64_t my_frame = 0;
+
+	// A change always flips its key, whether it went down or up doesn't need storing.
+	for (const SBatchInput& my_input : the_inputs)
+	{
+		put_varint(some_bytes, (my_input.the_frame - my_frame) << 4 | my_input.the_key);
+		my_frame = my_input.the_frame;
+	}
+
+	put_varint(some_bytes, hash(some_bytes.data(), some_bytes.size()));
+
+	size_t my_count = get_keyframe_count();
+
+	if (my_count == 0)
+		return;
+
+	const uint8_t* my_bytes = get_keyframe_bytes();
+	const SKeyframe* my_keyframes = get_keyframes();
+
+	some_bytes.insert(some_bytes.end(), my_bytes, my_bytes + my_keyframes[my_count - 1].the_offset + my_keyframes[my_count - 1].the_size);
+	some_bytes.resize((some_bytes.size() + 7) & ~(size_t)7, 0);
+
+	size_t		my_index		= some_bytes.size();
+	size_t		my_index_size	= my_count * sizeof(SKeyframe);
+	uint32_t	my_trailer[4]	= { (uint32_t)my_count, the_keyframe_interval, 0, KEYFRAME_MAGIC };
+
+	some_bytes.resize(my_index + my_index_size + TRAILER_SIZE);
+	memcpy(some_bytes.data() + my_index, my_keyframes, my_index_size);
+	memcpy(some_bytes.data() + my_index + my_index_size, my_trailer, 8);
+
+	my_trailer[2] = CSnapshot::checksum(some_bytes.data() + my_index, my_index_size + 8);
+	memcpy(some_bytes.data() + my_index + my_index_size, my_trailer, TRAILER_SIZE);
+}
+
+bool
+CMovie::read(const uint8_t* some_bytes, size_t a_size)
+{
+	return read(some_bytes, a_size, false);
+}
+
+bool
+CMovie::read(const uint8_t* some_bytes, size_t a_size, bool a_mapped)
+{
+	const uint8_t*	my_in	= some_bytes;
+	const uint8_t*	my_end	= some_bytes + a_size;
+	uint64_t		my_fields[8];
+
+	if (a_size < sizeof(MOVIE_MAGIC) || memcmp(some_bytes, MOVIE_MAGIC, sizeof(MOVIE_MAGIC)) != 0)
+		return false;
+
+	my_in += sizeof(MOVIE_MAGIC);
+
+	for (uint64_t& my_field : my_fields)
+	{
+		if (!take_varint(my_in, my_end, my_field))
+			return false;
+	}
+
+	// Every change takes a byte at least.
+	if (my_fields[0] != VERSION || my_fields[1] > sizeof(SChip8State::the_memory) - 0x200 || my_fields[4] > UINT32_MAX
+		|| my_fields[7] > (uint64_t)(my_end - my_in))
+		return false;
+
+	std::vector<SBatchInput>	my_inputs((size_t)my_fields[7]);
+	uint64_t					my_frame	= 0;
+	uint8_t						my_keys[16]	= {};
+
+	for (SBatchInput& my_input : my_inputs)
+	{
+		uint64_t my_change;
+
+		if (!take_varint(my_in, my_end, my_change) || (my_change >> 4) > UINT64_MAX - my_frame)
+			return false;
+
+		my_frame += my_change >> 4;
+
+		my_input.the_frame	= my_frame;
+		my_input.the_key	= (uint8_t)(my_change & 0xf);
+		my_input.the_state	= my_keys[my_input.the_key] ^= 1;
+	}
+
+	uint64_t my_checksum	= hash(some_bytes, my_in - some_bytes);
+	uint64_t my_stored;
+
+	if (!take_varint(my_in, my_end, my_stored) || my_stored != my_checksum)
+		return false;
+
+	// What's left, if anything, is keyframes and their index. The blobs check themselves when they're loaded.
+	const uint8_t*	my_keyframe_bytes	= my_in;
+	const uint8_t*	my_index			= my_end;
+	uint32_t		my_trailer[4]		= {};
+
+	if (my_in != my_end)
+	{
+		if ((size_t)(my_end - my_in) < TRAILER_SIZE)
+			return false;
+
+		memcpy(my_trailer, my_end - TRAILER_SIZE, TRAILER_SIZE);
+
+		uint64_t my_index_size = (uint64_t)my_trailer[0] * sizeof(SKeyframe);
+
+		if (my_trailer[3] != KEYFRAME_MAGIC || my_trailer[1] == 0 || my_index_size > (uint64_t)(my_end - my_in) - TRAILER_SIZE)
+			return false;
+
+		my_index = my_end - TRAILER_SIZE - my_index_size;
+
+		if ((my_index - some_bytes) % 8 != 0 || CSnapshot::checksum(my_index, (size_t)my_index_size + 8) != my_trailer[2])
+			return false;
+
+		uint64_t my_keyframe_frame = 0;
+
+		for (uint32_t i = 0; i < my_trailer[0]; i++)
+		{
+			SKeyframe my_keyframe;
+			memcpy(&my_keyframe, my_index + i * sizeof(SKeyframe), sizeof(SKeyframe));
+
+			// In the blobs, and in order of their frames.
+			if ((uint64_t)my_keyframe.the_offset + my_keyframe.the_size > (uint64_t)(my_index - my_keyframe_bytes)
+				|| my_keyframe.the_frame > my_fields[5] || (i > 0 && my_keyframe.the_frame <= my_keyframe_frame))
+				return false;
+
+			my_keyframe_frame = my_keyframe.the_frame;
+		}
+	}
+
+	the_rom_size	= (uint32_t)my_fields[1];
+	the_rom_hash	= my_fields[2];
+	the_seed		= my_fields[3];
+	the_clock_rate	= (uint32_t)my_fields[4];
+	the_frames		= my_fields[5];
+	the_final_hash	= my_fields[6];
+	the_inputs.swap(my_inputs);
+
+	the_keyframe_interval	= my_trailer[1];
+	the_image.clear();
+
+	if (a_mapped)
+	{
+		the_mapped_keyframes	= reinterpret_cast<const SKeyframe*>(my_index);
+		the_mapped_count		= my_trailer[0];
+		the_mapped_bytes		= my_keyframe_bytes;
+
+		the_keyframes.clear();
+		the_keyframe_bytes.clear();
+	}
+	else
+	{
+		the_file.close();
+		the_mapped_keyframes	= nullptr;
+		the_mapped_count		= 0;
+		the_mapped_bytes		= nullptr;
+
+		the_keyframes.resize(my_trailer[0]);
+		memcpy(the_keyframes.data(), my_index, the_keyframes.size() * sizeof(SKeyframe));
+		the_keyframe_bytes.assign(my_keyframe_bytes, my_index);
+	}
+
+	return true;
+}
+
+bool
+CMovie::save(const std::string& a_file)
+{
+	std::vector<uint8_t>	my_bytes;
+	std::ofstream			my_file(a_file, std::ios::binary);
+
+	write(my_bytes);
+
+	if (!my_file.write(reinterpret_cast<const char*>(my_bytes.data()), my_bytes.size()))
+	{
+		std::cerr << "Unable to write " << a_file << "\n";
+		return false;
+	}
+
+	return true;
+}
+
+bool
+CMovie::load(const std::string& a_file)
+{
+	std::ifstream my_file(a_file, std::ios::binary | std::ios::ate);
+
+	if (!my_file)
+	{
+		std::cerr << "Unable to load " << a_file << "\n";
+		return false;
+	}
+
+	std::vector<uint8_t> my_bytes((size_t)my_file.tellg());
+	my_file.seekg(0, std::ios::beg);
+	my_file.read(reinterpret_cast<char*>(my_bytes.data()), my_bytes.size());
+
+	if (!read(my_bytes.data(), my_bytes.size()))
+	{
+		std::cerr << "Bad movie in " << a_file << "\n";
+		return false;
+	}
+
+	return true;
+}
+
+bool
+CMovie::map(const std::string& a_file)
+{
+	// What the movie held may lie in the file mapped before, it goes along with it.
+	the_mapped_keyframes	= nullptr;
+	the_mapped_count		= 0;
+	the_mapped_bytes		= nullptr;
+	the_keyframes.clear();
+	the_keyframe_bytes.clear();
+	the_inputs.clear();
+	the_frames				= 0;
+
+	if (!the_file.open(a_file))
+		return false;
+
+	if (!read(the_file.get_data(), the_file.get_size(), true))
+	{
+		std::cerr << "Bad movie in " << a_file << "\n";
+		the_file.close();
+		return false;
+	}
+
+	return true;
+}
+
+uint64_t
+CMovie::get_rom_hash()
+{
+	return the_rom_hash;
+}
+
+uint64_t
+CMovie::get_seed()
+{
+	return the_seed;
+}
+
+uint32_t
+CMovie::get_clock_rate()
+{
+	return the_clock_rate;
+}
+
+uint64_t
+CMovie::get_frame_count()
+{
+	return the_frames;
+}
+
+uint64_t
+CMovie::get_final_hash()
+{
+	return the_final_hash;
+}
+
+uint64_t
+CMovie::get_keyframe_frame(size_t an_index)
+{
+	return get_keyframes()[an_index].the_frame;
+}
+
+uint32_t
+CMovie::get_keyframe_interval()
+{
+	return the_keyframe_interval;
+}
+
+size_t
+CMovie::get_keyframe_count()
+{
+	return the_mapped_keyframes != nullptr ? the_mapped_count : the_keyframes.size();
+}
+
+bool
+CMovie::start_at(size_t an_index, CCPU& a_cpu, const uint8_t* an_image)
+{
+	const SKeyframe&	my_keyframe = get_keyframes()[an_index];
+	SChip8State			my_state;
+	SSnapshotClock		my_clock;
+
+	if (!CSnapshot::load(my_state, my_clock, get_keyframe_bytes() + my_keyframe.the_offset, my_keyframe.the_size, an_image))
+		return false;
+
+	a_cpu.restore_state(my_state, my_clock);
+
+	return true;
+}
+
+void
+CMovie::run_to(CCPU& a_cpu, CKeyboard& a_keyboard, uint64_t a_frame)
+{
+	// The keys of the frame it's at are in the machine already, the ones after go in at the end of theirs.
+	auto my_input = std::upper_bound(the_inputs.begin(), the_inputs.end(), a_cpu.get_frame_count(),
+		[](uint64_t a_value, const SBatchInput& an_input) { return a_value < an_input.the_frame; });
+
+	while (a_cpu.get_frame_count() < a_frame)
+	{
+		a_cpu.run_frame();
+
+		for (; my_input != the_inputs.end() && my_input->the_frame <= a_cpu.get_frame_count(); ++my_input)
+			a_keyboard.set_key_state(my_input->the_key, my_input->the_state);
+	}
+}
+
+const CMovie::SKeyframe*
+CMovie::get_keyframes()
+{
+	return the_mapped_keyframes != nullptr ? the_mapped_keyframes : the_keyframes.data();
+}
+
+const uint8_t*
+CMovie::get_keyframe_bytes()
+{
+	return the_mapped_keyframes != nullptr ? the_mapped_bytes : the_keyframe_bytes.data();
+}
+
+const std::vector<SBatchInput>&
+CMovie::get_inputs()
+{
+	return the_inputs;
+}
+
+uint64_t
+CMovie::hash(const uint8_t* some_bytes, size_t a_size)
+{
+	// FNV-1a.
+	uint64_t my_hash = 0xcbf29ce484222325ull;
+
+	for (size_t i = 0; i < a_size; i++)
+		my_hash = (my_hash ^ some_bytes[i]) * 0x100000001b3ull;
+
+	return my_hash;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "CBatch.h"
+#include "CMappedFile.h"
+#include "CSnapshot.h"
+#include "SChip8State.h"
+
+class CCPU;
+class CKeyboard;
+
+/**
+	A session as its inputs: which ROM, the seed and clock rate it ran with, every key change and the frame it came
+	in, and the hash of the state it ended in (see CRecompRuntime::hash()). Played back from a reset machine, the
+	same inputs at the same frames end in that same state.
+
+	Recording starts with begin() on the reset machine, then record() at the end of every frame (from the frame hook
+	of CCPU, say) and end() after the last one. Keys have to change between frames for their frame to be exact.
+	replay() runs it in turbo and feeds the keys back in at the same frame ends.
+
+	With a keyframe interval the machine is also kept whole every that many frames, as a CSnapshot against the RAM of
+	the reset machine. seek() then gets to any frame from the keyframe at or before it, running less than an interval.
+
+	The file is "C8MV" and the rest as varints, byte order doesn't matter: version, ROM size and hash, seed, clock
+	rate, frames, final hash, the number of key changes and the changes themselves, then a checksum. A change is the
+	frames since the one before it and the key in one varint, the key flips, most take a byte or two.
+
+	Keyframes go after that, in the byte order of the host like the snapshots are. Then the index, 8 byte aligned:
+	frame, offset and size of every keyframe, and a trailer at the very end with their count, the interval, a checksum
+	over the index and "C8KI". map() maps a file and reads the index where it lies, keyframes are only touched by the
+	seeks that need them.
+*/
+class CMovie
+{
+	public:
+		static const uint32_t	VERSION		= 1;
+
+		CMovie();
+		~CMovie() = default;
+
+		void		begin(const SChip8State& a_state, const SSnapshotClock& a_clock, size_t a_rom_size, uint32_t a_keyframe_interval = 0);
+		void		record(const SChip8State& a_state, const SSnapshotClock& a_clock);
+		void		end(const SChip8State& a_state, uint64_t a_frame);
+		bool		replay(CCPU& a_cpu, CKeyboard& a_keyboard);
+
+		// The machine as it was at the end of a_frame, with the keys it had then. an_image is the RAM of a machine
+		// reset with the ROM loaded, a_cpu can be anywhere. False when there's no keyframe to start from.
+		bool		seek(CCPU& a_cpu, CKeyboard& a_keyboard, uint64_t a_frame, const uint8_t* an_image);
+
+		// Runs from keyframe an_index to the next on a machine of its own, true when it ends in that keyframe (in the
+		// final hash, for the last). Any number of segments can be checked at once, see CBatch::verify().
+		bool		check_segment(size_t an_index, const uint8_t* an_image);
+
+		void		write(std::vector<uint8_t>& some_bytes);
+		bool		read(const uint8_t* some_bytes, size_t a_size);
+		bool		save(const std::string& a_file);
+		bool		load(const std::string& a_file);
+		bool		map(const std::string& a_file);
+
+		uint64_t	get_rom_hash();
+		uint64_t	get_seed();
+		uint32_t	get_clock_rate();
+		uint64_t	get_frame_count();
+		uint64_t	get_final_hash();
+		uint32_t	get_keyframe_interval();
+		size_t		get_keyframe_count();
+		uint64_t	get_keyframe_frame(size_t an_index);
+
+		// The key changes, in the form CBatch::run_job() takes them.
+		const std::vector<SBatchInput>&	get_inputs();
+
+		static uint64_t	hash(const uint8_t* some_bytes, size_t a_size);
+
+	private:
+		struct SKeyframe
+		{
+			uint64_t	the_frame;
+			uint32_t	the_offset;
+			uint32_t	the_size;
+		};
+
+		bool		read(const uint8_t* some_bytes, size_t a_size, bool a_mapped);
+		bool		start_at(size_t an_index, CCPU& a_cpu, const uint8_t* an_image);
+		void		run_to(CCPU& a_cpu, CKeyboard& a_keyboard, uint64_t a_frame);
+
+		// The keyframes and their blobs, in the_keyframes and the_keyframe_bytes or in the_file.
+		const SKeyframe*	get_keyframes();
+		const uint8_t*		get_keyframe_bytes();
+
+		// The ROM as it sits in the RAM of a reset machine.
+		uint32_t					the_rom_size;
+		uint64_t					the_rom_hash;
+
+		uint64_t					the_seed;
+		uint32_t					the_clock_rate;
+		uint64_t					the_frames;
+		uint64_t					the_final_hash;
+		std::vector<SBatchInput>	the_inputs;
+
+		// The keys as of the last record().
+		uint8_t						the_keys[16];
+
+		// The RAM keyframes are stored against.
+		std::vector<uint8_t>		the_image;
+
+		uint32_t					the_keyframe_interval;
+		std::vector<SKeyframe>		the_keyframes;
+		std::vector<uint8_t>		the_keyframe_bytes;
+
+		// A mapped file, the index and blobs are read where they lie.
+		CMappedFile					the_file;
+		const SKeyframe*			the_mapped_keyframes;
+		size_t						the_mapped_count;
+		const uint8_t*				the_mapped_bytes;
+};
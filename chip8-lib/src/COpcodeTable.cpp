@@ -0,0 +1,126 @@
+#include "COpcodeTable.h"
+#include "CCPUOpcodes.h"
+#include <utility>
+
+namespace {
+
+	// Operand fields of an opcode, all known at compile time.
+	template<uint16_t OP> constexpr uint8_t		X	= (OP & 0x0f00) >> 8;
+	template<uint16_t OP> constexpr uint8_t		Y	= (OP & 0x00f0) >> 4;
+	template<uint16_t OP> constexpr uint8_t		N	= OP & 0x000f;
+	template<uint16_t OP> constexpr uint8_t		KK	= OP & 0x00ff;
+	template<uint16_t OP> constexpr uint16_t	NNN	= OP & 0x0fff;
+}
+
+/**
+	The handlers. CCPU befriends this struct, so they can reach the op_ functions.
+*/
+struct COpcodeTable::handlers
+{
+	static void unknown(CCPU& a_cpu) { a_cpu.op_unknown(); }
+
+	template<uint16_t OP> static void CLS(CCPU& a_cpu)				{ a_cpu.op_CLS(); }
+	template<uint16_t OP> static void RET(CCPU& a_cpu)				{ a_cpu.op_RET(); }
+	template<uint16_t OP> static void JP_addr(CCPU& a_cpu)			{ a_cpu.op_JP_addr(NNN<OP>); }
+	template<uint16_t OP> static void CALL_addr(CCPU& a_cpu)		{ a_cpu.op_CALL_addr(NNN<OP>); }
+	template<uint16_t OP> static void SE_Vx_byte(CCPU& a_cpu)		{ a_cpu.op_SE_Vx_byte(X<OP>, KK<OP>); }
+	template<uint16_t OP> static void SNE_Vx_byte(CCPU& a_cpu)		{ a_cpu.op_SNE_Vx_byte(X<OP>, KK<OP>); }
+	template<uint16_t OP> static void SE_Vx_Vy(CCPU& a_cpu)			{ a_cpu.op_SE_Vx_Vy(X<OP>, Y<OP>); }
+	template<uint16_t OP> static void LD_Vx_byte(CCPU& a_cpu)		{ a_cpu.op_LD_Vx_byte(X<OP>, KK<OP>); }
+	template<uint16_t OP> static void ADD_Vx_byte(CCPU& a_cpu)		{ a_cpu.op_ADD_Vx_byte(X<OP>, KK<OP>); }
+	template<uint16_t OP> static void LD_Vx_Vy(CCPU& a_cpu)			{ a_cpu.op_LD_Vx_Vy(X<OP>, Y<OP>); }
+	template<uint16_t OP> static void OR_Vx_Vy(CCPU& a_cpu)			{ a_cpu.op_OR_Vx_Vy(X<OP>, Y<OP>); }
+	template<uint16_t OP> static void AND_Vx_Vy(CCPU& a_cpu)		{ a_cpu.op_AND_Vx_Vy(X<OP>, Y<OP>); }
+	template<uint16_t OP> static void XOR_Vx_Vy(CCPU& a_cpu)		{ a_cpu.op_XOR_Vx_Vy(X<OP>, Y<OP>); }
+	template<uint16_t OP> static void ADD_Vx_Vy(CCPU& a_cpu)		{ a_cpu.op_ADD_Vx_Vy(X<OP>, Y<OP>); }
+	template<uint16_t OP> static void SUB_Vx_Vy(CCPU& a_cpu)		{ a_cpu.op_SUB_Vx_Vy(X<OP>, Y<OP>); }
+	template<uint16_t OP> static void SHR_Vx_Vy(CCPU& a_cpu)		{ a_cpu.op_SHR_Vx_Vy(X<OP>, Y<OP>); }
+	template<uint16_t OP> static void SUBN_Vx_Vy(CCPU& a_cpu)		{ a_cpu.op_SUBN_Vx_Vy(X<OP>, Y<OP>); }
+	template<uint16_t OP> static void SHL_Vx_Vy(CCPU& a_cpu)		{ a_cpu.op_SHL_Vx_Vy(X<OP>, Y<OP>); }
+	template<uint16_t OP> static void SNE_Vx_Vy(CCPU& a_cpu)		{ a_cpu.op_SNE_Vx_Vy(X<OP>, Y<OP>); }
+	template<uint16_t OP> static void LD_I_addr(CCPU& a_cpu)		{ a_cpu.op_LD_I_addr(NNN<OP>); }
+	template<uint16_t OP> static void JP_V0_addr(CCPU& a_cpu)		{ a_cpu.op_JP_V0_addr(NNN<OP>); }
+	template<uint16_t OP> static void RND_Vx_byte(CCPU& a_cpu)		{ a_cpu.op_RND_Vx_byte(X<OP>, KK<OP>); }
+	template<uint16_t OP> static void DRW_Vx_Vy_nibble(CCPU& a_cpu)	{ a_cpu.op_DRW_Vx_Vy_nibble(X<OP>, Y<OP>, N<OP>); }
+	template<uint16_t OP> static void SKP_Vx(CCPU& a_cpu)			{ a_cpu.op_SKP_Vx(X<OP>); }
+	template<uint16_t OP> static void SKNP_Vx(CCPU& a_cpu)			{ a_cpu.op_SKNP_Vx(X<OP>); }
+	template<uint16_t OP> static void LD_Vx_DT(CCPU& a_cpu)			{ a_cpu.op_LD_Vx_DT(X<OP>); }
+	template<uint16_t OP> static void LD_Vx_K(CCPU& a_cpu)			{ a_cpu.op_LD_Vx_K(X<OP>); }
+	template<uint16_t OP> static void LD_DT_Vx(CCPU& a_cpu)			{ a_cpu.op_LD_DT_Vx(X<OP>); }
+	template<uint16_t OP> static void LD_ST_Vx(CCPU& a_cpu)			{ a_cpu.op_LD_ST_Vx(X<OP>); }
+	template<uint16_t OP> static void ADD_I_Vx(CCPU& a_cpu)			{ a_cpu.op_ADD_I_Vx(X<OP>); }
+	template<uint16_t OP> static void LD_F_Vx(CCPU& a_cpu)			{ a_cpu.op_LD_F_Vx(X<OP>); }
+	template<uint16_t OP> static void LD_B_Vx(CCPU& a_cpu)			{ a_cpu.op_LD_B_Vx(X<OP>); }
+	template<uint16_t OP> static void LD_I_Vx(CCPU& a_cpu)			{ a_cpu.op_LD_I_Vx(X<OP>); }
+	template<uint16_t OP> static void LD_Vx_I(CCPU& a_cpu)			{ a_cpu.op_LD_Vx_I(X<OP>); }
+
+	/**
+		Picks the handler for a single opcode. This mirrors the decoding of CCPU::execute_switch exactly, so that both
+		interpreters accept the same set of opcodes.
+	*/
+	template<uint16_t OP>
+	static constexpr opcode_handler select()
+	{
+		// Only the chosen branch gets instantiated, so every opcode produces exactly one handler.
+		constexpr uint16_t my_group = OP & 0xf000;
+		constexpr uint8_t my_low_byte = OP & 0x00ff;
+		constexpr uint8_t my_low_nibble = OP & 0x000f;
+
+		if constexpr (my_group == 0x0000 && my_low_byte == 0xe0)		return &CLS<OP>;
+		else if constexpr (my_group == 0x0000 && my_low_byte == 0xee)	return &RET<OP>;
+		else if constexpr (my_group == 0x1000)							return &JP_addr<OP>;
+		else if constexpr (my_group == 0x2000)							return &CALL_addr<OP>;
+		else if constexpr (my_group == 0x3000)							return &SE_Vx_byte<OP>;
+		else if constexpr (my_group == 0x4000)							return &SNE_Vx_byte<OP>;
+		else if constexpr (my_group == 0x5000)							return &SE_Vx_Vy<OP>;
+		else if constexpr (my_group == 0x6000)							return &LD_Vx_byte<OP>;
+		else if constexpr (my_group == 0x7000)							return &ADD_Vx_byte<OP>;
+		else if constexpr (my_group == 0x8000 && my_low_nibble == 0x0)	return &LD_Vx_Vy<OP>;
+		else if constexpr (my_group == 0x8000 && my_low_nibble == 0x1)	return &OR_Vx_Vy<OP>;
+		else if constexpr (my_group == 0x8000 && my_low_nibble == 0x2)	return &AND_Vx_Vy<OP>;
+		else if constexpr (my_group == 0x8000 && my_low_nibble == 0x3)	return &XOR_Vx_Vy<OP>;
+		else if constexpr (my_group == 0x8000 && my_low_nibble == 0x4)	return &ADD_Vx_Vy<OP>;
+		else if constexpr (my_group == 0x8000 && my_low_nibble == 0x5)	return &SUB_Vx_Vy<OP>;
+		else if constexpr (my_group == 0x8000 && my_low_nibble == 0x6)	return &SHR_Vx_Vy<OP>;
+		else if constexpr (my_group == 0x8000 && my_low_nibble == 0x7)	return &SUBN_Vx_Vy<OP>;
+		else if constexpr (my_group == 0x8000 && my_low_nibble == 0xe)	return &SHL_Vx_Vy<OP>;
+		else if constexpr (my_group == 0x9000)							return &SNE_Vx_Vy<OP>;
+		else if constexpr (my_group == 0xA000)							return &LD_I_addr<OP>;
+		else if constexpr (my_group == 0xB000)							return &JP_V0_addr<OP>;
+		else if constexpr (my_group == 0xC000)							return &RND_Vx_byte<OP>;
+		else if constexpr (my_group == 0xD000)							return &DRW_Vx_Vy_nibble<OP>;
+		else if constexpr (my_group == 0xE000 && my_low_byte == 0x9e)	return &SKP_Vx<OP>;
+		else if constexpr (my_group == 0xE000 && my_low_byte == 0xa1)	return &SKNP_Vx<OP>;
+		else if constexpr (my_group == 0xF000 && my_low_byte == 0x07)	return &LD_Vx_DT<OP>;
+		else if constexpr (my_group == 0xF000 && my_low_byte == 0x0a)	return &LD_Vx_K<OP>;
+		else if constexpr (my_group == 0xF000 && my_low_byte == 0x15)	return &LD_DT_Vx<OP>;
+		else if constexpr (my_group == 0xF000 && my_low_byte == 0x18)	return &LD_ST_Vx<OP>;
+		else if constexpr (my_group == 0xF000 && my_low_byte == 0x1e)	return &ADD_I_Vx<OP>;
+		else if constexpr (my_group == 0xF000 && my_low_byte == 0x29)	return &LD_F_Vx<OP>;
+		else if constexpr (my_group == 0xF000 && my_low_byte == 0x33)	return &LD_B_Vx<OP>;
+		else if constexpr (my_group == 0xF000 && my_low_byte == 0x55)	return &LD_I_Vx<OP>;
+		else if constexpr (my_group == 0xF000 && my_low_byte == 0x65)	return &LD_Vx_I<OP>;
+		else															return &unknown;
+	}
+
+	// The table is built one row (high byte) at a time, a single pack of 65536 elements is too much for the compilers.
+	template<uint16_t HI, uint16_t... LO>
+	static constexpr std::array<opcode_handler, 256> make_row(std::integer_sequence<uint16_t, LO...>)
+	{
+		return {{ select<(HI << 8) | LO>()... }};
+	}
+
+	template<uint16_t... HI>
+	static constexpr table_type make_table(std::integer_sequence<uint16_t, HI...>)
+	{
+		return {{ make_row<HI>(std::make_integer_sequence<uint16_t, 256>{})... }};
+	}
+};
+
+const COpcodeTable::table_type COpcodeTable::the_table = COpcodeTable::handlers::make_table(std::make_integer_sequence<uint16_t, 256>{});
+
+bool
+COpcodeTable::is_known(uint16_t an_opcode)
+{
+	return get_handler(an_opcode) != &handlers::unknown;
+}
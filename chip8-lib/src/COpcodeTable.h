@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include <array>
+
+class CCPU;
+
+typedef void (*opcode_handler)(CCPU&);
+
+/**
+	One handler per 16-bit opcode, built at compile time.
+
+	Every handler is a template instantiated for exactly one opcode, so the register indices and immediates are constants
+	inside it and dispatching is a single indirect call. Opcodes the interpreter doesn't know map to a trap handler.
+*/
+class COpcodeTable
+{
+	public:
+		typedef std::array<std::array<opcode_handler, 256>, 256> table_type;
+
+		// The handler templates, defined in COpcodeTable.cpp. CCPU befriends them.
+		struct handlers;
+
+		static opcode_handler	get_handler(uint16_t an_opcode) { return the_table[an_opcode >> 8][an_opcode & 0xff]; }
+		static bool				is_known(uint16_t an_opcode);
+
+	private:
+		static const table_type		the_table;
+};
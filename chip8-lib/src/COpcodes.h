@@ -0,0 +1,377 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "SChip8State.h"
+#include "CRandom.h"
+
+/**
+	The semantics of every opcode, the one place they are written down. Header only, on a bare SChip8State.
+
+	CCPU runs them through CCPUOpcodes.h for the switch, the table, the threaded loop and the superinstructions, the
+	recompiled ROMs and the lockstep batches through CRecompRuntime. The operands are passed in already decoded. When
+	called from a table handler they are template constants, so the compiler folds them straight into the body.
+
+	The opcodes that read or write RAM, or change the screen, take a bus as well:
+
+		uint8_t	get_byte(int an_address);					// 0 outside the RAM.
+		void	set_byte(int an_address, uint8_t a_value);	// Dropped outside the RAM.
+		void	cleared();									// After CLS.
+		void	drawn(uint16_t an_address, uint8_t x, uint8_t y, uint8_t a_height, bool a_collision);	// After DRW, x and y wrapped.
+*/
+class COpcodes
+{
+	public:
+		template <typename TBus>
+		static void op_CLS(SChip8State& a_state, TBus& a_bus)
+		{
+			memset(a_state.the_screen, 0, sizeof(a_state.the_screen));
+			a_bus.cleared();
+			a_state.the_pc += 2;
+		}
+
+		static void op_RET(SChip8State& a_state)
+		{
+			// The return address is the last one pushed, CALL pushes its own address.
+			a_state.the_sp--;
+			a_state.the_pc = a_state.the_stack[a_state.the_sp & 0xf];
+		}
+
+		static void op_JP_addr(SChip8State& a_state, uint16_t an_address)
+		{
+			a_state.the_pc = an_address;
+		}
+
+		static void op_CALL_addr(SChip8State& a_state, uint16_t an_address)
+		{
+			a_state.the_stack[a_state.the_sp & 0xf] = a_state.the_pc;
+			a_state.the_sp++;
+			a_state.the_pc = an_address;
+		}
+
+		static void op_SE_Vx_byte(SChip8State& a_state, uint8_t a_regx, uint8_t a_byte)
+		{
+			if (a_state.the_V[a_regx] == a_byte)
+			{
+				a_state.the_pc += 2;
+			}
+
+			a_state.the_pc += 2;
+		}
+
+		static void op_SNE_Vx_byte(SChip8State& a_state, uint8_t a_regx, uint8_t a_byte)
+		{
+			if (a_state.the_V[a_regx] != a_byte)
+			{
+				a_state.the_pc += 2;
+			}
+
+			a_state.the_pc += 2;
+		}
+
+		static void op_SE_Vx_Vy(SChip8State& a_state, uint8_t a_regx, uint8_t a_regy)
+		{
+			if (a_state.the_V[a_regx] == a_state.the_V[a_regy])
+			{
+				a_state.the_pc += 2;
+			}
+
+			a_state.the_pc += 2;
+		}
+
+		static void op_LD_Vx_byte(SChip8State& a_state, uint8_t a_regx, uint8_t a_byte)
+		{
+			a_state.the_V[a_regx] = a_byte;
+			a_state.the_pc += 2;
+		}
+
+		static void op_ADD_Vx_byte(SChip8State& a_state, uint8_t a_regx, uint8_t a_byte)
+		{
+			uint8_t my_value = a_state.the_V[a_regx] + a_byte;
+
+			a_state.the_V[a_regx] = my_value;
+			a_state.the_pc += 2;
+		}
+
+		static void op_LD_Vx_Vy(SChip8State& a_state, uint8_t a_regx, uint8_t a_regy)
+		{
+			a_state.the_V[a_regx] = a_state.the_V[a_regy];
+			a_state.the_pc += 2;
+		}
+
+		static void op_OR_Vx_Vy(SChip8State& a_state, uint8_t a_regx, uint8_t a_regy)
+		{
+			uint8_t my_value = a_state.the_V[a_regx] | a_state.the_V[a_regy];
+
+			a_state.the_V[a_regx] = my_value;
+			a_state.the_pc += 2;
+		}
+
+		static void op_AND_Vx_Vy(SChip8State& a_state, uint8_t a_regx, uint8_t a_regy)
+		{
+			uint8_t my_value = a_state.the_V[a_regx] & a_state.the_V[a_regy];
+
+			a_state.the_V[a_regx] = my_value;
+			a_state.the_pc += 2;
+		}
+
+		static void op_XOR_Vx_Vy(SChip8State& a_state, uint8_t a_regx, uint8_t a_regy)
+		{
+			uint8_t my_value = a_state.the_V[a_regx] ^ a_state.the_V[a_regy];
+
+			a_state.the_V[a_regx] = my_value;
+			a_state.the_pc += 2;
+		}
+
+		static void op_ADD_Vx_Vy(SChip8State& a_state, uint8_t a_regx, uint8_t a_regy)
+		{
+			int my_sum = a_state.the_V[a_regx] + a_state.the_V[a_regy];
+
+			a_state.the_V[a_regx] = (uint8_t)my_sum;
+
+			if (my_sum > 0xff)
+			{
+				a_state.the_V[0xf] = 1;
+			}
+
+			a_state.the_pc += 2;
+		}
+
+		static void op_SUB_Vx_Vy(SChip8State& a_state, uint8_t a_regx, uint8_t a_regy)
+		{
+			uint8_t my_x = a_state.the_V[a_regx];
+			uint8_t my_y = a_state.the_V[a_regy];
+
+			a_state.the_V[0xf] = my_x > my_y ? 1 : 0;
+
+			// Re-read Vx and Vy, either of them may be VF.
+			my_x = a_state.the_V[a_regx];
+			my_y = a_state.the_V[a_regy];
+
+			a_state.the_V[a_regx] = my_x - my_y;
+			a_state.the_pc += 2;
+		}
+
+		static void op_SHR_Vx_Vy(SChip8State& a_state, uint8_t a_regx, uint8_t a_regy)
+		{
+			uint8_t my_value = a_state.the_V[a_regx] >> 1;
+			uint8_t my_lsb = a_state.the_V[a_regy] & 0b0001;
+
+			a_state.the_V[0xf] = my_lsb;
+			a_state.the_V[a_regx] = my_value;
+			a_state.the_pc += 2;
+		}
+
+		static void op_SUBN_Vx_Vy(SChip8State& a_state, uint8_t a_regx, uint8_t a_regy)
+		{
+			uint8_t my_x = a_state.the_V[a_regx];
+			uint8_t my_y = a_state.the_V[a_regy];
+
+			a_state.the_V[0xf] = my_y > my_x ? 1 : 0;
+
+			// Re-read Vx and Vy, either of them may be VF.
+			my_x = a_state.the_V[a_regx];
+			my_y = a_state.the_V[a_regy];
+
+			a_state.the_V[a_regx] = my_y - my_x;
+			a_state.the_pc += 2;
+		}
+
+		static void op_SHL_Vx_Vy(SChip8State& a_state, uint8_t a_regx, uint8_t a_regy)
+		{
+			uint8_t my_msb = a_state.the_V[a_regy] & 0b1000;
+
+			a_state.the_V[0xf] = my_msb;
+
+			uint8_t my_value = a_state.the_V[a_regy] << 1;
+
+			a_state.the_V[a_regx] = my_value;
+			a_state.the_pc += 2;
+		}
+
+		static void op_SNE_Vx_Vy(SChip8State& a_state, uint8_t a_regx, uint8_t a_regy)
+		{
+			if (a_state.the_V[a_regx] != a_state.the_V[a_regy])
+			{
+				a_state.the_pc += 2;
+			}
+
+			a_state.the_pc += 2;
+		}
+
+		static void op_LD_I_addr(SChip8State& a_state, uint16_t an_address)
+		{
+			a_state.the_I = an_address;
+			a_state.the_pc += 2;
+		}
+
+		static void op_JP_V0_addr(SChip8State& a_state, uint16_t an_address)
+		{
+			a_state.the_pc = an_address + a_state.the_V[0x0];
+		}
+
+		static void op_RND_Vx_byte(SChip8State& a_state, uint8_t a_regx, uint8_t a_byte)
+		{
+			uint8_t my_number = CRandom::next_byte(a_state.the_random);
+
+			a_state.the_V[a_regx] = my_number & a_byte;
+			a_state.the_pc += 2;
+		}
+
+		template <typename TBus>
+		static void op_DRW_Vx_Vy_nibble(SChip8State& a_state, TBus& a_bus, uint8_t a_regx, uint8_t a_regy, uint8_t a_height)
+		{
+			uint8_t x = a_state.the_V[a_regx];
+			uint8_t y = a_state.the_V[a_regy];
+
+			// F is set on collision and reset otherwise.
+			a_state.the_V[0xf] = draw(a_state, a_bus, x, y, a_state.the_I, a_height) ? 1 : 0;
+			a_state.the_pc += 2;
+		}
+
+		/**
+			The sprite at an_address onto the screen at a_x, a_y, returns whether a pixel was turned off. DRW without
+			the registers, CLockstep keeps them elsewhere.
+		*/
+		template <typename TBus>
+		static bool draw(SChip8State& a_state, TBus& a_bus, uint8_t a_x, uint8_t a_y, uint16_t an_address, uint8_t a_height)
+		{
+			// Sprites are ALWAYS 8 pixels wide, and between 1 and 15 pixels high, where N is height. A sprite starting off
+			// the screen wraps around to it, the part running off the right or the bottom edge is clipped.
+			uint8_t x = a_x % SChip8State::SCREEN_WIDTH;
+			uint8_t y = a_y % SChip8State::SCREEN_HEIGHT;
+
+			bool my_collision = false;
+
+			for (int row = 0; row < a_height && y + row < SChip8State::SCREEN_HEIGHT; row++)
+			{
+				// The sprite row, leftmost pixel in the top bit like the screen row, shifted across to x. What's shifted
+				// out on the right is clipped.
+				uint64_t	my_sprite	= ((uint64_t)a_bus.get_byte(an_address + row) << 56) >> x;
+				uint64_t&	my_row		= a_state.the_screen[y + row];
+
+				if ((my_row & my_sprite) != 0)
+				{
+					my_collision = true;
+				}
+				my_row ^= my_sprite;
+			}
+
+			a_bus.drawn(an_address, x, y, a_height, my_collision);
+
+			return my_collision;
+		}
+
+		static bool is_key_down(const SChip8State& a_state, uint8_t a_key)
+		{
+			// There are only 16 keys, the others are never down.
+			return a_key < sizeof(a_state.the_keys) && a_state.the_keys[a_key] == 1;
+		}
+
+		static void op_SKP_Vx(SChip8State& a_state, uint8_t a_regx)
+		{
+			if (is_key_down(a_state, a_state.the_V[a_regx]))
+			{
+				a_state.the_pc += 2;
+			}
+
+			a_state.the_pc += 2;
+		}
+
+		static void op_SKNP_Vx(SChip8State& a_state, uint8_t a_regx)
+		{
+			if (!is_key_down(a_state, a_state.the_V[a_regx]))
+			{
+				a_state.the_pc += 2;
+			}
+
+			a_state.the_pc += 2;
+		}
+
+		static void op_LD_Vx_DT(SChip8State& a_state, uint8_t a_regx)
+		{
+			a_state.the_V[a_regx] = a_state.the_delay_timer;
+			a_state.the_pc += 2;
+		}
+
+		static void op_LD_Vx_K(SChip8State& a_state, uint8_t a_regx)
+		{
+			// Check status of all keys stored in key.
+			for (int i = 0; i < (int)sizeof(a_state.the_keys); i++)
+			{
+				// If key state is active.
+				if (a_state.the_keys[i] == 1)
+				{
+					// Store key value in Vreg.
+					a_state.the_V[a_regx] = a_state.the_keys[i];
+					a_state.the_pc += 2;
+				}
+			}
+		}
+
+		static void op_LD_DT_Vx(SChip8State& a_state, uint8_t a_regx)
+		{
+			a_state.the_delay_timer = a_state.the_V[a_regx];
+			a_state.the_pc += 2;
+		}
+
+		static void op_LD_ST_Vx(SChip8State& a_state, uint8_t a_regx)
+		{
+			a_state.the_sound_timer = a_state.the_V[a_regx];
+			a_state.the_pc += 2;
+		}
+
+		static void op_ADD_I_Vx(SChip8State& a_state, uint8_t a_regx)
+		{
+			uint8_t my_value = a_state.the_I + a_state.the_V[a_regx];
+
+			a_state.the_I = my_value;
+			a_state.the_pc += 2;
+		}
+
+		static void op_LD_F_Vx(SChip8State& a_state, uint8_t a_regx)
+		{
+			uint8_t my_value = a_state.the_V[a_regx] * 0x05;
+
+			a_state.the_I = my_value;
+			a_state.the_pc += 2;
+		}
+
+		template <typename TBus>
+		static void op_LD_B_Vx(SChip8State& a_state, TBus& a_bus, uint8_t a_regx)
+		{
+			uint8_t bcd = a_state.the_V[a_regx];
+
+			a_bus.set_byte(a_state.the_I,		bcd / 100);
+			a_bus.set_byte(a_state.the_I + 1,	(bcd / 10) % 10);
+			a_bus.set_byte(a_state.the_I + 2,	bcd % 10);
+
+			a_state.the_pc += 2;
+		}
+
+		template <typename TBus>
+		static void op_LD_I_Vx(SChip8State& a_state, TBus& a_bus, uint8_t a_regx)
+		{
+			for (int i = 0; i <= a_regx; i++)
+			{
+				a_bus.set_byte(a_state.the_I + i, a_state.the_V[i]);
+			}
+
+			a_state.the_pc += 2;
+		}
+
+		template <typename TBus>
+		static void op_LD_Vx_I(SChip8State& a_state, TBus& a_bus, uint8_t a_regx)
+		{
+			for (int i = 0; i <= a_regx; i++)
+			{
+				a_state.the_V[i] = a_bus.get_byte(a_state.the_I + i);
+			}
+
+			a_state.the_pc += 2;
+		}
+
+		static void op_unknown(SChip8State&)
+		{
+			// Unknown opcodes leave the machine untouched, the PC doesn't advance.
+		}
+};
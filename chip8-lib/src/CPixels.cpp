@@ -0,0 +1,214 @@
+#include "CPixels.h"
+#include <string.h>
+#include "CCpuFeatures.h"
+#include "SChip8State.h"
+
+#if defined(CHIP8_AVX2_KERNELS)
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CHIP8_PIXELS_SSE2
+#include <emmintrin.h>
+#endif
+
+const uint8_t	CPixels::RGB332_ON;
+const uint8_t	CPixels::RGB332_OFF;
+const uint32_t	CPixels::ARGB8888_ON;
+const uint32_t	CPixels::ARGB8888_OFF;
+
+// Eight copies of a byte.
+static const uint64_t BYTE_COPIES = 0x0101010101010101ull;
+
+#if defined(CHIP8_AVX2_KERNELS)
+static CHIP8_TARGET_AVX2 void
+expand_rgb332_avx2(uint64_t a_row, uint8_t* a_pixels)
+{
+	// Every byte of the row copied over the 8 bytes its pixels go to, then each of those tests its own bit.
+	const __m256i my_bits = _mm256_set1_epi64x(0x0102040810204080ll);
+
+	for (int i = 0; i < 2; i++, a_row <<= 32)
+	{
+		__m256i my_copies = _mm256_set_epi64x(
+			(int64_t)(((a_row >> 32) & 0xff) * BYTE_COPIES), (int64_t)(((a_row >> 40) & 0xff) * BYTE_COPIES),
+			(int64_t)(((a_row >> 48) & 0xff) * BYTE_COPIES), (int64_t)(((a_row >> 56) & 0xff) * BYTE_COPIES));
+
+		_mm256_storeu_si256((__m256i*)(a_pixels + i * 32), _mm256_cmpeq_epi8(_mm256_and_si256(my_copies, my_bits), my_bits));
+	}
+}
+
+static CHIP8_TARGET_AVX2 void
+expand_argb8888_avx2(uint64_t a_row, uint32_t* a_pixels)
+{
+	// A byte of the row in every lane, each lane tests its own bit. Black still has its alpha.
+	const __m256i my_bits	= _mm256_set_epi32(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80);
+	const __m256i my_off	= _mm256_set1_epi32((int)CPixels::ARGB8888_OFF);
+
+	for (int i = 0; i < 8; i++, a_row <<= 8)
+	{
+		__m256i my_copies = _mm256_set1_epi32((int)(a_row >> 56));
+
+		_mm256_storeu_si256((__m256i*)(a_pixels + i * 8), _mm256_or_si256(_mm256_cmpeq_epi32(_mm256_and_si256(my_copies, my_bits), my_bits), my_off));
+	}
+}
+#endif
+
+#if defined(CHIP8_PIXELS_SSE2)
+static void
+expand_rgb332_sse2(uint64_t a_row, uint8_t* a_pixels)
+{
+	const __m128i my_bits = _mm_set1_epi64x(0x0102040810204080ll);
+
+	for (int i = 0; i < 4; i++, a_row <<= 16)
+	{
+		__m128i my_copies = _mm_set_epi64x(
+			(int64_t)(((a_row >> 48) & 0xff) * BYTE_COPIES), (int64_t)(((a_row >> 56) & 0xff) * BYTE_COPIES));
+
+		_mm_storeu_si128((__m128i*)(a_pixels + i * 16), _mm_cmpeq_epi8(_mm_and_si128(my_copies, my_bits), my_bits));
+	}
+}
+
+static void
+expand_argb8888_sse2(uint64_t a_row, uint32_t* a_pixels)
+{
+	const __m128i my_bits	= _mm_set_epi32(0x1, 0x2, 0x4, 0x8);
+	const __m128i my_off	= _mm_set1_epi32((int)CPixels::ARGB8888_OFF);
+
+	for (int i = 0; i < 16; i++, a_row <<= 4)
+	{
+		__m128i my_copies = _mm_set1_epi32((int)(a_row >> 60));
+
+		_mm_storeu_si128((__m128i*)(a_pixels + i * 4), _mm_or_si128(_mm_cmpeq_epi32(_mm_and_si128(my_copies, my_bits), my_bits), my_off));
+	}
+}
+#endif
+
+// Bit by bit until the best kernel the CPU has is picked, before main().
+CPixels::EKernel			CPixels::the_kernel		= CPixels::EKernel::SCALAR;
+CPixels::rgb332_kernel		CPixels::the_rgb332		= &CPixels::expand_rgb332_scalar;
+CPixels::argb8888_kernel	CPixels::the_argb8888	= &CPixels::expand_argb8888_scalar;
+
+static const bool PICKED = CPixels::set_kernel(CPixels::EKernel::AVX2) || CPixels::set_kernel(CPixels::EKernel::SSE2);
+
+bool
+CPixels::is_vectorised()
+{
+	return the_kernel != EKernel::SCALAR;
+}
+
+bool
+CPixels::is_supported(EKernel a_kernel)
+{
+	switch (a_kernel)
+	{
+		case EKernel::SCALAR:
+			return true;
+
+		case EKernel::SSE2:
+#if defined(CHIP8_PIXELS_SSE2)
+			return true;
+#else
+			return false;
+#endif
+
+		case EKernel::AVX2:
+#if defined(CHIP8_AVX2_KERNELS)
+			return CCpuFeatures::has_avx2();
+#else
+			return false;
+#endif
+	}
+
+	return false;
+}
+
+CPixels::EKernel
+CPixels::get_kernel()
+{
+	return the_kernel;
+}
+
+bool
+CPixels::set_kernel(EKernel a_kernel)
+{
+	if (!is_supported(a_kernel))
+		return false;
+
+	switch (a_kernel)
+	{
+#if defined(CHIP8_AVX2_KERNELS)
+		case EKernel::AVX2:
+			the_rgb332		= &expand_rgb332_avx2;
+			the_argb8888	= &expand_argb8888_avx2;
+			break;
+#endif
+#if defined(CHIP8_PIXELS_SSE2)
+		case EKernel::SSE2:
+			the_rgb332		= &expand_rgb332_sse2;
+			the_argb8888	= &expand_argb8888_sse2;
+			break;
+#endif
+		default:
+			the_rgb332		= &expand_rgb332_scalar;
+			the_argb8888	= &expand_argb8888_scalar;
+			break;
+	}
+
+	the_kernel = a_kernel;
+
+	return true;
+}
+
+size_t
+CPixels::get_bytes_per_pixel(EFormat a_format)
+{
+	return a_format == EFormat::ARGB8888 ? sizeof(uint32_t) : sizeof(uint8_t);
+}
+
+void
+CPixels::expand_rgb332(uint64_t a_row, uint8_t* a_pixels)
+{
+	the_rgb332(a_row, a_pixels);
+}
+
+void
+CPixels::expand_argb8888(uint64_t a_row, uint32_t* a_pixels)
+{
+	the_argb8888(a_row, a_pixels);
+}
+
+void
+CPixels::expand_rgb332_scalar(uint64_t a_row, uint8_t* a_pixels)
+{
+	for (int x = 0; x < SChip8State::SCREEN_WIDTH; x++, a_row <<= 1)
+		a_pixels[x] = (a_row >> 63) != 0 ? RGB332_ON : RGB332_OFF;
+}
+
+void
+CPixels::expand_argb8888_scalar(uint64_t a_row, uint32_t* a_pixels)
+{
+	for (int x = 0; x < SChip8State::SCREEN_WIDTH; x++, a_row <<= 1)
+		a_pixels[x] = (a_row >> 63) != 0 ? ARGB8888_ON : ARGB8888_OFF;
+}
+
+size_t
+CPixels::expand(EFormat a_format, const uint64_t* a_screen, const SDirtyRect& a_rect, uint8_t* a_pixels, int a_pitch)
+{
+	size_t my_bytes_per_pixel	= get_bytes_per_pixel(a_format);
+	size_t my_row_bytes			= a_rect.the_width * my_bytes_per_pixel;
+
+	// Whole rows are quickest to expand, the part of them in the rectangle is copied out.
+	uint32_t my_row[SChip8State::SCREEN_WIDTH];
+
+	for (int y = 0; y < a_rect.the_height; y++)
+	{
+		if (a_format == EFormat::ARGB8888)
+			expand_argb8888(a_screen[a_rect.the_y + y], my_row);
+		else
+			expand_rgb332(a_screen[a_rect.the_y + y], (uint8_t*)my_row);
+
+		memcpy(a_pixels + y * a_pitch, (uint8_t*)my_row + a_rect.the_x * my_bytes_per_pixel, my_row_bytes);
+	}
+
+	return my_row_bytes * a_rect.the_height;
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "CPresenter.h"
+
+/**
+	Turns the packed screen rows into texture pixels, one bit to a whole pixel.
+
+	A set bit becomes white, a clear one black. A row expands 8 pixels at a time with AVX2, 16 (RGB332) or 4
+	(ARGB8888) with SSE2, and bit by bit where neither is there. Which of them runs is up to the CPU, it's picked
+	before main(). The _scalar functions always go bit by bit, they're what the vector kernels are checked against.
+*/
+class CPixels
+{
+	public:
+		enum class EFormat
+		{
+			RGB332,
+			ARGB8888
+		};
+
+		static const uint8_t	RGB332_ON		= 0xff;
+		static const uint8_t	RGB332_OFF		= 0x00;
+		static const uint32_t	ARGB8888_ON		= 0xffffffff;
+		static const uint32_t	ARGB8888_OFF	= 0xff000000;
+
+		// The ways of expanding a row.
+		enum class EKernel
+		{
+			SCALAR,
+			SSE2,
+			AVX2
+		};
+
+		static bool		is_vectorised();
+		static bool		is_supported(EKernel a_kernel);
+		static EKernel	get_kernel();
+		// For tests and benchmarks. One the CPU doesn't have is refused, and false returned.
+		static bool		set_kernel(EKernel a_kernel);
+		static size_t	get_bytes_per_pixel(EFormat a_format);
+
+		// A whole row, 64 pixels.
+		static void		expand_rgb332(uint64_t a_row, uint8_t* a_pixels);
+		static void		expand_argb8888(uint64_t a_row, uint32_t* a_pixels);
+		static void		expand_rgb332_scalar(uint64_t a_row, uint8_t* a_pixels);
+		static void		expand_argb8888_scalar(uint64_t a_row, uint32_t* a_pixels);
+
+		// a_rect of a_screen to a_pixels, its top left pixel first and a_pitch bytes from one row to the next.
+		// Returns the bytes written.
+		static size_t	expand(EFormat a_format, const uint64_t* a_screen, const SDirtyRect& a_rect, uint8_t* a_pixels, int a_pitch);
+
+	private:
+		typedef void (*rgb332_kernel)(uint64_t a_row, uint8_t* a_pixels);
+		typedef void (*argb8888_kernel)(uint64_t a_row, uint32_t* a_pixels);
+
+		static EKernel			the_kernel;
+		static rgb332_kernel	the_rgb332;
+		static argb8888_kernel	the_argb8888;
+};
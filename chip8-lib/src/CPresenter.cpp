@@ -0,0 +1,33 @@
+#include "CPresenter.h"
+
+bool
+CNullPresenter::init()
+{
+	return true;
+}
+
+size_t
+CNullPresenter::present(const uint64_t*, const SDirtyRect&)
+{
+	return 0;
+}
+
+CCallbackPresenter::CCallbackPresenter(frame_callback a_callback) :
+	the_callback(a_callback)
+{
+}
+
+bool
+CCallbackPresenter::init()
+{
+	return true;
+}
+
+size_t
+CCallbackPresenter::present(const uint64_t* a_screen, const SDirtyRect& a_dirty)
+{
+	if (the_callback)
+		the_callback(a_screen, a_dirty);
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+/**
+	The part of the screen that changed since the last frame presented, in pixels.
+*/
+struct SDirtyRect
+{
+	int	the_x;
+	int	the_y;
+	int	the_width;
+	int	the_height;
+};
+
+/**
+	Where finished frames go. CGraphics owns the screen, a presenter only ever sees it once a frame is done.
+
+	CSDLPresenter shows it in a window and is the only part of chip8-lib that touches SDL, so anything presenting
+	through the others never loads it.
+*/
+class CPresenter
+{
+	public:
+		virtual ~CPresenter() = default;
+
+		// Sets up whatever the frames go to, false when that failed.
+		virtual bool	init() = 0;
+
+		// a_screen is the 64x32 screen, a word per row with the leftmost pixel in the top bit. Only a_dirty changed
+		// since the last call, the whole screen after init(). Returns the bytes it uploaded.
+		virtual size_t	present(const uint64_t* a_screen, const SDirtyRect& a_dirty) = 0;
+};
+
+/**
+	Drops every frame, for tests and headless runs.
+*/
+class CNullPresenter : public CPresenter
+{
+	public:
+		bool	init() override;
+		size_t	present(const uint64_t* a_screen, const SDirtyRect& a_dirty) override;
+};
+
+/**
+	Hands every frame and what changed in it to a function, uploads nothing.
+*/
+class CCallbackPresenter : public CPresenter
+{
+	public:
+		typedef std::function<void(const uint64_t*, const SDirtyRect&)> frame_callback;
+
+		CCallbackPresenter(frame_callback a_callback);
+
+		bool	init() override;
+		size_t	present(const uint64_t* a_screen, const SDirtyRect& a_dirty) override;
+
+	private:
+		frame_callback	the_callback;
+};
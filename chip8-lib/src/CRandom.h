@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+
+/**
+	The random numbers RND draws: SplitMix64 on the_random of an SChip8State. Every machine has its own, so runs
+	repeat whatever else runs beside them, and snapshots carry it along. Any value is a seed, 0 included.
+
+	Header only, the recompiled ROMs draw the same numbers through CRecompRuntime.
+*/
+class CRandom
+{
+	public:
+		static uint64_t next(uint64_t& a_state)
+		{
+			uint64_t my_value = (a_state += 0x9e3779b97f4a7c15ull);
+
+			my_value = (my_value ^ (my_value >> 30)) * 0xbf58476d1ce4e5b9ull;
+			my_value = (my_value ^ (my_value >> 27)) * 0x94d049bb133111ebull;
+
+			return my_value ^ (my_value >> 31);
+		}
+
+		// All 256 values alike, the top bits are the best mixed.
+		static uint8_t next_byte(uint64_t& a_state)
+		{
+			return (uint8_t)(next(a_state) >> 56);
+		}
+};
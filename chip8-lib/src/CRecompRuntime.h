@@ -0,0 +1,188 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "SChip8State.h"
+#include "COpcodes.h"
+
+// What a recompiled ROM runs through, see recomp_run() in the generated code: a number of instructions on a machine.
+typedef uint32_t (*recomp_run_function)(SChip8State& a_state, uint32_t a_count);
+
+/**
+	Runtime for recompiled ROMs, header only so the generated code doesn't need chip8-lib.
+
+	The opcodes are the ones in COpcodes.h, on the SChip8State itself with SBus for the RAM. The generated code calls
+	them for everything but the jumps and skips, and step() decodes the code it couldn't compile. Once the ROM writes
+	over compiled code the_code_written is set, only the interpreter is right from there on.
+*/
+class CRecompRuntime
+{
+	public:
+		/**
+			The bus COpcodes run on: RAM straight from the state, writes to a byte set in the_compiled (one per
+			address, may be null) set the_code_written. There is no draw flag or log.
+		*/
+		struct SBus
+		{
+			SChip8State&	the_state;
+			const uint8_t*	the_compiled;
+
+			uint8_t get_byte(int an_address)
+			{
+				return an_address >= 0 && an_address < (int)sizeof(the_state.the_memory) ? the_state.the_memory[an_address] : 0;
+			}
+
+			void set_byte(int an_address, uint8_t a_value)
+			{
+				if (an_address < 0 || an_address >= (int)sizeof(the_state.the_memory))
+					return;
+
+				the_state.the_memory[an_address] = a_value;
+
+				if (the_compiled != nullptr && the_compiled[an_address])
+					the_state.the_code_written = true;
+			}
+
+			void cleared() {}
+			void drawn(uint16_t, uint8_t, uint8_t, uint8_t, bool) {}
+		};
+
+		// Instructions per frame, about the 500 / 60 CCPU::run_frame() runs by default. The timers tick per instruction
+		// here, like in CCPU::run().
+		static const uint32_t FRAME_INSTRUCTIONS = 8;
+
+		static void reset(SChip8State& a_state, const uint8_t* an_image)
+		{
+			memset(&a_state, 0, sizeof(a_state));
+			memcpy(a_state.the_memory, an_image, sizeof(a_state.the_memory));
+			a_state.the_pc = 0x200;
+		}
+
+		// The same as CCPU::update_timers(), once per instruction.
+		static void tick(SChip8State& a_state)
+		{
+			if (a_state.the_delay_timer > 0)
+				--a_state.the_delay_timer;
+
+			if (a_state.the_sound_timer > 0)
+			{
+				if (a_state.the_sound_timer == 1)
+					printf("BEEP\n");
+
+				--a_state.the_sound_timer;
+			}
+		}
+
+		/**
+			FNV-1a over everything a ROM can observe.
+		*/
+		static uint64_t hash(const SChip8State& a_state)
+		{
+			uint64_t my_hash = 0xcbf29ce484222325ull;
+
+			auto my_add = [&my_hash](const void* a_data, size_t a_size)
+			{
+				const uint8_t* my_bytes = (const uint8_t*)a_data;
+
+				for (size_t i = 0; i < a_size; i++)
+					my_hash = (my_hash ^ my_bytes[i]) * 0x100000001b3ull;
+			};
+
+			my_add(&a_state.the_pc, sizeof(a_state.the_pc));
+			my_add(&a_state.the_I, sizeof(a_state.the_I));
+			my_add(&a_state.the_sp, sizeof(a_state.the_sp));
+			my_add(a_state.the_V, sizeof(a_state.the_V));
+			my_add(&a_state.the_delay_timer, sizeof(a_state.the_delay_timer));
+			my_add(&a_state.the_sound_timer, sizeof(a_state.the_sound_timer));
+			my_add(a_state.the_stack, sizeof(a_state.the_stack));
+			my_add(&a_state.the_random, sizeof(a_state.the_random));
+			my_add(a_state.the_screen, sizeof(a_state.the_screen));
+			my_add(a_state.the_memory, sizeof(a_state.the_memory));
+
+			return my_hash;
+		}
+
+		// Interprets a number of instructions, returns how many ran.
+		static uint32_t run(SChip8State& a_state, uint32_t a_count)
+		{
+			for (uint32_t i = 0; i < a_count; i++)
+			{
+				step(a_state, nullptr);
+				tick(a_state);
+			}
+
+			return a_count;
+		}
+
+		/**
+			Interprets one instruction, decoded like CCPU::execute_switch(). Writes to a byte set in a_compiled (one
+			per address, may be null) set the_code_written.
+		*/
+		static void step(SChip8State& a_state, const uint8_t* a_compiled)
+		{
+			if (a_state.the_pc >= sizeof(a_state.the_memory) - 1)
+				return;
+
+			SBus		my_bus		= { a_state, a_compiled };
+			uint16_t	my_opcode	= a_state.the_memory[a_state.the_pc] << 8 | a_state.the_memory[a_state.the_pc + 1];
+			uint8_t		x			= (my_opcode & 0x0f00) >> 8;
+			uint8_t		y			= (my_opcode & 0x00f0) >> 4;
+			uint8_t		kk			= my_opcode & 0x00ff;
+			uint16_t	nnn			= my_opcode & 0x0fff;
+
+			switch (my_opcode & 0xf000)
+			{
+				case 0x0000:
+					if (kk == 0xe0)			COpcodes::op_CLS(a_state, my_bus);
+					else if (kk == 0xee)	COpcodes::op_RET(a_state);
+					break;
+				case 0x1000: COpcodes::op_JP_addr(a_state, nnn); break;
+				case 0x2000: COpcodes::op_CALL_addr(a_state, nnn); break;
+				case 0x3000: COpcodes::op_SE_Vx_byte(a_state, x, kk); break;
+				case 0x4000: COpcodes::op_SNE_Vx_byte(a_state, x, kk); break;
+				case 0x5000: COpcodes::op_SE_Vx_Vy(a_state, x, y); break;
+				case 0x6000: COpcodes::op_LD_Vx_byte(a_state, x, kk); break;
+				case 0x7000: COpcodes::op_ADD_Vx_byte(a_state, x, kk); break;
+				case 0x8000:
+					switch (my_opcode & 0x000f)
+					{
+						case 0x0: COpcodes::op_LD_Vx_Vy(a_state, x, y); break;
+						case 0x1: COpcodes::op_OR_Vx_Vy(a_state, x, y); break;
+						case 0x2: COpcodes::op_AND_Vx_Vy(a_state, x, y); break;
+						case 0x3: COpcodes::op_XOR_Vx_Vy(a_state, x, y); break;
+						case 0x4: COpcodes::op_ADD_Vx_Vy(a_state, x, y); break;
+						case 0x5: COpcodes::op_SUB_Vx_Vy(a_state, x, y); break;
+						case 0x6: COpcodes::op_SHR_Vx_Vy(a_state, x, y); break;
+						case 0x7: COpcodes::op_SUBN_Vx_Vy(a_state, x, y); break;
+						case 0xe: COpcodes::op_SHL_Vx_Vy(a_state, x, y); break;
+						default: break;
+					}
+					break;
+				case 0x9000: COpcodes::op_SNE_Vx_Vy(a_state, x, y); break;
+				case 0xa000: COpcodes::op_LD_I_addr(a_state, nnn); break;
+				case 0xb000: COpcodes::op_JP_V0_addr(a_state, nnn); break;
+				case 0xc000: COpcodes::op_RND_Vx_byte(a_state, x, kk); break;
+				case 0xd000: COpcodes::op_DRW_Vx_Vy_nibble(a_state, my_bus, x, y, my_opcode & 0x000f); break;
+				case 0xe000:
+					if (kk == 0x9e)			COpcodes::op_SKP_Vx(a_state, x);
+					else if (kk == 0xa1)	COpcodes::op_SKNP_Vx(a_state, x);
+					break;
+				case 0xf000:
+					switch (kk)
+					{
+						case 0x07: COpcodes::op_LD_Vx_DT(a_state, x); break;
+						case 0x0a: COpcodes::op_LD_Vx_K(a_state, x); break;
+						case 0x15: COpcodes::op_LD_DT_Vx(a_state, x); break;
+						case 0x18: COpcodes::op_LD_ST_Vx(a_state, x); break;
+						case 0x1e: COpcodes::op_ADD_I_Vx(a_state, x); break;
+						case 0x29: COpcodes::op_LD_F_Vx(a_state, x); break;
+						case 0x33: COpcodes::op_LD_B_Vx(a_state, my_bus, x); break;
+						case 0x55: COpcodes::op_LD_I_Vx(a_state, my_bus, x); break;
+						case 0x65: COpcodes::op_LD_Vx_I(a_state, my_bus, x); break;
+						default: break;
+					}
+					break;
+			}
+		}
+};
@@ -0,0 +1,362 @@
+#include "CRecompiler.h"
+#include "CCPU.h"
+#include "CMemory.h"
+#include "CGraphics.h"
+#include <stdarg.h>
+#include <vector>
+#include <memory>
+
+namespace {
+
+	std::string format(const char* a_format, ...)
+	{
+		char my_buffer[256];
+
+		va_list my_arguments;
+		va_start(my_arguments, a_format);
+		vsnprintf(my_buffer, sizeof(my_buffer), a_format, my_arguments);
+		va_end(my_arguments);
+
+		return my_buffer;
+	}
+
+	// Writes a byte array as a C initialiser, 16 to a line.
+	void emit_bytes(std::ostream& a_stream, const char* a_name, const uint8_t* a_bytes, size_t a_size)
+	{
+		a_stream << "static const uint8_t " << a_name << "[" << a_size << "] =\n{\n";
+
+		for (size_t i = 0; i < a_size; i += 16)
+		{
+			a_stream << "\t";
+
+			for (size_t j = i; j < i + 16 && j < a_size; j++)
+				a_stream << format("0x%02x,", a_bytes[j]);
+
+			a_stream << "\n";
+		}
+
+		a_stream << "};\n\n";
+	}
+}
+
+CRecompiler::CRecompiler(const SChip8State& an_image, uint32_t a_rom_size) :
+	the_rom_size(a_rom_size),
+	the_instructions({}),
+	the_compiled({})
+{
+	memcpy(the_image.data(), an_image.the_memory, the_image.size());
+	analyse();
+}
+
+bool
+CRecompiler::is_compiled(int an_address)
+{
+	return the_instructions[an_address];
+}
+
+size_t
+CRecompiler::get_instruction_count()
+{
+	size_t my_count = 0;
+
+	for (bool my_instruction : the_instructions)
+		my_count += my_instruction ? 1 : 0;
+
+	return my_count;
+}
+
+uint16_t
+CRecompiler::get_opcode(int an_address)
+{
+	return the_image[an_address] << 8 | the_image[an_address + 1];
+}
+
+void
+CRecompiler::analyse()
+{
+	std::vector<int> my_work = { 0x200 };
+
+	while (!my_work.empty())
+	{
+		int my_address = my_work.back();
+		my_work.pop_back();
+
+		// Ran off the end of memory, or been here before.
+		if (my_address + 1 >= (int)the_image.size() || the_instructions[my_address])
+			continue;
+
+		the_instructions[my_address]	= true;
+		the_compiled[my_address]		= 1;
+		the_compiled[my_address + 1]	= 1;
+
+		uint16_t my_opcode = get_opcode(my_address);
+
+		switch (my_opcode & 0xf000)
+		{
+			case 0x0000:
+				// 00EE goes wherever the stack says, unknown opcodes never leave.
+				if ((my_opcode & 0x00ff) == 0xe0)
+					my_work.push_back(my_address + 2);
+				break;
+			case 0x1000:
+				my_work.push_back(my_opcode & 0x0fff);
+				break;
+			case 0x2000:
+				// RET returns to the CALL itself, the instruction after it is where a return normally goes.
+				my_work.push_back(my_opcode & 0x0fff);
+				my_work.push_back(my_address + 2);
+				break;
+			case 0x3000:
+			case 0x4000:
+			case 0x5000:
+			case 0x9000:
+			case 0xe000:
+				my_work.push_back(my_address + 2);
+				my_work.push_back(my_address + 4);
+				break;
+			case 0xb000:
+				// Only known at run time.
+				break;
+			default:
+				my_work.push_back(my_address + 2);
+				break;
+		}
+	}
+}
+
+void
+CRecompiler::emit(std::ostream& a_stream, const std::string& a_source)
+{
+	a_stream << "// Generated by chip8-recomp from " << a_source << ", do not edit.\n";
+	a_stream << "// " << get_instruction_count() << " instructions compiled.\n\n";
+	a_stream << "#include \"CRecompRuntime.h\"\n\n";
+
+	a_stream << "// Memory at reset, the font and the ROM.\n";
+	emit_bytes(a_stream, "the_image", the_image.data(), the_image.size());
+
+	a_stream << "// The bytes of every compiled instruction, writes to them hand over to the interpreter.\n";
+	emit_bytes(a_stream, "the_compiled", the_compiled.data(), the_compiled.size());
+
+	a_stream << "// Finish an instruction: tick the timers, leave once the count is used up, otherwise carry on.\n";
+	a_stream << "#define RECOMP_GOTO(an_address, a_label)\tdo { CRecompRuntime::tick(s); if (++my_executed == a_count) { s.the_pc = an_address; return my_executed; } goto a_label; } while (0)\n";
+	a_stream << "#define RECOMP_DISPATCH()\t\t\t\t\tdo { CRecompRuntime::tick(s); if (++my_executed == a_count) return my_executed; goto dispatch; } while (0)\n\n";
+
+	a_stream << "void\nrecomp_reset(SChip8State& s)\n{\n\tCRecompRuntime::reset(s, the_image);\n}\n\n";
+
+	a_stream << "uint32_t\nrecomp_run(SChip8State& s, uint32_t a_count)\n{\n";
+	a_stream << "\tCRecompRuntime::SBus my_bus = { s, the_compiled };\n";
+	a_stream << "\tuint32_t my_executed = 0;\n\n";
+	a_stream << "\tif (a_count == 0)\n\t\treturn 0;\n\n";
+
+	a_stream << "dispatch:\n";
+	a_stream << "\tif (!s.the_code_written)\n\t{\n\t\tswitch (s.the_pc)\n\t\t{\n";
+
+	for (int i = 0; i < (int)the_instructions.size(); i++)
+	{
+		if (the_instructions[i])
+			a_stream << format("\t\t\tcase 0x%03X: goto L_%03X;\n", i, i);
+	}
+
+	a_stream << "\t\t\tdefault: break;\n\t\t}\n\t}\n\n";
+	a_stream << "\t// Not compiled, or written over.\n";
+	a_stream << "\tCRecompRuntime::step(s, the_compiled);\n";
+	a_stream << "\tRECOMP_DISPATCH();\n";
+
+	for (int i = 0; i < (int)the_instructions.size(); i++)
+	{
+		if (the_instructions[i])
+			emit_instruction(a_stream, i);
+	}
+
+	a_stream << "}\n\n";
+	a_stream << "#undef RECOMP_GOTO\n#undef RECOMP_DISPATCH\n\n";
+
+	a_stream << "#ifndef CHIP8_RECOMP_NO_MAIN\n";
+	a_stream << "#include <chrono>\n";
+	a_stream << "#ifdef CHIP8_RECOMP_VERIFY\n#include \"CRecompiler.h\"\n#endif\n\n";
+	a_stream << "int main(int argc, char* argv[])\n{\n";
+	a_stream << "\tuint32_t my_frames = argc > 1 ? (uint32_t)atoi(argv[1]) : 600;\n\n";
+	a_stream << "\tstatic SChip8State s;\n";
+	a_stream << "\trecomp_reset(s);\n\n";
+	a_stream << "#ifdef CHIP8_RECOMP_VERIFY\n";
+	a_stream << "\tuint32_t my_matched = CRecompiler::verify(s, &recomp_run, my_frames);\n\n";
+	a_stream << "\tif (my_matched != my_frames)\n\t{\n";
+	a_stream << "\t\tprintf(\"State differs from CCPU in frame %u\\n\", my_matched);\n\t\treturn 1;\n\t}\n\n";
+	a_stream << "\tprintf(\"%u frames match CCPU\\n\", my_frames);\n";
+	a_stream << "#else\n";
+	a_stream << "\tauto my_start = std::chrono::steady_clock::now();\n\n";
+	a_stream << "\tfor (uint32_t my_frame = 0; my_frame < my_frames; my_frame++)\n";
+	a_stream << "\t\trecomp_run(s, CRecompRuntime::FRAME_INSTRUCTIONS);\n\n";
+	a_stream << "\tstd::chrono::duration<double> my_elapsed = std::chrono::steady_clock::now() - my_start;\n\n";
+	a_stream << "\tprintf(\"%u frames, hash %016llx, %.2f MIPS\\n\", my_frames, (unsigned long long)CRecompRuntime::hash(s),\n";
+	a_stream << "\t\tmy_frames * CRecompRuntime::FRAME_INSTRUCTIONS / my_elapsed.count() / 1e6);\n";
+	a_stream << "#endif\n\n";
+	a_stream << "\treturn 0;\n}\n";
+	a_stream << "#endif\n";
+}
+
+void
+CRecompiler::emit_goto(std::ostream& a_stream, int an_address)
+{
+	// Straight to the label when there is one, through the switch otherwise.
+	if (an_address < (int)the_instructions.size() && the_instructions[an_address])
+		a_stream << format("RECOMP_GOTO(0x%03X, L_%03X);\n", an_address, an_address);
+	else
+		a_stream << format("{ s.the_pc = 0x%03X; RECOMP_DISPATCH(); }\n", an_address);
+}
+
+void
+CRecompiler::emit_instruction(std::ostream& a_stream, int an_address)
+{
+	uint16_t	my_opcode	= get_opcode(an_address);
+	int			x			= (my_opcode & 0x0f00) >> 8;
+	int			y			= (my_opcode & 0x00f0) >> 4;
+	int			n			= my_opcode & 0x000f;
+	int			kk			= my_opcode & 0x00ff;
+	int			nnn			= my_opcode & 0x0fff;
+	int			my_next		= an_address + 2;
+	int			my_skip		= an_address + 4;
+
+	// The PC in the state is only kept up to date where something reads it.
+	std::string my_set_pc = format("s.the_pc = 0x%03X; ", an_address);
+
+	a_stream << format("\nL_%03X:\t// %04X\n\t", an_address, my_opcode);
+
+	// A skip: the instruction after the next one when the condition holds.
+	auto my_skip_if = [&](const std::string& a_condition)
+	{
+		a_stream << "if (" << a_condition << ") ";
+		emit_goto(a_stream, my_skip);
+		a_stream << "\t";
+		emit_goto(a_stream, my_next);
+	};
+
+	switch (my_opcode & 0xf000)
+	{
+		case 0x0000:
+			if (kk == 0xe0)
+			{
+				a_stream << "COpcodes::op_CLS(s, my_bus);\n\t";
+				emit_goto(a_stream, my_next);
+			}
+			else if (kk == 0xee)
+			{
+				a_stream << "COpcodes::op_RET(s);\n\tRECOMP_DISPATCH();\n";
+			}
+			else
+			{
+				a_stream << "// Unknown, the PC doesn't move.\n\t";
+				emit_goto(a_stream, an_address);
+			}
+			return;
+		case 0x1000:
+			emit_goto(a_stream, nnn);
+			return;
+		case 0x2000:
+			a_stream << my_set_pc << format("COpcodes::op_CALL_addr(s, 0x%03X);\n\t", nnn);
+			emit_goto(a_stream, nnn);
+			return;
+		case 0x3000: my_skip_if(format("s.the_V[%d] == 0x%02X", x, kk)); return;
+		case 0x4000: my_skip_if(format("s.the_V[%d] != 0x%02X", x, kk)); return;
+		case 0x5000: my_skip_if(format("s.the_V[%d] == s.the_V[%d]", x, y)); return;
+		case 0x6000: a_stream << format("COpcodes::op_LD_Vx_byte(s, %d, 0x%02X);\n\t", x, kk); break;
+		case 0x7000: a_stream << format("COpcodes::op_ADD_Vx_byte(s, %d, 0x%02X);\n\t", x, kk); break;
+		case 0x8000:
+			switch (n)
+			{
+				case 0x0: a_stream << format("COpcodes::op_LD_Vx_Vy(s, %d, %d);\n\t", x, y); break;
+				case 0x1: a_stream << format("COpcodes::op_OR_Vx_Vy(s, %d, %d);\n\t", x, y); break;
+				case 0x2: a_stream << format("COpcodes::op_AND_Vx_Vy(s, %d, %d);\n\t", x, y); break;
+				case 0x3: a_stream << format("COpcodes::op_XOR_Vx_Vy(s, %d, %d);\n\t", x, y); break;
+				case 0x4: a_stream << format("COpcodes::op_ADD_Vx_Vy(s, %d, %d);\n\t", x, y); break;
+				case 0x5: a_stream << format("COpcodes::op_SUB_Vx_Vy(s, %d, %d);\n\t", x, y); break;
+				case 0x6: a_stream << format("COpcodes::op_SHR_Vx_Vy(s, %d, %d);\n\t", x, y); break;
+				case 0x7: a_stream << format("COpcodes::op_SUBN_Vx_Vy(s, %d, %d);\n\t", x, y); break;
+				case 0xe: a_stream << format("COpcodes::op_SHL_Vx_Vy(s, %d, %d);\n\t", x, y); break;
+				default:
+					a_stream << "// Unknown, the PC doesn't move.\n\t";
+					emit_goto(a_stream, an_address);
+					return;
+			}
+			break;
+		case 0x9000: my_skip_if(format("s.the_V[%d] != s.the_V[%d]", x, y)); return;
+		case 0xa000: a_stream << format("COpcodes::op_LD_I_addr(s, 0x%03X);\n\t", nnn); break;
+		case 0xb000:
+			a_stream << format("COpcodes::op_JP_V0_addr(s, 0x%03X);\n\tRECOMP_DISPATCH();\n", nnn);
+			return;
+		case 0xc000: a_stream << format("COpcodes::op_RND_Vx_byte(s, %d, 0x%02X);\n\t", x, kk); break;
+		case 0xd000: a_stream << format("COpcodes::op_DRW_Vx_Vy_nibble(s, my_bus, %d, %d, %d);\n\t", x, y, n); break;
+		case 0xe000:
+			if (kk == 0x9e)
+			{
+				my_skip_if(format("COpcodes::is_key_down(s, s.the_V[%d])", x));
+				return;
+			}
+			if (kk == 0xa1)
+			{
+				my_skip_if(format("!COpcodes::is_key_down(s, s.the_V[%d])", x));
+				return;
+			}
+			a_stream << "// Unknown, the PC doesn't move.\n\t";
+			emit_goto(a_stream, an_address);
+			return;
+		case 0xf000:
+			switch (kk)
+			{
+				case 0x07: a_stream << format("COpcodes::op_LD_Vx_DT(s, %d);\n\t", x); break;
+				case 0x0a:
+					a_stream << my_set_pc << format("COpcodes::op_LD_Vx_K(s, %d);\n\tRECOMP_DISPATCH();\n", x);
+					return;
+				case 0x15: a_stream << format("COpcodes::op_LD_DT_Vx(s, %d);\n\t", x); break;
+				case 0x18: a_stream << format("COpcodes::op_LD_ST_Vx(s, %d);\n\t", x); break;
+				case 0x1e: a_stream << format("COpcodes::op_ADD_I_Vx(s, %d);\n\t", x); break;
+				case 0x29: a_stream << format("COpcodes::op_LD_F_Vx(s, %d);\n\t", x); break;
+				case 0x33:
+				case 0x55:
+					a_stream << format("COpcodes::%s(s, my_bus, %d);\n\t", kk == 0x33 ? "op_LD_B_Vx" : "op_LD_I_Vx", x);
+					a_stream << format("if (s.the_code_written) { s.the_pc = 0x%03X; RECOMP_DISPATCH(); }\n\t", my_next);
+					break;
+				case 0x65: a_stream << format("COpcodes::op_LD_Vx_I(s, my_bus, %d);\n\t", x); break;
+				default:
+					a_stream << "// Unknown, the PC doesn't move.\n\t";
+					emit_goto(a_stream, an_address);
+					return;
+			}
+			break;
+	}
+
+	emit_goto(a_stream, my_next);
+}
+
+uint32_t
+CRecompiler::verify(const SChip8State& a_start, recomp_run_function a_run, uint32_t a_frames)
+{
+	struct SMachine
+	{
+		SChip8State	the_state;
+		CMemory		the_memory;
+		CGraphics	the_graphics;
+		CCPU		the_cpu;
+
+		SMachine(const SChip8State& a_state) :
+			the_state(a_state), the_memory(the_state), the_graphics(the_state), the_cpu(the_state, &the_memory, &the_graphics) {}
+	};
+
+	// Both sides start from the same copy of the machine.
+	std::unique_ptr<SMachine>		my_machine(new SMachine(a_start));
+	std::unique_ptr<SChip8State>	my_state(new SChip8State(a_start));
+
+	my_machine->the_cpu.set_trace(false);
+
+	// Both sides draw the same random numbers, they come with the state.
+	for (uint32_t my_frame = 0; my_frame < a_frames; my_frame++)
+	{
+		my_machine->the_cpu.run(CRecompRuntime::FRAME_INSTRUCTIONS);
+		a_run(*my_state, CRecompRuntime::FRAME_INSTRUCTIONS);
+
+		if (CRecompRuntime::hash(my_machine->the_state) != CRecompRuntime::hash(*my_state))
+			return my_frame;
+	}
+
+	return a_frames;
+}
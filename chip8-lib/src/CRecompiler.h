@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include <array>
+#include <ostream>
+#include <string>
+#include "CRecompRuntime.h"
+
+/**
+	Static recompiler, turns a ROM into a C++ translation unit.
+
+	Starting at 0x200 it follows every path the ROM can take without knowing register values: jumps, calls and both
+	sides of every skip. Each instruction it reaches becomes a label in the output, running straight on an
+	SChip8State, with direct jumps as plain gotos. Where the next address is only known at run time (00EE, BNNN,
+	FX0A) the code goes through a switch over all labels, and addresses that weren't compiled are interpreted by
+	CRecompRuntime. So is everything after the ROM writes over compiled code.
+
+	The output has a main() that runs the ROM and prints a state hash, built with CHIP8_RECOMP_VERIFY and linked
+	against chip8-lib it compares the hash after every frame with CCPU instead.
+*/
+class CRecompiler
+{
+	public:
+		CRecompiler(const SChip8State& an_image, uint32_t a_rom_size);
+		~CRecompiler() = default;
+
+		bool		is_compiled(int an_address);
+		size_t		get_instruction_count();
+		void		emit(std::ostream& a_stream, const std::string& a_source);
+
+		static uint32_t	verify(const SChip8State& a_start, recomp_run_function a_run, uint32_t a_frames);
+
+	private:
+		void		analyse();
+		void		emit_instruction(std::ostream& a_stream, int an_address);
+		void		emit_goto(std::ostream& a_stream, int an_address);
+		uint16_t	get_opcode(int an_address);
+
+		std::array<uint8_t, 4096>	the_image;
+		uint32_t					the_rom_size;
+
+		// Addresses of the instructions found, and every byte that belongs to one of them.
+		std::array<bool, 4096>		the_instructions;
+		std::array<uint8_t, 4096>	the_compiled;
+};
@@ -1,18 +1,23 @@
 #include "CRegisters.h"
 
-CRegisters::CRegisters()
+CRegisters::CRegisters(SChip8State& a_state) : the_state(a_state)
 {
-	the_registers = {};
 }
 
 void
 CRegisters::set_register_value(int a_register, uint8_t a_value)
 {
-	the_registers[a_register] = a_value;
+	the_state.the_V[a_register & 0xf] = a_value;
 }
 
 uint8_t
 CRegisters::get_register_value(int a_register)
 {
-	return the_registers[a_register];
+	return the_state.the_V[a_register & 0xf];
+}
+
+uint8_t*
+CRegisters::get_data()
+{
+	return the_state.the_V;
 }
\ No newline at end of file
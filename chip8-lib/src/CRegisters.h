@@ -1,16 +1,17 @@
 #pragma once
 #include <array>
+#include "SChip8State.h"
 
 class CRegisters
 {
 	public:
-		CRegisters();
+		CRegisters(SChip8State& a_state);
 		~CRegisters() = default;
 		
 		void	set_register_value(int a_register, uint8_t a_value);
 		uint8_t get_register_value(int a_register);
+		uint8_t* get_data();
 
 	private:
-		std::array<uint8_t, 16>		the_registers;
+		SChip8State&	the_state;
 };
-
@@ -0,0 +1,237 @@
+#include "CRewind.h"
+#include <string.h>
+
+const size_t	CRewind::DEFAULT_FRAMES;
+const size_t	CRewind::DEFAULT_BUDGET;
+const uint32_t	CRewind::DEFAULT_KEYFRAME_INTERVAL;
+const size_t	CRewind::FRAME_SIZE;
+const size_t	CRewind::MAX_ENTRY_SIZE;
+
+// The clock at the front of a frame: frame count, clock credit and rate.
+static const size_t CLOCK_SIZE = 8 + 8 + 4;
+
+// The state up to the end of its RAM, what's behind that is padding.
+static const size_t STATE_SIZE = offsetof(SChip8State, the_memory) + sizeof(SChip8State::the_memory);
+
+CRewind::CRewind(size_t a_frames, size_t a_budget, uint32_t a_keyframe_interval, const uint8_t* an_image) :
+	the_arena(a_budget > MAX_ENTRY_SIZE ? a_budget : MAX_ENTRY_SIZE),
+	the_write(0),
+	the_used(0),
+	the_entries((a_frames > 0 ? a_frames : 1) + (a_keyframe_interval > 0 ? a_keyframe_interval : 1)),
+	the_first(0),
+	the_size(0),
+	the_base(FRAME_SIZE, 0),
+	the_previous(FRAME_SIZE, 0),
+	the_current(FRAME_SIZE, 0),
+	the_runs(MAX_ENTRY_SIZE),
+	the_keyframe_interval(a_keyframe_interval > 0 ? a_keyframe_interval : 1),
+	the_since_keyframe(0),
+	the_evicted_count(0)
+{
+	// Keyframes are what changed from a machine with nothing but the image in its RAM.
+	if (an_image != nullptr)
+		memcpy(the_base.data() + CLOCK_SIZE + offsetof(SChip8State, the_memory), an_image, sizeof(SChip8State::the_memory));
+}
+
+void
+CRewind::capture(const SChip8State& a_state, const SSnapshotClock& a_clock)
+{
+	pack(a_state, a_clock, the_current.data());
+
+	bool	my_keyframe	= the_size == 0 || the_since_keyframe + 1 >= the_keyframe_interval;
+	size_t	my_size		= 0;
+
+	if (!my_keyframe)
+	{
+		my_size = CSnapshot::save_runs(the_current.data(), the_previous.data(), FRAME_SIZE, the_runs.data(), the_runs.size());
+
+		if (my_size != 0)
+		{
+			place(my_size, false);
+
+			// Making room took the frame it was against, it has to be a keyframe after all.
+			if (the_size == 1)
+			{
+				the_size = 0;
+				the_used = 0;
+				my_keyframe = true;
+			}
+		}
+		else
+		{
+			my_keyframe = true;
+		}
+	}
+
+	if (my_keyframe)
+	{
+		my_size = CSnapshot::save_runs(the_current.data(), the_base.data(), FRAME_SIZE, the_runs.data(), the_runs.size());
+		place(my_size, true);
+	}
+
+	the_since_keyframe = my_keyframe ? 0 : the_since_keyframe + 1;
+	the_previous.swap(the_current);
+}
+
+bool
+CRewind::step_back(SChip8State& a_state, SSnapshotClock& a_clock)
+{
+	if (the_size == 0)
+		return false;
+
+	// The newest frame is the one the next would have been stored against, it's at hand already.
+	unpack(the_previous.data(), a_state, a_clock);
+
+	// Its space is the next one's again.
+	SEntry& my_newest = get_entry(the_size - 1);
+
+	the_write	= my_newest.the_offset;
+	the_used	-= my_newest.the_size;
+	the_size--;
+
+	rebuild();
+
+	return true;
+}
+
+void
+CRewind::clear()
+{
+	the_write			= 0;
+	the_used			= 0;
+	the_first			= 0;
+	the_size			= 0;
+	the_since_keyframe	= 0;
+}
+
+size_t
+CRewind::get_size()
+{
+	return the_size;
+}
+
+size_t
+CRewind::get_capacity()
+{
+	return the_entries.size();
+}
+
+size_t
+CRewind::get_used_bytes()
+{
+	return the_used;
+}
+
+size_t
+CRewind::get_budget()
+{
+	return the_arena.size();
+}
+
+uint32_t
+CRewind::get_keyframe_interval()
+{
+	return the_keyframe_interval;
+}
+
+uint64_t
+CRewind::get_evicted_count()
+{
+	return the_evicted_count;
+}
+
+CRewind::SEntry&
+CRewind::get_entry(size_t an_index)
+{
+	size_t my_slot = the_first + an_index;
+
+	return the_entries[my_slot < the_entries.size() ? my_slot : my_slot - the_entries.size()];
+}
+
+void
+CRewind::place(size_t a_size, bool a_keyframe)
+{
+	// Past the end of the arena it starts over at the front, the frames left in the tail are the oldest.
+	size_t my_offset = the_write;
+
+	if (my_offset + a_size > the_arena.size())
+	{
+		while (the_size > 0 && get_entry(0).the_offset >= the_write)
+			evict();
+
+		my_offset = 0;
+	}
+
+	// The oldest frame is the next one in the way, if any is.
+	while (the_size > 0 && get_entry(0).the_offset >= my_offset && get_entry(0).the_offset < my_offset + a_size)
+		evict();
+
+	if (the_size == the_entries.size())
+		evict();
+
+	memcpy(the_arena.data() + my_offset, the_runs.data(), a_size);
+
+	SEntry& my_entry = get_entry(the_size++);
+
+	my_entry.the_offset		= (uint32_t)my_offset;
+	my_entry.the_size		= (uint16_t)a_size;
+	my_entry.the_keyframe	= a_keyframe;
+
+	the_write	= my_offset + a_size;
+	the_used	+= a_size;
+}
+
+void
+CRewind::evict()
+{
+	// The oldest keyframe and every frame up to the next one.
+	do
+	{
+		the_used -= get_entry(0).the_size;
+
+		if (++the_first == the_entries.size())
+			the_first = 0;
+
+		the_size--;
+		the_evicted_count++;
+	}
+	while (the_size > 0 && !get_entry(0).the_keyframe);
+}
+
+void
+CRewind::rebuild()
+{
+	// The newest frame into the_previous: its keyframe, then the frames after it.
+	if (the_size == 0)
+		return;
+
+	size_t my_keyframe = the_size - 1;
+
+	while (!get_entry(my_keyframe).the_keyframe)
+		my_keyframe--;
+
+	memcpy(the_previous.data(), the_base.data(), FRAME_SIZE);
+
+	for (size_t i = my_keyframe; i < the_size; i++)
+		CSnapshot::load_runs(the_previous.data(), the_arena.data() + get_entry(i).the_offset);
+
+	the_since_keyframe = (uint32_t)(the_size - 1 - my_keyframe);
+}
+
+void
+CRewind::pack(const SChip8State& a_state, const SSnapshotClock& a_clock, uint8_t* a_frame)
+{
+	memcpy(a_frame, &a_clock.the_frame_count, 8);
+	memcpy(a_frame + 8, &a_clock.the_clock_credit, 8);
+	memcpy(a_frame + 16, &a_clock.the_clock_rate, 4);
+	memcpy(a_frame + CLOCK_SIZE, &a_state, STATE_SIZE);
+}
+
+void
+CRewind::unpack(const uint8_t* a_frame, SChip8State& a_state, SSnapshotClock& a_clock)
+{
+	memcpy(&a_clock.the_frame_count, a_frame, 8);
+	memcpy(&a_clock.the_clock_credit, a_frame + 8, 8);
+	memcpy(&a_clock.the_clock_rate, a_frame + 16, 4);
+	memcpy(&a_state, a_frame + CLOCK_SIZE, STATE_SIZE);
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "CSnapshot.h"
+#include "SChip8State.h"
+
+/**
+	The last frames of a machine, to step back through them one at a time. CCPU::set_frame_hook() hands it every
+	frame, capture() keeps it and step_back() gives the newest one back and forgets it.
+
+	A frame is stored as the runs of bytes that changed since the frame before (see CSnapshot::save_runs()), most are
+	a few registers, the clock and a screen row or two. Every keyframe_interval frames one is stored against a blank
+	machine instead (with the image as its RAM, when there is one), stepping back rebuilds a frame from the keyframe
+	in front of it.
+
+	Everything is allocated once. The frames go into a ring of a_budget bytes, and when that's full the oldest keyframe
+	goes along with the frames that need it. Short of that, a_frames are always kept, and at most a keyframe interval
+	more.
+*/
+class CRewind
+{
+	public:
+		// Ten minutes at 60 frames a second, a keyframe a second.
+		static const size_t		DEFAULT_FRAMES				= 10 * 60 * 60;
+		static const size_t		DEFAULT_BUDGET				= 4 * 1024 * 1024;
+		static const uint32_t	DEFAULT_KEYFRAME_INTERVAL	= 60;
+
+		// A frame unpacked: the clock, then the state up to the end of its RAM.
+		static const size_t		FRAME_SIZE		= 20 + offsetof(SChip8State, the_memory) + sizeof(SChip8State::the_memory);
+
+		// The most runs of FRAME_SIZE bytes take, with their count and headers.
+		static const size_t		MAX_ENTRY_SIZE	= FRAME_SIZE + 8;
+
+		CRewind(size_t a_frames = DEFAULT_FRAMES, size_t a_budget = DEFAULT_BUDGET,
+			uint32_t a_keyframe_interval = DEFAULT_KEYFRAME_INTERVAL, const uint8_t* an_image = nullptr);
+		~CRewind() = default;
+
+		void		capture(const SChip8State& a_state, const SSnapshotClock& a_clock);
+		bool		step_back(SChip8State& a_state, SSnapshotClock& a_clock);
+		void		clear();
+
+		size_t		get_size();
+		size_t		get_capacity();
+		size_t		get_used_bytes();
+		size_t		get_budget();
+		uint32_t	get_keyframe_interval();
+		uint64_t	get_evicted_count();
+
+	private:
+		struct SEntry
+		{
+			uint32_t	the_offset;
+			uint16_t	the_size;
+			bool		the_keyframe;
+		};
+
+		SEntry&		get_entry(size_t an_index);
+		void		place(size_t a_size, bool a_keyframe);
+		void		evict();
+		void		rebuild();
+
+		static void	pack(const SChip8State& a_state, const SSnapshotClock& a_clock, uint8_t* a_frame);
+		static void	unpack(const uint8_t* a_frame, SChip8State& a_state, SSnapshotClock& a_clock);
+
+		// The frames' runs, where the next one goes, and the bytes in use.
+		std::vector<uint8_t>	the_arena;
+		size_t					the_write;
+		size_t					the_used;
+
+		// The frames, oldest first from the_first.
+		std::vector<SEntry>		the_entries;
+		size_t					the_first;
+		size_t					the_size;
+
+		// The blank machine keyframes are stored against, the newest frame, the one being captured, its runs.
+		std::vector<uint8_t>	the_base;
+		std::vector<uint8_t>	the_previous;
+		std::vector<uint8_t>	the_current;
+		std::vector<uint8_t>	the_runs;
+
+		// Frames since the newest keyframe.
+		uint32_t				the_keyframe_interval;
+		uint32_t				the_since_keyframe;
+		uint64_t				the_evicted_count;
+};
@@ -0,0 +1,89 @@
+#include "CSDLPresenter.h"
+#include "SChip8State.h"
+#include <string.h>
+
+CSDLPresenter::CSDLPresenter(CPixels::EFormat a_format) :
+	the_window(nullptr),
+	the_renderer(nullptr),
+	the_surface(nullptr),
+	the_texture(nullptr),
+	the_format(a_format)
+{
+}
+
+bool
+CSDLPresenter::init()
+{
+	bool my_return_flag;
+
+	if (SDL_Init(SDL_INIT_VIDEO) < 0)
+	{
+		my_return_flag = false;
+	}
+	else
+	{
+		// Create the window at the desired size.
+		//SDL_CreateWindowAndRenderer(WINDOW_WIDTH * SCALE, WINDOW_HEIGHT * SCALE, SDL_WINDOW_SHOWN, &the_window, &the_renderer);
+		the_window = SDL_CreateWindow("chip8", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_SHOWN);
+		the_renderer = SDL_CreateRenderer(the_window, -1, SDL_RENDERER_SOFTWARE);
+
+		if (the_window == nullptr || the_renderer == nullptr)
+		{
+			my_return_flag = false;
+		}
+		else
+		{
+			// Create the texture at the size of the screen, written to through SDL_LockTexture().
+			Uint32 my_format = the_format == CPixels::EFormat::ARGB8888 ? SDL_PIXELFORMAT_ARGB8888 : SDL_PIXELFORMAT_RGB332;
+			the_texture = SDL_CreateTexture(the_renderer, my_format, SDL_TEXTUREACCESS_STREAMING, SChip8State::SCREEN_WIDTH, SChip8State::SCREEN_HEIGHT);
+
+			// Set the colour to black, copy texture to render and render it.
+			/*SDL_SetTextureColorMod(the_texture, 0xff, 0xff, 0xff);
+			SDL_RenderCopy(the_renderer, the_texture, NULL, NULL);
+			SDL_RenderPresent(the_renderer);*/
+
+			my_return_flag = the_texture != nullptr;
+		}
+	}
+
+	return my_return_flag;
+}
+
+size_t
+CSDLPresenter::present(const uint64_t* a_screen, const SDirtyRect& a_dirty)
+{
+	// Nothing to draw on before init().
+	if (the_renderer == nullptr)
+		return 0;
+
+	// Only the part that changed, the texture keeps the rest. Every bit becomes a whole pixel, set is white.
+	SDL_Rect my_dirty;
+	my_dirty.x = a_dirty.the_x;
+	my_dirty.y = a_dirty.the_y;
+	my_dirty.w = a_dirty.the_width;
+	my_dirty.h = a_dirty.the_height;
+
+	void*	my_pixels;
+	int		my_pitch;
+
+	if (SDL_LockTexture(the_texture, &my_dirty, &my_pixels, &my_pitch) != 0)
+		return 0;
+
+	size_t my_bytes = CPixels::expand(the_format, a_screen, a_dirty, (uint8_t*)my_pixels, my_pitch);
+
+	SDL_UnlockTexture(the_texture);
+
+	// Rect set-up for auto scaling.
+	SDL_Rect my_rect;
+	my_rect.w = 640;
+	my_rect.h = 320;
+	my_rect.x = 0;
+	my_rect.y = 0;
+
+	// Copy texture to renderer. In this case, the texture will be automatically scaled to the render size.
+	//SDL_RenderCopyEx(the_renderer, the_texture, NULL, &my_rect, 180, &my_point, SDL_FLIP_HORIZONTAL);
+	SDL_RenderCopy(the_renderer, the_texture, NULL, &my_rect);
+	SDL_RenderPresent(the_renderer);
+
+	return my_bytes;
+}
\ No newline at end of file
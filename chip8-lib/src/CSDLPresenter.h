@@ -0,0 +1,31 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include "CPresenter.h"
+#include "CPixels.h"
+
+#define WINDOW_WIDTH 640
+#define WINDOW_HEIGHT 320
+
+/**
+	Shows the frames in an SDL window, scaled up to WINDOW_WIDTH x WINDOW_HEIGHT.
+
+	The texture is a streaming one in a_format, the dirty rectangle is locked and CPixels expands the rows straight
+	into it.
+*/
+class CSDLPresenter : public CPresenter
+{
+	public:
+		CSDLPresenter(CPixels::EFormat a_format = CPixels::EFormat::ARGB8888);
+		~CSDLPresenter() = default;
+
+		bool	init() override;
+		size_t	present(const uint64_t* a_screen, const SDirtyRect& a_dirty) override;
+
+	private:
+		// sdl stuff
+		SDL_Window* the_window;
+		SDL_Renderer* the_renderer;
+		SDL_Surface* the_surface;
+		SDL_Texture* the_texture;
+		CPixels::EFormat the_format;
+};
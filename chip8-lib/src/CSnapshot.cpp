@@ -0,0 +1,343 @@
+#include "CSnapshot.h"
+#include <string.h>
+
+// A run of changed RAM costs its offset and length on top of its bytes, equal bytes up to that many between two
+// changes are cheaper to store along with them.
+static const int DELTA_GAP = 4;
+
+// The clock as it's stored: frame count, clock credit and rate.
+static const size_t CLOCK_SIZE = 8 + 8 + 4;
+
+// The registers, timers, stack, random state and keys, the part of SChip8State in front of the screen.
+static const size_t HEAD_SIZE = offsetof(SChip8State, the_screen);
+
+static const uint64_t FNV_PRIME = 0x100000001b3ull;
+
+template <typename T>
+static inline void
+put(uint8_t*& a_buffer, const T& a_value)
+{
+	memcpy(a_buffer, &a_value, sizeof(T));
+	a_buffer += sizeof(T);
+}
+
+template <typename T>
+static inline T
+take(const uint8_t*& a_buffer)
+{
+	T my_value;
+	memcpy(&my_value, a_buffer, sizeof(T));
+	a_buffer += sizeof(T);
+
+	return my_value;
+}
+
+size_t
+CSnapshot::save(const SChip8State& a_state, const SSnapshotClock& a_clock, uint8_t* a_buffer, size_t a_size, const uint8_t* an_image)
+{
+	// Everything up to the RAM, a blank screen being the smallest it gets.
+	if (a_size < HEADER_SIZE + CLOCK_SIZE + HEAD_SIZE + 4)
+		return 0;
+
+	uint8_t* my_out			= a_buffer + HEADER_SIZE;
+	uint8_t* my_end			= a_buffer + a_size;
+	uint16_t my_flags		= 0;
+
+	put(my_out, a_clock.the_frame_count);
+	put(my_out, a_clock.the_clock_credit);
+	put(my_out, a_clock.the_clock_rate);
+
+	memcpy(my_out, &a_state, HEAD_SIZE);
+	my_out += HEAD_SIZE;
+
+	// The screen rows with anything on them.
+	uint32_t my_rows = 0;
+
+	for (int y = 0; y < SChip8State::SCREEN_HEIGHT; y++)
+	{
+		if (a_state.the_screen[y] != 0)
+			my_rows |= 1u << y;
+	}
+
+	put(my_out, my_rows);
+
+	for (int y = 0; y < SChip8State::SCREEN_HEIGHT; y++)
+	{
+		if ((my_rows & (1u << y)) == 0)
+			continue;
+
+		if ((size_t)(my_end - my_out) < sizeof(uint64_t))
+			return 0;
+
+		put(my_out, a_state.the_screen[y]);
+	}
+
+	// The RAM as changes to the image when that's smaller, whole otherwise.
+	size_t my_left = my_end - my_out;
+
+	if (an_image != nullptr)
+	{
+		size_t my_delta = save_runs(a_state.the_memory, an_image, sizeof(a_state.the_memory), my_out, my_left < sizeof(a_state.the_memory) ? my_left : sizeof(a_state.the_memory) - 1);
+
+		if (my_delta != 0)
+		{
+			my_flags |= RAM_DELTA;
+			my_out += my_delta;
+		}
+	}
+
+	if ((my_flags & RAM_DELTA) == 0)
+	{
+		if (my_left < sizeof(a_state.the_memory))
+			return 0;
+
+		memcpy(my_out, a_state.the_memory, sizeof(a_state.the_memory));
+		my_out += sizeof(a_state.the_memory);
+	}
+
+	uint32_t	my_size		= (uint32_t)(my_out - a_buffer);
+	uint8_t*	my_header	= a_buffer;
+
+	put(my_header, MAGIC);
+	put(my_header, VERSION);
+	put(my_header, my_flags);
+	put(my_header, my_size);
+	put(my_header, checksum(a_buffer + HEADER_SIZE, my_size - HEADER_SIZE));
+
+	return my_size;
+}
+
+bool
+CSnapshot::load(SChip8State& a_state, SSnapshotClock& a_clock, const uint8_t* a_buffer, size_t a_size, const uint8_t* an_image)
+{
+	size_t my_size = get_size(a_buffer, a_size);
+
+	if (my_size == 0)
+		return false;
+
+	// Past magic and version, get_size() checked those.
+	const uint8_t*	my_in		= a_buffer + 6;
+	uint16_t		my_flags	= take<uint16_t>(my_in);
+	const uint8_t*	my_end		= a_buffer + my_size;
+
+	take<uint32_t>(my_in);
+
+	if (take<uint32_t>(my_in) != checksum(a_buffer + HEADER_SIZE, my_size - HEADER_SIZE))
+		return false;
+
+	if ((my_flags & RAM_DELTA) != 0 && an_image == nullptr)
+		return false;
+
+	// Walk it once to see everything is where the sizes say, before any of it is written.
+	const uint8_t*	my_head		= my_in + CLOCK_SIZE;
+	const uint8_t*	my_screen	= my_head + HEAD_SIZE;
+	uint32_t		my_rows		= take<uint32_t>(my_screen);
+	const uint8_t*	my_memory	= my_screen;
+
+	for (int y = 0; y < SChip8State::SCREEN_HEIGHT; y++)
+	{
+		if ((my_rows & (1u << y)) != 0)
+			my_memory += sizeof(uint64_t);
+	}
+
+	if (my_memory > my_end)
+		return false;
+
+	if ((my_flags & RAM_DELTA) != 0)
+	{
+		if (check_runs(my_memory, my_end - my_memory, sizeof(a_state.the_memory)) != (size_t)(my_end - my_memory))
+			return false;
+	}
+	else if (my_end - my_memory != sizeof(a_state.the_memory))
+	{
+		return false;
+	}
+
+	// Now in.
+	a_clock.the_frame_count		= take<uint64_t>(my_in);
+	a_clock.the_clock_credit	= take<int64_t>(my_in);
+	a_clock.the_clock_rate		= take<uint32_t>(my_in);
+
+	memcpy(&a_state, my_head, HEAD_SIZE);
+
+	for (int y = 0; y < SChip8State::SCREEN_HEIGHT; y++)
+		a_state.the_screen[y] = (my_rows & (1u << y)) != 0 ? take<uint64_t>(my_screen) : 0;
+
+	if ((my_flags & RAM_DELTA) != 0)
+	{
+		memcpy(a_state.the_memory, an_image, sizeof(a_state.the_memory));
+		load_runs(a_state.the_memory, my_memory);
+	}
+	else
+	{
+		memcpy(a_state.the_memory, my_memory, sizeof(a_state.the_memory));
+	}
+
+	return true;
+}
+
+size_t
+CSnapshot::get_size(const uint8_t* a_buffer, size_t a_size)
+{
+	// The size of the snapshot at the start of a_buffer, 0 when there isn't one of this version.
+	if (a_size < HEADER_SIZE)
+		return 0;
+
+	const uint8_t* my_in = a_buffer;
+
+	if (take<uint32_t>(my_in) != MAGIC || take<uint16_t>(my_in) != VERSION)
+		return 0;
+
+	// No flags it doesn't know.
+	if ((take<uint16_t>(my_in) & ~RAM_DELTA) != 0)
+		return 0;
+
+	uint32_t my_size = take<uint32_t>(my_in);
+
+	if (my_size > a_size || my_size < HEADER_SIZE + CLOCK_SIZE + HEAD_SIZE + 4)
+		return 0;
+
+	return my_size;
+}
+
+uint32_t
+CSnapshot::checksum(const uint8_t* a_data, size_t a_size)
+{
+	// Fletcher's sums over 64 bit words in four independent lanes: the first sum of a lane catches changed bytes, the
+	// second where they are. Mixed down to 32 bits at the end.
+	uint64_t	my_sum0 = 0, my_sum1 = 0, my_sum2 = 0, my_sum3 = 0;
+	uint64_t	my_weighted0 = 0, my_weighted1 = 0, my_weighted2 = 0, my_weighted3 = 0;
+	size_t		i = 0;
+
+	for (; i + 32 <= a_size; i += 32)
+	{
+		uint64_t my_words[4];
+		memcpy(my_words, a_data + i, sizeof(my_words));
+
+		my_sum0 += my_words[0];		my_weighted0 += my_sum0;
+		my_sum1 += my_words[1];		my_weighted1 += my_sum1;
+		my_sum2 += my_words[2];		my_weighted2 += my_sum2;
+		my_sum3 += my_words[3];		my_weighted3 += my_sum3;
+	}
+
+	for (; i < a_size; i++)
+	{
+		my_sum0 += a_data[i];
+		my_weighted0 += my_sum0;
+	}
+
+	const uint64_t my_sums[8] = { my_sum0, my_weighted0, my_sum1, my_weighted1, my_sum2, my_weighted2, my_sum3, my_weighted3 };
+
+	uint64_t my_hash = 0xcbf29ce484222325ull ^ a_size;
+
+	for (uint64_t my_sum : my_sums)
+	{
+		my_hash = (my_hash ^ my_sum) * FNV_PRIME;
+		my_hash ^= my_hash >> 29;
+	}
+
+	return (uint32_t)(my_hash ^ (my_hash >> 32));
+}
+
+size_t
+CSnapshot::save_runs(const uint8_t* a_data, const uint8_t* a_base, size_t a_length, uint8_t* a_buffer, size_t a_size)
+{
+	// A run count, then offset, length and bytes of every run. 0 when it doesn't fit into a_size.
+	const int	my_data_size	= (int)a_length;
+	uint8_t*	my_out			= a_buffer + 2;
+	uint8_t*	my_end			= a_buffer + a_size;
+	uint16_t	my_count		= 0;
+	int			i				= 0;
+
+	if (a_size < 2)
+		return 0;
+
+	while (i < my_data_size)
+	{
+		// Most of it is the same, eight bytes at a time.
+		while (i + 8 <= my_data_size && memcmp(a_data + i, a_base + i, 8) == 0)
+			i += 8;
+
+		if (i >= my_data_size)
+			break;
+
+		if (a_data[i] == a_base[i])
+		{
+			i++;
+			continue;
+		}
+
+		// Up to the last change that isn't followed by more than DELTA_GAP equal bytes.
+		int my_first	= i;
+		int my_last		= i;
+
+		for (i = my_first + 1; i < my_data_size && i - my_last <= DELTA_GAP; i++)
+		{
+			if (a_data[i] != a_base[i])
+				my_last = i;
+		}
+
+		uint16_t my_length = (uint16_t)(my_last - my_first + 1);
+
+		if (my_end - my_out < 4 + my_length)
+			return 0;
+
+		put(my_out, (uint16_t)my_first);
+		put(my_out, my_length);
+		memcpy(my_out, a_data + my_first, my_length);
+
+		my_out	+= my_length;
+		i		= my_last + 1;
+		my_count++;
+	}
+
+	memcpy(a_buffer, &my_count, sizeof(my_count));
+
+	return my_out - a_buffer;
+}
+
+size_t
+CSnapshot::check_runs(const uint8_t* a_buffer, size_t a_size, size_t a_length)
+{
+	const uint8_t* my_run = a_buffer;
+	const uint8_t* my_end = a_buffer + a_size;
+
+	if (a_size < 2)
+		return 0;
+
+	uint16_t my_count = take<uint16_t>(my_run);
+
+	for (uint16_t i = 0; i < my_count; i++)
+	{
+		if (my_end - my_run < 4)
+			return 0;
+
+		uint16_t my_offset = take<uint16_t>(my_run);
+		uint16_t my_length = take<uint16_t>(my_run);
+
+		if ((size_t)my_offset + my_length > a_length || my_end - my_run < my_length)
+			return 0;
+
+		my_run += my_length;
+	}
+
+	return my_run - a_buffer;
+}
+
+size_t
+CSnapshot::load_runs(uint8_t* a_data, const uint8_t* a_buffer)
+{
+	const uint8_t*	my_run		= a_buffer;
+	uint16_t		my_count	= take<uint16_t>(my_run);
+
+	for (uint16_t i = 0; i < my_count; i++)
+	{
+		uint16_t my_offset = take<uint16_t>(my_run);
+		uint16_t my_length = take<uint16_t>(my_run);
+
+		memcpy(a_data + my_offset, my_run, my_length);
+		my_run += my_length;
+	}
+
+	return my_run - a_buffer;
+}
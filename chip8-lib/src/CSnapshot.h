@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "SChip8State.h"
+
+/**
+	What a machine is besides its SChip8State: where it is in its frames, and the clock that fills them.
+*/
+struct SSnapshotClock
+{
+	uint64_t	the_frame_count;
+	int64_t		the_clock_credit;
+	uint32_t	the_clock_rate;
+};
+
+/**
+	A whole machine as a compact binary blob, written into and read from a buffer the caller owns. Nothing allocates.
+
+	The blob is a header (magic, version, flags, size, checksum over everything after the header) followed by the
+	clock, the registers, timers, stack, random state and keys as they are in SChip8State, the screen rows that
+	aren't blank behind a mask of which ones those are, and the RAM. Given an image (the RAM right after the ROM was loaded, or any other
+	4096 bytes the loader will have too) the RAM is stored as the runs of bytes that differ from it, which makes most
+	snapshots a few hundred bytes. Where that would come out larger than the RAM itself it's stored whole.
+
+	Numbers are in the byte order of the host, snapshots are for the machine and build that wrote them.
+*/
+class CSnapshot
+{
+	public:
+		static const uint32_t	MAGIC		= 0x4e533843;	// "C8SN"
+		static const uint16_t	VERSION		= 2;
+
+		// Flags.
+		static const uint16_t	RAM_DELTA	= 0x0001;
+
+		static const size_t		HEADER_SIZE	= 16;
+		static const size_t		MAX_SIZE	= HEADER_SIZE + 20 + offsetof(SChip8State, the_screen) + 4 + sizeof(SChip8State::the_screen)
+			+ sizeof(SChip8State::the_memory);
+
+		// Returns the bytes written, 0 when a_size isn't enough (MAX_SIZE always is).
+		static size_t	save(const SChip8State& a_state, const SSnapshotClock& a_clock, uint8_t* a_buffer, size_t a_size,
+			const uint8_t* an_image = nullptr);
+
+		// False, with a_state and a_clock left as they were, when the blob is damaged, from another version, or was
+		// saved against an image and none is given.
+		static bool		load(SChip8State& a_state, SSnapshotClock& a_clock, const uint8_t* a_buffer, size_t a_size,
+			const uint8_t* an_image = nullptr);
+
+		static size_t	get_size(const uint8_t* a_buffer, size_t a_size);
+		static uint32_t	checksum(const uint8_t* a_data, size_t a_size);
+
+		// The runs of a_length bytes at a_data that differ from a_base, as the RAM of a delta snapshot is stored.
+		// Returns the bytes written, 0 when a_size isn't enough. check_runs() returns the bytes of well-formed runs
+		// for a_length bytes at the start of a_buffer (0 otherwise), load_runs() writes checked ones over a_data.
+		static size_t	save_runs(const uint8_t* a_data, const uint8_t* a_base, size_t a_length, uint8_t* a_buffer, size_t a_size);
+		static size_t	check_runs(const uint8_t* a_buffer, size_t a_size, size_t a_length);
+		static size_t	load_runs(uint8_t* a_data, const uint8_t* a_buffer);
+};
@@ -1,24 +1,23 @@
 #include "CStack.h"
 
-CStack::CStack()
+CStack::CStack(SChip8State& a_state) : the_state(a_state)
 {
-	the_stack = {};
 }
 
 void
 CStack::push(uint16_t a_data)
 {
-	the_stack.push(a_data);
+	the_state.the_stack[the_state.the_sp++ & 0xf] = a_data;
 }
 
 uint16_t
 CStack::top()
 {
-	return the_stack.top();
+	return the_state.the_stack[(the_state.the_sp - 1) & 0xf];
 }
 
 void
 CStack::pop()
 {
-	the_stack.pop();
+	the_state.the_sp--;
 }
\ No newline at end of file
@@ -1,11 +1,15 @@
 #pragma once
 #include <stdint.h>
-#include <stack>
+#include "SChip8State.h"
 
+/**
+	The sixteen return addresses in the state, the_sp counts the entries. Deeper nesting wraps around instead of
+	overflowing into the rest of the state.
+*/
 class CStack
 {
 	public:
-		CStack();
+		CStack(SChip8State& a_state);
 		~CStack() = default;
 
 		void		push(uint16_t a_data);
@@ -13,6 +17,5 @@ class CStack
 		void		pop();
 
 	private:
-		std::stack<uint16_t> the_stack;
+		SChip8State&	the_state;
 };
-
@@ -0,0 +1,144 @@
+#include "CThreadPool.h"
+
+CThreadPool::CThreadPool(size_t a_threads) :
+	the_thread_count(a_threads),
+	the_batch(nullptr),
+	the_batch_number(0),
+	the_busy(0),
+	the_stopping(false)
+{
+	if (the_thread_count == 0)
+		the_thread_count = std::thread::hardware_concurrency();
+
+	if (the_thread_count == 0)
+		the_thread_count = 1;
+
+	for (size_t i = 0; i < the_thread_count; i++)
+		the_queues.emplace_back(new SQueue);
+
+	for (size_t i = 1; i < the_thread_count; i++)
+		the_threads.emplace_back(&CThreadPool::worker, this, i);
+}
+
+CThreadPool::~CThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> my_lock(the_mutex);
+		the_stopping = true;
+	}
+
+	the_start.notify_all();
+
+	for (std::thread& my_thread : the_threads)
+		my_thread.join();
+}
+
+size_t
+CThreadPool::get_thread_count()
+{
+	return the_thread_count;
+}
+
+void
+CThreadPool::run(std::vector<task>& some_tasks)
+{
+	// Contiguous shares, neighbouring tasks (the same ROM, say) tend to stay on one core.
+	for (size_t i = 0; i < the_thread_count; i++)
+	{
+		size_t my_begin	= some_tasks.size() * i / the_thread_count;
+		size_t my_end	= some_tasks.size() * (i + 1) / the_thread_count;
+
+		for (size_t j = my_begin; j < my_end; j++)
+			the_queues[i]->the_tasks.push_back(j);
+	}
+
+	// Nothing is added while the batch runs, so a worker that finds every queue empty is done.
+	{
+		std::lock_guard<std::mutex> my_lock(the_mutex);
+		the_batch = &some_tasks;
+		the_batch_number++;
+		the_busy = the_threads.size();
+	}
+
+	the_start.notify_all();
+
+	work(0, some_tasks);
+
+	std::unique_lock<std::mutex> my_lock(the_mutex);
+	the_done.wait(my_lock, [this] { return the_busy == 0; });
+	the_batch = nullptr;
+}
+
+void
+CThreadPool::worker(size_t a_worker)
+{
+	uint64_t my_batch_number = 0;
+
+	for (;;)
+	{
+		std::vector<task>* my_batch;
+
+		{
+			std::unique_lock<std::mutex> my_lock(the_mutex);
+			the_start.wait(my_lock, [&] { return the_stopping || the_batch_number != my_batch_number; });
+
+			if (the_stopping)
+				return;
+
+			my_batch_number	= the_batch_number;
+			my_batch		= the_batch;
+		}
+
+		work(a_worker, *my_batch);
+
+		std::lock_guard<std::mutex> my_lock(the_mutex);
+
+		if (--the_busy == 0)
+			the_done.notify_one();
+	}
+}
+
+void
+CThreadPool::work(size_t a_worker, std::vector<task>& some_tasks)
+{
+	size_t my_task;
+
+	while (pop(a_worker, my_task) || steal(a_worker, my_task))
+		some_tasks[my_task]();
+}
+
+bool
+CThreadPool::pop(size_t a_worker, size_t& a_task)
+{
+	SQueue& my_queue = *the_queues[a_worker];
+	std::lock_guard<std::mutex> my_lock(my_queue.the_mutex);
+
+	if (my_queue.the_tasks.empty())
+		return false;
+
+	a_task = my_queue.the_tasks.back();
+	my_queue.the_tasks.pop_back();
+
+	return true;
+}
+
+bool
+CThreadPool::steal(size_t a_worker, size_t& a_task)
+{
+	// Start at the next worker, so the thieves don't all go for the same queue.
+	for (size_t i = 1; i < the_thread_count; i++)
+	{
+		SQueue& my_queue = *the_queues[(a_worker + i) % the_thread_count];
+		std::lock_guard<std::mutex> my_lock(my_queue.the_mutex);
+
+		if (my_queue.the_tasks.empty())
+			continue;
+
+		a_task = my_queue.the_tasks.front();
+		my_queue.the_tasks.pop_front();
+
+		return true;
+	}
+
+	return false;
+}
\ No newline at end of file
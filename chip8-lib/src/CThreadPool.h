@@ -0,0 +1,57 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+	Runs a batch of tasks on a number of threads, with work stealing.
+
+	Every worker gets a contiguous share of the tasks in a queue of its own and works through it from the back. A
+	worker whose queue runs dry takes tasks from the front of the others', the end their owners get to last, so
+	uneven tasks even out without a shared queue everyone waits on. The calling thread is one of the workers, the
+	others are started once with the pool and sleep between batches. run() is meant for one thread at a time.
+*/
+class CThreadPool
+{
+	public:
+		typedef std::function<void()> task;
+
+		// No thread count, or 0, means one per hardware thread.
+		CThreadPool(size_t a_threads = 0);
+		~CThreadPool();
+
+		size_t	get_thread_count();
+		void	run(std::vector<task>& some_tasks);
+
+	private:
+		struct SQueue
+		{
+			std::mutex			the_mutex;
+			std::deque<size_t>	the_tasks;
+		};
+
+		void	worker(size_t a_worker);
+		void	work(size_t a_worker, std::vector<task>& some_tasks);
+		bool	pop(size_t a_worker, size_t& a_task);
+		bool	steal(size_t a_worker, size_t& a_task);
+
+		size_t									the_thread_count;
+		std::vector<std::unique_ptr<SQueue>>	the_queues;
+		std::vector<std::thread>				the_threads;
+
+		// The batch being run, handed to the workers by bumping the_batch_number. the_busy counts the workers
+		// that haven't finished it yet.
+		std::mutex								the_mutex;
+		std::condition_variable					the_start;
+		std::condition_variable					the_done;
+		std::vector<task>*						the_batch;
+		uint64_t								the_batch_number;
+		size_t									the_busy;
+		bool									the_stopping;
+};
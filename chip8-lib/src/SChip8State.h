@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+
+/**
+	Everything a CHIP-8 machine is, in one flat block without pointers.
+
+	The registers, timers, stack and the state of the random numbers come first and fill the first cache line,
+	every instruction touches them. The keyboard, the screen and the RAM follow. Copying a machine is one memcpy, and as many of them as fit can go into a
+	plain array.
+
+	The screen is a 64 bit word per row, the leftmost pixel in the top bit. DRW draws a sprite row with one shift and
+	one XOR, and the whole machine is about 4.5 KB.
+
+	CCPU runs on one of these, CMemory, CRegisters, CStack, CKeyboard and CGraphics are views onto its parts.
+*/
+struct alignas(64) SChip8State
+{
+	static const int SCREEN_WIDTH	= 64;
+	static const int SCREEN_HEIGHT	= 32;
+
+	uint16_t	the_pc;
+	uint16_t	the_I;
+	uint8_t		the_sp;
+	uint8_t		the_delay_timer;
+	uint8_t		the_sound_timer;
+	uint8_t		the_code_written;	// Set by translated code once the ROM writes over it, see CRecompRuntime.
+	uint8_t		the_V[16];
+	uint16_t	the_stack[16];
+	uint64_t	the_random;			// What RND draws from next, see CRandom.
+
+	uint8_t		the_keys[16];
+	uint64_t	the_screen[SCREEN_HEIGHT];
+	uint8_t		the_memory[4096];
+};
+
+static_assert(std::is_trivially_copyable<SChip8State>::value, "SChip8State has to stay copyable with memcpy");
+static_assert(std::is_standard_layout<SChip8State>::value, "SChip8State has to stay a plain struct");
+static_assert(offsetof(SChip8State, the_keys) <= 64, "The registers, timers, stack and random state have to fit in one cache line");
+static_assert(sizeof(uint64_t) * 8 == SChip8State::SCREEN_WIDTH, "A screen row has to be one word");
@@ -1,29 +1,67 @@
 // chip8-main.cpp : This file contains the 'main' function. Program execution begins and ends there.
 //
+// Usage: chip8-main [--run-ahead <frames>]
+// Run-ahead presents every frame that many frames on, see CCPU::set_run_ahead(). 2 or so hides the frame or two most
+// games take to answer a key.
 
 #include <iostream>
+#include <string>
+#include <stdlib.h>
 #include "..\chip8-lib\src\CMemory.h"
 #include "..\chip8-lib\src\CRegisters.h"
 #include "..\chip8-lib\src\CKeyboard.h"
 #include "..\chip8-lib\src\CGraphics.h"
+#include "..\chip8-lib\src\CSDLPresenter.h"
 #include "..\chip8-lib\src\CCPU.h"
+#include "..\chip8-lib\src\CRewind.h"
 
 #include "..\chip8-lib\src\stuff.h"
 
 int main(int argc, char* argv[])
 {
-    CMemory*    my_memory       = new CMemory;
-    CRegisters* my_register     = new CRegisters;
-    CStack*     my_stack        = new CStack;
-    CGraphics*  my_graphics     = new CGraphics;
-    CKeyboard*  my_keyboard     = new CKeyboard;
+    uint32_t my_run_ahead = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--run-ahead" && i + 1 < argc)
+        {
+            my_run_ahead = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        }
+        else
+        {
+            std::cerr << "Usage: chip8-main [--run-ahead <frames>]\n";
+            return 1;
+        }
+    }
+
+    SChip8State*    my_state        = new SChip8State();
+    CMemory*        my_memory       = new CMemory(*my_state);
+    CGraphics*      my_graphics     = new CGraphics(*my_state);
+    CSDLPresenter*  my_presenter    = new CSDLPresenter;
+
+    my_graphics->set_presenter(my_presenter);
     
-    CCPU my_cpu(my_memory, my_register, my_stack, my_graphics, my_keyboard);
+    CCPU my_cpu(*my_state, my_memory, my_graphics);
 
     //my_cpu.load_game("..\\games\\draw.ch8");
     my_cpu.load_game("..\\games\\draw.ch8");
     my_cpu.initialize();
+    my_cpu.set_run_ahead(my_run_ahead);
+
+    // The last ten minutes, to step back through.
+    CRewind my_rewind(CRewind::DEFAULT_FRAMES, CRewind::DEFAULT_BUDGET, CRewind::DEFAULT_KEYFRAME_INTERVAL, my_state->the_memory);
+
+    my_cpu.set_frame_hook([&my_rewind](CCPU& a_cpu) { my_rewind.capture(a_cpu.get_state(), a_cpu.get_clock()); });
     my_cpu.start();
+
+    // What damage tracking saved over uploading every frame whole.
+    std::cout << my_cpu.get_frame_count() << " frames, " << my_graphics->get_present_count() << " presented, "
+        << my_graphics->get_skipped_count() << " skipped, " << my_graphics->get_uploaded_bytes() << " bytes uploaded" << std::endl;
+    std::cout << my_rewind.get_size() << " frames to rewind in " << my_rewind.get_used_bytes() << " bytes" << std::endl;
+
+    // From a key changing to the screen showing what the game drew after it read the key, run-ahead takes its frames off.
+    std::cout << my_cpu.get_input_latency() << " frames input latency over " << my_cpu.get_input_latency_count()
+        << " key changes, running " << my_cpu.get_run_ahead() << " frames ahead" << std::endl;
     
     return 0;
 }
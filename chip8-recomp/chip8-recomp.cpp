@@ -0,0 +1,51 @@
+// chip8-recomp.cpp : Turns a ROM into a C++ translation unit.
+//
+// Usage: chip8-recomp <rom.ch8> <out.cpp>
+// Build the output with chip8-lib/src on the include path. Define CHIP8_RECOMP_VERIFY and link chip8-lib to have it
+// compare every frame with the interpreter instead.
+
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include "../chip8-lib/src/CMemory.h"
+#include "../chip8-lib/src/CGraphics.h"
+#include "../chip8-lib/src/CCPU.h"
+#include "../chip8-lib/src/CRecompiler.h"
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: chip8-recomp <rom.ch8> <out.cpp>\n";
+        return 1;
+    }
+
+    // The machine as the ROM starts on it.
+    std::unique_ptr<SChip8State> my_image(new SChip8State());
+    CMemory     my_memory(*my_image);
+    CGraphics   my_graphics(*my_image);
+
+    CCPU my_cpu(*my_image, &my_memory, &my_graphics);
+
+    if (!my_cpu.load_game(argv[1]))
+        return 1;
+
+    my_cpu.reset();
+
+    std::ifstream my_rom(argv[1], std::ios::binary | std::ios::ate);
+    CRecompiler my_recompiler(*my_image, (uint32_t)my_rom.tellg());
+
+    std::ofstream my_output(argv[2]);
+
+    if (!my_output)
+    {
+        std::cerr << "Unable to write " << argv[2] << "\n";
+        return 1;
+    }
+
+    my_recompiler.emit(my_output, argv[1]);
+
+    std::cout << my_recompiler.get_instruction_count() << " instructions compiled into " << argv[2] << "\n";
+
+    return 0;
+}
@@ -5,9 +5,116 @@
 #include "../chip8-lib/src/CStack.h"
 #include "../chip8-lib/src/CGraphics.h"
 #include "../chip8-lib/src/CKeyboard.h"
+#include "../chip8-lib/src/CJit.h"
+#include "../chip8-lib/src/CFusion.h"
+#include "../chip8-lib/src/CRecompiler.h"
+#include "../chip8-lib/src/CPresenter.h"
+#include "../chip8-lib/src/CPixels.h"
+#include "../chip8-lib/src/CBatch.h"
+#include "../chip8-lib/src/CLockstep.h"
+#include "../chip8-lib/src/CCpuFeatures.h"
+#include "../chip8-lib/src/CDrawLog.h"
+#include "../chip8-lib/src/CSnapshot.h"
+#include "../chip8-lib/src/CRewind.h"
+#include "../chip8-lib/src/CRandom.h"
+#include "../chip8-lib/src/CMovie.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <cstddef>
+#include <thread>
+#include <set>
+#include <mutex>
+
+/**
+	The engine the opcode tests run on, CHIP8_TEST_ENGINE=switch|table|threaded|jit picks another one than the default.
+*/
+static CCPU::EEngine
+test_engine()
+{
+	const char* my_name = getenv("CHIP8_TEST_ENGINE");
+
+	if (my_name == nullptr)
+		return CCPU::EEngine::TABLE;
+	if (strcmp(my_name, "switch") == 0)
+		return CCPU::EEngine::SWITCH;
+	if (strcmp(my_name, "threaded") == 0)
+		return CCPU::EEngine::THREADED;
+	if (strcmp(my_name, "jit") == 0)
+		return CCPU::EEngine::JIT;
+
+	return CCPU::EEngine::TABLE;
+}
+
+/**
+	Every allocation of the test program, for tests that check a run doesn't allocate. All forms of new and delete
+	are replaced, so they always pair up, and over-aligned types like SChip8State are counted too.
+*/
+static std::atomic<uint64_t> the_allocation_count(0);
+
+static void*
+allocate(size_t a_size, size_t an_alignment)
+{
+	the_allocation_count++;
+
+	if (a_size == 0)
+		a_size = 1;
+
+	void* my_memory;
+
+	if (an_alignment <= alignof(std::max_align_t))
+		my_memory = malloc(a_size);
+	else
+#if defined(_WIN32)
+		my_memory = _aligned_malloc(a_size, an_alignment);
+#else
+		my_memory = aligned_alloc(an_alignment, (a_size + an_alignment - 1) / an_alignment * an_alignment);
+#endif
+
+	if (my_memory == nullptr)
+		throw std::bad_alloc();
+
+	return my_memory;
+}
+
+static void
+release(void* a_memory, size_t an_alignment)
+{
+#if defined(_WIN32)
+	if (an_alignment > alignof(std::max_align_t))
+	{
+		_aligned_free(a_memory);
+		return;
+	}
+#else
+	// aligned_alloc() memory goes back through free() like the rest.
+	(void)an_alignment;
+#endif
+
+	free(a_memory);
+}
+
+void* operator new(size_t a_size)										{ return allocate(a_size, 0); }
+void* operator new[](size_t a_size)										{ return allocate(a_size, 0); }
+void* operator new(size_t a_size, std::align_val_t an_alignment)		{ return allocate(a_size, (size_t)an_alignment); }
+void* operator new[](size_t a_size, std::align_val_t an_alignment)		{ return allocate(a_size, (size_t)an_alignment); }
+
+void operator delete(void* a_memory) noexcept															{ release(a_memory, 0); }
+void operator delete[](void* a_memory) noexcept															{ release(a_memory, 0); }
+void operator delete(void* a_memory, size_t) noexcept													{ release(a_memory, 0); }
+void operator delete[](void* a_memory, size_t) noexcept													{ release(a_memory, 0); }
+void operator delete(void* a_memory, std::align_val_t an_alignment) noexcept							{ release(a_memory, (size_t)an_alignment); }
+void operator delete[](void* a_memory, std::align_val_t an_alignment) noexcept							{ release(a_memory, (size_t)an_alignment); }
+void operator delete(void* a_memory, size_t, std::align_val_t an_alignment) noexcept					{ release(a_memory, (size_t)an_alignment); }
+void operator delete[](void* a_memory, size_t, std::align_val_t an_alignment) noexcept					{ release(a_memory, (size_t)an_alignment); }
 
 class opcode_parser : public testing::Test {
 public:
+	SChip8State*	the_state;
 	CMemory*		the_memory;
 	CRegisters*		the_registers;
 	CStack*			the_stack;
@@ -16,22 +123,26 @@ public:
 	CCPU*			the_cpu;
 
 	void SetUp() {
-		the_memory		= new CMemory;
-		the_registers	= new CRegisters;
-		the_stack		= new CStack;
-		the_graphics	= new CGraphics;
-		the_keyboard	= new CKeyboard;
-
-		the_cpu = new CCPU(the_memory, the_registers, the_stack, the_graphics, the_keyboard);
+		the_state		= new SChip8State();
+		the_memory		= new CMemory(*the_state);
+		the_registers	= new CRegisters(*the_state);
+		the_stack		= new CStack(*the_state);
+		the_graphics	= new CGraphics(*the_state);
+		the_keyboard	= new CKeyboard(*the_state);
+
+		the_cpu = new CCPU(*the_state, the_memory, the_graphics);
+		the_cpu->set_engine(test_engine());
 	}
 
 	void TearDown() {
+		// The CPU first, its JIT unhooks itself from the memory.
+		delete the_cpu;
 		delete the_memory;
 		delete the_registers;
 		delete the_stack;
 		delete the_graphics;
 		delete the_keyboard;
-		delete the_cpu;
+		delete the_state;
 	}
 };
 
@@ -58,6 +169,36 @@ TEST_F(opcode_parser, test_memory)
 }
 
 
+/**
+	Test to see if the decode cache follows writes to the memory.
+*/
+TEST_F(opcode_parser, test_decode_cache)
+{
+	// 0x200: LD V1, 0x28.
+	the_memory->load_data({ 0x61, 0x28 });
+
+	const CMemory::SDecoded& my_decoded = the_memory->get_decoded(0x200);
+
+	EXPECT_EQ(my_decoded.the_opcode, 0x6128);
+
+	// Rewrite the immediate, the entry has to be decoded again.
+	the_memory->set_byte(0x201, 0x44);
+
+	EXPECT_EQ(the_memory->get_decoded(0x200).the_opcode, 0x6144);
+
+	// The odd address overlapping it as well.
+	EXPECT_EQ(the_memory->get_decoded(0x201).the_opcode, 0x4400);
+	the_memory->set_byte(0x202, 0x12);
+	EXPECT_EQ(the_memory->get_decoded(0x201).the_opcode, 0x4412);
+
+	// Stepping runs the decoded instruction.
+	the_cpu->reset();
+	the_cpu->step();
+
+	EXPECT_EQ(the_registers->get_register_value(1), 0x44);
+	EXPECT_EQ(the_cpu->get_pc(), 0x202);
+}
+
 /**
 	Test to see if the registers are filled as intended.
 */
@@ -658,9 +799,8 @@ TEST_F(opcode_parser, test_JP_V0_addr)
 */
 TEST_F(opcode_parser, test_RND_Vx_byte)
 {
-	// Per definition of rand(), if we don't pass a seed to it using srand() before calling rand(), it will behave as if srand(1) is called.
-	// Seeing as we only set the seed in initialize(), we can abuse this for testing! 
-	// Therefore our implementation of rand() % 255 will always return 41.
+	// The numbers come from the machine's own generator, seeded with 0 its first one is 0xe220a8397b1dcdaf.
+	the_cpu->set_seed(0);
 
 	// Set up the opcode.
 	uint16_t my_opcode = 0xc521;
@@ -668,8 +808,8 @@ TEST_F(opcode_parser, test_RND_Vx_byte)
 	// Parse the opcode.
 	the_cpu->parse_opcode(my_opcode);
 
-	// My value to check, 41 is what rand() % 255 returns.
-	uint8_t my_value = 0x21 & 41;
+	// My value to check, the top byte of that number.
+	uint8_t my_value = 0x21 & 0xe2;
 
 	EXPECT_EQ(the_registers->get_register_value(5), my_value);
 }
@@ -755,6 +895,65 @@ TEST_F(opcode_parser, test_DRW_Vx_Vy_nibble)
 	EXPECT_EQ(the_graphics->get_pixel_state(1361), 0);
 }
 
+/**
+	DRW with a sprite that isn't symmetric: rows go across the screen, drawing on lit pixels sets VF, what runs off the
+	right and the bottom edge is clipped, and a start off the screen wraps around to it.
+*/
+TEST_F(opcode_parser, test_DRW_edges)
+{
+	// XXX.....		0xE0
+	// X.......		0x80
+	the_memory->set_byte(0, 0xe0);
+	the_memory->set_byte(1, 0x80);
+
+	// At (0,0): the first row across, the second one below it.
+	the_cpu->parse_opcode(0xd122);
+
+	EXPECT_EQ(the_graphics->get_pixel_state(0), 1);
+	EXPECT_EQ(the_graphics->get_pixel_state(1), 1);
+	EXPECT_EQ(the_graphics->get_pixel_state(2), 1);
+	EXPECT_EQ(the_graphics->get_pixel_state(64), 1);
+	EXPECT_EQ(the_graphics->get_pixel_state(65), 0);
+	EXPECT_EQ(the_registers->get_register_value(0xf), 0);
+
+	// One pixel further right overlaps twice, VF set, the overlap is gone.
+	the_registers->set_register_value(1, 1);
+	the_cpu->parse_opcode(0xd122);
+
+	EXPECT_EQ(the_registers->get_register_value(0xf), 1);
+	EXPECT_EQ(the_graphics->get_pixel_state(0), 1);
+	EXPECT_EQ(the_graphics->get_pixel_state(1), 0);
+	EXPECT_EQ(the_graphics->get_pixel_state(2), 0);
+	EXPECT_EQ(the_graphics->get_pixel_state(3), 1);
+	EXPECT_EQ(the_graphics->get_pixel_state(65), 1);
+
+	// At (62,31): two pixels of the first row are left, nothing wraps to the left edge or the top.
+	the_graphics->clear();
+	the_registers->set_register_value(1, 62);
+	the_registers->set_register_value(2, 31);
+	the_cpu->parse_opcode(0xd122);
+
+	EXPECT_EQ(the_graphics->get_pixel_state(31 * 64 + 62), 1);
+	EXPECT_EQ(the_graphics->get_pixel_state(31 * 64 + 63), 1);
+	EXPECT_EQ(the_registers->get_register_value(0xf), 0);
+
+	int my_lit = 0;
+	for (size_t i = 0; i < the_graphics->get_size(); i++)
+		my_lit += the_graphics->get_pixel_state(i);
+	EXPECT_EQ(my_lit, 2);
+
+	// At (70,33) it's drawn at (6,1).
+	the_graphics->clear();
+	the_registers->set_register_value(1, 70);
+	the_registers->set_register_value(2, 33);
+	the_cpu->parse_opcode(0xd122);
+
+	EXPECT_EQ(the_graphics->get_pixel_state(64 + 6), 1);
+	EXPECT_EQ(the_graphics->get_pixel_state(64 + 8), 1);
+	EXPECT_EQ(the_graphics->get_pixel_state(128 + 6), 1);
+	EXPECT_EQ(the_graphics->get_pixel_state(128 + 7), 0);
+}
+
 /**
 	Ex9E - SKP Vx
 	Skip next instruction if key with the value of Vx is pressed.
@@ -1038,4 +1237,1971 @@ TEST_F(opcode_parser, test_LD_VX_I)
 
 		EXPECT_EQ(the_registers->get_register_value(i), my_value);
 	}
-}
\ No newline at end of file
+}
+/**
+	The dispatch table has to decode exactly like the reference switch.
+
+	Every opcode is executed once through each of them, on two machines in the same state, and the results compared.
+	RND included, both machines draw the same numbers from their own generators.
+*/
+TEST_F(opcode_parser, test_opcode_table)
+{
+	SChip8State	my_state = {};
+	CMemory		my_memory(my_state);
+	CRegisters	my_registers(my_state);
+	CStack		my_stack(my_state);
+	CGraphics	my_graphics(my_state);
+	CCPU		my_cpu(my_state, &my_memory, &my_graphics);
+
+	for (uint32_t my_opcode = 0; my_opcode <= 0xffff; my_opcode++)
+	{
+		// Same registers, I and stack on both machines, small enough to keep DRW and the memory opcodes in bounds.
+		// Give RET something to return to.
+		for (int i = 0; i < 0x10; i++)
+		{
+			the_registers->set_register_value(i, i);
+			my_registers.set_register_value(i, i);
+		}
+
+		the_cpu->execute(0xa300);
+		my_cpu.execute_switch(0xa300);
+
+		the_stack->push(0x300);
+		my_stack.push(0x300);
+
+		the_cpu->execute(my_opcode);
+		my_cpu.execute_switch(my_opcode);
+
+		ASSERT_EQ(the_cpu->get_pc(), my_cpu.get_pc()) << std::hex << my_opcode;
+		ASSERT_EQ(the_cpu->get_I_reg(), my_cpu.get_I_reg()) << std::hex << my_opcode;
+		ASSERT_EQ(the_cpu->get_delay_timer(), my_cpu.get_delay_timer()) << std::hex << my_opcode;
+		ASSERT_EQ(the_cpu->get_sound_timer(), my_cpu.get_sound_timer()) << std::hex << my_opcode;
+
+		for (int i = 0; i < 0x10; i++)
+			ASSERT_EQ(the_registers->get_register_value(i), my_registers.get_register_value(i)) << std::hex << my_opcode;
+	}
+
+	EXPECT_TRUE(COpcodeTable::is_known(0x00e0));
+	EXPECT_TRUE(COpcodeTable::is_known(0xd128));
+	EXPECT_FALSE(COpcodeTable::is_known(0x0123));
+	EXPECT_FALSE(COpcodeTable::is_known(0x8008));
+	EXPECT_FALSE(COpcodeTable::is_known(0xf0ff));
+}
+
+/**
+	The threaded interpreter has to decode exactly like the reference switch, checked the same way as the table.
+*/
+TEST_F(opcode_parser, test_threaded_dispatch)
+{
+	SChip8State	my_state = {};
+	CMemory		my_memory(my_state);
+	CRegisters	my_registers(my_state);
+	CStack		my_stack(my_state);
+	CGraphics	my_graphics(my_state);
+	CCPU		my_cpu(my_state, &my_memory, &my_graphics);
+
+	for (uint32_t my_opcode = 0; my_opcode <= 0xffff; my_opcode++)
+	{
+		for (int i = 0; i < 0x10; i++)
+		{
+			the_registers->set_register_value(i, i);
+			my_registers.set_register_value(i, i);
+		}
+
+		the_cpu->execute_switch(0xa300);
+		my_cpu.execute_switch(0xa300);
+
+		the_stack->push(0x300);
+		my_stack.push(0x300);
+
+		the_cpu->execute_threaded(my_opcode);
+		my_cpu.execute_switch(my_opcode);
+
+		ASSERT_EQ(the_cpu->get_pc(), my_cpu.get_pc()) << std::hex << my_opcode;
+		ASSERT_EQ(the_cpu->get_I_reg(), my_cpu.get_I_reg()) << std::hex << my_opcode;
+		ASSERT_EQ(the_cpu->get_delay_timer(), my_cpu.get_delay_timer()) << std::hex << my_opcode;
+		ASSERT_EQ(the_cpu->get_sound_timer(), my_cpu.get_sound_timer()) << std::hex << my_opcode;
+
+		for (int i = 0; i < 0x10; i++)
+			ASSERT_EQ(the_registers->get_register_value(i), my_registers.get_register_value(i)) << std::hex << my_opcode;
+	}
+}
+
+
+/**
+	A complete machine, for the tests that run whole ROMs.
+*/
+struct SMachine
+{
+	SChip8State	the_state;
+	CMemory		the_memory;
+	CRegisters	the_registers;
+	CStack		the_stack;
+	CGraphics	the_graphics;
+	CKeyboard	the_keyboard;
+	CCPU		the_cpu;
+
+	SMachine() :
+		the_state(),
+		the_memory(the_state),
+		the_registers(the_state),
+		the_stack(the_state),
+		the_graphics(the_state),
+		the_keyboard(the_state),
+		the_cpu(the_state, &the_memory, &the_graphics) {}
+};
+
+/**
+	Runs the bundled ROMs through the JIT and the interpreter in lockstep: every JIT block is followed by the same
+	number of interpreted instructions, after which registers, I, PC, timers and the screen have to match.
+	Both machines carry the same random state, so RND draws the same numbers on both.
+*/
+TEST(jit, test_lockstep)
+{
+	if (!CJit::is_supported())
+		return;
+
+	const char* my_roms[] = { "../games/draw.ch8", "../games/space-invaders.ch8", "../games/test_opcode.ch8" };
+
+	for (const char* my_rom : my_roms)
+	{
+		std::unique_ptr<SMachine> my_jit_machine(new SMachine);
+		std::unique_ptr<SMachine> my_interpreter(new SMachine);
+
+		ASSERT_TRUE(my_jit_machine->the_cpu.load_game(my_rom)) << my_rom;
+		ASSERT_TRUE(my_interpreter->the_cpu.load_game(my_rom)) << my_rom;
+
+		my_jit_machine->the_cpu.reset();
+		my_interpreter->the_cpu.reset();
+
+		CJit my_jit(&my_jit_machine->the_cpu, &my_jit_machine->the_memory, &my_jit_machine->the_state);
+
+		uint32_t my_executed = 0;
+
+		for (uint32_t my_block = 0; my_executed < 200000; my_block++)
+		{
+			uint32_t my_count = my_jit.run_block();
+
+			for (uint32_t i = 0; i < my_count; i++)
+			{
+				my_interpreter->the_cpu.step();
+				my_interpreter->the_cpu.update_timers();
+			}
+
+			my_executed += my_count;
+
+			CCPU& my_a = my_jit_machine->the_cpu;
+			CCPU& my_b = my_interpreter->the_cpu;
+
+			ASSERT_EQ(my_a.get_pc(), my_b.get_pc()) << my_rom << " after " << my_executed;
+			ASSERT_EQ(my_a.get_I_reg(), my_b.get_I_reg()) << my_rom << " after " << my_executed;
+			ASSERT_EQ(my_a.get_delay_timer(), my_b.get_delay_timer()) << my_rom << " after " << my_executed;
+			ASSERT_EQ(my_a.get_sound_timer(), my_b.get_sound_timer()) << my_rom << " after " << my_executed;
+
+			for (int i = 0; i < 0x10; i++)
+				ASSERT_EQ(my_jit_machine->the_registers.get_register_value(i), my_interpreter->the_registers.get_register_value(i)) << my_rom << " after " << my_executed;
+
+			// The screen is bigger, compare it every now and then.
+			if (my_block % 64 == 0)
+			{
+				for (size_t i = 0; i < my_jit_machine->the_graphics.get_size(); i++)
+					ASSERT_EQ(my_jit_machine->the_graphics.get_pixel_state(i), my_interpreter->the_graphics.get_pixel_state(i)) << my_rom << " after " << my_executed;
+			}
+		}
+
+		EXPECT_GT(my_jit.get_block_count(), 0);
+	}
+}
+
+/**
+	Code the ROM writes over has to be translated again.
+*/
+TEST(jit, test_self_modifying_code)
+{
+	if (!CJit::is_supported())
+		return;
+
+	std::unique_ptr<SMachine> my_machine(new SMachine);
+
+	// 0x200 LD I, 0x20A	0x202 SE V0, 1		0x204 JP 0x20A		0x206 LD V0, 0x61
+	// 0x208 LD [I], V0		0x20A ADD V0, 0x55	0x20C LD V0, 1		0x20E JP 0x202
+	//
+	// The first pass runs the ADD at 0x20A. The second one overwrites it with 0x61, turning it into LD V1, 0x55.
+	my_machine->the_memory.load_data({ 0xa2, 0x0a, 0x30, 0x01, 0x12, 0x0a, 0x60, 0x61, 0xf0, 0x55, 0x70, 0x55, 0x60, 0x01, 0x12, 0x02 });
+	my_machine->the_cpu.reset();
+
+	CJit my_jit(&my_machine->the_cpu, &my_machine->the_memory, &my_machine->the_state);
+
+	for (int i = 0; i < 10; i++)
+		my_jit.run_block();
+
+	EXPECT_EQ(my_machine->the_memory.get_byte(0x20a), 0x61);
+	EXPECT_EQ(my_machine->the_registers.get_register_value(1), 0x55);
+}
+
+/**
+	Batches through run() have to end up in the same state on every engine. RND draws the same numbers on all of
+	them, the JIT can run past the end of a batch so the others catch up to its count.
+*/
+TEST(engine, test_run_lockstep)
+{
+	const char* my_roms[] = { "../games/draw.ch8", "../games/space-invaders.ch8", "../games/test_opcode.ch8" };
+	const CCPU::EEngine my_engines[] = { CCPU::EEngine::SWITCH, CCPU::EEngine::THREADED, CCPU::EEngine::JIT };
+
+	for (const char* my_rom : my_roms)
+	{
+		std::unique_ptr<SMachine> my_reference(new SMachine);
+
+		ASSERT_TRUE(my_reference->the_cpu.load_game(my_rom)) << my_rom;
+		my_reference->the_cpu.reset();
+		my_reference->the_cpu.set_trace(false);
+
+		std::vector<std::unique_ptr<SMachine>> my_machines;
+
+		for (CCPU::EEngine my_engine : my_engines)
+		{
+			my_machines.emplace_back(new SMachine);
+			ASSERT_TRUE(my_machines.back()->the_cpu.load_game(my_rom)) << my_rom;
+			my_machines.back()->the_cpu.reset();
+			my_machines.back()->the_cpu.set_trace(false);
+			my_machines.back()->the_cpu.set_engine(my_engine);
+		}
+
+		uint32_t my_executed = 0;
+
+		for (uint32_t my_batch = 0; my_executed < 100000; my_batch++)
+		{
+			uint32_t my_count = 100 + my_batch % 37;
+
+			// The JIT goes first, it decides how far this batch really goes.
+			my_count = my_machines[2]->the_cpu.run(my_count);
+			ASSERT_EQ(my_reference->the_cpu.run(my_count), my_count);
+
+			for (size_t m = 0; m < 2; m++)
+				ASSERT_EQ(my_machines[m]->the_cpu.run(my_count), my_count);
+
+			my_executed += my_count;
+
+			for (const std::unique_ptr<SMachine>& my_machine : my_machines)
+			{
+				CCPU& my_a = my_machine->the_cpu;
+				CCPU& my_b = my_reference->the_cpu;
+
+				ASSERT_EQ(my_a.get_pc(), my_b.get_pc()) << my_rom << " after " << my_executed;
+				ASSERT_EQ(my_a.get_I_reg(), my_b.get_I_reg()) << my_rom << " after " << my_executed;
+				ASSERT_EQ(my_a.get_delay_timer(), my_b.get_delay_timer()) << my_rom << " after " << my_executed;
+				ASSERT_EQ(my_a.get_sound_timer(), my_b.get_sound_timer()) << my_rom << " after " << my_executed;
+
+				for (int i = 0; i < 0x10; i++)
+					ASSERT_EQ(my_machine->the_registers.get_register_value(i), my_reference->the_registers.get_register_value(i)) << my_rom << " after " << my_executed;
+			}
+		}
+
+		for (const std::unique_ptr<SMachine>& my_machine : my_machines)
+		{
+			for (size_t i = 0; i < my_machine->the_graphics.get_size(); i++)
+				ASSERT_EQ(my_machine->the_graphics.get_pixel_state(i), my_reference->the_graphics.get_pixel_state(i)) << my_rom;
+		}
+	}
+}
+
+/**
+	Runs a program that has every idiom in it with and without fusion, the state has to be the same after every batch.
+*/
+TEST(fusion, test_idioms)
+{
+	// 0x200 LD V2, 3		0x202 LD DT, V2
+	// 0x204 LD V3, DT		0x206 SE V3, 0			0x208 JP 0x204		timer wait
+	// 0x20A LD V4, 0
+	// 0x20C ADD V4, 1		0x20E SNE V4, 0x10		0x210 JP 0x214		counted loop
+	// 0x212 JP 0x20C
+	// 0x214 LD V0, 5		0x216 LD V1, 6									load pair
+	// 0x218 LD I, 0x0		0x21A DRW V0, V1, 5								load I and draw
+	// 0x21C JP 0x200
+	std::vector<uint8_t> my_program = { 0x62, 0x03, 0xf2, 0x15, 0xf3, 0x07, 0x33, 0x00, 0x12, 0x04, 0x64, 0x00, 0x74, 0x01,
+		0x44, 0x10, 0x12, 0x14, 0x12, 0x0c, 0x60, 0x05, 0x61, 0x06, 0xa0, 0x00, 0xd0, 0x15, 0x12, 0x00 };
+
+	std::unique_ptr<SMachine> my_fused(new SMachine);
+	std::unique_ptr<SMachine> my_plain(new SMachine);
+
+	for (SMachine* my_machine : { my_fused.get(), my_plain.get() })
+	{
+		my_machine->the_memory.load_data(my_program);
+		my_machine->the_cpu.reset();
+		my_machine->the_cpu.set_trace(false);
+	}
+
+	my_plain->the_cpu.set_fusion(false);
+
+	for (int my_batch = 0; my_batch < 200; my_batch++)
+	{
+		EXPECT_EQ(my_fused->the_cpu.run(50), 50);
+		EXPECT_EQ(my_plain->the_cpu.run(50), 50);
+
+		ASSERT_EQ(my_fused->the_cpu.get_pc(), my_plain->the_cpu.get_pc()) << my_batch;
+		ASSERT_EQ(my_fused->the_cpu.get_I_reg(), my_plain->the_cpu.get_I_reg()) << my_batch;
+		ASSERT_EQ(my_fused->the_cpu.get_delay_timer(), my_plain->the_cpu.get_delay_timer()) << my_batch;
+
+		for (int i = 0; i < 0x10; i++)
+			ASSERT_EQ(my_fused->the_registers.get_register_value(i), my_plain->the_registers.get_register_value(i)) << my_batch;
+
+		for (size_t i = 0; i < my_fused->the_graphics.get_size(); i++)
+			ASSERT_EQ(my_fused->the_graphics.get_pixel_state(i), my_plain->the_graphics.get_pixel_state(i)) << my_batch;
+	}
+
+	for (int i = 0; i < CFusion::IDIOM_COUNT; i++)
+	{
+		EXPECT_GT(my_fused->the_cpu.get_fusion_hits((CFusion::EIdiom)i), 0) << CFusion::get_name((CFusion::EIdiom)i);
+		EXPECT_EQ(my_plain->the_cpu.get_fusion_hits((CFusion::EIdiom)i), 0) << CFusion::get_name((CFusion::EIdiom)i);
+	}
+
+	EXPECT_EQ(my_fused->the_cpu.get_instruction_count(), 10000);
+}
+
+/**
+	Writing into the second half of a fused pair has to take effect on the next pass.
+*/
+TEST(fusion, test_write_into_fused_range)
+{
+	std::unique_ptr<SMachine> my_machine(new SMachine);
+
+	// 0x200 LD V0, 5		0x202 LD V1, 6		0x204 LD V0, 0x99	0x206 LD I, 0x203
+	// 0x208 LD [I], V0	0x20A JP 0x200
+	//
+	// The first pass overwrites the 6 at 0x203, turning the second load into LD V1, 0x99.
+	my_machine->the_memory.load_data({ 0x60, 0x05, 0x61, 0x06, 0x60, 0x99, 0xa2, 0x03, 0xf0, 0x55, 0x12, 0x00 });
+	my_machine->the_cpu.reset();
+	my_machine->the_cpu.set_trace(false);
+
+	my_machine->the_cpu.run(6);
+	EXPECT_EQ(my_machine->the_registers.get_register_value(1), 0x06);
+
+	my_machine->the_cpu.run(6);
+	EXPECT_EQ(my_machine->the_memory.get_byte(0x203), 0x99);
+	EXPECT_EQ(my_machine->the_registers.get_register_value(1), 0x99);
+	EXPECT_EQ(my_machine->the_cpu.get_fusion_hits(CFusion::LOAD_PAIR), 4);
+}
+
+/**
+	The runtime recompiled ROMs fall back to has to keep in step with CCPU, frame by frame.
+*/
+TEST(recomp, test_runtime_against_cpu)
+{
+	const char* my_roms[] = { "../games/draw.ch8", "../games/space-invaders.ch8", "../games/test_opcode.ch8" };
+
+	for (const char* my_rom : my_roms)
+	{
+		std::unique_ptr<SMachine> my_machine(new SMachine);
+
+		ASSERT_TRUE(my_machine->the_cpu.load_game(my_rom)) << my_rom;
+		my_machine->the_cpu.reset();
+
+		EXPECT_EQ(CRecompiler::verify(my_machine->the_state, &CRecompRuntime::run, 5000), 5000) << my_rom;
+	}
+}
+
+/**
+	The recompiler follows jumps, calls and skips, and leaves the data behind them alone.
+*/
+TEST(recomp, test_analysis)
+{
+	std::unique_ptr<SChip8State> my_image(new SChip8State());
+
+	// 0x200 SE V0, 1		0x202 JP 0x208		0x204 CALL 0x20C	0x206 JP 0x206
+	// 0x208 JP V0, 0x210	0x20A data			0x20C RET
+	const uint8_t my_program[] = { 0x30, 0x01, 0x12, 0x08, 0x22, 0x0c, 0x12, 0x06, 0xb2, 0x10, 0xff, 0xff, 0x00, 0xee };
+	memcpy(my_image->the_memory + 0x200, my_program, sizeof(my_program));
+
+	CRecompiler my_recompiler(*my_image, sizeof(my_program));
+
+	EXPECT_TRUE(my_recompiler.is_compiled(0x200));
+	EXPECT_TRUE(my_recompiler.is_compiled(0x202));
+	EXPECT_TRUE(my_recompiler.is_compiled(0x204));
+	EXPECT_TRUE(my_recompiler.is_compiled(0x208));
+	EXPECT_TRUE(my_recompiler.is_compiled(0x20c));
+	EXPECT_FALSE(my_recompiler.is_compiled(0x20a));
+	EXPECT_FALSE(my_recompiler.is_compiled(0x210));
+
+	// The return address after the CALL counts as code.
+	EXPECT_TRUE(my_recompiler.is_compiled(0x206));
+	EXPECT_EQ(my_recompiler.get_instruction_count(), 6);
+
+	std::ostringstream my_output;
+	my_recompiler.emit(my_output, "test");
+
+	EXPECT_NE(my_output.str().find("L_208:"), std::string::npos);
+	EXPECT_NE(my_output.str().find("case 0x20C: goto L_20C;"), std::string::npos);
+	EXPECT_EQ(my_output.str().find("L_20A:"), std::string::npos);
+}
+
+/**
+	RND draws from a generator in the machine's state. It's SplitMix64, gets to every byte value 0xFF included, and
+	the same seed gives the same run on another machine.
+*/
+TEST(random, test_seed)
+{
+	uint64_t my_random = 0;
+
+	EXPECT_EQ(CRandom::next(my_random), 0xe220a8397b1dcdafull);
+	EXPECT_EQ(CRandom::next(my_random), 0x6e789e6aa1b965f4ull);
+	EXPECT_EQ(CRandom::next(my_random), 0x06c45d188009454full);
+
+	std::vector<int> my_counts(256, 0);
+
+	for (int i = 0; i < 256 * 256; i++)
+		my_counts[CRandom::next_byte(my_random)]++;
+
+	for (int i = 0; i < 256; i++)
+	{
+		EXPECT_GT(my_counts[i], 256 / 2) << i;
+		EXPECT_LT(my_counts[i], 256 * 2) << i;
+	}
+
+	// 0x200 RND V0, 0xFF	0x202 LD [I], V0	0x204 ADD I, V1		0x206 ADD V1, 1		0x208 JP 0x200
+	const uint8_t my_program[] = { 0xc0, 0xff, 0xf0, 0x55, 0xf1, 0x1e, 0x71, 0x01, 0x12, 0x00 };
+
+	std::unique_ptr<SMachine> my_machines[3] = { std::unique_ptr<SMachine>(new SMachine), std::unique_ptr<SMachine>(new SMachine),
+		std::unique_ptr<SMachine>(new SMachine) };
+
+	for (int i = 0; i < 3; i++)
+	{
+		my_machines[i]->the_memory.load_data(std::vector<uint8_t>(my_program, my_program + sizeof(my_program)));
+		my_machines[i]->the_cpu.reset();
+		my_machines[i]->the_cpu.set_trace(false);
+		my_machines[i]->the_cpu.set_seed(i < 2 ? 42 : 43);
+
+		for (int j = 0; j < 60; j++)
+			my_machines[i]->the_cpu.run_frame();
+	}
+
+	EXPECT_EQ(memcmp(&my_machines[0]->the_state, &my_machines[1]->the_state, sizeof(SChip8State)), 0);
+	EXPECT_NE(memcmp(my_machines[0]->the_state.the_memory, my_machines[2]->the_state.the_memory, 4096), 0);
+}
+
+/**
+	A machine is its SChip8State: a copy made with memcpy runs on exactly like the original.
+*/
+TEST(state, test_copy)
+{
+	EXPECT_EQ(sizeof(SChip8State) % 64, 0);
+	EXPECT_EQ(alignof(SChip8State), 64);
+
+	std::unique_ptr<SMachine> my_original(new SMachine);
+	std::unique_ptr<SMachine> my_copy(new SMachine);
+
+	ASSERT_TRUE(my_original->the_cpu.load_game("../games/space-invaders.ch8"));
+	my_original->the_cpu.reset();
+	my_original->the_cpu.set_trace(false);
+	my_copy->the_cpu.set_trace(false);
+
+	my_original->the_cpu.set_seed(1);
+	my_original->the_cpu.run(10000);
+
+	// Copied in as a whole, the decode cache of the copy's memory doesn't know about it yet.
+	memcpy(&my_copy->the_state, &my_original->the_state, sizeof(SChip8State));
+	my_copy->the_memory.invalidate_all();
+
+	// Machines pack into a plain array.
+	std::vector<SChip8State> my_states(4, my_original->the_state);
+
+	// The random numbers too.
+	my_original->the_cpu.run(10000);
+	my_copy->the_cpu.run(10000);
+
+	EXPECT_EQ(memcmp(&my_original->the_state, &my_copy->the_state, sizeof(SChip8State)), 0);
+	EXPECT_NE(memcmp(&my_original->the_state, &my_states[3], sizeof(SChip8State)), 0);
+	EXPECT_EQ(my_original->the_cpu.get_pc(), my_copy->the_cpu.get_pc());
+}
+
+/**
+	The tracing policies: STraceOn prints the disassembly parse_opcode() always has, STraceOff prints nothing.
+*/
+TEST(trace, test_policies)
+{
+	std::unique_ptr<SMachine> my_machine(new SMachine);
+
+	// 0x200 LD V1, 0x05	0x202 LD I, 0x123
+	const uint8_t my_program[] = { 0x61, 0x05, 0xa1, 0x23 };
+	my_machine->the_memory.load_data(std::vector<uint8_t>(my_program, my_program + sizeof(my_program)));
+	my_machine->the_cpu.reset();
+	my_machine->the_cpu.set_fusion(false);
+
+	testing::internal::CaptureStdout();
+	my_machine->the_cpu.run<CCPU::STraceOn>(1);
+	my_machine->the_cpu.run<CCPU::STraceOff>(1);
+	std::string my_output = testing::internal::GetCapturedStdout();
+
+	EXPECT_EQ(my_output, "0200 61 05 MVI        V1,#$05\n");
+	EXPECT_EQ(my_machine->the_cpu.get_pc(), 0x204);
+	EXPECT_EQ(my_machine->the_cpu.get_I_reg(), 0x123);
+}
+
+/**
+	Every engine traces every instruction it runs, the threaded loop and the JIT included.
+*/
+TEST(trace, test_engine)
+{
+	std::unique_ptr<SMachine> my_machine(new SMachine);
+
+	// 0x200 LD V1, 0x05	0x202 LD I, 0x123	0x204 JP 0x200
+	const uint8_t my_program[] = { 0x61, 0x05, 0xa1, 0x23, 0x12, 0x00 };
+	my_machine->the_memory.load_data(std::vector<uint8_t>(my_program, my_program + sizeof(my_program)));
+	my_machine->the_cpu.reset();
+	my_machine->the_cpu.set_engine(test_engine());
+
+	testing::internal::CaptureStdout();
+	EXPECT_EQ(my_machine->the_cpu.run<CCPU::STraceOn>(4), 4);
+	std::string my_output = testing::internal::GetCapturedStdout();
+
+	EXPECT_EQ(my_output,
+		"0200 61 05 MVI        V1,#$05\n"
+		"0202 a1 23 LD I       #$123\n"
+		"0204 12 00 JP         #$200\n"
+		"0200 61 05 MVI        V1,#$05\n");
+	EXPECT_EQ(my_machine->the_cpu.get_pc(), 0x202);
+	EXPECT_EQ(my_machine->the_cpu.get_instruction_count(), 4);
+}
+
+/**
+	run_frame() runs the clock rate over 60 instructions per frame, carrying the remainder, and ticks the timers once
+	per frame instead of once per instruction.
+*/
+TEST(scheduler, test_frame_budget)
+{
+	std::unique_ptr<SMachine> my_machine(new SMachine);
+
+	// 0x200 LD VF, 60		0x202 LD DT, VF		0x204 JP 0x204
+	const uint8_t my_program[] = { 0x6f, 0x3c, 0xff, 0x15, 0x12, 0x04 };
+	my_machine->the_memory.load_data(std::vector<uint8_t>(my_program, my_program + sizeof(my_program)));
+	my_machine->the_cpu.reset();
+	my_machine->the_cpu.set_engine(test_engine());
+
+	EXPECT_DOUBLE_EQ(my_machine->the_cpu.get_frame_budget(), 500.0 / 60.0);
+
+	EXPECT_EQ(my_machine->the_cpu.run_frame(), 8);
+	EXPECT_EQ(my_machine->the_cpu.get_delay_timer(), 59);
+
+	for (int i = 1; i < 60; i++)
+		my_machine->the_cpu.run_frame();
+
+	EXPECT_EQ(my_machine->the_cpu.get_frame_count(), 60);
+	EXPECT_EQ(my_machine->the_cpu.get_delay_timer(), 0);
+
+	// The JIT may run a little past a frame, it still comes out at the clock rate.
+	if (test_engine() != CCPU::EEngine::JIT)
+	{
+		EXPECT_EQ(my_machine->the_cpu.get_instruction_count(), 500);
+	}
+
+	my_machine->the_cpu.set_clock_rate(1000);
+
+	for (int i = 0; i < 60; i++)
+		my_machine->the_cpu.run_frame();
+
+	EXPECT_NEAR((double)my_machine->the_cpu.get_instruction_count(), 1500.0, 64.0);
+}
+
+/**
+	Turbo runs the same frames as the paced timer, only without waiting for them: both end in the same state.
+*/
+TEST(scheduler, test_turbo_matches_paced)
+{
+	// 0x200 RND V0, 0xFF	0x202 ADD V1, 1		0x204 LD DT, V0		0x206 LD [I], V0	0x208 JP 0x200
+	const uint8_t my_program[] = { 0xc0, 0xff, 0x71, 0x01, 0xf0, 0x15, 0xf0, 0x55, 0x12, 0x00 };
+
+	std::unique_ptr<SMachine> my_machines[2] = { std::unique_ptr<SMachine>(new SMachine), std::unique_ptr<SMachine>(new SMachine) };
+
+	for (int i = 0; i < 2; i++)
+	{
+		CCPU& my_cpu = my_machines[i]->the_cpu;
+
+		my_machines[i]->the_memory.load_data(std::vector<uint8_t>(my_program, my_program + sizeof(my_program)));
+		my_cpu.reset();
+		my_cpu.set_trace(false);
+		my_cpu.set_turbo(i == 1);
+		my_cpu.set_frame_limit(12);
+
+		my_cpu.set_seed(7);
+		my_cpu.start();
+
+		EXPECT_EQ(my_cpu.get_frame_count(), 12);
+		EXPECT_GT(my_cpu.get_frames_per_second(), 0.0);
+	}
+
+	EXPECT_EQ(memcmp(&my_machines[0]->the_state, &my_machines[1]->the_state, sizeof(SChip8State)), 0);
+
+	// The paced run took a fifth of a second, turbo only a fraction of that.
+	EXPECT_LT(my_machines[0]->the_cpu.get_frames_per_second(), 65.0);
+	EXPECT_GT(my_machines[1]->the_cpu.get_frames_per_second(), my_machines[0]->the_cpu.get_frames_per_second());
+}
+
+/**
+	Without a presenter the frames go nowhere, with a CCallbackPresenter every presented frame reaches the callback.
+*/
+TEST(presenter, test_callback)
+{
+	std::unique_ptr<SMachine> my_machine(new SMachine);
+
+	// Headless, nothing to set up.
+	auto my_start = std::chrono::steady_clock::now();
+	EXPECT_TRUE(my_machine->the_graphics.init());
+	EXPECT_LT(std::chrono::steady_clock::now() - my_start, std::chrono::milliseconds(1));
+
+	uint32_t				my_frames = 0;
+	std::vector<uint64_t>	my_screen;
+
+	CCallbackPresenter my_presenter([&](const uint64_t* a_screen, const SDirtyRect&)
+	{
+		my_frames++;
+		my_screen.assign(a_screen, a_screen + 32);
+	});
+
+	my_machine->the_graphics.set_presenter(&my_presenter);
+
+	// 0x200 LD I, 0x0 (the font's 0)		0x202 DRW V0, V0, 1		0x204 JP 0x204
+	const uint8_t my_program[] = { 0xa0, 0x00, 0xd0, 0x01, 0x12, 0x04 };
+	my_machine->the_memory.load_data(std::vector<uint8_t>(my_program, my_program + sizeof(my_program)));
+	my_machine->the_cpu.reset();
+	my_machine->the_cpu.set_trace(false);
+	my_machine->the_cpu.set_turbo(true);
+	my_machine->the_cpu.set_frame_limit(3);
+	my_machine->the_cpu.start();
+
+	// Only the first frame draws, the other two aren't even handed to the graphics.
+	EXPECT_EQ(my_frames, 1);
+	EXPECT_EQ(my_machine->the_graphics.get_skipped_count(), 0);
+	ASSERT_EQ(my_screen.size(), 32);
+
+	// 0xF0: the top of the 0, four pixels at the left of the first row.
+	EXPECT_EQ(my_screen[0], 0xf0ull << 56);
+	for (int i = 1; i < 32; i++)
+		EXPECT_EQ(my_screen[i], 0) << i;
+
+	// Back to no presenter.
+	my_machine->the_graphics.set_presenter(nullptr);
+	my_machine->the_graphics.draw();
+	EXPECT_EQ(my_frames, 1);
+}
+
+/**
+	Uploads a byte per pixel of what it's given, like CSDLPresenter, and remembers the last rectangle.
+*/
+class CCountingPresenter : public CPresenter
+{
+	public:
+		bool	init() override { return true; }
+
+		size_t	present(const uint64_t*, const SDirtyRect& a_dirty) override
+		{
+			the_dirty = a_dirty;
+			return a_dirty.the_width * a_dirty.the_height;
+		}
+
+		SDirtyRect	the_dirty;
+};
+
+/**
+	draw() hands over the whole screen first, then only the rectangle around what changed since, and nothing when the
+	screen looks the same as last time.
+*/
+TEST(presenter, test_damage)
+{
+	SChip8State			my_state = {};
+	CGraphics			my_graphics(my_state);
+	CCountingPresenter	my_presenter;
+
+	my_graphics.set_presenter(&my_presenter);
+	my_graphics.draw();
+
+	EXPECT_EQ(my_presenter.the_dirty.the_width, 64);
+	EXPECT_EQ(my_presenter.the_dirty.the_height, 32);
+	EXPECT_EQ(my_graphics.get_uploaded_bytes(), 2048);
+
+	// Nothing changed.
+	my_graphics.draw();
+	EXPECT_EQ(my_graphics.get_present_count(), 1);
+	EXPECT_EQ(my_graphics.get_skipped_count(), 1);
+
+	// (10,5) and (20,7).
+	my_graphics.flip_pixel(5 * 64 + 10);
+	my_graphics.flip_pixel(7 * 64 + 20);
+	my_graphics.draw();
+
+	EXPECT_EQ(my_presenter.the_dirty.the_x, 10);
+	EXPECT_EQ(my_presenter.the_dirty.the_y, 5);
+	EXPECT_EQ(my_presenter.the_dirty.the_width, 11);
+	EXPECT_EQ(my_presenter.the_dirty.the_height, 3);
+	EXPECT_EQ(my_graphics.get_uploaded_bytes(), 2048 + 33);
+
+	// Drawn and drawn back between two frames, the same as presented.
+	my_graphics.flip_pixel(63);
+	my_graphics.flip_pixel(63);
+	my_graphics.draw();
+	EXPECT_EQ(my_graphics.get_present_count(), 2);
+	EXPECT_EQ(my_graphics.get_skipped_count(), 2);
+
+	// The edge pixel alone.
+	my_graphics.flip_pixel(31 * 64 + 63);
+	my_graphics.draw();
+
+	EXPECT_EQ(my_presenter.the_dirty.the_x, 63);
+	EXPECT_EQ(my_presenter.the_dirty.the_y, 31);
+	EXPECT_EQ(my_presenter.the_dirty.the_width, 1);
+	EXPECT_EQ(my_presenter.the_dirty.the_height, 1);
+
+	// A new presenter gets everything again.
+	my_graphics.set_presenter(&my_presenter);
+	my_graphics.draw();
+	EXPECT_EQ(my_presenter.the_dirty.the_width, 64);
+	EXPECT_EQ(my_presenter.the_dirty.the_height, 32);
+	EXPECT_EQ(my_graphics.get_present_count(), 4);
+}
+
+/**
+	frame_ready() presents a frame that changed the screen, at most once a refresh. What's held back goes out with a
+	later frame or flush().
+*/
+TEST(presenter, test_pacing)
+{
+	SChip8State			my_state = {};
+	CGraphics			my_graphics(my_state);
+	CCountingPresenter	my_presenter;
+
+	my_graphics.set_presenter(&my_presenter);
+
+	// Every frame that changed the screen.
+	my_graphics.frame_ready(false);
+	EXPECT_EQ(my_graphics.get_present_count(), 0);
+
+	my_graphics.flip_pixel(0);
+	my_graphics.frame_ready(true);
+	my_graphics.frame_ready(false);
+	EXPECT_EQ(my_graphics.get_present_count(), 1);
+
+	// Once a second: the first goes out, the next two wait as one.
+	my_graphics.set_refresh_rate(1);
+
+	my_graphics.flip_pixel(1);
+	my_graphics.frame_ready(true);
+	my_graphics.flip_pixel(2);
+	my_graphics.frame_ready(true);
+	my_graphics.flip_pixel(3);
+	my_graphics.frame_ready(true);
+	my_graphics.frame_ready(false);
+
+	EXPECT_EQ(my_graphics.get_present_count(), 2);
+	EXPECT_EQ(my_graphics.get_coalesced_count(), 1);
+
+	my_graphics.flush();
+	EXPECT_EQ(my_graphics.get_present_count(), 3);
+	EXPECT_EQ(my_presenter.the_dirty.the_x, 2);
+	EXPECT_EQ(my_presenter.the_dirty.the_width, 2);
+
+	my_graphics.flush();
+	EXPECT_EQ(my_graphics.get_present_count(), 3);
+}
+
+/**
+	A ROM drawing all the time in turbo is presented once a refresh, not once a frame, and its last frame is
+	presented when start() returns.
+*/
+TEST(presenter, test_turbo_pacing)
+{
+	std::unique_ptr<SMachine> my_machine(new SMachine);
+
+	CCountingPresenter my_presenter;
+	my_machine->the_graphics.set_presenter(&my_presenter);
+
+	// 0x200 LD I, 0x0		0x202 ADD V0, 1		0x204 DRW V0, V1, 5		0x206 JP 0x202
+	const uint8_t my_program[] = { 0xa0, 0x00, 0x70, 0x01, 0xd0, 0x15, 0x12, 0x02 };
+	my_machine->the_memory.load_data(std::vector<uint8_t>(my_program, my_program + sizeof(my_program)));
+	my_machine->the_cpu.reset();
+	my_machine->the_cpu.set_trace(false);
+	my_machine->the_cpu.set_turbo(true);
+	my_machine->the_cpu.set_frame_limit(6000);
+	my_machine->the_cpu.start();
+
+	double		my_seconds	= my_machine->the_cpu.get_frame_count() / my_machine->the_cpu.get_frames_per_second();
+	uint64_t	my_presents	= my_machine->the_graphics.get_present_count();
+
+	EXPECT_GE(my_presents, 2);
+	EXPECT_LE(my_presents, 2 + (uint64_t)(my_seconds * CGraphics::REFRESH_RATE));
+	EXPECT_GT(my_machine->the_graphics.get_coalesced_count(), 0);
+
+	// The last frame is what the presenter has, drawing again finds nothing new.
+	uint64_t my_skipped = my_machine->the_graphics.get_skipped_count();
+	my_machine->the_graphics.draw();
+	EXPECT_EQ(my_machine->the_graphics.get_skipped_count(), my_skipped + 1);
+	EXPECT_EQ(my_machine->the_graphics.get_present_count(), my_presents);
+}
+
+/**
+	The pixel kernels this CPU can run, worst first.
+*/
+static std::vector<CPixels::EKernel>
+pixel_kernels()
+{
+	std::vector<CPixels::EKernel> my_kernels;
+
+	for (CPixels::EKernel my_kernel : { CPixels::EKernel::SCALAR, CPixels::EKernel::SSE2, CPixels::EKernel::AVX2 })
+		if (CPixels::is_supported(my_kernel))
+			my_kernels.push_back(my_kernel);
+
+	return my_kernels;
+}
+
+/**
+	Every vector kernel the CPU has gives the same pixels as going bit by bit, for both formats.
+*/
+TEST(pixels, test_vectorised)
+{
+	std::vector<uint64_t> my_rows = { 0, ~0ull, 0x8000000000000001ull, 0xaaaaaaaaaaaaaaaaull, 0x0123456789abcdefull };
+	uint64_t my_random = 0x9e3779b97f4a7c15ull;
+
+	for (int i = 0; i < 1000; i++)
+	{
+		my_random = my_random * 6364136223846793005ull + 1442695040888963407ull;
+		my_rows.push_back(my_random);
+	}
+
+	CPixels::EKernel my_picked = CPixels::get_kernel();
+
+	for (CPixels::EKernel my_kernel : pixel_kernels())
+	{
+		ASSERT_TRUE(CPixels::set_kernel(my_kernel));
+
+		for (uint64_t my_row : my_rows)
+		{
+			uint8_t		my_rgb332[64], my_rgb332_scalar[64];
+			uint32_t	my_argb8888[64], my_argb8888_scalar[64];
+
+			CPixels::expand_rgb332(my_row, my_rgb332);
+			CPixels::expand_rgb332_scalar(my_row, my_rgb332_scalar);
+			CPixels::expand_argb8888(my_row, my_argb8888);
+			CPixels::expand_argb8888_scalar(my_row, my_argb8888_scalar);
+
+			ASSERT_EQ(memcmp(my_rgb332, my_rgb332_scalar, sizeof(my_rgb332)), 0) << (int)my_kernel << " " << std::hex << my_row;
+			ASSERT_EQ(memcmp(my_argb8888, my_argb8888_scalar, sizeof(my_argb8888)), 0) << (int)my_kernel << " " << std::hex << my_row;
+		}
+
+		// The leftmost pixel is the top bit.
+		uint32_t my_pixels[64];
+		CPixels::expand_argb8888(0x8000000000000001ull, my_pixels);
+
+		EXPECT_EQ(my_pixels[0], CPixels::ARGB8888_ON);
+		EXPECT_EQ(my_pixels[1], CPixels::ARGB8888_OFF);
+		EXPECT_EQ(my_pixels[63], CPixels::ARGB8888_ON);
+	}
+
+	CPixels::set_kernel(my_picked);
+
+	// The best the CPU has was picked, and nothing it hasn't is taken.
+	EXPECT_EQ(my_picked, pixel_kernels().back());
+	EXPECT_EQ(CPixels::set_kernel(CPixels::EKernel::AVX2), CPixels::is_supported(CPixels::EKernel::AVX2));
+	EXPECT_EQ(CPixels::get_kernel(), CPixels::is_supported(CPixels::EKernel::AVX2) ? CPixels::EKernel::AVX2 : my_picked);
+
+	CPixels::set_kernel(my_picked);
+}
+
+/**
+	The font drawn with DRW and expanded to texture pixels by every kernel the CPU has, against how it has to look.
+*/
+TEST(pixels, test_golden)
+{
+	const char* my_golden[] =
+	{
+		"................................................................",
+		"..####......#.....####....####....#..#....####....####....####..",
+		"..#..#.....##........#.......#....#..#....#.......#..........#..",
+		"..#..#......#.....####....####....####....####....####......#...",
+		"..#..#......#.....#..........#.......#.......#....#..#.....#....",
+		"..####.....###....####....####.......#....####....####.....#....",
+		"................................................................",
+		"................................................................",
+		"..####....####....####....###.....####....###.....####....####..",
+		"..#..#....#..#....#..#....#..#....#.......#..#....#.......#.....",
+		"..####....####....####....###.....#.......#..#....####....####..",
+		"..#..#.......#....#..#....#..#....#.......#..#....#.......#.....",
+		"..####....####....#..#....###.....####....###.....####....#.....",
+		"................................................................",
+	};
+
+	std::unique_ptr<SMachine> my_machine(new SMachine);
+	my_machine->the_cpu.reset();
+
+	// 0-7 over the top, 8-F below, each glyph 8 pixels apart.
+	for (int i = 0; i < 16; i++)
+	{
+		my_machine->the_state.the_I		= i * 5;
+		my_machine->the_state.the_V[1]	= (i % 8) * 8 + 2;
+		my_machine->the_state.the_V[2]	= (i / 8) * 7 + 1;
+		my_machine->the_cpu.parse_opcode(0xd125);
+	}
+
+	CPixels::EKernel my_picked = CPixels::get_kernel();
+
+	for (CPixels::EKernel my_kernel : pixel_kernels())
+	{
+		ASSERT_TRUE(CPixels::set_kernel(my_kernel));
+		SCOPED_TRACE((int)my_kernel);
+
+		std::vector<uint32_t>	my_argb8888(64 * 32);
+		SDirtyRect				my_screen = { 0, 0, 64, 32 };
+
+		EXPECT_EQ(CPixels::expand(CPixels::EFormat::ARGB8888, my_machine->the_state.the_screen, my_screen, (uint8_t*)my_argb8888.data(), 64 * sizeof(uint32_t)), 64 * 32 * 4);
+
+		for (int y = 0; y < 32; y++)
+		{
+			std::string my_row;
+			for (int x = 0; x < 64; x++)
+				my_row += my_argb8888[y * 64 + x] == CPixels::ARGB8888_ON ? '#' : my_argb8888[y * 64 + x] == CPixels::ARGB8888_OFF ? '.' : '?';
+
+			EXPECT_EQ(my_row, y < 14 ? my_golden[y] : std::string(64, '.')) << y;
+		}
+
+		// Part of it to RGB332 at a wider pitch, like a locked rectangle of a texture: the top of the 3 and the 4.
+		SDirtyRect	my_rect = { 25, 1, 14, 2 };
+		uint8_t		my_rgb332[2][20];
+		memset(my_rgb332, 0x55, sizeof(my_rgb332));
+
+		EXPECT_EQ(CPixels::expand(CPixels::EFormat::RGB332, my_machine->the_state.the_screen, my_rect, &my_rgb332[0][0], 20), 28);
+
+		for (int y = 0; y < 2; y++)
+		{
+			for (int x = 0; x < 20; x++)
+			{
+				uint8_t my_expected = x >= 14 ? 0x55 : my_golden[1 + y][25 + x] == '#' ? CPixels::RGB332_ON : CPixels::RGB332_OFF;
+				EXPECT_EQ(my_rgb332[y][x], my_expected) << x << "," << y;
+			}
+		}
+	}
+
+	CPixels::set_kernel(my_picked);
+}
+
+/**
+	The ring keeps the newest events up to its capacity and hands them out oldest first.
+*/
+TEST(drawlog, test_ring)
+{
+	CDrawLog my_log(4);
+
+	for (int i = 0; i < 6; i++)
+		my_log.record({ (uint64_t)i, 0, 0, 0, 1, false });
+
+	EXPECT_EQ(my_log.get_size(), 4);
+	EXPECT_EQ(my_log.get_recorded_count(), 6);
+	EXPECT_EQ(my_log.get_dropped_count(), 2);
+
+	SDrawEvent my_events[8];
+
+	ASSERT_EQ(my_log.drain(my_events, 3), 3);
+	EXPECT_EQ(my_events[0].the_frame, 2);
+	EXPECT_EQ(my_events[1].the_frame, 3);
+	EXPECT_EQ(my_events[2].the_frame, 4);
+
+	// Room again, nothing more is dropped.
+	my_log.record({ 6, 0, 0, 0, 1, false });
+
+	ASSERT_EQ(my_log.drain(my_events, 8), 2);
+	EXPECT_EQ(my_events[0].the_frame, 5);
+	EXPECT_EQ(my_events[1].the_frame, 6);
+	EXPECT_EQ(my_log.drain(my_events, 8), 0);
+	EXPECT_EQ(my_log.get_dropped_count(), 2);
+}
+
+/**
+	Every DRW goes to the log with where it drew and whether it hit anything, in the frame it ran in.
+*/
+TEST(drawlog, test_cpu)
+{
+	std::unique_ptr<SMachine>	my_machine(new SMachine);
+	CDrawLog					my_log;
+
+	// 0x200 LD I, 0x5		0x202 LD V1, 0x46		0x204 DRW V1, V2, 5		0x206 DRW V1, V2, 5		0x208 JP 0x208
+	const uint8_t my_program[] = { 0xa0, 0x05, 0x61, 0x46, 0xd1, 0x25, 0xd1, 0x25, 0x12, 0x08 };
+	my_machine->the_memory.load_data(std::vector<uint8_t>(my_program, my_program + sizeof(my_program)));
+	my_machine->the_cpu.reset();
+	my_machine->the_cpu.set_trace(false);
+	my_machine->the_cpu.set_draw_log(&my_log);
+	my_machine->the_cpu.set_clock_rate(CCPU::FRAME_RATE * 2);
+	my_machine->the_cpu.run_frame();
+	my_machine->the_cpu.run_frame();
+	my_machine->the_cpu.run_frame();
+
+	SDrawEvent my_events[4];
+	ASSERT_EQ(my_log.drain(my_events, 4), 2);
+
+	// Two instructions a frame. x 0x46 wraps to 6.
+	EXPECT_EQ(my_events[0].the_frame, 1);
+	EXPECT_EQ(my_events[0].the_I, 5);
+	EXPECT_EQ(my_events[0].the_x, 6);
+	EXPECT_EQ(my_events[0].the_y, 0);
+	EXPECT_EQ(my_events[0].the_height, 5);
+	EXPECT_FALSE(my_events[0].the_collision);
+
+	EXPECT_EQ(my_events[1].the_frame, 1);
+	EXPECT_TRUE(my_events[1].the_collision);
+
+	// Off again.
+	my_machine->the_cpu.set_draw_log(nullptr);
+	my_machine->the_cpu.get_state().the_pc = 0x204;
+	my_machine->the_cpu.run_frame();
+	EXPECT_EQ(my_log.get_recorded_count(), 2);
+}
+
+/**
+	A day of emulated time drawing all the time with the log on: nothing is allocated while it runs, the log stays at
+	its capacity and only the newest events are kept.
+*/
+TEST(drawlog, test_soak)
+{
+	std::unique_ptr<SMachine>	my_machine(new SMachine);
+	CDrawLog					my_log(256);
+
+	// 0x200 LD I, 0x0		0x202 ADD V0, 1		0x204 DRW V0, V1, 5		0x206 JP 0x202
+	const uint8_t my_program[] = { 0xa0, 0x00, 0x70, 0x01, 0xd0, 0x15, 0x12, 0x02 };
+	my_machine->the_memory.load_data(std::vector<uint8_t>(my_program, my_program + sizeof(my_program)));
+	my_machine->the_cpu.reset();
+	my_machine->the_cpu.set_trace(false);
+	my_machine->the_cpu.set_draw_log(&my_log);
+	my_machine->the_cpu.set_turbo(true);
+	my_machine->the_cpu.set_frame_limit(24ull * 60 * 60 * CCPU::FRAME_RATE);
+
+	uint64_t my_allocations = the_allocation_count;
+	my_machine->the_cpu.start();
+
+	EXPECT_EQ(the_allocation_count, my_allocations);
+	EXPECT_EQ(my_machine->the_cpu.get_frame_count(), 24ull * 60 * 60 * CCPU::FRAME_RATE);
+
+	// About a third of the instructions.
+	EXPECT_GT(my_log.get_recorded_count(), my_machine->the_cpu.get_instruction_count() / 4);
+	EXPECT_EQ(my_log.get_size(), my_log.get_capacity());
+	EXPECT_EQ(my_log.get_dropped_count(), my_log.get_recorded_count() - 256);
+
+	SDrawEvent my_events[256];
+	ASSERT_EQ(my_log.drain(my_events, 256), 256);
+	EXPECT_EQ(my_events[255].the_frame, my_machine->the_cpu.get_frame_count() - 1);
+}
+
+/**
+	A machine saved halfway and loaded again runs on exactly as it did the first time, with the RAM stored whole and
+	as changes to the ROM image. Neither saving nor loading allocates.
+*/
+TEST(snapshot, test_round_trip)
+{
+	const char* my_roms[] = { "../games/draw.ch8", "../games/space-invaders.ch8", "../games/test_opcode.ch8" };
+
+	for (const char* my_rom : my_roms)
+	{
+		std::unique_ptr<SMachine> my_machine(new SMachine);
+
+		ASSERT_TRUE(my_machine->the_cpu.load_game(my_rom));
+		my_machine->the_cpu.reset();
+		my_machine->the_cpu.set_trace(false);
+
+		// The RAM right after loading.
+		std::vector<uint8_t> my_image(my_machine->the_state.the_memory, my_machine->the_state.the_memory + 4096);
+
+		my_machine->the_cpu.set_seed(1);
+		for (int i = 0; i < 300; i++)
+			my_machine->the_cpu.run_frame();
+
+		uint8_t my_whole[CSnapshot::MAX_SIZE];
+		uint8_t my_delta[CSnapshot::MAX_SIZE];
+
+		uint64_t	my_allocations	= the_allocation_count;
+		size_t		my_whole_size	= my_machine->the_cpu.save_state(my_whole, sizeof(my_whole));
+		size_t		my_delta_size	= my_machine->the_cpu.save_state(my_delta, sizeof(my_delta), my_image.data());
+
+		ASSERT_GT(my_whole_size, 4096);
+		ASSERT_GT(my_delta_size, 0);
+		EXPECT_LT(my_delta_size, 1024) << my_rom;
+
+		// The first time through.
+		for (int i = 0; i < 300; i++)
+			my_machine->the_cpu.run_frame();
+
+		SChip8State my_end = my_machine->the_state;
+
+		for (int my_pass = 0; my_pass < 2; my_pass++)
+		{
+			ASSERT_TRUE(my_pass == 0 ? my_machine->the_cpu.load_state(my_whole, my_whole_size)
+				: my_machine->the_cpu.load_state(my_delta, my_delta_size, my_image.data()));
+			EXPECT_EQ(my_machine->the_cpu.get_frame_count(), 300);
+
+			for (int i = 0; i < 300; i++)
+				my_machine->the_cpu.run_frame();
+
+			EXPECT_EQ(memcmp(&my_machine->the_state, &my_end, sizeof(my_end)), 0) << my_rom << " " << my_pass;
+		}
+
+		ASSERT_TRUE(my_machine->the_cpu.load_state(my_delta, my_delta_size, my_image.data()));
+		EXPECT_EQ(the_allocation_count, my_allocations);
+	}
+}
+
+/**
+	A snapshot that's damaged, cut short, from another version or missing its image doesn't load, and the machine
+	stays as it was. A buffer too small to save into gets nothing.
+*/
+TEST(snapshot, test_damaged)
+{
+	std::unique_ptr<SMachine> my_machine(new SMachine);
+
+	ASSERT_TRUE(my_machine->the_cpu.load_game("../games/draw.ch8"));
+	my_machine->the_cpu.reset();
+	my_machine->the_cpu.set_trace(false);
+
+	std::vector<uint8_t> my_image(my_machine->the_state.the_memory, my_machine->the_state.the_memory + 4096);
+
+	for (int i = 0; i < 60; i++)
+		my_machine->the_cpu.run_frame();
+
+	uint8_t	my_blob[CSnapshot::MAX_SIZE];
+	size_t	my_size = my_machine->the_cpu.save_state(my_blob, sizeof(my_blob), my_image.data());
+	ASSERT_GT(my_size, 0);
+
+	// Somewhere else.
+	for (int i = 0; i < 60; i++)
+		my_machine->the_cpu.run_frame();
+
+	SChip8State my_before = my_machine->the_state;
+
+	// Every byte flipped in turn.
+	for (size_t i = 0; i < my_size; i++)
+	{
+		my_blob[i] ^= 0x40;
+		EXPECT_FALSE(my_machine->the_cpu.load_state(my_blob, my_size, my_image.data())) << i;
+		my_blob[i] ^= 0x40;
+	}
+
+	EXPECT_FALSE(my_machine->the_cpu.load_state(my_blob, my_size - 1, my_image.data()));
+	EXPECT_FALSE(my_machine->the_cpu.load_state(my_blob, my_size));
+	EXPECT_EQ(memcmp(&my_machine->the_state, &my_before, sizeof(my_before)), 0);
+	EXPECT_EQ(my_machine->the_cpu.get_frame_count(), 120);
+
+	// Whole, it's fine.
+	EXPECT_TRUE(my_machine->the_cpu.load_state(my_blob, my_size, my_image.data()));
+	EXPECT_EQ(my_machine->the_cpu.get_frame_count(), 60);
+
+	// Too small for it.
+	EXPECT_EQ(my_machine->the_cpu.save_state(my_blob, 40), 0);
+	EXPECT_EQ(my_machine->the_cpu.save_state(my_blob, 1000), 0);
+	EXPECT_EQ(my_machine->the_cpu.save_state(my_blob, my_size, my_image.data()), my_size);
+}
+
+/**
+	Captured at the end of every frame start() runs, the frames come back newest first and exactly as they were, with
+	nothing allocated on the way. Captures after stepping back go on from there.
+*/
+TEST(rewind, test_step_back)
+{
+	std::unique_ptr<SMachine> my_machine(new SMachine);
+
+	ASSERT_TRUE(my_machine->the_cpu.load_game("../games/space-invaders.ch8"));
+	my_machine->the_cpu.reset();
+	my_machine->the_cpu.set_trace(false);
+
+	std::vector<uint8_t>		my_image(my_machine->the_state.the_memory, my_machine->the_state.the_memory + 4096);
+	CRewind						my_rewind(600, CRewind::DEFAULT_BUDGET, 60, my_image.data());
+	std::vector<SChip8State>	my_frames(600);
+	std::vector<uint64_t>		my_frame_counts(600);
+	size_t						my_count = 0;
+
+	my_machine->the_cpu.set_frame_hook([&](CCPU& a_cpu)
+	{
+		my_frames[my_count]			= a_cpu.get_state();
+		my_frame_counts[my_count]	= a_cpu.get_frame_count();
+		my_count++;
+
+		my_rewind.capture(a_cpu.get_state(), a_cpu.get_clock());
+	});
+
+	my_machine->the_cpu.set_turbo(true);
+	my_machine->the_cpu.set_frame_limit(600);
+
+	uint64_t my_allocations = the_allocation_count;
+	my_machine->the_cpu.start();
+
+	ASSERT_EQ(my_count, 600);
+	EXPECT_EQ(my_rewind.get_size(), 600);
+	EXPECT_EQ(my_rewind.get_evicted_count(), 0);
+	EXPECT_LT(my_rewind.get_used_bytes(), 64 * 1024);
+
+	SChip8State		my_state;
+	SSnapshotClock	my_clock;
+
+	for (size_t i = 600; i-- > 300; )
+	{
+		ASSERT_TRUE(my_rewind.step_back(my_state, my_clock));
+		EXPECT_EQ(memcmp(&my_state, &my_frames[i], offsetof(SChip8State, the_memory) + 4096), 0) << i;
+		EXPECT_EQ(my_clock.the_frame_count, my_frame_counts[i]);
+	}
+
+	EXPECT_EQ(the_allocation_count, my_allocations);
+	EXPECT_EQ(my_rewind.get_size(), 300);
+
+	// Back in the machine, and on from there.
+	my_machine->the_cpu.restore_state(my_state, my_clock);
+	EXPECT_EQ(my_machine->the_cpu.get_frame_count(), 301);
+
+	my_count = 0;
+	my_machine->the_cpu.set_frame_limit(401);
+	my_machine->the_cpu.start();
+
+	ASSERT_EQ(my_count, 100);
+	EXPECT_EQ(my_rewind.get_size(), 400);
+
+	for (size_t i = 100; i-- > 0; )
+	{
+		ASSERT_TRUE(my_rewind.step_back(my_state, my_clock));
+		EXPECT_EQ(memcmp(&my_state, &my_frames[i], offsetof(SChip8State, the_memory) + 4096), 0) << i;
+	}
+
+	// And what was there before.
+	for (size_t i = 300; i-- > 0; )
+	{
+		ASSERT_TRUE(my_rewind.step_back(my_state, my_clock));
+		EXPECT_EQ(my_clock.the_frame_count, i + 1);
+	}
+
+	EXPECT_FALSE(my_rewind.step_back(my_state, my_clock));
+}
+
+/**
+	A budget too small for the whole run holds on to it, dropping the oldest keyframes and what needs them. What's
+	left is the newest frames without a gap. Ten minutes fit into the default budget.
+*/
+TEST(rewind, test_budget)
+{
+	for (size_t my_budget : { (size_t)16 * 1024, (size_t)64 * 1024, CRewind::DEFAULT_BUDGET })
+	{
+		std::unique_ptr<SMachine> my_machine(new SMachine);
+
+		ASSERT_TRUE(my_machine->the_cpu.load_game("../games/space-invaders.ch8"));
+		my_machine->the_cpu.reset();
+		my_machine->the_cpu.set_trace(false);
+
+		CRewind		my_rewind(CRewind::DEFAULT_FRAMES, my_budget);
+		uint64_t	my_most = 0;
+
+		for (uint64_t i = 0; i < CRewind::DEFAULT_FRAMES; i++)
+		{
+			my_machine->the_cpu.run_frame();
+			my_rewind.capture(my_machine->the_state, my_machine->the_cpu.get_clock());
+
+			my_most = std::max<uint64_t>(my_most, my_rewind.get_used_bytes());
+		}
+
+		EXPECT_LE(my_most, my_budget);
+
+		if (my_budget == CRewind::DEFAULT_BUDGET)
+		{
+			EXPECT_EQ(my_rewind.get_size(), CRewind::DEFAULT_FRAMES);
+			EXPECT_EQ(my_rewind.get_evicted_count(), 0);
+		}
+		else
+		{
+			EXPECT_GT(my_rewind.get_evicted_count(), 0);
+			EXPECT_GT(my_rewind.get_size(), my_rewind.get_keyframe_interval());
+		}
+
+		SChip8State		my_state;
+		SSnapshotClock	my_clock;
+		size_t			my_size = my_rewind.get_size();
+
+		ASSERT_TRUE(my_rewind.step_back(my_state, my_clock));
+		EXPECT_EQ(memcmp(&my_state, &my_machine->the_state, offsetof(SChip8State, the_memory) + 4096), 0);
+
+		for (size_t i = 1; i < my_size; i++)
+		{
+			ASSERT_TRUE(my_rewind.step_back(my_state, my_clock));
+			EXPECT_EQ(my_clock.the_frame_count, CRewind::DEFAULT_FRAMES - i) << my_budget;
+		}
+
+		EXPECT_FALSE(my_rewind.step_back(my_state, my_clock));
+	}
+}
+
+/**
+	A session recorded with keys going down and up at odd frames plays back from its file to the same state, and it
+	is the same run CBatch::run_job() makes of its inputs. Damaged files and other ROMs are turned down.
+*/
+TEST(movie, test_replay)
+{
+	std::vector<uint8_t> my_rom;
+	ASSERT_TRUE(CBatch::load_rom("../games/space-invaders.ch8", my_rom));
+
+	std::unique_ptr<SMachine> my_machine(new SMachine);
+
+	ASSERT_TRUE(my_machine->the_cpu.load_game("../games/space-invaders.ch8"));
+	my_machine->the_cpu.reset();
+	my_machine->the_cpu.set_trace(false);
+	my_machine->the_cpu.set_seed(7);
+
+	CMovie my_movie;
+	my_movie.begin(my_machine->the_state, my_machine->the_cpu.get_clock(), my_rom.size());
+
+	// Left, right and fire, held for a while and let go.
+	const int	my_keys[]	= { 4, 5, 6 };
+	uint64_t	my_random	= 1;
+
+	my_machine->the_cpu.set_frame_hook([&](CCPU& a_cpu)
+	{
+		uint64_t my_value = CRandom::next(my_random);
+
+		if (my_value % 8 == 0)
+			my_machine->the_keyboard.set_key_state(my_keys[(my_value >> 8) % 3], (my_value >> 16) & 1);
+
+		my_movie.record(a_cpu.get_state(), a_cpu.get_clock());
+	});
+
+	my_machine->the_cpu.set_turbo(true);
+	my_machine->the_cpu.set_frame_limit(3000);
+	my_machine->the_cpu.start();
+	my_machine->the_cpu.set_frame_hook(nullptr);
+
+	my_movie.end(my_machine->the_state, my_machine->the_cpu.get_frame_count());
+
+	EXPECT_EQ(my_movie.get_frame_count(), 3000);
+	EXPECT_EQ(my_movie.get_seed(), 7);
+	EXPECT_GT(my_movie.get_inputs().size(), 100);
+
+	std::vector<uint8_t> my_bytes;
+	my_movie.write(my_bytes);
+
+	EXPECT_LT(my_bytes.size(), 4 + 64 + 2 * my_movie.get_inputs().size());
+
+	CMovie my_copy;
+	ASSERT_TRUE(my_copy.read(my_bytes.data(), my_bytes.size()));
+	EXPECT_EQ(my_copy.get_final_hash(), my_movie.get_final_hash());
+
+	std::unique_ptr<SMachine> my_player(new SMachine);
+
+	ASSERT_TRUE(my_player->the_cpu.load_game("../games/space-invaders.ch8"));
+	my_player->the_cpu.reset();
+	my_player->the_cpu.set_trace(false);
+
+	EXPECT_TRUE(my_copy.replay(my_player->the_cpu, my_player->the_keyboard));
+	EXPECT_EQ(memcmp(&my_player->the_state, &my_machine->the_state, offsetof(SChip8State, the_memory) + 4096), 0);
+
+	SBatchResult my_result = CBatch::run_job(my_rom, my_copy.get_inputs(), my_copy.get_frame_count(), my_copy.get_seed());
+	EXPECT_EQ(my_result.the_hash, my_copy.get_final_hash());
+
+	// No byte can change, and none can go missing.
+	for (size_t i = 0; i < my_bytes.size(); i++)
+	{
+		std::vector<uint8_t> my_damaged(my_bytes);
+		my_damaged[i] ^= 0x01;
+
+		EXPECT_FALSE(CMovie().read(my_damaged.data(), my_damaged.size())) << i;
+	}
+
+	EXPECT_FALSE(CMovie().read(my_bytes.data(), my_bytes.size() - 1));
+
+	std::unique_ptr<SMachine> my_other(new SMachine);
+
+	ASSERT_TRUE(my_other->the_cpu.load_game("../games/draw.ch8"));
+	my_other->the_cpu.reset();
+	my_other->the_cpu.set_trace(false);
+
+	EXPECT_FALSE(my_copy.replay(my_other->the_cpu, my_other->the_keyboard));
+}
+
+/**
+	With keyframes every 300 frames, a movie mapped from its file gets a machine to any frame, in any order, as it
+	was when the frame was recorded. Keyframes only add to the file, and damage to them or their index is caught.
+*/
+TEST(movie, test_seek)
+{
+	std::unique_ptr<SMachine> my_machine(new SMachine);
+
+	ASSERT_TRUE(my_machine->the_cpu.load_game("../games/space-invaders.ch8"));
+	my_machine->the_cpu.reset();
+	my_machine->the_cpu.set_trace(false);
+	my_machine->the_cpu.set_seed(3);
+
+	std::vector<uint8_t>		my_image(my_machine->the_state.the_memory, my_machine->the_state.the_memory + 4096);
+	std::vector<SChip8State>	my_frames(3001);
+	std::vector<uint8_t>		my_rom;
+
+	ASSERT_TRUE(CBatch::load_rom("../games/space-invaders.ch8", my_rom));
+
+	CMovie my_movie;
+	my_movie.begin(my_machine->the_state, my_machine->the_cpu.get_clock(), my_rom.size(), 300);
+	my_frames[0] = my_machine->the_state;
+
+	uint64_t my_random = 5;
+
+	my_machine->the_cpu.set_frame_hook([&](CCPU& a_cpu)
+	{
+		uint64_t my_value = CRandom::next(my_random);
+
+		if (my_value % 8 == 0)
+			my_machine->the_keyboard.set_key_state(4 + (my_value >> 8) % 3, (my_value >> 16) & 1);
+
+		my_movie.record(a_cpu.get_state(), a_cpu.get_clock());
+		my_frames[a_cpu.get_frame_count()] = a_cpu.get_state();
+	});
+
+	my_machine->the_cpu.set_turbo(true);
+	my_machine->the_cpu.set_frame_limit(3000);
+	my_machine->the_cpu.start();
+	my_machine->the_cpu.set_frame_hook(nullptr);
+
+	my_movie.end(my_machine->the_state, my_machine->the_cpu.get_frame_count());
+
+	EXPECT_EQ(my_movie.get_keyframe_interval(), 300);
+	EXPECT_EQ(my_movie.get_keyframe_count(), 11);
+
+	std::vector<uint8_t> my_bytes;
+	my_movie.write(my_bytes);
+
+	ASSERT_TRUE(my_movie.save("movie_test_seek.c8mv"));
+
+	CMovie my_mapped;
+	ASSERT_TRUE(my_mapped.map("movie_test_seek.c8mv"));
+	EXPECT_EQ(my_mapped.get_keyframe_count(), 11);
+	EXPECT_EQ(my_mapped.get_inputs().size(), my_movie.get_inputs().size());
+
+	std::vector<uint8_t> my_rewritten;
+	my_mapped.write(my_rewritten);
+	EXPECT_EQ(my_rewritten, my_bytes);
+
+	std::unique_ptr<SMachine> my_player(new SMachine);
+
+	ASSERT_TRUE(my_player->the_cpu.load_game("../games/space-invaders.ch8"));
+	my_player->the_cpu.reset();
+	my_player->the_cpu.set_trace(false);
+
+	for (uint64_t my_frame : { 2999, 0, 1, 300, 299, 301, 1234, 3000, 599, 17, 2700 })
+	{
+		ASSERT_TRUE(my_mapped.seek(my_player->the_cpu, my_player->the_keyboard, my_frame, my_image.data())) << my_frame;
+		EXPECT_EQ(my_player->the_cpu.get_frame_count(), my_frame);
+		EXPECT_EQ(memcmp(&my_player->the_state, &my_frames[my_frame], offsetof(SChip8State, the_memory) + 4096), 0) << my_frame;
+	}
+
+	EXPECT_FALSE(my_mapped.seek(my_player->the_cpu, my_player->the_keyboard, 3001, my_image.data()));
+
+	// The inputs don't change, a full replay ends where the recording did.
+	my_player->the_cpu.load_game("../games/space-invaders.ch8");
+	my_player->the_cpu.reset();
+	EXPECT_TRUE(my_mapped.replay(my_player->the_cpu, my_player->the_keyboard));
+
+	// A damaged keyframe is only found by the seeks that load it, damage to the index is found when reading.
+	std::vector<uint8_t> my_damaged(my_bytes);
+	my_damaged[my_bytes.size() - 16 - 11 * 16 - 8 - 40] ^= 0x01;
+
+	CMovie my_copy;
+	ASSERT_TRUE(my_copy.read(my_damaged.data(), my_damaged.size()));
+	EXPECT_TRUE(my_copy.seek(my_player->the_cpu, my_player->the_keyboard, 2000, my_image.data()));
+	EXPECT_FALSE(my_copy.seek(my_player->the_cpu, my_player->the_keyboard, 3000, my_image.data()));
+
+	for (size_t i = my_bytes.size() - 16 - 11 * 16; i < my_bytes.size(); i++)
+	{
+		my_damaged = my_bytes;
+		my_damaged[i] ^= 0x01;
+
+		EXPECT_FALSE(CMovie().read(my_damaged.data(), my_damaged.size())) << i;
+	}
+
+	remove("movie_test_seek.c8mv");
+}
+
+/**
+	A movie splits at its keyframes into segments that check out on their own, on any number of threads. A change
+	made to the machine behind the recording's back shows up in the segment it was made in, and only there.
+*/
+TEST(movie, test_verify)
+{
+	std::vector<uint8_t> my_rom;
+	ASSERT_TRUE(CBatch::load_rom("../games/space-invaders.ch8", my_rom));
+
+	for (bool my_tampered : { false, true })
+	{
+		std::unique_ptr<SMachine> my_machine(new SMachine);
+
+		ASSERT_TRUE(my_machine->the_cpu.load_game("../games/space-invaders.ch8"));
+		my_machine->the_cpu.reset();
+		my_machine->the_cpu.set_trace(false);
+		my_machine->the_cpu.set_seed(11);
+
+		CMovie		my_movie;
+		uint64_t	my_random = 9;
+
+		my_movie.begin(my_machine->the_state, my_machine->the_cpu.get_clock(), my_rom.size(), 300);
+
+		my_machine->the_cpu.set_frame_hook([&](CCPU& a_cpu)
+		{
+			uint64_t my_value = CRandom::next(my_random);
+
+			if (my_value % 8 == 0)
+				my_machine->the_keyboard.set_key_state(4 + (my_value >> 8) % 3, (my_value >> 16) & 1);
+
+			// A byte of RAM no input put there.
+			if (my_tampered && a_cpu.get_frame_count() == 1000)
+				my_machine->the_state.the_memory[0xfff] ^= 0x5a;
+
+			my_movie.record(a_cpu.get_state(), a_cpu.get_clock());
+		});
+
+		my_machine->the_cpu.set_turbo(true);
+		my_machine->the_cpu.set_frame_limit(3000);
+		my_machine->the_cpu.start();
+		my_machine->the_cpu.set_frame_hook(nullptr);
+
+		my_movie.end(my_machine->the_state, my_machine->the_cpu.get_frame_count());
+
+		for (size_t my_threads : { 1, 4 })
+		{
+			CBatch			my_batch(my_threads);
+			SBatchVerify	my_verify = my_batch.verify(my_movie, my_rom);
+
+			EXPECT_EQ(my_verify.the_segments, 11);
+			EXPECT_EQ(my_verify.the_ok, !my_tampered);
+			EXPECT_EQ(my_verify.the_first_bad, my_tampered ? 3 : 11);
+			EXPECT_EQ(my_verify.the_first_bad_frame, my_tampered ? 900 : 0);
+		}
+
+		std::vector<uint8_t> my_other_rom;
+		ASSERT_TRUE(CBatch::load_rom("../games/draw.ch8", my_other_rom));
+
+		SBatchVerify my_other = CBatch(2).verify(my_movie, my_other_rom);
+
+		EXPECT_FALSE(my_other.the_ok);
+		EXPECT_EQ(my_other.the_first_bad, 0);
+	}
+
+	// Without keyframes there's nothing to split at.
+	CMovie my_plain;
+	std::unique_ptr<SMachine> my_machine(new SMachine);
+
+	ASSERT_TRUE(my_machine->the_cpu.load_game("../games/space-invaders.ch8"));
+	my_machine->the_cpu.reset();
+	my_plain.begin(my_machine->the_state, my_machine->the_cpu.get_clock(), my_rom.size());
+	my_plain.end(my_machine->the_state, 0);
+
+	EXPECT_FALSE(CBatch(2).verify(my_plain, my_rom).the_ok);
+}
+
+/**
+	A ROM that draws a few frames after a key goes down: run-ahead shows it that many frames sooner, down to the frame
+	right after, and the real machine goes through the very same frames with it as without.
+*/
+TEST(runahead, test_latency)
+{
+	// 0x200 LD V0, 5		0x202 SKP V0		0x204 JP 0x202		0x206 LD V1, 3		0x208 LD DT, V1		0x20A LD V2, DT
+	// 0x20C SE V2, 0		0x20E JP 0x20A		0x210 LD I, 0x200	0x212 DRW V0, V1, 5	0x214 JP 0x214
+	const uint8_t my_program[] = { 0x60, 0x05, 0xe0, 0x9e, 0x12, 0x02, 0x61, 0x03, 0xf1, 0x15, 0xf2, 0x07, 0x32, 0x00, 0x12, 0x0a,
+		0xa2, 0x00, 0xd0, 0x15, 0x12, 0x14 };
+
+	const uint32_t				my_run_aheads[] = { 0, 1, 2, 8 };
+	double						my_latencies[4];
+	uint64_t					my_instructions[4];
+	std::vector<SChip8State>	my_frames(41);
+
+	for (int i = 0; i < 4; i++)
+	{
+		std::unique_ptr<SMachine>	my_machine(new SMachine);
+		CCountingPresenter			my_presenter;
+
+		my_machine->the_graphics.set_presenter(&my_presenter);
+		my_machine->the_memory.load_data(std::vector<uint8_t>(my_program, my_program + sizeof(my_program)));
+		my_machine->the_cpu.reset();
+		my_machine->the_cpu.set_trace(false);
+		my_machine->the_cpu.set_turbo(true);
+		my_machine->the_graphics.set_refresh_rate(0);
+		my_machine->the_cpu.set_run_ahead(my_run_aheads[i]);
+
+		my_machine->the_cpu.set_frame_hook([&](CCPU& a_cpu)
+		{
+			uint64_t my_frame = a_cpu.get_frame_count();
+
+			if (i == 0)
+				my_frames[my_frame] = a_cpu.get_state();
+			else
+				EXPECT_EQ(memcmp(&a_cpu.get_state(), &my_frames[my_frame], offsetof(SChip8State, the_memory) + 4096), 0) << my_frame;
+
+			if (my_frame == 10)
+				my_machine->the_keyboard.set_key_state(5, 1);
+		});
+
+		my_machine->the_cpu.set_frame_limit(40);
+		my_machine->the_cpu.start();
+
+		EXPECT_EQ(my_machine->the_cpu.get_input_latency_count(), 1);
+		EXPECT_EQ(my_machine->the_graphics.get_present_count(), 1);
+
+		my_latencies[i]		= my_machine->the_cpu.get_input_latency();
+		my_instructions[i]	= my_machine->the_cpu.get_instruction_count();
+	}
+
+	EXPECT_GE(my_latencies[0], 4.0);
+	EXPECT_EQ(my_latencies[1], my_latencies[0] - 1);
+	EXPECT_EQ(my_latencies[2], my_latencies[0] - 2);
+	EXPECT_EQ(my_latencies[3], 1.0);
+
+	for (int i = 1; i < 4; i++)
+		EXPECT_EQ(my_instructions[i], my_instructions[0]);
+}
+
+/**
+	A ROM that draws every frame counts no latency until it reads a changed key. One that moves its sprite on a key
+	counts from the key to the present after it moved, run-ahead takes its frames off that too.
+*/
+TEST(runahead, test_latency_every_frame)
+{
+	// 0x200 LD V0, 1		0x202 LD DT, V0		0x204 ADD V4, 1		0x206 LD I, 0x200	0x208 DRW V4, V1, 1	0x20A LD V2, DT
+	// 0x20C SE V2, 0		0x20E JP 0x20A		0x210 JP 0x200, or with the key: 0x210 LD V3, 5	0x212 SKNP V3
+	// 0x214 ADD V1, 1		0x216 JP 0x200
+	std::vector<uint8_t> my_deaf = { 0x60, 0x01, 0xf0, 0x15, 0x74, 0x01, 0xa2, 0x00, 0xd4, 0x11, 0xf2, 0x07, 0x32, 0x00,
+		0x12, 0x0a, 0x12, 0x00 };
+	std::vector<uint8_t> my_moving(my_deaf.begin(), my_deaf.end() - 2);
+	my_moving.insert(my_moving.end(), { 0x63, 0x05, 0xe3, 0xa1, 0x71, 0x01, 0x12, 0x00 });
+
+	double my_latencies[2];
+
+	for (int i = 0; i < 4; i++)
+	{
+		std::unique_ptr<SMachine>	my_machine(new SMachine);
+		CCountingPresenter			my_presenter;
+
+		my_machine->the_graphics.set_presenter(&my_presenter);
+		my_machine->the_memory.load_data(i < 2 ? my_deaf : my_moving);
+		my_machine->the_cpu.reset();
+		my_machine->the_cpu.set_trace(false);
+		my_machine->the_cpu.set_turbo(true);
+		my_machine->the_graphics.set_refresh_rate(0);
+		my_machine->the_cpu.set_run_ahead(i % 2);
+
+		my_machine->the_cpu.set_frame_hook([&](CCPU& a_cpu)
+		{
+			if (a_cpu.get_frame_count() == 10)
+				my_machine->the_keyboard.set_key_state(5, 1);
+		});
+
+		my_machine->the_cpu.set_frame_limit(40);
+		my_machine->the_cpu.start();
+
+		EXPECT_GT(my_machine->the_graphics.get_present_count(), 20) << i;
+
+		if (i < 2)
+		{
+			EXPECT_EQ(my_machine->the_cpu.get_input_latency_count(), 0) << i;
+		}
+		else
+		{
+			EXPECT_EQ(my_machine->the_cpu.get_input_latency_count(), 1) << i;
+			my_latencies[i - 2] = my_machine->the_cpu.get_input_latency();
+		}
+	}
+
+	EXPECT_GE(my_latencies[0], 1.0);
+	EXPECT_EQ(my_latencies[1], std::max(1.0, my_latencies[0] - 1));
+}
+
+/**
+	Every task runs exactly once. The first worker's share is slow, the others run out of work early and take from it.
+*/
+TEST(batch, test_work_stealing)
+{
+	CThreadPool my_pool(4);
+	ASSERT_EQ(my_pool.get_thread_count(), 4);
+
+	std::vector<std::atomic<int>>	my_runs(1000);
+	std::set<std::thread::id>		my_threads;
+	std::mutex						my_mutex;
+	std::vector<CThreadPool::task>	my_tasks;
+
+	for (size_t i = 0; i < my_runs.size(); i++)
+	{
+		my_tasks.push_back([&, i]()
+		{
+			my_runs[i]++;
+
+			if (i < 250)
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+
+				std::lock_guard<std::mutex> my_lock(my_mutex);
+				my_threads.insert(std::this_thread::get_id());
+			}
+		});
+	}
+
+	my_pool.run(my_tasks);
+
+	for (size_t i = 0; i < my_runs.size(); i++)
+		ASSERT_EQ(my_runs[i], 1) << i;
+
+	EXPECT_GT(my_threads.size(), 1);
+
+	// A pool runs any number of batches, an empty one included, on the same workers every time.
+	std::vector<CThreadPool::task> my_none;
+	my_pool.run(my_none);
+	my_pool.run(my_tasks);
+
+	EXPECT_EQ(my_runs[999], 2);
+	EXPECT_LE(my_threads.size(), 4);
+}
+
+/**
+	A job ends in the same state however many threads the batch has, and the input script gets to the ROM.
+*/
+TEST(batch, test_jobs)
+{
+	// 0x200 LD V1, 5		0x202 SKNP V1		0x204 ADD V2, 1		0x206 ADD V3, 1		0x208 JP 0x202
+	const uint8_t my_program[] = { 0x61, 0x05, 0xe1, 0xa1, 0x72, 0x01, 0x73, 0x01, 0x12, 0x02 };
+
+	{
+		std::ofstream my_rom("batch_test.ch8", std::ios::binary);
+		my_rom.write((const char*)my_program, sizeof(my_program));
+
+		std::ofstream my_input("batch_test_input.txt");
+		my_input << "# key 5 held for frames 10 to 19\n20 5 0\n10 5 1\n";
+
+		std::ofstream my_jobs("batch_test_jobs.txt");
+
+		for (int i = 0; i < 32; i++)
+			my_jobs << "batch_test.ch8 30 batch_test_input.txt\nbatch_test.ch8 30\n";
+
+		// 0x200 RND V0, 0xFF	0x202 JP 0x200
+		const uint8_t my_random[] = { 0xc0, 0xff, 0x12, 0x00 };
+
+		std::ofstream my_random_rom("batch_test_random.ch8", std::ios::binary);
+		my_random_rom.write((const char*)my_random, sizeof(my_random));
+
+		for (int i = 0; i < 32; i++)
+			my_jobs << "batch_test_random.ch8 30 - " << i % 4 << "\n";
+	}
+
+	std::vector<uint8_t>		my_rom;
+	std::vector<SBatchInput>	my_input;
+	std::vector<SBatchJob>		my_jobs;
+
+	ASSERT_TRUE(CBatch::load_rom("batch_test.ch8", my_rom));
+	ASSERT_TRUE(CBatch::load_input("batch_test_input.txt", my_input));
+	ASSERT_TRUE(CBatch::load_jobs("batch_test_jobs.txt", my_jobs));
+	ASSERT_EQ(my_input.size(), 2);
+	EXPECT_EQ(my_input[0].the_frame, 10);
+	ASSERT_EQ(my_jobs.size(), 96);
+	EXPECT_TRUE(my_jobs[64].the_input.empty());
+	EXPECT_EQ(my_jobs[67].the_seed, 3);
+
+	SBatchResult my_pressed	= CBatch::run_job(my_rom, my_input, 30);
+	SBatchResult my_idle	= CBatch::run_job(my_rom, std::vector<SBatchInput>(), 30);
+
+	EXPECT_TRUE(my_pressed.the_ok);
+	EXPECT_EQ(my_pressed.the_frames, 30);
+	EXPECT_NE(my_pressed.the_hash, my_idle.the_hash);
+	EXPECT_EQ(CBatch::run_job(my_rom, my_input, 30).the_hash, my_pressed.the_hash);
+
+	// Another seed, other numbers.
+	std::vector<uint8_t>	my_random_rom;
+	std::vector<uint64_t>	my_random_hashes;
+
+	ASSERT_TRUE(CBatch::load_rom("batch_test_random.ch8", my_random_rom));
+
+	for (uint64_t i = 0; i < 4; i++)
+		my_random_hashes.push_back(CBatch::run_job(my_random_rom, std::vector<SBatchInput>(), 30, i).the_hash);
+
+	EXPECT_NE(my_random_hashes[0], my_random_hashes[1]);
+
+	for (size_t my_threads : { 1, 4 })
+	{
+		CBatch my_batch(my_threads);
+		std::vector<SBatchResult> my_results = my_batch.run(my_jobs);
+
+		ASSERT_EQ(my_results.size(), my_jobs.size());
+
+		for (size_t i = 0; i < my_results.size(); i++)
+		{
+			EXPECT_TRUE(my_results[i].the_ok) << i;
+			EXPECT_EQ(my_results[i].the_frames, 30) << i;
+
+			if (i < 64)
+				EXPECT_EQ(my_results[i].the_hash, i % 2 == 0 ? my_pressed.the_hash : my_idle.the_hash) << i;
+			else
+				EXPECT_EQ(my_results[i].the_hash, my_random_hashes[i % 4]) << i;
+		}
+	}
+
+	// A ROM that isn't there fails its job only.
+	my_jobs.push_back({ "batch_test_missing.ch8", "", 30, 0 });
+	std::vector<SBatchResult> my_results = CBatch(2).run(my_jobs);
+	EXPECT_TRUE(my_results[0].the_ok);
+	EXPECT_FALSE(my_results.back().the_ok);
+
+	remove("batch_test.ch8");
+	remove("batch_test_random.ch8");
+	remove("batch_test_input.txt");
+	remove("batch_test_jobs.txt");
+}
+
+/**
+	The lane kernels this CPU can run, plain loops and AVX2 where it has it. The best of them runs by default.
+*/
+static std::vector<bool>
+lockstep_kernels()
+{
+	EXPECT_EQ(CLockstep::is_vectorised(), CCpuFeatures::has_avx2());
+
+	if (CCpuFeatures::has_avx2())
+		return { false, true };
+
+	return { false };
+}
+
+/**
+	Every lane of the lockstep engine runs exactly like its own CCPU, frame by frame, with every lane kernel. The lanes start with other
+	registers and keys, so they split up on the skips and meet again, and the program writes one of its own
+	instructions with a value that differs per lane. 40 instances leave some padding lanes.
+*/
+TEST(lockstep, test_against_cpu)
+{
+	// 0x200 ADD V0, V1		0x202 SUB V2, V3	0x204 SHR V4, V5	0x206 SUBN V6, V7	0x208 SHL V8, V9
+	// 0x20A OR VA, V0		0x20C AND VB, V2	0x20E XOR VC, V4	0x210 SE VF, 1		0x212 ADD V1, 3
+	// 0x214 SNE VC, 0x80	0x216 ADD V3, 5		0x218 SE V0, V1		0x21A SNE V0, V2	0x21C LD VD, 5
+	// 0x21E SKNP VD		0x220 ADD VE, 1		0x222 LD V5, DT		0x224 SE V5, 0		0x226 JP 0x22C
+	// 0x228 LD DT, V7		0x22A ADD I, VE		0x22C LD F, V0		0x22E ADD VF, VF	0x230 SUB VF, V0
+	// 0x232 SHR V0, VF		0x234 LD B, V2		0x236 DRW V0, V1, 5	0x238 LD I, 0x241	0x23A LD [I], V0
+	// 0x23C JP 0x240		0x240 LD VB, (V0)	0x242 LD ST, V9		0x244 LD V3, [I]	0x246 SKP VE
+	// 0x248 CLS			0x24A JP 0x200
+	const uint8_t my_program[] =
+	{
+		0x80, 0x14, 0x82, 0x35, 0x84, 0x56, 0x86, 0x77, 0x88, 0x9e,
+		0x8a, 0x01, 0x8b, 0x22, 0x8c, 0x43, 0x3f, 0x01, 0x71, 0x03,
+		0x4c, 0x80, 0x73, 0x05, 0x50, 0x10, 0x90, 0x20, 0x6d, 0x05,
+		0xed, 0xa1, 0x7e, 0x01, 0xf5, 0x07, 0x35, 0x00, 0x12, 0x2c,
+		0xf7, 0x15, 0xfe, 0x1e, 0xf0, 0x29, 0x8f, 0xf4, 0x8f, 0x05,
+		0x80, 0xf6, 0xf2, 0x33, 0xd0, 0x15, 0xa2, 0x41, 0xf0, 0x55,
+		0x12, 0x40, 0x00, 0x00, 0x6b, 0x00, 0xf9, 0x18, 0xf3, 0x65,
+		0xee, 0x9e, 0x00, 0xe0, 0x12, 0x00
+	};
+
+	bool my_picked = CLockstep::is_vectorised();
+
+	for (bool my_vectorised : lockstep_kernels())
+	{
+		ASSERT_TRUE(CLockstep::set_vectorised(my_vectorised));
+		SCOPED_TRACE(my_vectorised ? "AVX2" : "plain");
+
+		const size_t my_instances = 40;
+
+		std::vector<std::unique_ptr<SMachine>>	my_machines;
+		CLockstep								my_lockstep(my_instances);
+
+		for (size_t i = 0; i < my_instances; i++)
+		{
+			my_machines.emplace_back(new SMachine);
+
+			SMachine& my_machine = *my_machines.back();
+
+			my_machine.the_memory.load_data(std::vector<uint8_t>(my_program, my_program + sizeof(my_program)));
+			my_machine.the_cpu.reset();
+			my_machine.the_cpu.set_trace(false);
+
+			if (i == 0)
+				my_lockstep.load(my_machine.the_state);
+
+			for (int j = 0; j < 16; j++)
+				my_machine.the_registers.set_register_value(j, (uint8_t)(i * 37 + j * 11));
+
+			my_machine.the_keyboard.set_key_state(5, i % 3 == 0);
+			my_lockstep.set_instance(i, my_machine.the_state);
+		}
+
+		SChip8State my_lane;
+
+		for (int my_frame = 0; my_frame < 120; my_frame++)
+		{
+			// Key 5 changes on some lanes halfway through.
+			if (my_frame == 60)
+			{
+				for (size_t i = 0; i < my_instances; i += 4)
+				{
+					my_machines[i]->the_keyboard.set_key_state(5, 1);
+					my_lockstep.set_key_state(i, 5, 1);
+				}
+			}
+
+			for (size_t i = 0; i < my_instances; i++)
+				my_machines[i]->the_cpu.run_frame();
+
+			my_lockstep.run_frame();
+
+			for (size_t i = 0; i < my_instances; i++)
+			{
+				my_lockstep.get_instance(i, my_lane);
+				ASSERT_EQ(memcmp(&my_lane, &my_machines[i]->the_state, sizeof(SChip8State)), 0) << "frame " << my_frame << ", lane " << i;
+			}
+		}
+
+		// Every instance ran every instruction, in fewer steps than that.
+		uint64_t my_instructions = 0;
+
+		for (size_t i = 0; i < my_instances; i++)
+			my_instructions += my_machines[i]->the_cpu.get_instruction_count();
+
+		EXPECT_EQ(my_lockstep.get_instruction_count(), my_instructions);
+		EXPECT_LT(my_lockstep.get_step_count(), my_instructions / 4);
+		EXPECT_EQ(my_lockstep.get_frame_count(), 120);
+	}
+
+	CLockstep::set_vectorised(my_picked);
+}
+
+/**
+	The bundled ROMs in lockstep against CCPU, with a different key held on every lane and every lane kernel.
+*/
+TEST(lockstep, test_roms)
+{
+	bool my_picked = CLockstep::is_vectorised();
+
+	for (bool my_vectorised : lockstep_kernels())
+	{
+		ASSERT_TRUE(CLockstep::set_vectorised(my_vectorised));
+		SCOPED_TRACE(my_vectorised ? "AVX2" : "plain");
+
+		const char* my_roms[] = { "../games/draw.ch8", "../games/test_opcode.ch8" };
+
+		for (const char* my_rom : my_roms)
+		{
+			const size_t my_instances = 16;
+
+			std::vector<std::unique_ptr<SMachine>>	my_machines;
+			CLockstep								my_lockstep(my_instances);
+
+			for (size_t i = 0; i < my_instances; i++)
+			{
+				my_machines.emplace_back(new SMachine);
+				ASSERT_TRUE(my_machines.back()->the_cpu.load_game(my_rom)) << my_rom;
+				my_machines.back()->the_cpu.reset();
+				my_machines.back()->the_cpu.set_trace(false);
+
+				if (i == 0)
+					my_lockstep.load(my_machines.back()->the_state);
+
+				my_machines.back()->the_keyboard.set_key_state((int)i, 1);
+				my_lockstep.set_key_state(i, (int)i, 1);
+			}
+
+			SChip8State my_lane;
+
+			for (int my_frame = 0; my_frame < 300; my_frame++)
+			{
+				my_lockstep.run_frame();
+
+				for (size_t i = 0; i < my_instances; i++)
+				{
+					my_machines[i]->the_cpu.run_frame();
+					my_lockstep.get_instance(i, my_lane);
+					ASSERT_EQ(memcmp(&my_lane, &my_machines[i]->the_state, sizeof(SChip8State)), 0) << my_rom << ", frame " << my_frame << ", lane " << i;
+				}
+			}
+		}
+	}
+
+	CLockstep::set_vectorised(my_picked);
+}